@@ -0,0 +1,179 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/callable_result_cache.h"
+
+#include <iterator>
+#include <utility>
+
+#include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/fingerprint.h"
+
+namespace tensorflow {
+namespace {
+
+bool SameTensor(const Tensor& a, const Tensor& b) {
+  if (a.dtype() != b.dtype() || a.shape() != b.shape()) {
+    return false;
+  }
+  if (a.dtype() == DT_STRING) {
+    const auto a_flat = a.flat<tstring>();
+    const auto b_flat = b.flat<tstring>();
+    for (int64_t i = 0; i < a_flat.size(); ++i) {
+      if (a_flat(i) != b_flat(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return a.tensor_data() == b.tensor_data();
+}
+
+bool SameTensors(const std::vector<Tensor>& a, const std::vector<Tensor>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (int i = 0; i < a.size(); ++i) {
+    if (!SameTensor(a[i], b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the bytes that a copy of `t` holds, including the payloads of
+// strings, which are not in the tensor buffer.
+int64_t SizeBytes(const Tensor& t) {
+  if (t.dtype() != DT_STRING) {
+    return t.AllocatedBytes();
+  }
+  int64_t size_bytes = t.NumElements() * sizeof(tstring);
+  const auto flat = t.flat<tstring>();
+  for (int64_t i = 0; i < flat.size(); ++i) {
+    size_bytes += flat(i).size();
+  }
+  return size_bytes;
+}
+
+int64_t TotalBytes(const std::vector<Tensor>& tensors) {
+  int64_t total_bytes = 0;
+  for (const Tensor& t : tensors) {
+    total_bytes += SizeBytes(t);
+  }
+  return total_bytes;
+}
+
+}  // namespace
+
+CallableResultCache::CallableResultCache(int64_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes) {}
+
+/* static */ bool CallableResultCache::ComputeKey(
+    const std::vector<Tensor>& feed_tensors, uint64* key) {
+  uint64 fingerprint = 0;
+  for (const Tensor& t : feed_tensors) {
+    fingerprint = FingerprintCat64(fingerprint, t.dtype());
+    for (int64_t dim : t.shape().dim_sizes()) {
+      fingerprint = FingerprintCat64(fingerprint, dim);
+    }
+    if (t.dtype() == DT_STRING) {
+      const auto flat = t.flat<tstring>();
+      for (int64_t i = 0; i < flat.size(); ++i) {
+        fingerprint = FingerprintCat64(fingerprint, Fingerprint64(flat(i)));
+      }
+    } else if (DataTypeCanUseMemcpy(t.dtype())) {
+      fingerprint =
+          FingerprintCat64(fingerprint, Fingerprint64(t.tensor_data()));
+    } else {
+      return false;
+    }
+  }
+  *key = fingerprint;
+  return true;
+}
+
+bool CallableResultCache::Lookup(uint64 key,
+                                 const std::vector<Tensor>& feed_tensors,
+                                 std::vector<Tensor>* fetch_tensors) {
+  mutex_lock l(mu_);
+  auto it = index_.find(key);
+  if (it == index_.end() || !SameTensors(it->second->feed_tensors,
+                                         feed_tensors)) {
+    return false;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  const std::vector<Tensor>& cached_fetches = it->second->fetch_tensors;
+  // Returns copies, so that callers may modify their outputs.
+  fetch_tensors->clear();
+  fetch_tensors->reserve(cached_fetches.size());
+  for (const Tensor& t : cached_fetches) {
+    fetch_tensors->push_back(tensor::DeepCopy(t));
+  }
+  return true;
+}
+
+void CallableResultCache::Insert(uint64 key,
+                                 const std::vector<Tensor>& feed_tensors,
+                                 const std::vector<Tensor>& fetch_tensors) {
+  const int64_t size_bytes =
+      TotalBytes(feed_tensors) + TotalBytes(fetch_tensors);
+  if (size_bytes > capacity_bytes_) {
+    return;
+  }
+  // Copies the feeds, which the caller may reuse for other inputs, and the
+  // fetched tensors, which the caller may modify.
+  Entry entry;
+  entry.key = key;
+  entry.feed_tensors.reserve(feed_tensors.size());
+  for (const Tensor& t : feed_tensors) {
+    entry.feed_tensors.push_back(tensor::DeepCopy(t));
+  }
+  entry.fetch_tensors.reserve(fetch_tensors.size());
+  for (const Tensor& t : fetch_tensors) {
+    entry.fetch_tensors.push_back(tensor::DeepCopy(t));
+  }
+  entry.size_bytes = size_bytes;
+
+  mutex_lock l(mu_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    Erase(it->second);
+  }
+  while (size_bytes_ + size_bytes > capacity_bytes_) {
+    Erase(std::prev(entries_.end()));
+  }
+  entries_.push_front(std::move(entry));
+  index_[key] = entries_.begin();
+  size_bytes_ += size_bytes;
+}
+
+void CallableResultCache::Erase(std::list<Entry>::iterator it) {
+  size_bytes_ -= it->size_bytes;
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+int64_t CallableResultCache::size_bytes() const {
+  mutex_lock l(mu_);
+  return size_bytes_;
+}
+
+int64_t CallableResultCache::num_entries() const {
+  mutex_lock l(mu_);
+  return entries_.size();
+}
+
+}  // namespace tensorflow
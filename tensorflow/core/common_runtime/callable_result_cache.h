@@ -0,0 +1,88 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_CALLABLE_RESULT_CACHE_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_CALLABLE_RESULT_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A bounded cache of the fetched tensors of a callable, keyed by its feed
+// tensors, with least-recently-used eviction.
+//
+// The cache is only correct for callables whose graphs contain no stateful
+// ops, which the owner must check. Entries hold a copy of their feeds, so a
+// fingerprint collision never returns the results of different feeds. The
+// fetched tensors are copied on insertion and on lookup, so callers may modify
+// them. All tensors must be in host memory.
+//
+// This class is thread-safe.
+class CallableResultCache {
+ public:
+  // `capacity_bytes` bounds the total size of the feed and fetched tensors of
+  // all entries.
+  explicit CallableResultCache(int64_t capacity_bytes);
+
+  // Sets `*key` to the fingerprint of `feed_tensors` and returns true, or
+  // returns false if the feeds cannot be cached (e.g. resource handles).
+  static bool ComputeKey(const std::vector<Tensor>& feed_tensors, uint64* key);
+
+  // Returns true and sets `*fetch_tensors` to the cached results for
+  // `feed_tensors`, whose key is `key`, if there are any.
+  bool Lookup(uint64 key, const std::vector<Tensor>& feed_tensors,
+              std::vector<Tensor>* fetch_tensors);
+
+  // Caches `fetch_tensors` as the results for `feed_tensors`, evicting the
+  // least recently used entries to stay within the capacity.
+  void Insert(uint64 key, const std::vector<Tensor>& feed_tensors,
+              const std::vector<Tensor>& fetch_tensors);
+
+  int64_t size_bytes() const;
+  int64_t num_entries() const;
+
+ private:
+  struct Entry {
+    uint64 key;
+    std::vector<Tensor> feed_tensors;
+    std::vector<Tensor> fetch_tensors;
+    int64_t size_bytes;
+  };
+
+  void Erase(std::list<Entry>::iterator it) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int64_t capacity_bytes_;
+
+  mutable mutex mu_;
+  // Most recently used first.
+  std::list<Entry> entries_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<uint64, std::list<Entry>::iterator> index_
+      TF_GUARDED_BY(mu_);
+  int64_t size_bytes_ TF_GUARDED_BY(mu_) = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(CallableResultCache);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_CALLABLE_RESULT_CACHE_H_
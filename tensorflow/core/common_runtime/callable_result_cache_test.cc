@@ -0,0 +1,140 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/callable_result_cache.h"
+
+#include <vector>
+
+#include "tensorflow/core/framework/resource_handle.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+std::vector<Tensor> Feeds(int64_t value) {
+  return {test::AsTensor<int64_t>({value, value + 1}),
+          test::AsTensor<tstring>({"feed"})};
+}
+
+std::vector<Tensor> Fetches(float value) {
+  return {test::AsTensor<float>({value, value, value, value})};
+}
+
+uint64 Key(const std::vector<Tensor>& feeds) {
+  uint64 key;
+  EXPECT_TRUE(CallableResultCache::ComputeKey(feeds, &key));
+  return key;
+}
+
+TEST(CallableResultCacheTest, LookupAfterInsert) {
+  CallableResultCache cache(1 << 20);
+  std::vector<Tensor> fetches;
+  EXPECT_FALSE(cache.Lookup(Key(Feeds(1)), Feeds(1), &fetches));
+
+  cache.Insert(Key(Feeds(1)), Feeds(1), Fetches(1));
+  ASSERT_TRUE(cache.Lookup(Key(Feeds(1)), Feeds(1), &fetches));
+  ASSERT_EQ(fetches.size(), 1);
+  test::ExpectTensorEqual<float>(fetches[0], Fetches(1)[0]);
+  EXPECT_FALSE(cache.Lookup(Key(Feeds(2)), Feeds(2), &fetches));
+  EXPECT_EQ(cache.num_entries(), 1);
+}
+
+TEST(CallableResultCacheTest, KeyDependsOnShapeAndStrings) {
+  EXPECT_NE(Key({test::AsTensor<int64_t>({1, 2})}),
+            Key({test::AsTensor<int64_t>({1, 2}, {2, 1})}));
+  EXPECT_NE(Key({test::AsTensor<tstring>({"a", "bc"})}),
+            Key({test::AsTensor<tstring>({"ab", "c"})}));
+
+  Tensor resource(DT_RESOURCE, TensorShape({}));
+  uint64 key;
+  EXPECT_FALSE(CallableResultCache::ComputeKey({resource}, &key));
+}
+
+TEST(CallableResultCacheTest, CollidingKeysDoNotMatch) {
+  CallableResultCache cache(1 << 20);
+  cache.Insert(/*key=*/7, Feeds(1), Fetches(1));
+  std::vector<Tensor> fetches;
+  EXPECT_FALSE(cache.Lookup(/*key=*/7, Feeds(2), &fetches));
+}
+
+TEST(CallableResultCacheTest, EvictsLeastRecentlyUsed) {
+  int64_t entry_size = Fetches(1)[0].TotalBytes();
+  for (const Tensor& t : Feeds(1)) {
+    entry_size += t.TotalBytes();
+  }
+  CallableResultCache cache(2 * entry_size);
+  cache.Insert(Key(Feeds(1)), Feeds(1), Fetches(1));
+  cache.Insert(Key(Feeds(2)), Feeds(2), Fetches(2));
+  EXPECT_EQ(cache.size_bytes(), 2 * entry_size);
+
+  std::vector<Tensor> fetches;
+  EXPECT_TRUE(cache.Lookup(Key(Feeds(1)), Feeds(1), &fetches));
+  cache.Insert(Key(Feeds(3)), Feeds(3), Fetches(3));
+  EXPECT_EQ(cache.num_entries(), 2);
+  EXPECT_EQ(cache.size_bytes(), 2 * entry_size);
+  EXPECT_TRUE(cache.Lookup(Key(Feeds(1)), Feeds(1), &fetches));
+  EXPECT_FALSE(cache.Lookup(Key(Feeds(2)), Feeds(2), &fetches));
+  EXPECT_TRUE(cache.Lookup(Key(Feeds(3)), Feeds(3), &fetches));
+}
+
+TEST(CallableResultCacheTest, SkipsEntriesLargerThanCapacity) {
+  CallableResultCache cache(16);
+  cache.Insert(Key(Feeds(1)), Feeds(1), Fetches(1));
+  EXPECT_EQ(cache.num_entries(), 0);
+  EXPECT_EQ(cache.size_bytes(), 0);
+}
+
+TEST(CallableResultCacheTest, CountsStringPayloads) {
+  const std::vector<Tensor> feeds = {test::AsTensor<int64_t>({1})};
+  const std::vector<Tensor> fetches = {
+      test::AsTensor<tstring>({std::string(1000, 'a')})};
+  CallableResultCache cache(1 << 20);
+  cache.Insert(Key(feeds), feeds, fetches);
+  EXPECT_GE(cache.size_bytes(), 1000);
+
+  CallableResultCache small_cache(100);
+  small_cache.Insert(Key(feeds), feeds, fetches);
+  EXPECT_EQ(small_cache.num_entries(), 0);
+}
+
+TEST(CallableResultCacheTest, FeedsAreCopied) {
+  CallableResultCache cache(1 << 20);
+  std::vector<Tensor> feeds = Feeds(1);
+  cache.Insert(Key(feeds), feeds, Fetches(1));
+  // Reusing the feed buffer for other values does not change the entry.
+  feeds[0].flat<int64_t>()(0) = 5;
+  std::vector<Tensor> fetches;
+  EXPECT_FALSE(cache.Lookup(Key(Feeds(1)), feeds, &fetches));
+  EXPECT_TRUE(cache.Lookup(Key(Feeds(1)), Feeds(1), &fetches));
+}
+
+TEST(CallableResultCacheTest, FetchesAreCopied) {
+  CallableResultCache cache(1 << 20);
+  std::vector<Tensor> fetches = Fetches(1);
+  cache.Insert(Key(Feeds(1)), Feeds(1), fetches);
+  // Modifying the fetched tensors of a step or of a hit does not change the
+  // entry.
+  fetches[0].flat<float>()(0) = 5;
+  std::vector<Tensor> hit;
+  ASSERT_TRUE(cache.Lookup(Key(Feeds(1)), Feeds(1), &hit));
+  test::ExpectTensorEqual<float>(hit[0], Fetches(1)[0]);
+  hit[0].flat<float>()(0) = 5;
+  ASSERT_TRUE(cache.Lookup(Key(Feeds(1)), Feeds(1), &hit));
+  test::ExpectTensorEqual<float>(hit[0], Fetches(1)[0]);
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,276 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/client_graph_cache.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/graph_constructor.h"
+#include "tensorflow/core/framework/device.h"
+#include "tensorflow/core/framework/device_attributes.pb.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/file_statistics.h"
+#include "tensorflow/core/platform/fingerprint.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/stringprintf.h"
+#include "tensorflow/core/public/version.h"
+
+namespace tensorflow {
+namespace {
+
+bool IsArg(const Node* n) {
+  return n->type_string() == "_Arg" || n->type_string() == "_DeviceArg";
+}
+
+bool IsRetval(const Node* n) {
+  return n->type_string() == "_Retval" || n->type_string() == "_DeviceRetval";
+}
+
+// Sets `*types` to the types of the nodes of `graph` that match `predicate`,
+// ordered by their "index" attribute.
+template <typename Predicate>
+Status GetSignatureTypes(const Graph& graph, Predicate predicate,
+                         DataTypeVector* types) {
+  std::map<int, DataType> types_by_index;
+  for (const Node* n : graph.op_nodes()) {
+    if (!predicate(n)) {
+      continue;
+    }
+    int index;
+    DataType type;
+    TF_RETURN_IF_ERROR(GetNodeAttr(n->attrs(), "index", &index));
+    TF_RETURN_IF_ERROR(GetNodeAttr(n->attrs(), "T", &type));
+    if (!types_by_index.emplace(index, type).second) {
+      return errors::DataLoss("Duplicate index ", index, " of node ",
+                              n->name());
+    }
+  }
+  types->clear();
+  for (const auto& index_and_type : types_by_index) {
+    if (index_and_type.first != static_cast<int>(types->size())) {
+      return errors::DataLoss("Missing index ", types->size());
+    }
+    types->push_back(index_and_type.second);
+  }
+  return OkStatus();
+}
+
+Status ParseClientGraph(GraphDef graph_def,
+                        std::unique_ptr<ClientGraph>* client_graph) {
+  auto flib_def = std::make_unique<FunctionLibraryDefinition>(
+      OpRegistry::Global(), graph_def.library());
+  graph_def.clear_library();
+  auto result = std::make_unique<ClientGraph>(
+      std::move(flib_def), DataTypeVector(), DataTypeVector(),
+      BuildGraphOptions::kNoCollectiveGraphKey);
+  GraphConstructorOptions opts;
+  opts.allow_internal_ops = true;
+  opts.expect_device_spec = true;
+  TF_RETURN_IF_ERROR(
+      ConvertGraphDefToGraph(opts, std::move(graph_def), &result->graph));
+  TF_RETURN_IF_ERROR(
+      GetSignatureTypes(result->graph, IsArg, &result->feed_types));
+  TF_RETURN_IF_ERROR(
+      GetSignatureTypes(result->graph, IsRetval, &result->fetch_types));
+  *client_graph = std::move(result);
+  return OkStatus();
+}
+
+// Returns a fingerprint of the CPU model and features of the host, since
+// kernels and rewrites may be selected for them.
+uint64 FingerprintHostCPU() {
+  uint64 fingerprint = Fingerprint64(port::CPUVendorIDString());
+  fingerprint = FingerprintCat64(fingerprint, port::CPUFamily());
+  fingerprint = FingerprintCat64(fingerprint, port::CPUModelNum());
+  uint64 features = 0;
+  for (int feature = port::MMX; feature <= port::AMX_BF16; ++feature) {
+    if (port::TestCPUFeature(static_cast<port::CPUFeature>(feature))) {
+      features |= uint64{1} << feature;
+    }
+  }
+  return FingerprintCat64(fingerprint, features);
+}
+
+bool IsEntry(const std::string& filename) {
+  return absl::EndsWith(filename, ".pb");
+}
+
+}  // namespace
+
+ClientGraphCache::ClientGraphCache(Env* env, std::string directory,
+                                   int64_t max_entries)
+    : env_(env),
+      directory_(std::move(directory)),
+      max_entries_(max_entries > 0 ? max_entries : kDefaultMaxEntries) {}
+
+uint64 ClientGraphCache::FingerprintSession(
+    const Graph& full_graph, const FunctionLibraryDefinition& flib_def,
+    const DeviceSet& device_set, const ConfigProto& config) {
+  GraphDef graph_def;
+  full_graph.ToGraphDef(&graph_def);
+  uint64 fingerprint = DeterministicProtoHash64(graph_def);
+  fingerprint = FingerprintCat64(fingerprint,
+                                 DeterministicProtoHash64(flib_def.ToProto()));
+  fingerprint = FingerprintCat64(fingerprint, DeterministicProtoHash64(config));
+  for (const Device* device : device_set.devices()) {
+    // Grappler specializes the graph for the devices, e.g. for their memory
+    // and compute capability, which are part of their attributes. Only the
+    // incarnation changes whenever the process restarts.
+    DeviceAttributes attributes = device->attributes();
+    attributes.clear_incarnation();
+    fingerprint =
+        FingerprintCat64(fingerprint, DeterministicProtoHash64(attributes));
+  }
+  fingerprint = FingerprintCat64(fingerprint, FingerprintHostCPU());
+  // Graphs optimized by other versions of TensorFlow may not be valid.
+  return FingerprintCat64(fingerprint, Fingerprint64(TF_VERSION_STRING));
+}
+
+uint64 ClientGraphCache::ComputeKey(uint64 session_fingerprint,
+                                    const BuildGraphOptions& options) {
+  uint64 key = FingerprintCat64(
+      session_fingerprint, DeterministicProtoHash64(options.callable_options));
+  key = FingerprintCat64(key, options.use_function_convention);
+  key = FingerprintCat64(key, options.collective_graph_key);
+  return FingerprintCat64(key, static_cast<uint64>(options.collective_order));
+}
+
+bool ClientGraphCache::IsCacheable(const BuildGraphOptions& options) {
+  return options.use_function_convention &&
+         options.collective_graph_key ==
+             BuildGraphOptions::kNoCollectiveGraphKey &&
+         options.collective_order == GraphCollectiveOrder::kNone;
+}
+
+bool ClientGraphCache::Lookup(
+    uint64 key, std::unique_ptr<ClientGraph>* client_graph) const {
+  const std::string path = EntryPath(key);
+  if (!env_->FileExists(path).ok()) {
+    return false;
+  }
+  GraphDef graph_def;
+  Status s = ReadBinaryProto(env_, path, &graph_def);
+  if (s.ok()) {
+    s = ParseClientGraph(std::move(graph_def), client_graph);
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << "Ignoring the cached client graph " << path << ": " << s;
+    return false;
+  }
+  VLOG(1) << "Read the client graph " << path;
+  return true;
+}
+
+Status ClientGraphCache::Insert(uint64 key,
+                                const ClientGraph& client_graph) const {
+  if (client_graph.collective_graph_key !=
+      BuildGraphOptions::kNoCollectiveGraphKey) {
+    return OkStatus();
+  }
+  GraphDef graph_def;
+  client_graph.graph.ToGraphDef(&graph_def);
+  *graph_def.mutable_library() = client_graph.flib_def->ToProto();
+
+  TF_RETURN_IF_ERROR(env_->RecursivelyCreateDir(directory_));
+  const std::string path = EntryPath(key);
+  const std::string tmp_path =
+      strings::StrCat(path, ".tmp", random::New64());
+  TF_RETURN_IF_ERROR(WriteBinaryProto(env_, tmp_path, graph_def));
+  Status s = env_->RenameFile(tmp_path, path);
+  if (!s.ok()) {
+    env_->DeleteFile(tmp_path).IgnoreError();
+    return s;
+  }
+  EvictEntries(path);
+  return OkStatus();
+}
+
+void ClientGraphCache::ListEntries() const {
+  std::vector<std::string> children;
+  Status s = env_->GetChildren(directory_, &children);
+  if (!s.ok()) {
+    LOG(WARNING) << "Could not list the client graph cache " << directory_
+                 << ": " << s;
+    return;
+  }
+  std::vector<std::pair<int64_t, std::string>> entries;
+  for (const std::string& child : children) {
+    if (!IsEntry(child)) {
+      continue;
+    }
+    const std::string path = io::JoinPath(directory_, child);
+    FileStatistics stats;
+    if (env_->Stat(path, &stats).ok()) {
+      entries.emplace_back(stats.mtime_nsec, path);
+    }
+  }
+  std::sort(entries.begin(), entries.end());
+  for (auto& entry : entries) {
+    entries_.push_back(std::move(entry.second));
+    entry_positions_[entries_.back()] = std::prev(entries_.end());
+  }
+}
+
+void ClientGraphCache::EvictEntries(const std::string& path) const {
+  std::vector<std::string> evicted;
+  {
+    mutex_lock l(mu_);
+    if (!entries_listed_) {
+      // Lists the entries that were written before this cache was created,
+      // including the one at `path`, which is moved to the back below.
+      ListEntries();
+      entries_listed_ = true;
+    }
+    auto it = entry_positions_.find(path);
+    if (it != entry_positions_.end()) {
+      entries_.splice(entries_.end(), entries_, it->second);
+    } else {
+      entries_.push_back(path);
+      entry_positions_[path] = std::prev(entries_.end());
+    }
+    while (entries_.size() > max_entries_) {
+      entry_positions_.erase(entries_.front());
+      evicted.push_back(std::move(entries_.front()));
+      entries_.pop_front();
+    }
+  }
+  // Deletes the entries written longest ago. Concurrent lookups of a deleted
+  // entry miss.
+  for (const std::string& evicted_path : evicted) {
+    VLOG(1) << "Evicting the client graph " << evicted_path;
+    env_->DeleteFile(evicted_path).IgnoreError();
+  }
+}
+
+std::string ClientGraphCache::EntryPath(uint64 key) const {
+  return io::JoinPath(
+      directory_,
+      strings::Printf("%016llx.pb",
+                      static_cast<unsigned long long>(key)));  // NOLINT
+}
+
+}  // namespace tensorflow
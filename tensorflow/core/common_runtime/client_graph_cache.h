@@ -0,0 +1,116 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_CLIENT_GRAPH_CACHE_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_CLIENT_GRAPH_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/common_runtime/build_graph_options.h"
+#include "tensorflow/core/common_runtime/device_set.h"
+#include "tensorflow/core/common_runtime/graph_execution_state.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+
+namespace tensorflow {
+
+// A cache of the client graphs built by GraphExecutionState::BuildGraph(),
+// stored as files in a directory so that they outlive the process.
+//
+// Building a client graph prunes the full graph and runs Grappler on the
+// result, which can take seconds for large graphs. A session that is created
+// again with the same graph, devices and configuration, e.g. after a restart,
+// reads the client graphs of its signatures back from the cache instead.
+//
+// Only client graphs that use the function calling convention and contain no
+// collective ops can be cached. Their feed and fetch types are recovered from
+// the _Arg and _Retval nodes.
+//
+// The directory holds at most `max_entries` client graphs. Beyond that, the
+// entries written longest ago are deleted. The entries are listed once, on the
+// first insertion, and then tracked in memory, so entries written to the same
+// directory by other caches are only accounted for when they are listed.
+//
+// This class is thread-safe.
+class ClientGraphCache {
+ public:
+  // The number of entries kept if `max_entries` is not positive.
+  static constexpr int64_t kDefaultMaxEntries = 1024;
+
+  ClientGraphCache(Env* env, std::string directory, int64_t max_entries = 0);
+
+  // Returns a fingerprint of the inputs of BuildGraph() other than its
+  // options: the placed full graph, its function library, the attributes of
+  // the devices, the CPU of the host and the session configuration.
+  static uint64 FingerprintSession(const Graph& full_graph,
+                                   const FunctionLibraryDefinition& flib_def,
+                                   const DeviceSet& device_set,
+                                   const ConfigProto& config);
+
+  // Returns the key of the client graph built for `options` in a session
+  // whose fingerprint is `session_fingerprint`.
+  static uint64 ComputeKey(uint64 session_fingerprint,
+                           const BuildGraphOptions& options);
+
+  // Returns true if the client graphs built for `options` can be cached.
+  static bool IsCacheable(const BuildGraphOptions& options);
+
+  // Returns true and sets `*client_graph` to the client graph cached under
+  // `key`, if there is one. Entries that cannot be read are logged and
+  // treated as missing.
+  bool Lookup(uint64 key, std::unique_ptr<ClientGraph>* client_graph) const;
+
+  // Stores `client_graph` under `key`, unless it contains collective ops, and
+  // evicts old entries if the cache is full. Entries are written to a
+  // temporary file and renamed, so that concurrent lookups never see partial
+  // entries.
+  Status Insert(uint64 key, const ClientGraph& client_graph) const;
+
+ private:
+  std::string EntryPath(uint64 key) const;
+
+  // Lists the entries of `directory_`, oldest first, into `entries_`.
+  void ListEntries() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Records the entry at `path` as the newest, and deletes the oldest entries
+  // beyond `max_entries_`. Errors are logged.
+  void EvictEntries(const std::string& path) const;
+
+  Env* const env_;
+  const std::string directory_;
+  const size_t max_entries_;
+
+  mutable mutex mu_;
+  mutable bool entries_listed_ TF_GUARDED_BY(mu_) = false;
+  // The paths of the entries, oldest first.
+  mutable std::list<std::string> entries_ TF_GUARDED_BY(mu_);
+  mutable absl::flat_hash_map<std::string, std::list<std::string>::iterator>
+      entry_positions_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ClientGraphCache);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_CLIENT_GRAPH_CACHE_H_
@@ -0,0 +1,231 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/client_graph_cache.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/device_set.h"
+#include "tensorflow/core/framework/device.h"
+#include "tensorflow/core/framework/device_attributes.pb.h"
+#include "tensorflow/core/framework/function.pb.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr char kDevice[] = "/job:localhost/replica:0/task:0/device:CPU:0";
+
+// Returns a client graph that computes `retval = XTimesTwo(arg1)`, with
+// `int32` and `float` feeds.
+std::unique_ptr<ClientGraph> MakeClientGraph() {
+  FunctionDefLibrary library;
+  *library.add_function() = test::function::XTimesTwo();
+  auto client_graph = std::make_unique<ClientGraph>(
+      std::make_unique<FunctionLibraryDefinition>(OpRegistry::Global(),
+                                                  library),
+      DataTypeVector({DT_INT32, DT_FLOAT}), DataTypeVector({DT_FLOAT}),
+      BuildGraphOptions::kNoCollectiveGraphKey);
+  Graph* graph = &client_graph->graph;
+  Node* arg0;
+  TF_CHECK_OK(NodeBuilder("arg0", "_Arg")
+                  .Attr("T", DT_INT32)
+                  .Attr("index", 0)
+                  .AssignedDevice(kDevice)
+                  .Finalize(graph, &arg0));
+  Node* arg1;
+  TF_CHECK_OK(NodeBuilder("arg1", "_Arg")
+                  .Attr("T", DT_FLOAT)
+                  .Attr("index", 1)
+                  .AssignedDevice(kDevice)
+                  .Finalize(graph, &arg1));
+  Node* times_two;
+  TF_CHECK_OK(NodeBuilder("times_two", "XTimesTwo", graph->op_registry())
+                  .Input(arg1)
+                  .Attr("T", DT_FLOAT)
+                  .AssignedDevice(kDevice)
+                  .Finalize(graph, &times_two));
+  Node* retval;
+  TF_CHECK_OK(NodeBuilder("retval", "_Retval")
+                  .Input(times_two)
+                  .Attr("index", 0)
+                  .AssignedDevice(kDevice)
+                  .Finalize(graph, &retval));
+  return client_graph;
+}
+
+string MakeCacheDir() {
+  return io::JoinPath(testing::TmpDir(),
+                      strings::StrCat("client_graph_cache_", random::New64()));
+}
+
+TEST(ClientGraphCacheTest, RoundTrip) {
+  ClientGraphCache cache(Env::Default(), MakeCacheDir());
+  std::unique_ptr<ClientGraph> client_graph;
+  EXPECT_FALSE(cache.Lookup(1, &client_graph));
+
+  TF_ASSERT_OK(cache.Insert(1, *MakeClientGraph()));
+  ASSERT_TRUE(cache.Lookup(1, &client_graph));
+  EXPECT_FALSE(cache.Lookup(2, &client_graph));
+
+  EXPECT_EQ(client_graph->feed_types, DataTypeVector({DT_INT32, DT_FLOAT}));
+  EXPECT_EQ(client_graph->fetch_types, DataTypeVector({DT_FLOAT}));
+  EXPECT_EQ(client_graph->collective_graph_key,
+            BuildGraphOptions::kNoCollectiveGraphKey);
+  EXPECT_NE(client_graph->flib_def->Find("XTimesTwo"), nullptr);
+  EXPECT_EQ(client_graph->graph.num_op_nodes(), 4);
+  for (const Node* n : client_graph->graph.op_nodes()) {
+    EXPECT_EQ(n->assigned_device_name(), kDevice);
+  }
+}
+
+TEST(ClientGraphCacheTest, IgnoresCorruptEntries) {
+  const string cache_dir = MakeCacheDir();
+  ClientGraphCache cache(Env::Default(), cache_dir);
+  TF_ASSERT_OK(cache.Insert(1, *MakeClientGraph()));
+
+  std::vector<string> entries;
+  TF_ASSERT_OK(Env::Default()->GetChildren(cache_dir, &entries));
+  ASSERT_EQ(entries.size(), 1);
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(),
+                                 io::JoinPath(cache_dir, entries[0]),
+                                 "not a graph"));
+  std::unique_ptr<ClientGraph> client_graph;
+  EXPECT_FALSE(cache.Lookup(1, &client_graph));
+}
+
+TEST(ClientGraphCacheTest, DoesNotCacheCollectiveGraphs) {
+  ClientGraphCache cache(Env::Default(), MakeCacheDir());
+  std::unique_ptr<ClientGraph> collective_graph = MakeClientGraph();
+  collective_graph->collective_graph_key = 7;
+  TF_ASSERT_OK(cache.Insert(1, *collective_graph));
+  std::unique_ptr<ClientGraph> client_graph;
+  EXPECT_FALSE(cache.Lookup(1, &client_graph));
+
+  BuildGraphOptions options;
+  options.use_function_convention = true;
+  EXPECT_TRUE(ClientGraphCache::IsCacheable(options));
+  options.collective_order = GraphCollectiveOrder::kEdges;
+  EXPECT_FALSE(ClientGraphCache::IsCacheable(options));
+  options.collective_order = GraphCollectiveOrder::kNone;
+  options.use_function_convention = false;
+  EXPECT_FALSE(ClientGraphCache::IsCacheable(options));
+}
+
+TEST(ClientGraphCacheTest, KeyDependsOnSignature) {
+  BuildGraphOptions options;
+  options.use_function_convention = true;
+  options.callable_options.add_feed("x:0");
+  options.callable_options.add_fetch("y:0");
+  const uint64 key = ClientGraphCache::ComputeKey(1, options);
+  EXPECT_EQ(key, ClientGraphCache::ComputeKey(1, options));
+  EXPECT_NE(key, ClientGraphCache::ComputeKey(2, options));
+
+  BuildGraphOptions other_fetch = options;
+  other_fetch.callable_options.set_fetch(0, "z:0");
+  EXPECT_NE(key, ClientGraphCache::ComputeKey(1, other_fetch));
+}
+
+TEST(ClientGraphCacheTest, EvictsOldEntries) {
+  const string cache_dir = MakeCacheDir();
+  ClientGraphCache cache(Env::Default(), cache_dir, /*max_entries=*/2);
+  for (uint64 key = 1; key <= 3; ++key) {
+    TF_ASSERT_OK(cache.Insert(key, *MakeClientGraph()));
+  }
+  std::vector<string> entries;
+  TF_ASSERT_OK(Env::Default()->GetChildren(cache_dir, &entries));
+  EXPECT_EQ(entries.size(), 2);
+  std::unique_ptr<ClientGraph> client_graph;
+  EXPECT_FALSE(cache.Lookup(1, &client_graph));
+  EXPECT_TRUE(cache.Lookup(2, &client_graph));
+  EXPECT_TRUE(cache.Lookup(3, &client_graph));
+
+  // Inserting an existing entry again makes it the newest.
+  TF_ASSERT_OK(cache.Insert(2, *MakeClientGraph()));
+  TF_ASSERT_OK(cache.Insert(4, *MakeClientGraph()));
+  EXPECT_TRUE(cache.Lookup(2, &client_graph));
+  EXPECT_FALSE(cache.Lookup(3, &client_graph));
+  EXPECT_TRUE(cache.Lookup(4, &client_graph));
+}
+
+TEST(ClientGraphCacheTest, CountsEntriesOfEarlierCaches) {
+  const string cache_dir = MakeCacheDir();
+  {
+    ClientGraphCache cache(Env::Default(), cache_dir, /*max_entries=*/2);
+    TF_ASSERT_OK(cache.Insert(1, *MakeClientGraph()));
+    TF_ASSERT_OK(cache.Insert(2, *MakeClientGraph()));
+  }
+  ClientGraphCache cache(Env::Default(), cache_dir, /*max_entries=*/2);
+  TF_ASSERT_OK(cache.Insert(3, *MakeClientGraph()));
+  std::vector<string> entries;
+  TF_ASSERT_OK(Env::Default()->GetChildren(cache_dir, &entries));
+  EXPECT_EQ(entries.size(), 2);
+  std::unique_ptr<ClientGraph> client_graph;
+  EXPECT_TRUE(cache.Lookup(3, &client_graph));
+}
+
+class FakeDevice : public Device {
+ public:
+  explicit FakeDevice(const DeviceAttributes& attributes)
+      : Device(nullptr, attributes) {}
+  Status Sync() override { return OkStatus(); }
+  Allocator* GetAllocator(AllocatorAttributes) override { return nullptr; }
+};
+
+uint64 FingerprintWithDevice(const DeviceAttributes& attributes) {
+  Graph graph(OpRegistry::Global());
+  FunctionLibraryDefinition flib_def(OpRegistry::Global(),
+                                     FunctionDefLibrary());
+  FakeDevice device(attributes);
+  DeviceSet device_set;
+  device_set.AddDevice(&device);
+  return ClientGraphCache::FingerprintSession(graph, flib_def, device_set,
+                                              ConfigProto());
+}
+
+TEST(ClientGraphCacheTest, FingerprintDependsOnDeviceAttributes) {
+  DeviceAttributes attributes;
+  attributes.set_name("/job:localhost/replica:0/task:0/device:GPU:0");
+  attributes.set_device_type("GPU");
+  attributes.set_memory_limit(1 << 30);
+  attributes.set_physical_device_desc("device: 0, compute capability: 7.0");
+  attributes.set_incarnation(1);
+  const uint64 fingerprint = FingerprintWithDevice(attributes);
+
+  // The incarnation changes with every process.
+  DeviceAttributes other_incarnation = attributes;
+  other_incarnation.set_incarnation(2);
+  EXPECT_EQ(fingerprint, FingerprintWithDevice(other_incarnation));
+
+  DeviceAttributes other_desc = attributes;
+  other_desc.set_physical_device_desc("device: 0, compute capability: 8.0");
+  EXPECT_NE(fingerprint, FingerprintWithDevice(other_desc));
+
+  DeviceAttributes other_memory = attributes;
+  other_memory.set_memory_limit(int64_t{2} << 30);
+  EXPECT_NE(fingerprint, FingerprintWithDevice(other_memory));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -83,6 +83,36 @@ const char* GetCollectiveName(const CollectiveParams* cp, bool nccl) {
   }
 }
 
+// Returns true if the reduction `cp` should first reduce within each host and
+// then across hosts, which takes fewer steps across the network than a ring
+// over all devices: the group spans several hosts with the same number,
+// greater than one, of CPU devices each, and no flat ring is requested.
+//
+// Every member must report its host, so that all members make the same
+// choice. Binaries that do not know the hierarchical reduction never report
+// a host, so groups that include them keep using the flat ring.
+bool UseHierarchicalReduce(const CollectiveParams* cp) {
+  if (cp->instance.type != REDUCTION_COLLECTIVE ||
+      cp->group.device_type != DEVICE_CPU ||
+      cp->instance.impl_details.communication_hint == "ring") {
+    return false;
+  }
+  std::vector<std::vector<int>> hosts;
+  if (!cp->group.MembersByHost(&hosts) || hosts.size() <= 1 ||
+      hosts[0].size() <= 1) {
+    return false;
+  }
+  for (const std::vector<int>& host : hosts) {
+    if (host.size() != hosts[0].size()) {
+      return false;
+    }
+  }
+  CollectiveImplementationInterface* col_impl;
+  return CollectiveRegistry::LookupParamResolverInstance(
+             "HierarchicalRingReduce", &col_impl)
+      .ok();
+}
+
 string TaskNameFromDeviceName(const string& device_name) {
   DeviceNameUtils::ParsedName parsed_device;
   CHECK(DeviceNameUtils::ParseFullName(device_name, &parsed_device));
@@ -708,6 +738,9 @@ void CollectiveParamResolverLocal::AssignCollectiveType(CollectiveParams* cp) {
       CollectiveRegistry::LookupParamResolverInstance("NcclReduce", &col_impl)
           .ok();
   cp->instance.impl_details.collective_name = GetCollectiveName(cp, use_nccl);
+  if (!use_nccl && UseHierarchicalReduce(cp)) {
+    cp->instance.impl_details.collective_name = "HierarchicalRingReduce";
+  }
   VLOG(1) << "AssignCollectiveType "
           << cp->instance.impl_details.collective_name;
 }
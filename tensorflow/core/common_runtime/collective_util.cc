@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/common_runtime/collective_util.h"
 
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -27,6 +28,35 @@ limitations under the License.
 
 namespace tensorflow {
 namespace collective_util {
+namespace {
+
+template <typename T, typename F>
+void MergeOnHost(const Tensor& input, Tensor* output, F f) {
+  DCHECK_EQ(input.NumElements(), output->NumElements());
+  const T* src = input.flat<T>().data();
+  T* dst = output->flat<T>().data();
+  const int64_t n = output->NumElements();
+  for (int64_t i = 0; i < n; ++i) {
+    dst[i] = f(dst[i], src[i]);
+  }
+}
+
+template <typename T>
+HostMergeFn GetHostMergeFnForType(const string& op_type) {
+  if (op_type == "Add") {
+    return [](const Tensor& input, Tensor* output) {
+      MergeOnHost<T>(input, output, std::plus<T>());
+    };
+  }
+  if (op_type == "Mul") {
+    return [](const Tensor& input, Tensor* output) {
+      MergeOnHost<T>(input, output, std::multiplies<T>());
+    };
+  }
+  return nullptr;
+}
+
+}  // namespace
 
 /*static*/
 Status InitializeDeviceAndLocality(const DeviceMgr* dev_mgr,
@@ -109,5 +139,23 @@ Status ComputeBinOp(OpKernelContext* op_ctx, OpKernelContext::Params* params,
   return sub_ctx->sub_ctx_->status();
 }
 
+HostMergeFn GetHostMergeFn(const OpKernel* op) {
+  if (op == nullptr || op->num_inputs() != 2) {
+    return nullptr;
+  }
+  switch (op->input_type(0)) {
+    case DT_FLOAT:
+      return GetHostMergeFnForType<float>(op->type_string());
+    case DT_DOUBLE:
+      return GetHostMergeFnForType<double>(op->type_string());
+    case DT_INT32:
+      return GetHostMergeFnForType<int32>(op->type_string());
+    case DT_INT64:
+      return GetHostMergeFnForType<int64_t>(op->type_string());
+    default:
+      return nullptr;
+  }
+}
+
 }  // namespace collective_util
 }  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_COMMON_RUNTIME_COLLECTIVE_UTIL_H_
 #define TENSORFLOW_CORE_COMMON_RUNTIME_COLLECTIVE_UTIL_H_
 
+#include <functional>
 #include <string>
 
 #include "tensorflow/core/common_runtime/device.h"
@@ -53,6 +54,17 @@ Status ComputeBinOp(OpKernelContext* op_ctx, OpKernelContext::Params* params,
                     Device* device, OpKernel* op, Tensor* output,
                     Tensor* input);
 
+// Merges `input` into `output` element-wise on the host.
+using HostMergeFn = std::function<void(const Tensor& input, Tensor* output)>;
+
+// Returns a function that computes the element-wise binary `op` in place on
+// host tensors, in a single loop that the compiler vectorizes, when `op` is
+// an "Add" or "Mul" kernel on float, double, int32 or int64 values. This
+// avoids the cost of a kernel invocation and a separate pass over the data
+// for each merge, so the result can be merged as soon as it is received.
+// Returns nullptr for any other op, which must be computed by ComputeBinOp.
+HostMergeFn GetHostMergeFn(const OpKernel* op);
+
 }  // namespace collective_util
 }  // namespace tensorflow
 
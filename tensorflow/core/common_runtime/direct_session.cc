@@ -40,6 +40,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 #include "tensorflow/core/common_runtime/scoped_allocator_mgr.h"
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/graph.pb.h"
@@ -53,6 +54,7 @@ limitations under the License.
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/graph_node_util.h"
 #include "tensorflow/core/graph/graph_partition.h"
 #include "tensorflow/core/graph/subgraph.h"
 #include "tensorflow/core/graph/tensor_id.h"
@@ -90,6 +92,109 @@ auto* direct_session_runs = monitoring::Counter<0>::New(
     "/tensorflow/core/direct_session_runs",
     "The number of times DirectSession::Run() has been called.");
 
+auto* direct_session_result_cache_hits = monitoring::Counter<0>::New(
+    "/tensorflow/core/direct_session_result_cache_hits",
+    "The number of DirectSession::RunCallable() calls that returned cached "
+    "results.");
+
+auto* direct_session_result_cache_misses = monitoring::Counter<0>::New(
+    "/tensorflow/core/direct_session_result_cache_misses",
+    "The number of DirectSession::RunCallable() calls with a result cache that "
+    "ran the graph.");
+
+auto* direct_session_executor_cache_evictions = monitoring::Counter<0>::New(
+    "/tensorflow/core/direct_session_executor_cache_evictions",
+    "The number of executors that DirectSession evicted to stay within "
+    "ConfigProto.Experimental.executor_cache_capacity.");
+
+// Appends to `functions` the functions that a node of type `op` with `attrs`
+// calls, either directly or through function-valued attrs.
+void AppendCalledFunctions(const FunctionLibraryDefinition& flib_def,
+                           const string& op, AttrSlice attrs,
+                           std::vector<string>* functions) {
+  if (flib_def.Contains(op)) {
+    functions->push_back(op);
+  }
+  for (const auto& attr : attrs) {
+    if (attr.second.has_func()) {
+      functions->push_back(attr.second.func().name());
+    }
+    for (const NameAttrList& func : attr.second.list().func()) {
+      functions->push_back(func.name());
+    }
+  }
+}
+
+// Returns an error if `graph`, or a function it calls, contains an op whose
+// results may differ between steps that feed the same values, and which
+// therefore must not be cached.
+Status CheckResultCacheable(const Graph& graph) {
+  const FunctionLibraryDefinition& flib_def = graph.flib_def();
+  std::vector<string> functions;
+  for (const Node* n : graph.op_nodes()) {
+    // The ops that feed, fetch and transfer tensors are stateful, but do not
+    // change the results of the step.
+    if (n->IsArg() || n->IsRetval() || n->IsSend() || n->IsRecv()) {
+      continue;
+    }
+    if (n->op_def().is_stateful()) {
+      return errors::InvalidArgument(
+          "CallableOptions.result_cache_size_bytes requires a graph without "
+          "stateful ops, but it contains ",
+          FormatNodeForError(*n), " of stateful type ", n->type_string(), ".");
+    }
+    AppendCalledFunctions(flib_def, n->type_string(), n->attrs(), &functions);
+  }
+  absl::flat_hash_set<string> visited;
+  while (!functions.empty()) {
+    const string function = std::move(functions.back());
+    functions.pop_back();
+    if (!visited.insert(function).second) {
+      continue;
+    }
+    const FunctionDef* fdef = flib_def.Find(function);
+    if (fdef == nullptr) {
+      return errors::NotFound("Function ", function,
+                              " is not in the function library.");
+    }
+    for (const NodeDef& node : fdef->node_def()) {
+      const OpDef* op_def;
+      TF_RETURN_IF_ERROR(flib_def.LookUpOpDef(node.op(), &op_def));
+      if (op_def->is_stateful()) {
+        return errors::InvalidArgument(
+            "CallableOptions.result_cache_size_bytes requires a graph without "
+            "stateful ops, but function ",
+            function, " contains node ", node.name(), " of stateful type ",
+            node.op(), ".");
+      }
+      AppendCalledFunctions(flib_def, node.op(), AttrSlice(node), &functions);
+    }
+  }
+  return OkStatus();
+}
+
+// Returns an error if a feed or fetch of `callable_options` is backed by the
+// memory of a device other than the host CPU. The result cache fingerprints
+// and copies feed and fetched tensors on the host.
+Status CheckResultCacheDevices(const DeviceMgr& device_mgr,
+                               const CallableOptions& callable_options) {
+  for (const auto* devices : {&callable_options.feed_devices(),
+                              &callable_options.fetch_devices()}) {
+    for (const auto& name_and_device : *devices) {
+      Device* device;
+      TF_RETURN_IF_ERROR(
+          device_mgr.LookupDevice(name_and_device.second, &device));
+      if (device->device_type() != DEVICE_CPU) {
+        return errors::InvalidArgument(
+            "CallableOptions.result_cache_size_bytes requires feed and fetch "
+            "tensors in host memory, but ",
+            name_and_device.first, " is on ", name_and_device.second, ".");
+      }
+    }
+  }
+  return OkStatus();
+}
+
 Status NewThreadPoolFromThreadPoolOptions(
     const SessionOptions& options,
     const ThreadPoolOptionProto& thread_pool_options, int pool_number,
@@ -357,6 +462,13 @@ DirectSession::DirectSession(const SessionOptions& options,
   }
   session_handle_ =
       strings::StrCat("direct", strings::FpToString(random::New64()));
+  const string& client_graph_cache_dir =
+      options_.config.experimental().client_graph_cache_dir();
+  if (!client_graph_cache_dir.empty()) {
+    client_graph_cache_ = std::make_unique<ClientGraphCache>(
+        options_.env, client_graph_cache_dir,
+        options_.config.experimental().client_graph_cache_max_entries());
+  }
   int devices_added = 0;
   if (options.config.log_device_placement()) {
     const string mapping_str = device_mgr_->DeviceMappingString();
@@ -459,6 +571,7 @@ Status DirectSession::ExtendLocked(GraphDef&& graph) {
     // value and move `graph` in here.
     TF_RETURN_IF_ERROR(execution_state_->Extend(graph, &state));
     execution_state_.swap(state);
+    session_fingerprint_.reset();
     TF_RETURN_IF_ERROR(flib_def_->AddLibrary(graph.library()));
   }
   return OkStatus();
@@ -622,6 +735,16 @@ Status DirectSession::RunInternal(
         step_id, call_timeout,
         run_options.experimental().run_handler_pool_options());
     if (!handler) {
+      // The request waited until the earlier of its deadline and its timeout.
+      const int64_t deadline_in_ms = run_options.experimental()
+                                         .run_handler_pool_options()
+                                         .deadline_in_ms();
+      if (deadline_in_ms > 0 &&
+          (call_timeout <= 0 || deadline_in_ms <= call_timeout)) {
+        return errors::DeadlineExceeded(
+            "Could not obtain RunHandler for request before its deadline of ",
+            deadline_in_ms, "ms expired.");
+      }
       return errors::DeadlineExceeded(
           "Could not obtain RunHandler for request after waiting for ",
           call_timeout, "ms.");
@@ -704,6 +827,17 @@ Status DirectSession::RunInternal(
   }
   args.cancellation_manager = &step_cancellation_manager;
 
+  // Allocators for the tensors of the step on each partition, if their memory
+  // is planned.
+  std::vector<core::RefCountPtr<StepArenaAllocator>> step_allocators(
+      num_executors);
+  for (size_t i = 0; i < num_executors; ++i) {
+    const auto& item = executors_and_keys->items[i];
+    if (item.step_arena_planner != nullptr) {
+      step_allocators[i] = item.step_arena_planner->StartStep();
+    }
+  }
+
   Status run_status;
 
   auto set_threadpool_args_for_item =
@@ -736,6 +870,7 @@ Status DirectSession::RunInternal(
 
     const auto& item = executors_and_keys->items[0];
     set_threadpool_args_for_item(item, &args);
+    args.step_allocator = step_allocators[0].get();
     run_status = item.executor->Run(args);
   } else {
     core::RefCountPtr<RefCountedIntraProcessRendezvous> rendezvous(
@@ -754,8 +889,10 @@ Status DirectSession::RunInternal(
                               executors_done.Notify();
                             });
 
-    for (const auto& item : executors_and_keys->items) {
+    for (size_t i = 0; i < num_executors; ++i) {
+      const auto& item = executors_and_keys->items[i];
       set_threadpool_args_for_item(item, &args);
+      args.step_allocator = step_allocators[i].get();
       item.executor->RunAsync(args, barrier->Get());
     }
 
@@ -771,6 +908,13 @@ Status DirectSession::RunInternal(
     run_status.Update(errors::Cancelled("Run call was cancelled"));
   }
 
+  for (size_t i = 0; i < num_executors; ++i) {
+    if (step_allocators[i] != nullptr) {
+      executors_and_keys->items[i].step_arena_planner->EndStep(
+          step_allocators[i].get(), run_status);
+    }
+  }
+
   if (device_profiler_session) {
     TF_RETURN_IF_ERROR(device_profiler_session->CollectData(
         run_metadata->mutable_step_stats()));
@@ -865,7 +1009,7 @@ Status DirectSession::Run(const RunOptions& run_options,
   metrics::RecordGraphInputTensors(input_size);
 
   // Check if we already have an executor for these arguments.
-  ExecutorsAndKeys* executors_and_keys;
+  std::shared_ptr<ExecutorsAndKeys> executors_and_keys;
   RunStateArgs run_state_args(run_options.debug_options());
   run_state_args.collective_graph_key =
       run_options.experimental().collective_graph_key();
@@ -908,7 +1052,7 @@ Status DirectSession::Run(const RunOptions& run_options,
   }
 
   TF_RETURN_IF_ERROR(RunInternal(step_id, run_options, &call_frame,
-                                 executors_and_keys, run_metadata,
+                                 executors_and_keys.get(), run_metadata,
                                  threadpool_options));
 
   // Receive outputs.
@@ -965,7 +1109,7 @@ Status DirectSession::PRunSetup(const std::vector<string>& input_names,
   thread::ThreadPool* pool = thread_pools_[0].first;
 
   // Check if we already have an executor for these arguments.
-  ExecutorsAndKeys* executors_and_keys;
+  std::shared_ptr<ExecutorsAndKeys> executors_and_keys;
   // TODO(cais): TFDBG support for partial runs.
   DebugOptions debug_options;
   RunStateArgs run_state_args(debug_options);
@@ -980,6 +1124,7 @@ Status DirectSession::PRunSetup(const std::vector<string>& input_names,
   PartialRunState* run_state =
       new PartialRunState(input_names, output_names, args.step_id, &devices_);
   run_state->rendez.reset(new IntraProcessRendezvous(device_mgr_.get()));
+  run_state->executors_and_keys = executors_and_keys;
   {
     mutex_lock l(executor_lock_);
     if (!partial_runs_
@@ -1037,26 +1182,18 @@ Status DirectSession::PRun(const string& handle, const NamedTensorList& inputs,
                            const std::vector<string>& output_names,
                            std::vector<Tensor>* outputs) {
   TF_RETURN_IF_ERROR(CheckNotClosed());
-  std::vector<string> parts = str_util::Split(handle, ';');
-  const string& key = parts[0];
   // Get the executors for this partial run.
   ExecutorsAndKeys* executors_and_keys;
   PartialRunState* run_state;
   {
     mutex_lock l(executor_lock_);  // could use reader lock
-    auto exc_it = executors_.find(key);
-    if (exc_it == executors_.end()) {
-      return errors::InvalidArgument(
-          "Must run 'setup' before performing partial runs!");
-    }
-    executors_and_keys = exc_it->second.get();
-
     auto prun_it = partial_runs_.find(handle);
     if (prun_it == partial_runs_.end()) {
       return errors::InvalidArgument(
           "Must run 'setup' before performing partial runs!");
     }
     run_state = prun_it->second.get();
+    executors_and_keys = run_state->executors_and_keys.get();
 
     // Make sure that this is a new set of feeds that are still pending.
     for (const auto& input : inputs) {
@@ -1326,6 +1463,16 @@ Status DirectSession::CreateExecutors(
   std::unique_ptr<ExecutorsAndKeys> ek(new ExecutorsAndKeys);
 
   ek->callable_options = callable_options;
+  const int64_t result_cache_size_bytes =
+      callable_options.result_cache_size_bytes();
+  if (result_cache_size_bytes < 0) {
+    return errors::InvalidArgument(
+        "CallableOptions.result_cache_size_bytes must not be negative, got ",
+        result_cache_size_bytes);
+  }
+  if (result_cache_size_bytes > 0) {
+    TF_RETURN_IF_ERROR(CheckResultCacheDevices(*device_mgr_, callable_options));
+  }
 
   std::unordered_map<string, std::unique_ptr<Graph>> graphs;
   TF_RETURN_IF_ERROR(CreateGraphs(
@@ -1417,6 +1564,10 @@ Status DirectSession::CreateExecutors(
     optimizer.Optimize(lib, options_.env, device, &partition_graph,
                        GraphOptimizer::Options());
 
+    if (result_cache_size_bytes > 0) {
+      TF_RETURN_IF_ERROR(CheckResultCacheable(*partition_graph));
+    }
+
     // TensorFlow Debugger (tfdbg) inserts debug nodes in the graph.
     const DebugOptions& debug_options =
         options.callable_options.run_options().debug_options();
@@ -1434,11 +1585,21 @@ Status DirectSession::CreateExecutors(
     auto executor_type = options_.config.experimental().executor_type();
     TF_RETURN_IF_ERROR(
         NewExecutor(executor_type, params, *partition_graph, &item->executor));
+    if (options_.config.experimental().use_step_arena() &&
+        !run_state_args->is_partial_run &&
+        device->device_type() == DEVICE_CPU) {
+      item->step_arena_planner = std::make_unique<StepArenaPlanner>(
+          device->GetAllocator(AllocatorAttributes()));
+    }
     if (!options_.config.experimental().disable_output_partition_graphs() ||
         options_.config.graph_options().build_cost_model() > 0) {
       item->graph = std::move(partition_graph);
     }
   }
+  if (result_cache_size_bytes > 0) {
+    ek->result_cache =
+        std::make_unique<CallableResultCache>(result_cache_size_bytes);
+  }
 
   // Cache the mapping from input/output names to graph elements to
   // avoid recomputing it every time.
@@ -1480,7 +1641,8 @@ Status DirectSession::CreateExecutors(
 
 Status DirectSession::GetOrCreateExecutors(
     gtl::ArraySlice<string> inputs, gtl::ArraySlice<string> outputs,
-    gtl::ArraySlice<string> target_nodes, ExecutorsAndKeys** executors_and_keys,
+    gtl::ArraySlice<string> target_nodes,
+    std::shared_ptr<ExecutorsAndKeys>* executors_and_keys,
     RunStateArgs* run_state_args) {
   int64_t handle_name_counter_value = -1;
   if (LogMemory::IsEnabled() || run_state_args->is_partial_run) {
@@ -1509,7 +1671,8 @@ Status DirectSession::GetOrCreateExecutors(
     mutex_lock l(executor_lock_);  // could use reader lock
     auto it = executors_.find(key);
     if (it != executors_.end()) {
-      *executors_and_keys = it->second.get();
+      TouchExecutorsLocked(it->second.get());
+      *executors_and_keys = it->second;
       return OkStatus();
     }
   }
@@ -1542,7 +1705,8 @@ Status DirectSession::GetOrCreateExecutors(
     mutex_lock l(executor_lock_);
     auto it = executors_.find(sorted_key);
     if (it != executors_.end()) {
-      *executors_and_keys = it->second.get();
+      TouchExecutorsLocked(it->second.get());
+      *executors_and_keys = it->second;
       return OkStatus();
     }
   }
@@ -1573,6 +1737,9 @@ Status DirectSession::GetOrCreateExecutors(
   TF_RETURN_IF_ERROR(
       CreateExecutors(callable_options, &ek, &func_info, run_state_args));
 
+  // Evicted executors are destroyed after the lock is released.
+  std::vector<std::shared_ptr<ExecutorsAndKeys>> evicted;
+
   // Reacquire the lock, try to insert into the map.
   mutex_lock l(executor_lock_);
 
@@ -1580,18 +1747,56 @@ Status DirectSession::GetOrCreateExecutors(
   // reuse the already created one.
   auto insert_result = executors_.emplace(
       sorted_key, std::shared_ptr<ExecutorsAndKeys>(std::move(ek)));
-  if (insert_result.second) {
+  ExecutorsAndKeys* inserted = insert_result.first->second.get();
+  if (!insert_result.second) {
+    TouchExecutorsLocked(inserted);
+  } else if (options_.config.experimental().executor_cache_capacity() > 0) {
+    // The executors may be evicted, so they own their function library.
+    inserted->function_info = std::move(func_info);
+    executors_lru_.push_front(inserted);
+    inserted->lru_position = executors_lru_.begin();
+  } else {
     functions_.push_back(std::move(func_info));
   }
 
   // Insert the value under the original key, so the fast path lookup will work
   // if the user uses the same order of inputs, outputs, and targets again.
   executors_.emplace(key, insert_result.first->second);
-  *executors_and_keys = insert_result.first->second.get();
+  *executors_and_keys = insert_result.first->second;
 
+  if (insert_result.second) {
+    EvictExecutorsLocked(&evicted);
+  }
   return OkStatus();
 }
 
+void DirectSession::TouchExecutorsLocked(ExecutorsAndKeys* executors_and_keys) {
+  if (options_.config.experimental().executor_cache_capacity() > 0) {
+    executors_lru_.splice(executors_lru_.begin(), executors_lru_,
+                          executors_and_keys->lru_position);
+  }
+}
+
+void DirectSession::EvictExecutorsLocked(
+    std::vector<std::shared_ptr<ExecutorsAndKeys>>* evicted) {
+  const size_t capacity =
+      std::max(0, options_.config.experimental().executor_cache_capacity());
+  while (capacity > 0 && executors_lru_.size() > capacity) {
+    const ExecutorsAndKeys* victim = executors_lru_.back();
+    executors_lru_.pop_back();
+    // Several keys may map to the same executors.
+    for (auto it = executors_.begin(); it != executors_.end();) {
+      if (it->second.get() == victim) {
+        evicted->push_back(std::move(it->second));
+        it = executors_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    direct_session_executor_cache_evictions->GetCell()->IncrementBy(1);
+  }
+}
+
 Status DirectSession::CreateGraphs(
     const BuildGraphOptions& subgraph_options,
     std::unordered_map<string, std::unique_ptr<Graph>>* outputs,
@@ -1622,8 +1827,31 @@ Status DirectSession::CreateGraphs(
     execution_state = temp_exec_state_holder.get();
   } else {
     execution_state = execution_state_.get();
-    TF_RETURN_IF_ERROR(
-        execution_state->BuildGraph(subgraph_options, &client_graph));
+    const bool use_client_graph_cache =
+        client_graph_cache_ != nullptr &&
+        ClientGraphCache::IsCacheable(subgraph_options);
+    uint64 client_graph_key = 0;
+    if (use_client_graph_cache) {
+      if (!session_fingerprint_.has_value()) {
+        session_fingerprint_ = ClientGraphCache::FingerprintSession(
+            *execution_state->full_graph(), execution_state->flib_def(),
+            device_set_, options_.config);
+      }
+      client_graph_key =
+          ClientGraphCache::ComputeKey(*session_fingerprint_, subgraph_options);
+    }
+    if (!use_client_graph_cache ||
+        !client_graph_cache_->Lookup(client_graph_key, &client_graph)) {
+      TF_RETURN_IF_ERROR(
+          execution_state->BuildGraph(subgraph_options, &client_graph));
+      if (use_client_graph_cache) {
+        const Status s =
+            client_graph_cache_->Insert(client_graph_key, *client_graph);
+        if (!s.ok()) {
+          LOG(WARNING) << "Failed to cache the client graph: " << s;
+        }
+      }
+    }
   }
   *collective_graph_key = client_graph->collective_graph_key;
 
@@ -1976,6 +2204,21 @@ class DirectSession::RunCallableCallFrame : public CallFrameInterface {
   }
   metrics::RecordGraphInputTensors(input_size);
 
+  // Steps of a callable with a result cache have no side effects, so cached
+  // results are returned without running the executors.
+  CallableResultCache* result_cache = executors_and_keys->result_cache.get();
+  uint64 result_cache_key;
+  if (result_cache != nullptr && fetch_tensors != nullptr &&
+      CallableResultCache::ComputeKey(feed_tensors, &result_cache_key)) {
+    if (result_cache->Lookup(result_cache_key, feed_tensors, fetch_tensors)) {
+      direct_session_result_cache_hits->GetCell()->IncrementBy(1);
+      return OkStatus();
+    }
+    direct_session_result_cache_misses->GetCell()->IncrementBy(1);
+  } else {
+    result_cache = nullptr;
+  }
+
   std::unique_ptr<std::vector<Tensor>> converted_feed_tensors;
   const std::vector<Tensor>* actual_feed_tensors;
 
@@ -2016,6 +2259,9 @@ class DirectSession::RunCallableCallFrame : public CallFrameInterface {
     }
     metrics::RecordGraphOutputTensors(output_size);
   }
+  if (result_cache != nullptr) {
+    result_cache->Insert(result_cache_key, feed_tensors, *fetch_tensors);
+  }
 
   return OkStatus();
 }
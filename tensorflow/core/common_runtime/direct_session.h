@@ -17,12 +17,16 @@ limitations under the License.
 #define TENSORFLOW_CORE_COMMON_RUNTIME_DIRECT_SESSION_H_
 
 #include <atomic>
+#include <list>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "absl/types/optional.h"
+#include "tensorflow/core/common_runtime/callable_result_cache.h"
+#include "tensorflow/core/common_runtime/client_graph_cache.h"
 #include "tensorflow/core/common_runtime/costmodel_manager.h"
 #include "tensorflow/core/common_runtime/debugger_state_interface.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
@@ -32,6 +36,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/process_function_library_runtime.h"
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 #include "tensorflow/core/common_runtime/session_factory.h"
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/collective.h"
 #include "tensorflow/core/framework/graph.pb.h"
@@ -148,6 +153,8 @@ class DirectSession : public Session {
     Device* device = nullptr;                // not owned.
     FunctionLibraryRuntime* flib = nullptr;  // not owned.
     std::unique_ptr<Executor> executor;
+    // If not null, plans the memory of the tensors of the steps of `executor`.
+    std::unique_ptr<StepArenaPlanner> step_arena_planner;
   };
 
   // An ExecutorsAndKeys is created for a given set of feeds/fetches.
@@ -158,9 +165,15 @@ class DirectSession : public Session {
   // a partition of the graph bundled with its dependent library runtime.
   // 'input_keys' are the rendezvous keys for the feeds and 'output_keys'
   // are rendezvous keys for the fetches.
+  struct FunctionInfo;
   struct ExecutorsAndKeys {
     ExecutorsAndKeys() : step_count(0) {}
 
+    // The function library of `items`, if it is owned by this object rather
+    // than by `DirectSession::functions_`. Declared first, so that it is
+    // destroyed after the executors.
+    std::unique_ptr<FunctionInfo> function_info;
+
     std::atomic_int_fast64_t step_count;
     std::unique_ptr<Graph> graph;
     NameNodeMap name_to_node;
@@ -175,7 +188,14 @@ class DirectSession : public Session {
 
     CallableOptions callable_options;
 
+    // Results of previous steps, if `callable_options` enables the cache.
+    std::unique_ptr<CallableResultCache> result_cache;
+
     int64_t collective_graph_key = BuildGraphOptions::kNoCollectiveGraphKey;
+
+    // Position in `DirectSession::executors_lru_`, if the number of cached
+    // executors is bounded.
+    std::list<ExecutorsAndKeys*>::iterator lru_position;
   };
 
   // A FunctionInfo object is created for every unique set of feeds/fetches.
@@ -216,6 +236,8 @@ class DirectSession : public Session {
     std::unordered_map<string, bool> pending_inputs;   // true if fed
     std::unordered_map<string, bool> pending_outputs;  // true if fetched
     core::RefCountPtr<IntraProcessRendezvous> rendez = nullptr;
+    // Keeps the executors alive if they are evicted from `executors_`.
+    std::shared_ptr<ExecutorsAndKeys> executors_and_keys;
 
     PartialRunState(const std::vector<string>& pending_input_names,
                     const std::vector<string>& pending_output_names,
@@ -239,11 +261,24 @@ class DirectSession : public Session {
   };
 
   // Retrieves an already existing set of executors to run 'inputs' and
-  // 'outputs', or creates and caches them for future use.
+  // 'outputs', or creates and caches them for future use. The caller must
+  // hold on to `*executors_and_keys` while it uses them, as they may be
+  // evicted from the cache at any time.
   ::tensorflow::Status GetOrCreateExecutors(
       gtl::ArraySlice<string> inputs, gtl::ArraySlice<string> outputs,
       gtl::ArraySlice<string> target_nodes,
-      ExecutorsAndKeys** executors_and_keys, RunStateArgs* run_state_args);
+      std::shared_ptr<ExecutorsAndKeys>* executors_and_keys,
+      RunStateArgs* run_state_args);
+
+  // Marks `executors_and_keys` as the most recently used executors.
+  void TouchExecutorsLocked(ExecutorsAndKeys* executors_and_keys)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(executor_lock_);
+
+  // Removes the least recently used executors from `executors_` until at
+  // most `executor_cache_capacity` remain, and moves them to `*evicted`.
+  void EvictExecutorsLocked(
+      std::vector<std::shared_ptr<ExecutorsAndKeys>>* evicted)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(executor_lock_);
 
   // Creates a set of executors to run the subgraph defined by
   // `callable_options`.
@@ -366,6 +401,9 @@ class DirectSession : public Session {
   // same ExecutorsAndKey object.
   std::unordered_map<string, std::shared_ptr<ExecutorsAndKeys>> executors_
       TF_GUARDED_BY(executor_lock_);
+  // The distinct values of `executors_`, most recently used first, if
+  // `executor_cache_capacity` bounds their number.
+  std::list<ExecutorsAndKeys*> executors_lru_ TF_GUARDED_BY(executor_lock_);
 
   class RunCallableCallFrame;
   struct Callable {
@@ -400,6 +438,12 @@ class DirectSession : public Session {
   std::unique_ptr<GraphExecutionState> execution_state_
       TF_GUARDED_BY(graph_state_lock_);
 
+  // If not null, persists the client graphs built by `execution_state_`.
+  std::unique_ptr<ClientGraphCache> client_graph_cache_;
+  // Fingerprint of `execution_state_` for `client_graph_cache_`, computed on
+  // first use.
+  absl::optional<uint64> session_fingerprint_ TF_GUARDED_BY(graph_state_lock_);
+
   // The function library, before any rewrites or optimizations have been
   // performed. In particular, CreateGraphs() may need to modify the function
   // library; it copies and modifies the function library.
@@ -43,8 +43,11 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
 #include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/path.h"
 #include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/platform/random.h"
 #include "tensorflow/core/platform/stacktrace.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
@@ -801,6 +804,236 @@ TEST_F(DirectSessionMinusAXTest, UseRunHandlerPool) {
   EXPECT_FLOAT_EQ(5.0, mat(0, 0));
 }
 
+TEST_F(DirectSessionMinusAXTest, TestFeed_CallableWithResultCache) {
+  Initialize({1, 2, 3, 4});
+  auto session = CreateSession();
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def_));
+
+  CallableOptions callable_options = MakeCallableOptions({x_}, {y_ + ":0"}, {});
+  callable_options.mutable_run_options()->set_trace_level(
+      RunOptions::SOFTWARE_TRACE);
+  callable_options.set_result_cache_size_bytes(1 << 20);
+  Session::CallableHandle handle;
+  TF_ASSERT_OK(session->MakeCallable(callable_options, &handle));
+
+  Tensor t(DT_FLOAT, TensorShape({2, 1}));
+  test::FillValues<float>(&t, {5, 6});
+  std::vector<Tensor> outputs;
+  RunMetadata run_metadata;
+  TF_ASSERT_OK(session->RunCallable(handle, {t}, &outputs, &run_metadata));
+  ASSERT_EQ(1, outputs.size());
+  test::ExpectTensorEqual<float>(outputs[0],
+                                 test::AsTensor<float>({17, 39}, {2, 1}));
+  EXPECT_TRUE(run_metadata.has_step_stats());
+
+  // The same feed is served from the cache, without running the graph.
+  Tensor same_t(DT_FLOAT, TensorShape({2, 1}));
+  test::FillValues<float>(&same_t, {5, 6});
+  outputs.clear();
+  run_metadata.Clear();
+  TF_ASSERT_OK(
+      session->RunCallable(handle, {same_t}, &outputs, &run_metadata));
+  ASSERT_EQ(1, outputs.size());
+  test::ExpectTensorEqual<float>(outputs[0],
+                                 test::AsTensor<float>({17, 39}, {2, 1}));
+  EXPECT_FALSE(run_metadata.has_step_stats());
+
+  // A different feed runs the graph.
+  Tensor other_t(DT_FLOAT, TensorShape({2, 1}));
+  test::FillValues<float>(&other_t, {1, 0});
+  outputs.clear();
+  run_metadata.Clear();
+  TF_ASSERT_OK(
+      session->RunCallable(handle, {other_t}, &outputs, &run_metadata));
+  ASSERT_EQ(1, outputs.size());
+  test::ExpectTensorEqual<float>(outputs[0],
+                                 test::AsTensor<float>({1, 3}, {2, 1}));
+  EXPECT_TRUE(run_metadata.has_step_stats());
+  TF_ASSERT_OK(session->ReleaseCallable(handle));
+}
+
+TEST_F(DirectSessionMinusAXTest, ExecutorCacheEvictsLeastRecentlyUsed) {
+  Initialize({3, 2, -1, 0});
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_experimental()->set_executor_cache_capacity(2);
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def_));
+  monitoring::testing::CellReader<int64_t> evictions(
+      "/tensorflow/core/direct_session_executor_cache_evictions");
+
+  auto run = [&session](const string& fetch) {
+    std::vector<Tensor> outputs;
+    TF_CHECK_OK(session->Run({}, {fetch + ":0"}, {}, &outputs));
+    return outputs[0].flat<float>()(0);
+  };
+  EXPECT_FLOAT_EQ(run(y_), 5.0);
+  EXPECT_FLOAT_EQ(run(y_neg_), -5.0);
+  EXPECT_FLOAT_EQ(run(y_), 5.0);
+  EXPECT_EQ(evictions.Delta(), 0);
+
+  // Evicts the executors of `y_neg_`, which are the least recently used.
+  EXPECT_FLOAT_EQ(run(z_), -5.0);
+  EXPECT_EQ(evictions.Delta(), 1);
+  EXPECT_FLOAT_EQ(run(y_), 5.0);
+  EXPECT_EQ(evictions.Delta(), 0);
+  EXPECT_FLOAT_EQ(run(y_neg_), -5.0);
+  EXPECT_EQ(evictions.Delta(), 1);
+}
+
+TEST_F(DirectSessionMinusAXTest, ClientGraphCache) {
+  Initialize({1, 2, 3, 4});
+  const string cache_dir =
+      io::JoinPath(testing::TmpDir(),
+                   strings::StrCat("client_graph_cache_", random::New64()));
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_experimental()->set_client_graph_cache_dir(cache_dir);
+
+  Tensor t(DT_FLOAT, TensorShape({2, 1}));
+  test::FillValues<float>(&t, {5, 6});
+  std::vector<Tensor> outputs;
+  {
+    std::unique_ptr<Session> session(NewSession(options));
+    ASSERT_TRUE(session != nullptr);
+    TF_ASSERT_OK(session->Create(def_));
+    TF_ASSERT_OK(session->Run({{x_, t}}, {y_ + ":0"}, {}, &outputs));
+    ASSERT_EQ(1, outputs.size());
+    test::ExpectTensorEqual<float>(outputs[0],
+                                   test::AsTensor<float>({17, 39}, {2, 1}));
+  }
+
+  std::vector<string> entries;
+  TF_ASSERT_OK(Env::Default()->GetChildren(cache_dir, &entries));
+  ASSERT_EQ(1, entries.size());
+
+  // Changes the value of `a` in the cached graph, so that the results show
+  // whether the next session reads it.
+  const string entry_path = io::JoinPath(cache_dir, entries[0]);
+  GraphDef cached_def;
+  TF_ASSERT_OK(ReadBinaryProto(Env::Default(), entry_path, &cached_def));
+  bool found_a = false;
+  for (NodeDef& node : *cached_def.mutable_node()) {
+    if (node.name() == a_) {
+      Tensor new_a = test::AsTensor<float>({2, 0, 0, 2}, {2, 2});
+      new_a.AsProtoTensorContent(
+          (*node.mutable_attr())["value"].mutable_tensor());
+      found_a = true;
+    }
+  }
+  ASSERT_TRUE(found_a);
+  TF_ASSERT_OK(WriteBinaryProto(Env::Default(), entry_path, cached_def));
+
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def_));
+  TF_ASSERT_OK(session->Run({{x_, t}}, {y_ + ":0"}, {}, &outputs));
+  ASSERT_EQ(1, outputs.size());
+  test::ExpectTensorEqual<float>(outputs[0],
+                                 test::AsTensor<float>({10, 12}, {2, 1}));
+}
+
+TEST(DirectSessionTest, ResultCacheRequiresStatelessGraph) {
+  GraphDef def;
+  Graph g(OpRegistry::Global());
+  Node* var = test::graph::Var(&g, DT_FLOAT, TensorShape({10}));
+  var->set_assigned_device_name("/job:localhost/replica:0/task:0/cpu:0");
+  g.ToGraphDef(&def);
+
+  auto session = CreateSession();
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def));
+
+  CallableOptions callable_options =
+      MakeCallableOptions({}, {var->name() + ":0"}, {});
+  callable_options.set_result_cache_size_bytes(1 << 20);
+  Session::CallableHandle handle;
+  Status s = session->MakeCallable(callable_options, &handle);
+  EXPECT_TRUE(errors::IsInvalidArgument(s)) << s;
+  EXPECT_TRUE(absl::StrContains(s.error_message(), "stateful")) << s;
+}
+
+TEST(DirectSessionTest, ResultCacheRequiresStatelessFunctions) {
+  FunctionDefLibrary library_graph_def;
+  *library_graph_def.add_function() = FunctionDefHelper::Define(
+      // Name
+      "RandomFn",
+      // Args
+      {"shape: int32"},
+      // Return values
+      {"y: float"},
+      // Attr def
+      {},
+      // Nodes
+      {{{"y"},
+        "RandomUniform",
+        {"shape"},
+        {{"T", DT_INT32}, {"dtype", DT_FLOAT}}}});
+  FunctionLibraryDefinition flib(OpRegistry::Global(), library_graph_def);
+  Graph g(&flib);
+  Node* shape = test::graph::Constant(&g, test::AsTensor<int32>({2}));
+  Node* y = test::graph::Unary(&g, "RandomFn", shape);
+  GraphDef def;
+  g.ToGraphDef(&def);
+  *def.mutable_library() = library_graph_def;
+
+  SessionOptions options = DefaultSessionOptions();
+  // Keeps the call, so that only the function body has the stateful op.
+  options.config.mutable_graph_options()
+      ->mutable_optimizer_options()
+      ->set_do_function_inlining(false);
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def));
+
+  CallableOptions callable_options =
+      MakeCallableOptions({}, {y->name() + ":0"}, {});
+  callable_options.set_result_cache_size_bytes(1 << 20);
+  Session::CallableHandle handle;
+  Status s = session->MakeCallable(callable_options, &handle);
+  EXPECT_TRUE(errors::IsInvalidArgument(s)) << s;
+  EXPECT_TRUE(absl::StrContains(s.error_message(), "stateful")) << s;
+}
+
+TEST(DirectSessionTest, StepArenaPlansRepeatedSteps) {
+  // z = A * (A * x), whose intermediate result is freed within each step.
+  Graph g(OpRegistry::Global());
+  Node* a = test::graph::Constant(
+      &g, test::AsTensor<float>({1, 2, 3, 4}, {2, 2}));
+  Node* x;
+  TF_ASSERT_OK(NodeBuilder(g.NewName("x"), "Placeholder")
+                   .Attr("shape", TensorShape({2, 1}))
+                   .Attr("dtype", DT_FLOAT)
+                   .Finalize(&g, &x));
+  Node* y = test::graph::Matmul(&g, a, x, false, false);
+  Node* z = test::graph::Matmul(&g, a, y, false, false);
+  GraphDef def;
+  g.ToGraphDef(&def);
+
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_experimental()->set_use_step_arena(true);
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def));
+  monitoring::testing::CellReader<int64_t> plans(
+      "/tensorflow/core/step_arena_plans");
+
+  // The first steps record their allocations, and the later ones are served
+  // from the arena of the plan.
+  for (int i = 0; i < 10; ++i) {
+    Tensor x_value = test::AsTensor<float>({1.0f * i, 1}, {2, 1});
+    std::vector<Tensor> outputs;
+    TF_ASSERT_OK(
+        session->Run({{x->name(), x_value}}, {z->name() + ":0"}, {}, &outputs));
+    ASSERT_EQ(1, outputs.size());
+    // A * A = [[7, 10], [15, 22]].
+    test::ExpectTensorEqual<float>(
+        outputs[0],
+        test::AsTensor<float>({7.0f * i + 10, 15.0f * i + 22}, {2, 1}));
+  }
+  EXPECT_GE(plans.Delta(), 1);
+}
+
 TEST(DirectSessionTest, KeepsStateAcrossRunsOfSession) {
   GraphDef def;
   Graph g(OpRegistry::Global());
@@ -1700,6 +1933,43 @@ TEST(DirectSessionTest, PartialRunMultiOutputFeed) {
   ASSERT_EQ(true, outputs[0].flat<bool>()(0));
 }
 
+TEST(DirectSessionTest, PartialRunSurvivesExecutorEviction) {
+  GraphDef def;
+  Graph g(OpRegistry::Global());
+
+  Tensor first_value(DT_FLOAT, TensorShape({}));
+  first_value.scalar<float>()() = 1.0;
+  Node* first_const = test::graph::Constant(&g, first_value);
+  Node* first_identity = test::graph::Identity(&g, first_const);
+
+  g.ToGraphDef(&def);
+
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_experimental()->set_executor_cache_capacity(1);
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def));
+
+  string handle;
+  TF_ASSERT_OK(session->PRunSetup({first_const->name()},
+                                  {first_identity->name() + ":0"}, {},
+                                  &handle));
+
+  // Evicts the executors of the partial run from the cache.
+  std::vector<Tensor> outputs;
+  TF_ASSERT_OK(
+      session->Run({}, {first_identity->name() + ":0"}, {}, &outputs));
+  ASSERT_EQ(1, outputs.size());
+  ASSERT_EQ(1.0, outputs[0].flat<float>()(0));
+
+  Tensor value_11(DT_FLOAT, TensorShape({}));
+  value_11.scalar<float>()() = 11.0;
+  TF_ASSERT_OK(session->PRun(handle, {{first_const->name(), value_11}},
+                             {first_identity->name() + ":0"}, &outputs));
+  ASSERT_EQ(1, outputs.size());
+  ASSERT_EQ(11.0, outputs[0].flat<float>()(0));
+}
+
 TEST(DirectSessionTest, RunHandleTest) {
   GraphDef def;
   Graph g(OpRegistry::Global());
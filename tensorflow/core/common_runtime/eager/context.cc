@@ -479,6 +479,11 @@ void EagerContext::ClearCachesAndThreadExecutors() {
   ClearCachesAndDefaultExecutor();
 }
 
+/* static */ int64_t EagerContext::NewKernelCacheGeneration() {
+  static std::atomic<int64_t>* next_generation = new std::atomic<int64_t>(0);
+  return next_generation->fetch_add(1, std::memory_order_relaxed);
+}
+
 void EagerContext::ClearCachesAndDefaultExecutor() {
   {
     // The executor stores pointers to kernels, so we need to make sure that no
@@ -495,6 +500,8 @@ void EagerContext::ClearCachesAndDefaultExecutor() {
     mutex_lock dl(device_cache_mu_);
     device_cache_.clear();
   }
+  kernel_cache_generation_.store(NewKernelCacheGeneration(),
+                                 std::memory_order_release);
   {
     mutex_lock ml(metadata_mu_);
     step_container_ = std::make_unique<ScopedStepContainer>(
@@ -16,6 +16,7 @@ limitations under the License.
 #define TENSORFLOW_CORE_COMMON_RUNTIME_EAGER_CONTEXT_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <map>
 #include <memory>
@@ -265,6 +266,14 @@ class EagerContext : public ImmediateExecutionContext, public core::RefCounted {
   void AddKernelToCache(Fprint128 cache_key, KernelAndDevice* kernel);
   void AddDeviceToCache(Fprint128 device_cache_key, Device* device);
 
+  // Returns the generation of the kernel and device caches, which changes
+  // whenever they are cleared. Generations are unique across contexts, so
+  // callers that memoize lookups in these caches (e.g. the per-thread kernel
+  // inline cache) can use it to identify both the context and its caches.
+  int64_t KernelCacheGeneration() const {
+    return kernel_cache_generation_.load(std::memory_order_acquire);
+  }
+
   bool LogDevicePlacement() const { return log_device_placement_; }
   void SetLogDevicePlacement(bool enable) override {
     log_device_placement_ = enable;
@@ -758,6 +767,9 @@ class EagerContext : public ImmediateExecutionContext, public core::RefCounted {
       TF_GUARDED_BY(cache_mu_);
   absl::flat_hash_map<Fprint128, Device*, Fprint128Hasher> device_cache_
       TF_GUARDED_BY(device_cache_mu_);
+  // Returns a kernel cache generation that was never returned before.
+  static int64_t NewKernelCacheGeneration();
+  std::atomic<int64_t> kernel_cache_generation_{NewKernelCacheGeneration()};
 
   // Whether we should compute RunMetadata.
   std::atomic<bool> should_store_graphs_{false};
@@ -1073,17 +1073,47 @@ Fprint128 GetDeviceCacheKey(EagerOperation* op, const EagerContext& ctx) {
   return device_cache_key;
 }
 
+// Returns the key of the kernel inline cache for an op with `device_cache_key`.
+// In addition to the device cache key, it covers the context settings that
+// GetKernelCacheKey() depends on.
+Fprint128 GetInlineCacheKey(const Fprint128& device_cache_key,
+                            const EagerContext& ctx) {
+  Fprint128 inline_cache_key =
+      FingerprintCat128(device_cache_key, ctx.RunEagerOpAsFunction());
+  return FingerprintCat128(inline_cache_key,
+                           ctx.GetReuseRendezvousForFunctions());
+}
+
 Status GetOrCreateKernelAndDevice(
     EagerOperation* op, TensorHandle** retvals, int* num_retvals,
     core::RefCountPtr<KernelAndDevice>* out_kernel) {
   EagerContext& ctx = op->EagerContext();
   Device* device = absl::get<Device*>(op->Device());
 
+  // Only ops that are placed here use the inline cache, since they compute
+  // the device cache key anyway. Ops with a device pay no extra fingerprints.
+  const bool use_inline_cache = device == nullptr && !op->is_function();
+  const int64_t cache_generation = ctx.KernelCacheGeneration();
+  Fprint128 inline_cache_key;
+  bool inline_cache_hit = false;
+  // A copy, since the entry may be replaced before it is used.
+  KernelInlineCache::Entry inline_cache_entry;
+
   // Set the EagerOperation's device prior to extracting the input_device_ptrs
   // to avoid any redundant H2D/D2H copies.
-  if (device == nullptr && !op->is_function()) {
+  if (use_inline_cache) {
     Fprint128 device_cache_key = GetDeviceCacheKey(op, ctx);
-    device = ctx.GetCachedDevice(device_cache_key);
+    inline_cache_key = GetInlineCacheKey(device_cache_key, ctx);
+    const KernelInlineCache::Entry* entry =
+        KernelInlineCache::ForCurrentThread()->Lookup(inline_cache_key,
+                                                      cache_generation);
+    if (entry != nullptr) {
+      inline_cache_hit = true;
+      inline_cache_entry = *entry;
+      device = inline_cache_entry.device;
+    } else {
+      device = ctx.GetCachedDevice(device_cache_key);
+    }
     if (device == nullptr) {
       TF_RETURN_IF_ERROR(SetOpDevice(ctx, op, &device));
       ctx.AddDeviceToCache(device_cache_key, device);
@@ -1106,7 +1136,9 @@ Status GetOrCreateKernelAndDevice(
   std::unordered_map<int, DtypeAndPartialTensorShape>
       input_resource_variable_dtypes_and_shapes;
   const KernelDef* kernel_def = nullptr;
-  if (!op->is_function()) {
+  if (inline_cache_hit) {
+    kernel_def = inline_cache_entry.kernel_def;
+  } else if (!op->is_function()) {
     const NodeDef* node_def = &op->MutableAttrs()->BuildNodeDef();
     kernel_def = GetKernelDef(*op, node_def, device);
   }
@@ -1116,11 +1148,19 @@ Status GetOrCreateKernelAndDevice(
         input_resource_variable_dtypes_and_shapes));
   }
 
-  TF_ASSIGN_OR_RETURN(
-      Fprint128 cache_key,
-      GetKernelCacheKey(*op, op->MutableAttrs()->CacheKey(op->DeviceName()),
-                        input_device_ptrs,
-                        input_resource_variable_dtypes_and_shapes));
+  Fprint128 cache_key;
+  if (inline_cache_hit && input_device_ptrs.empty() &&
+      input_resource_variable_dtypes_and_shapes.empty()) {
+    // The inputs are not part of the kernel cache key, so it is the same as
+    // in the last execution.
+    cache_key = inline_cache_entry.kernel_cache_key;
+  } else {
+    TF_ASSIGN_OR_RETURN(
+        cache_key,
+        GetKernelCacheKey(*op, op->MutableAttrs()->CacheKey(op->DeviceName()),
+                          input_device_ptrs,
+                          input_resource_variable_dtypes_and_shapes));
+  }
   core::RefCountPtr<KernelAndDevice> kernel = ctx.GetCachedKernel(cache_key);
   AbstractOperationPtr wrapped_op_releaser;
   // We can eliminate some overhead by running simple functions using regular
@@ -1302,6 +1342,16 @@ Status GetOrCreateKernelAndDevice(
   }
   *num_retvals = num_outputs;
 
+  if (use_inline_cache && !inline_cache_hit) {
+    KernelInlineCache::Entry entry;
+    entry.key = inline_cache_key;
+    entry.generation = cache_generation;
+    entry.device = device;
+    entry.kernel_def = kernel_def;
+    entry.kernel_cache_key = cache_key;
+    KernelInlineCache::ForCurrentThread()->Insert(entry);
+  }
+
   kernel->Ref();  // Ownership of reference is passed to out_kernel.
   out_kernel->reset(kernel.get());
   return OkStatus();
@@ -1816,6 +1866,26 @@ void CollectGraphs(EagerContext* ctx) {
 }
 }  // namespace
 
+/* static */ KernelInlineCache* KernelInlineCache::ForCurrentThread() {
+  static thread_local KernelInlineCache cache;
+  return &cache;
+}
+
+KernelInlineCache::Entry* KernelInlineCache::Lookup(const Fprint128& key,
+                                                    int64_t generation) {
+  for (Entry& entry : entries_) {
+    if (entry.generation == generation && entry.key == key) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void KernelInlineCache::Insert(const Entry& entry) {
+  entries_[next_] = entry;
+  next_ = (next_ + 1) % kCapacity;
+}
+
 Status EagerExecute(EagerOperation* op, TensorHandle** retvals,
                     int* num_retvals) {
   profiler::TraceMe activity([&] {
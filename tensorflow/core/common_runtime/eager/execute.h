@@ -24,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/eager/tensor_handle.h"
 #include "tensorflow/core/framework/step_stats.pb.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/fingerprint.h"
 
 namespace tensorflow {
 
@@ -85,6 +86,47 @@ Status EagerCopyToDevice(TensorHandle* h, EagerContext* ctx,
 void EagerLocalExecuteAsync(EagerOperation* op, TensorHandle** retvals,
                             int* num_retvals, StatusCallback done);
 
+// A small per-thread cache of the device and kernel lookups of recently
+// executed ops that were placed by the runtime. Entries are keyed by the op
+// name, attributes and requested device, together with the context settings
+// that the lookups depend on. A hit skips device selection, the KernelDef
+// lookup and, when no inputs contribute to it, the kernel cache key
+// computation. Threads that run a mix of ops, e.g. through the Python fast
+// path, which reuses one operation object per thread, hit for every op in the
+// mix as long as it has at most kCapacity distinct entries.
+//
+// Entries do not hold references to kernels, which are still fetched from the
+// context's kernel cache. They are only valid for the context and cache
+// generation they were filled in for (see
+// EagerContext::KernelCacheGeneration()). Exposed for testing.
+class KernelInlineCache {
+ public:
+  static constexpr int kCapacity = 16;
+
+  struct Entry {
+    Fprint128 key = {0, 0};
+    int64_t generation = -1;
+    Device* device = nullptr;               // Not owned.
+    const KernelDef* kernel_def = nullptr;  // Not owned.
+    Fprint128 kernel_cache_key = {0, 0};
+  };
+
+  // Returns the cache of the calling thread.
+  static KernelInlineCache* ForCurrentThread();
+
+  // Returns the entry for `key` and `generation`, or nullptr if there is none.
+  Entry* Lookup(const Fprint128& key, int64_t generation);
+
+  // Adds `entry`, replacing the oldest entry once the cache is full.
+  void Insert(const Entry& entry);
+
+  absl::Span<Entry> entries() { return absl::MakeSpan(entries_); }
+
+ private:
+  Entry entries_[kCapacity];
+  int next_ = 0;
+};
+
 }  // namespace tensorflow
 
 #endif  // TENSORFLOW_CORE_COMMON_RUNTIME_EAGER_EXECUTE_H_
@@ -20,6 +20,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace {
@@ -58,5 +59,109 @@ TEST(ExecuteTest, EagerOperationAsFunction) {
   ctx->Unref();
 }
 
+// Runs the binary op `op_name` on `x` and `x` with `op`, which is reset first.
+Status RunBinaryOp(EagerOperation* op, const char* op_name,
+                   ImmediateExecutionTensorHandle* x) {
+  op->Clear();
+  TF_RETURN_IF_ERROR(op->Reset(
+      op_name,
+      /*raw_device_name=*/"/job:localhost/replica:0/task:0/device:CPU:0"));
+  TF_RETURN_IF_ERROR(op->AddInput(x));
+  TF_RETURN_IF_ERROR(op->AddInput(x));
+  std::vector<TensorHandle*> retvals(1);
+  int num_retvals = retvals.size();
+  TF_RETURN_IF_ERROR(EagerExecute(op, retvals.data(), &num_retvals));
+  retvals[0]->Unref();
+  return OkStatus();
+}
+
+// Returns the entries of the calling thread's kernel inline cache that belong
+// to the current generation of `ctx`.
+std::vector<KernelInlineCache::Entry*> InlineCacheEntries(
+    const EagerContext& ctx) {
+  std::vector<KernelInlineCache::Entry*> entries;
+  for (KernelInlineCache::Entry& entry :
+       KernelInlineCache::ForCurrentThread()->entries()) {
+    if (entry.generation == ctx.KernelCacheGeneration()) {
+      entries.push_back(&entry);
+    }
+  }
+  return entries;
+}
+
+TEST(ExecuteTest, InlineCacheHitsForMixedOps) {
+  StaticDeviceMgr device_mgr(
+      DeviceFactory::NewDevice("CPU", {}, "/job:localhost/replica:0/task:0"));
+  auto ctx = new EagerContext(
+      SessionOptions(),
+      tensorflow::ContextDevicePlacementPolicy::DEVICE_PLACEMENT_EXPLICIT,
+      false, &device_mgr, false, nullptr, nullptr);
+  Tensor x_tensor = test::AsScalar<int64_t>(3);
+  ImmediateExecutionTensorHandle* x =
+      ctx->CreateLocalHandleFromTFTensor(x_tensor, ctx->HostCPUName().c_str());
+  auto op = std::make_unique<EagerOperation>(ctx);
+
+  TF_ASSERT_OK(RunBinaryOp(op.get(), "Mul", x));
+  std::vector<KernelInlineCache::Entry*> entries = InlineCacheEntries(*ctx);
+  ASSERT_EQ(entries.size(), 1);
+  KernelInlineCache::Entry* mul_entry = entries[0];
+  EXPECT_EQ(mul_entry->device, device_mgr.HostCPU());
+  EXPECT_NE(mul_entry->kernel_def, nullptr);
+  const Fprint128 mul_kernel_cache_key = mul_entry->kernel_cache_key;
+
+  // Another op on the same operation object gets an entry of its own.
+  TF_ASSERT_OK(RunBinaryOp(op.get(), "Add", x));
+  EXPECT_EQ(InlineCacheEntries(*ctx).size(), 2);
+
+  // A hit uses the cached kernel cache key as is, so the kernel is created
+  // again under the modified key.
+  mul_entry->kernel_cache_key = Fprint128{1, 2};
+  TF_ASSERT_OK(RunBinaryOp(op.get(), "Mul", x));
+  TF_ASSERT_OK(RunBinaryOp(op.get(), "Add", x));
+  EXPECT_EQ(InlineCacheEntries(*ctx).size(), 2);
+  EXPECT_NE(ctx->GetCachedKernel(Fprint128{1, 2}), nullptr);
+
+  // Clearing the caches of the context invalidates its entries.
+  ctx->ClearCachesAndThreadExecutors();
+  EXPECT_TRUE(InlineCacheEntries(*ctx).empty());
+  TF_ASSERT_OK(RunBinaryOp(op.get(), "Mul", x));
+  entries = InlineCacheEntries(*ctx);
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0]->kernel_cache_key, mul_kernel_cache_key);
+
+  op.reset();
+  x->Unref();
+  ctx->Unref();
+}
+
+// Runs small ops repeatedly with an operation that is reused across runs, as
+// the Python fast path does. Runs the same op every time if `state.range(0)`
+// is 1, and cycles through that many different ops otherwise.
+void BM_EagerExecuteSmallOp(::testing::benchmark::State& state) {
+  static constexpr const char* kOps[] = {"Mul", "Add", "Sub", "Maximum",
+                                         "Minimum"};
+  const int num_ops = state.range(0);
+  CHECK_LE(num_ops, sizeof(kOps) / sizeof(kOps[0]));
+  StaticDeviceMgr device_mgr(
+      DeviceFactory::NewDevice("CPU", {}, "/job:localhost/replica:0/task:0"));
+  auto ctx = new EagerContext(
+      SessionOptions(),
+      tensorflow::ContextDevicePlacementPolicy::DEVICE_PLACEMENT_SILENT, false,
+      &device_mgr, false, nullptr, nullptr);
+  Tensor x_tensor = test::AsScalar<float>(3.0f);
+  ImmediateExecutionTensorHandle* x =
+      ctx->CreateLocalHandleFromTFTensor(x_tensor, ctx->HostCPUName().c_str());
+  auto op = std::make_unique<EagerOperation>(ctx);
+  int i = 0;
+  for (auto s : state) {
+    TF_CHECK_OK(RunBinaryOp(op.get(), kOps[i], x));
+    i = (i + 1) % num_ops;
+  }
+  op.reset();
+  x->Unref();
+  ctx->Unref();
+}
+BENCHMARK(BM_EagerExecuteSmallOp)->Arg(1)->Arg(2)->Arg(5);
+
 }  // namespace
 }  // namespace tensorflow
@@ -29,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/graph_view.h"
 #include "tensorflow/core/common_runtime/immutable_executor_state.h"
+#include "tensorflow/core/common_runtime/kernel_cost_sampler.h"
 #include "tensorflow/core/common_runtime/pending_counts.h"
 #include "tensorflow/core/common_runtime/propagator_state.h"
 #include "tensorflow/core/common_runtime/renamed_device.h"
@@ -442,10 +443,12 @@ ExecutorState<PropagatorStateType>::ExecutorState(
       run_all_kernels_inline_(args.run_all_kernels_inline),
       propagator_(immutable_state, step_id_, vlog_),
       num_outstanding_ops_(0) {
-  if (args.user_intra_op_threadpool != nullptr) {
+  if (args.user_intra_op_threadpool != nullptr ||
+      args.step_allocator != nullptr) {
     Device* device = immutable_state_.params().device;
     user_device_ = RenamedDevice::NewRenamedDevice(
-        device->name(), device, false, false, args.user_intra_op_threadpool);
+        device->name(), device, false, false, args.user_intra_op_threadpool,
+        args.step_allocator);
   }
 }
 
@@ -584,6 +587,9 @@ Status ExecutorState<PropagatorStateType>::ProcessSync(
   OpKernel* op_kernel = item.kernel;
   Device* device = immutable_state_.params().device;
   const bool is_expensive = kernel_stats_->IsExpensive(item);
+  KernelCostSampler* cost_sampler = KernelCostSampler::Global();
+  const bool sample_cost = cost_sampler->ShouldSample();
+  const int64_t sample_start_nsec = sample_cost ? EnvTime::NowNanos() : 0;
 
   if (TF_PREDICT_FALSE(MightTrace(event_collector_, is_expensive))) {
     tracing::ScopedRegion region(tracing::EventCategory::kCompute,
@@ -609,6 +615,11 @@ Status ExecutorState<PropagatorStateType>::ProcessSync(
   } else {
     device->Compute(op_kernel, &ctx);
   }
+  if (TF_PREDICT_FALSE(sample_cost)) {
+    cost_sampler->Record(session_handle_, op_kernel->type_string_view(),
+                         op_kernel->name_view(),
+                         EnvTime::NowNanos() - sample_start_nsec);
+  }
   nodestats::SetOpEnd(stats);
   if (outputs->size() < item.num_outputs) outputs->resize(item.num_outputs);
   s = ProcessOutputs(item, &ctx, outputs->data(), stats);
@@ -102,6 +102,9 @@ class Executor {
     ScopedStepContainer* step_container = nullptr;
     CollectiveExecutor* collective_executor = nullptr;
     thread::ThreadPoolInterface* user_intra_op_threadpool = nullptr;
+    // If not null, used instead of the device allocator for the tensors that
+    // kernels allocate with default allocator attributes.
+    Allocator* step_allocator = nullptr;
     tsl::CoordinationServiceAgent* coordination_service_agent = nullptr;
     int64_t start_time_usecs = 0;
     // The deadline for the kernel to complete by. Empty if unspecified.
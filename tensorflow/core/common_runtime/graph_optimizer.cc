@@ -19,10 +19,13 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/function_utils.h"
 #include "tensorflow/core/common_runtime/graph_constructor.h"
 #include "tensorflow/core/common_runtime/inline_function_utils.h"
+#include "tensorflow/core/common_runtime/unary_op_fusion.h"
 #include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/graph/optimizer_cse.h"
+#include "tensorflow/core/platform/logging.h"
 
 namespace tensorflow {
 
@@ -150,6 +153,22 @@ void GraphOptimizer::Optimize(FunctionLibraryRuntime* runtime, Env* env,
     if (!changed) break;
   }
 
+  if (opts_.do_unary_op_fusion() && device != nullptr &&
+      device->device_type() == DEVICE_CPU) {
+    tensorflow::metrics::ScopedCounter<2> timings(
+        tensorflow::metrics::GetGraphOptimizationCounter(),
+        {kGraphOptimizerCategory, "unary_op_fusion"});
+    bool was_mutated;
+    Status s = FuseUnaryOpChains(g, &was_mutated);
+    if (!s.ok()) {
+      // The graph is left as it was, so it can still be run unfused.
+      LOG(WARNING) << "Failed to fuse unary op chains: " << s;
+    }
+    if (was_mutated) {
+      DumpGraph("UnaryOpFusion", g);
+    }
+  }
+
   // Clone the graph to copy the input FunctionLibraryDefinition, since the
   // original lib def will go out of scope.
   *graph = g->Clone();
@@ -0,0 +1,394 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/hierarchical_ring_reducer.h"
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/collective_rma_local.h"
+#include "tensorflow/core/common_runtime/collective_util.h"
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/common_runtime/ring_reducer.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/cancellation.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr char kReduceScatter[] = "hrs";
+constexpr char kAcrossHosts[] = "hring";
+constexpr char kGather[] = "hag";
+
+// Sets `hosts` to the ranks of the devices on each host, and returns true if
+// there is more than one host and every host has the same number, greater
+// than one, of devices.
+bool GetHostLayout(const CollGroupParams& group,
+                   std::vector<std::vector<int>>* hosts) {
+  if (!group.MembersByHost(hosts) || hosts->size() <= 1 ||
+      hosts->front().size() <= 1) {
+    return false;
+  }
+  for (const std::vector<int>& host : *hosts) {
+    if (host.size() != hosts->front().size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the ranks of the devices at position `local_idx` of every host, in
+// the order of their hosts except that the devices of a task are adjacent, as
+// RingAlg requires.  Sets `num_tasks` to the number of tasks they belong to.
+std::vector<int> AcrossHostsRanks(const CollGroupParams& group,
+                                  const std::vector<std::vector<int>>& hosts,
+                                  int local_idx, int* num_tasks) {
+  std::unordered_map<string, int> task_index;
+  std::vector<std::vector<int>> ranks_by_task;
+  for (const std::vector<int>& host : hosts) {
+    const int rank = host[local_idx];
+    auto it = task_index.emplace(group.members[rank].task, ranks_by_task.size())
+                  .first;
+    if (it->second == ranks_by_task.size()) {
+      ranks_by_task.emplace_back();
+    }
+    ranks_by_task[it->second].push_back(rank);
+  }
+  std::vector<int> ranks;
+  ranks.reserve(hosts.size());
+  for (const std::vector<int>& task_ranks : ranks_by_task) {
+    ranks.insert(ranks.end(), task_ranks.begin(), task_ranks.end());
+  }
+  *num_tasks = ranks_by_task.size();
+  return ranks;
+}
+
+}  // namespace
+
+HierarchicalRingReducer::HierarchicalRingReducer()
+    : col_ctx_(nullptr),
+      col_params_(nullptr),
+      num_hosts_(0),
+      devices_per_host_(0),
+      host_idx_(-1),
+      local_idx_(-1),
+      ran_ring_(false) {}
+
+bool HierarchicalRingReducer::IsHierarchical(const CollGroupParams& group) {
+  std::vector<std::vector<int>> hosts;
+  return GetHostLayout(group, &hosts);
+}
+
+Status HierarchicalRingReducer::InitializeCollectiveParams(
+    CollectiveParams* col_params) {
+  if (col_params->instance.type != REDUCTION_COLLECTIVE) {
+    return errors::Internal("HierarchicalRingReduce expects a reduction, got ",
+                            col_params->instance.type);
+  }
+  if (col_params->group.device_type != DEVICE_CPU) {
+    return errors::Unimplemented(
+        "HierarchicalRingReduce only supports CPU devices, got ",
+        col_params->group.device_type.type_string());
+  }
+  if (!IsHierarchical(col_params->group)) {
+    return errors::InvalidArgument(
+        "HierarchicalRingReduce requires several hosts with the same number "
+        "of devices each, got ",
+        col_params->group.ToString());
+  }
+  return OkStatus();
+}
+
+Status HierarchicalRingReducer::InitializeCollectiveContext(
+    std::shared_ptr<CollectiveContext> col_ctx) {
+  DCHECK(col_ctx->dev_mgr);
+  col_ctx_ = col_ctx;
+  col_params_ = col_ctx->col_params.get();
+  if (!GetHostLayout(col_params_->group, &hosts_)) {
+    return errors::Internal("Unexpected group for HierarchicalRingReduce: ",
+                            col_params_->group.ToString());
+  }
+  num_hosts_ = hosts_.size();
+  devices_per_host_ = hosts_.front().size();
+  for (int hi = 0; hi < num_hosts_; ++hi) {
+    for (int di = 0; di < devices_per_host_; ++di) {
+      if (hosts_[hi][di] == col_params_->default_rank) {
+        host_idx_ = hi;
+        local_idx_ = di;
+      }
+    }
+  }
+  return collective_util::InitializeDeviceAndLocality(
+      col_ctx->dev_mgr, col_ctx->device_name, &col_ctx->device,
+      &col_ctx->device_locality);
+}
+
+void HierarchicalRingReducer::Run(StatusCallback done) {
+  DCHECK(col_ctx_);
+  DCHECK(col_params_);
+  host_merge_fn_ = collective_util::GetHostMergeFn(col_params_->merge_op);
+  VLOG(1) << "HierarchicalRingReducer::Run for device "
+          << col_ctx_->device_name << " host " << host_idx_ << " of "
+          << num_hosts_ << " position " << local_idx_ << " of "
+          << devices_per_host_;
+
+  Status s = CopyInputToOutput();
+  if (s.ok()) {
+    AllocatorAttributes attr = col_ctx_->op_ctx->output_alloc_attr(0);
+    ca_.reset(MakeCollectiveAdapter(col_ctx_->output, devices_per_host_,
+                                    col_ctx_->device->GetAllocator(attr)));
+    s = ReduceScatterInHost();
+  }
+  if (s.ok()) {
+    s = ReduceAcrossHosts();
+  }
+  if (s.ok() && col_params_->final_op) {
+    // The rings across hosts only see a part of the group, so the final op is
+    // applied here.
+    Tensor chunk = ca_->ChunkAlias(local_idx_);
+    Tensor group_size = ca_->Scalar(col_params_->group.group_size);
+    s = collective_util::ComputeBinOp(col_ctx_->op_ctx, col_ctx_->op_params,
+                                      col_ctx_->device, col_params_->final_op,
+                                      &chunk, &group_size);
+  }
+  if (s.ok()) {
+    s = GatherInHost();
+  }
+  if (!ran_ring_) {
+    // Like RingReducer, this does not require non-overlapping collectives.
+    col_ctx_->col_exec->UnblockDependencies(*col_params_);
+  }
+  if (s.ok()) {
+    ca_->ConsumeFinalValue(col_ctx_->output);
+  } else {
+    StartAbort(s);
+  }
+  ca_.reset();
+  done(s);
+}
+
+Status HierarchicalRingReducer::CopyInputToOutput() {
+  if (col_ctx_->input == col_ctx_->output ||
+      DMAHelper::base(col_ctx_->input) == DMAHelper::base(col_ctx_->output)) {
+    return OkStatus();
+  }
+  Notification note;
+  Status status;
+  profiler::TraceMe activity("MemCpyAsync", profiler::TraceMeLevel::kInfo);
+  CollectiveRemoteAccessLocal::MemCpyAsync(
+      col_ctx_->op_ctx->op_device_context(),
+      col_ctx_->op_ctx->op_device_context(), col_ctx_->device,
+      col_ctx_->device, col_ctx_->op_ctx->input_alloc_attr(0),
+      col_ctx_->op_ctx->output_alloc_attr(0), col_ctx_->input,
+      col_ctx_->output, 0 /*dev_to_dev_stream_index*/,
+      [&note, &status](const Status& s) {
+        status.Update(s);
+        note.Notify();
+      });
+  note.WaitForNotification();
+  return status;
+}
+
+Status HierarchicalRingReducer::ReduceScatterInHost() {
+  // Every other device of the host sends its copy of this device's chunk,
+  // which is merged as soon as it arrives.
+  const int num_peers = devices_per_host_ - 1;
+  std::vector<Tensor> sent(devices_per_host_);
+  std::vector<Tensor> received(devices_per_host_);
+  std::vector<Status> recv_status(devices_per_host_);
+  std::vector<Notification> recv_done(devices_per_host_);
+  BlockingCounter sends_pending(num_peers);
+  mutex mu;
+  Status status;
+  for (int i = 0; i < devices_per_host_; ++i) {
+    if (i == local_idx_) continue;
+    sent[i] = ca_->ChunkAlias(i);
+    DispatchSend(kReduceScatter, i, &sent[i],
+                 [&mu, &status, &sends_pending](const Status& s) {
+                   {
+                     mutex_lock l(mu);
+                     status.Update(s);
+                   }
+                   sends_pending.DecrementCount();
+                 });
+    received[i] = ca_->TempChunk(local_idx_);
+    DispatchRecv(kReduceScatter, i, &received[i],
+                 [&recv_status, &recv_done, i](const Status& s) {
+                   recv_status[i] = s;
+                   recv_done[i].Notify();
+                 });
+  }
+  Tensor chunk = ca_->ChunkAlias(local_idx_);
+  Status merge_status;
+  for (int i = 0; i < devices_per_host_; ++i) {
+    if (i == local_idx_) continue;
+    recv_done[i].WaitForNotification();
+    merge_status.Update(recv_status[i]);
+    if (merge_status.ok()) {
+      merge_status = Merge(&chunk, &received[i]);
+    }
+  }
+  sends_pending.Wait();
+  mutex_lock l(mu);
+  status.Update(merge_status);
+  return status;
+}
+
+Status HierarchicalRingReducer::ReduceAcrossHosts() {
+  Tensor chunk = ca_->ChunkAlias(local_idx_);
+  if (chunk.NumElements() == 0) {
+    // The same chunk is empty on every host.
+    return OkStatus();
+  }
+  core::RefCountPtr<CollectiveParams> ring_params(new CollectiveParams());
+  ring_params->name = col_params_->name;
+  // num_devices_per_task is kept, so that the ring unblocks the collectives
+  // that depend on this instance once all the devices of the task started.
+  ring_params->group = col_params_->group;
+  ring_params->group.group_size = num_hosts_;
+  ring_params->group.members.clear();
+  int num_tasks;
+  const std::vector<int> ranks = AcrossHostsRanks(
+      col_params_->group, hosts_, local_idx_, &num_tasks);
+  ring_params->group.num_tasks = num_tasks;
+  for (int ri = 0; ri < ranks.size(); ++ri) {
+    ring_params->group.members.push_back(col_params_->group.members[ranks[ri]]);
+    if (ranks[ri] == col_params_->default_rank) {
+      ring_params->default_rank = ri;
+    }
+  }
+  ring_params->instance = col_params_->instance;
+  ring_params->instance.shape = chunk.shape();
+  ring_params->instance.impl_details.collective_name = "RingReduce";
+  ring_params->instance.impl_details.subdiv_offsets = {0};
+  ring_params->instance.impl_details.subdiv_permutations.clear();
+  ring_params->merge_op = col_params_->merge_op;
+
+  core::RefCountPtr<RingReducer> ring(new RingReducer());
+  TF_RETURN_IF_ERROR(ring->InitializeCollectiveParams(ring_params.get()));
+  auto ring_ctx = std::make_shared<CollectiveContext>(
+      col_ctx_->col_exec, col_ctx_->nccl_communicator, col_ctx_->dev_mgr,
+      col_ctx_->op_ctx, col_ctx_->op_params, ring_params.get(),
+      strings::StrCat(col_ctx_->exec_key, ":", kAcrossHosts, ":", local_idx_),
+      col_ctx_->step_id, &chunk, &chunk);
+  TF_RETURN_IF_ERROR(ring->InitializeCollectiveContext(ring_ctx));
+  ran_ring_ = true;
+  Notification note;
+  Status status;
+  ring->Run([&note, &status](const Status& s) {
+    status = s;
+    note.Notify();
+  });
+  note.WaitForNotification();
+  return status;
+}
+
+Status HierarchicalRingReducer::GatherInHost() {
+  const int num_peers = devices_per_host_ - 1;
+  Tensor chunk = ca_->ChunkAlias(local_idx_);
+  std::vector<Tensor> received(devices_per_host_);
+  BlockingCounter pending(2 * num_peers);
+  mutex mu;
+  Status status;
+  auto done = [&mu, &status, &pending](const Status& s) {
+    {
+      mutex_lock l(mu);
+      status.Update(s);
+    }
+    pending.DecrementCount();
+  };
+  for (int i = 0; i < devices_per_host_; ++i) {
+    if (i == local_idx_) continue;
+    DispatchSend(kGather, i, &chunk, done);
+    received[i] = ca_->ChunkAlias(i);
+    DispatchRecv(kGather, i, &received[i], done);
+  }
+  pending.Wait();
+  mutex_lock l(mu);
+  return status;
+}
+
+Status HierarchicalRingReducer::Merge(Tensor* output, Tensor* input) {
+  if (host_merge_fn_) {
+    host_merge_fn_(*input, output);
+    return OkStatus();
+  }
+  return collective_util::ComputeBinOp(col_ctx_->op_ctx, col_ctx_->op_params,
+                                       col_ctx_->device, col_params_->merge_op,
+                                       output, input);
+}
+
+void HierarchicalRingReducer::DispatchSend(const string& phase, int dst_idx,
+                                           const Tensor* tensor,
+                                           const StatusCallback& done) {
+  const CollGroupMember& dst =
+      col_params_->group.members[hosts_[host_idx_][dst_idx]];
+  string send_buf_key = strings::StrCat(col_ctx_->exec_key, ":", phase, ":",
+                                        local_idx_, ":", dst_idx);
+  VLOG(3) << "DispatchSend " << send_buf_key << " from_device "
+          << col_ctx_->device_name << " to_device " << dst.device.name();
+  col_ctx_->col_exec->remote_access()->PostToPeer(
+      dst.device.name(), dst.task, send_buf_key, col_ctx_->device,
+      col_ctx_->op_ctx->op_device_context(),
+      col_ctx_->op_ctx->output_alloc_attr(0), tensor,
+      col_ctx_->device_locality, col_ctx_->op_ctx->cancellation_manager(),
+      done);
+}
+
+void HierarchicalRingReducer::DispatchRecv(const string& phase, int src_idx,
+                                           Tensor* tensor,
+                                           const StatusCallback& done) {
+  const CollGroupMember& src =
+      col_params_->group.members[hosts_[host_idx_][src_idx]];
+  string recv_buf_key = strings::StrCat(col_ctx_->exec_key, ":", phase, ":",
+                                        src_idx, ":", local_idx_);
+  VLOG(3) << "DispatchRecv " << recv_buf_key << " from_device "
+          << src.device.name() << " to_device " << col_ctx_->device_name;
+  col_ctx_->col_exec->remote_access()->RecvFromPeer(
+      src.device.name(), src.task, src.is_local, recv_buf_key,
+      col_ctx_->device, col_ctx_->op_ctx->op_device_context(),
+      col_ctx_->op_ctx->output_alloc_attr(0), tensor,
+      col_ctx_->device_locality, 0 /*stream_index*/,
+      col_ctx_->op_ctx->cancellation_manager(), done);
+}
+
+void HierarchicalRingReducer::StartAbort(const Status& s) {
+  // The devices that wait for this one are released by aborting the
+  // outstanding transfers, unless they are being cancelled anyway.
+  CancellationManager* cancel_mgr = col_ctx_->op_ctx->cancellation_manager();
+  if (cancel_mgr == nullptr ||
+      (!cancel_mgr->IsCancelled() && !cancel_mgr->IsCancelling())) {
+    col_ctx_->col_exec->StartAbort(s);
+  }
+}
+
+namespace {
+REGISTER_COLLECTIVE(HierarchicalRingReduce, HierarchicalRingReducer);
+}  // namespace
+
+}  // namespace tensorflow
@@ -0,0 +1,110 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_HIERARCHICAL_RING_REDUCER_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_HIERARCHICAL_RING_REDUCER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/base_collective_executor.h"
+#include "tensorflow/core/common_runtime/collective_util.h"
+#include "tensorflow/core/framework/collective.h"
+
+namespace tensorflow {
+
+// Two-level implementation of collective all-reduce, for groups that span
+// several hosts with the same number of devices each.  Hosts are identified
+// by the host_name of the members' device attributes.
+//
+// The tensor is split into one chunk per device of a host.  First the devices
+// of each host reduce-scatter the chunks, so that the device at position d of
+// its host holds the host-wide reduction of chunk d.  Then the devices at
+// position d of every host all-reduce chunk d in a ring across hosts, one ring
+// per position.  Finally the devices of each host all-gather the reduced
+// chunks.  A flat ring over N devices on H hosts takes 2(N-1) sequential
+// steps, each of which may cross the network; here only the 2(H-1) steps of
+// the rings across hosts do.  The devices of a host may belong to different
+// tasks, e.g. one single-device worker per core, in which case the transfers
+// within a host go through the distributed RMA, which uses shared memory
+// between tasks on the same host.
+class HierarchicalRingReducer : public CollectiveImplementationInterface {
+ public:
+  HierarchicalRingReducer();
+  ~HierarchicalRingReducer() override = default;
+
+  // Checks that the group of `col_params` can be reduced hierarchically.
+  Status InitializeCollectiveParams(CollectiveParams* col_params) override;
+
+  // Initializes members of CollectiveContext not yet initialized, i.e. device
+  // and device_locality.  Also saves the CollectiveContext in this object.
+  Status InitializeCollectiveContext(
+      std::shared_ptr<CollectiveContext> col_ctx) override;
+
+  // Begins async execution of the hierarchical reduce.
+  // Must be called in a blockable thread.
+  void Run(StatusCallback done) override;
+
+  // Returns true if every member of `group` reports its host, and the group
+  // spans more than one host with the same number, greater than one, of
+  // devices each.
+  static bool IsHierarchical(const CollGroupParams& group);
+
+ private:
+  Status CopyInputToOutput();
+
+  // Reduces chunk local_idx_ of the tensor over the devices of this host.
+  Status ReduceScatterInHost();
+
+  // Reduces chunk local_idx_ of the tensor over the devices at the same
+  // position of every host.
+  Status ReduceAcrossHosts();
+
+  // Collects the reduced chunks of the other devices of this host.
+  Status GatherInHost();
+
+  // Merges `input` into `output` with the merge_op.
+  Status Merge(Tensor* output, Tensor* input);
+
+  // Sends `tensor` to the device at `dst_idx` of this host in `phase`.
+  void DispatchSend(const string& phase, int dst_idx, const Tensor* tensor,
+                    const StatusCallback& done);
+
+  // Receives `tensor` from the device at `src_idx` of this host in `phase`.
+  void DispatchRecv(const string& phase, int src_idx, Tensor* tensor,
+                    const StatusCallback& done);
+
+  void StartAbort(const Status& s);
+
+  std::shared_ptr<CollectiveContext> col_ctx_;
+  const CollectiveParams* col_params_;  // Not owned
+  std::unique_ptr<CollectiveAdapter> ca_;
+  // If set, merges received chunks on the host instead of with merge_op.
+  collective_util::HostMergeFn host_merge_fn_;
+  // The ranks of the devices of each host, from CollGroupParams::
+  // MembersByHost().
+  std::vector<std::vector<int>> hosts_;
+  int num_hosts_;
+  int devices_per_host_;
+  // Index of the host of this device, and of this device within its host.
+  int host_idx_;
+  int local_idx_;
+  // True once the ring across hosts has started, which unblocks the
+  // collectives that depend on this instance.
+  bool ran_ring_;
+};
+
+}  // namespace tensorflow
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_HIERARCHICAL_RING_REDUCER_H_
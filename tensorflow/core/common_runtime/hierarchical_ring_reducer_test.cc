@@ -0,0 +1,313 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/hierarchical_ring_reducer.h"
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/collective_param_resolver_local.h"
+#include "tensorflow/core/common_runtime/collective_test_util.h"
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/common_runtime/process_util.h"
+#include "tensorflow/core/framework/collective.h"
+#include "tensorflow/core/framework/device_attributes.pb.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/public/version.h"
+
+namespace tensorflow {
+namespace {
+
+std::unique_ptr<OpKernel> GetBinOp(const string& op, DataType dtype,
+                                   Device* device) {
+  NodeDef node_def;
+  TF_CHECK_OK(NodeDefBuilder("bin_op", op)
+                  .Attr("T", dtype)
+                  .Input(FakeInput(dtype))
+                  .Input(FakeInput(dtype))
+                  .Finalize(&node_def));
+  Status status;
+  std::unique_ptr<OpKernel> k = CreateOpKernel(
+      DEVICE_CPU, device, device->GetAllocator(AllocatorAttributes()),
+      node_def, TF_GRAPH_DEF_VERSION, &status);
+  TF_CHECK_OK(status);
+  return k;
+}
+
+// Places the tasks of `group` on `num_hosts` hosts in turn, so that a host
+// runs several tasks if there are more tasks than hosts.
+void SetHosts(int num_hosts, CollGroupParams* group) {
+  std::unordered_map<string, int> task_index;
+  for (CollGroupMember& member : group->members) {
+    const int index =
+        task_index.emplace(member.task, task_index.size()).first->second;
+    member.device.set_host_name(strings::StrCat("host", index % num_hosts));
+  }
+}
+
+class HierarchicalRingReducerTest : public ::testing::Test {
+ protected:
+  class DeviceInstance {
+   public:
+    DeviceInstance(int rank, int num_hosts, DataType dtype,
+                   const TensorShape& shape, CollectiveTestEnv* test_env)
+        : test_env_(test_env), tensor_(dtype, shape) {
+      col_params_ =
+          CreateCollectiveParams(*test_env_, rank, "HierarchicalRingReduce",
+                                 REDUCTION_COLLECTIVE, dtype, shape);
+      SetHosts(num_hosts, &col_params_->group);
+      string dev_name = col_params_->group.members[rank].device.name();
+      TF_CHECK_OK(test_env_->device_mgr->LookupDevice(dev_name, &device_));
+      merge_op_ = GetBinOp("Add", dtype, device_);
+      final_op_ = GetBinOp("Div", dtype, device_);
+      col_params_->merge_op = merge_op_.get();
+      col_params_->final_op = final_op_.get();
+    }
+
+    void DoReduce() {
+      status_ = RunCollective(test_env_, col_params_.get(), device_, &tensor_,
+                              &tensor_);
+    }
+
+    CollectiveTestEnv* test_env_;
+    Tensor tensor_;
+    Device* device_;
+    core::RefCountPtr<CollectiveParams> col_params_;
+    std::unique_ptr<OpKernel> merge_op_;
+    std::unique_ptr<OpKernel> final_op_;
+    Status status_;
+  };
+
+  // Runs a reduction over `num_workers` tasks with `num_devices` devices
+  // each, on `num_hosts` hosts.
+  template <typename T>
+  void RunTest(DataType dtype, int num_workers, int num_devices, int num_hosts,
+               int tensor_len, int fail_after) {
+    test_env_ = CreateCollectiveTestEnv(num_workers, num_devices, DEVICE_CPU);
+    test_env_->remote_access->set_fail_after(fail_after);
+    const int group_size = num_workers * num_devices;
+    std::vector<T> expected(tensor_len);
+    for (int rank = 0; rank < group_size; ++rank) {
+      instances_.push_back(std::make_unique<DeviceInstance>(
+          rank, num_hosts, dtype, TensorShape({tensor_len}), test_env_.get()));
+      auto values = instances_.back()->tensor_.flat<T>();
+      for (int i = 0; i < tensor_len; ++i) {
+        values(i) = static_cast<T>(rank * 10 + i);
+        expected[i] += values(i);
+      }
+    }
+
+    std::atomic<int> done(0);
+    for (auto& di : instances_) {
+      SchedClosure([&di, &done] {
+        di->DoReduce();
+        ++done;
+      });
+    }
+    while (done < group_size) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+
+    if (fail_after > 0) {
+      for (auto& di : instances_) {
+        EXPECT_NE(di->status_.error_message().find("Deliberate failure"),
+                  string::npos);
+      }
+      return;
+    }
+    for (int i = 0; i < tensor_len; ++i) {
+      expected[i] /= static_cast<T>(group_size);
+    }
+    for (auto& di : instances_) {
+      TF_EXPECT_OK(di->status_);
+      test::ExpectTensorEqual<T>(test::AsTensor<T>(expected), di->tensor_);
+    }
+  }
+
+  std::unique_ptr<CollectiveTestEnv> test_env_;
+  std::vector<std::unique_ptr<DeviceInstance>> instances_;
+};
+
+TEST_F(HierarchicalRingReducerTest, Float) {
+  RunTest<float>(DT_FLOAT, 2, 2, 2, 1001, 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, FloatManyHosts) {
+  RunTest<float>(DT_FLOAT, 4, 3, 4, 100000, 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, SingleDeviceTasks) {
+  // One single-device task per core, several tasks on each host.
+  RunTest<float>(DT_FLOAT, 8, 1, 2, 4096, 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, SeveralTasksPerHost) {
+  RunTest<float>(DT_FLOAT, 6, 2, 3, 1001, 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, Double) {
+  RunTest<double>(DT_DOUBLE, 3, 2, 3, 4096, 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, EmptyChunks) {
+  // Fewer elements than devices per host leaves some chunks empty.
+  RunTest<int32>(DT_INT32, 2, 4, 2, 3, 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, Failure) {
+  RunTest<float>(DT_FLOAT, 2, 2, 2, 1001, 3);
+}
+
+TEST(HierarchicalRingReducerInitParamsTest, RequiresSeveralHosts) {
+  core::RefCountPtr<HierarchicalRingReducer> reducer(
+      new HierarchicalRingReducer());
+
+  auto test_env = CreateCollectiveTestEnv(/*num_workers=*/2,
+                                          /*num_devices_per_worker=*/3,
+                                          DEVICE_CPU);
+  auto cp = CreateCollectiveParams(*test_env, /*rank=*/4,
+                                   "HierarchicalRingReduce",
+                                   REDUCTION_COLLECTIVE, DT_FLOAT,
+                                   TensorShape({8}));
+  // Members that do not report their host.
+  EXPECT_FALSE(HierarchicalRingReducer::IsHierarchical(cp->group));
+  SetHosts(/*num_hosts=*/2, &cp->group);
+  EXPECT_TRUE(HierarchicalRingReducer::IsHierarchical(cp->group));
+  TF_EXPECT_OK(reducer->InitializeCollectiveParams(cp.get()));
+
+  // A single host.
+  SetHosts(/*num_hosts=*/1, &cp->group);
+  EXPECT_FALSE(HierarchicalRingReducer::IsHierarchical(cp->group));
+  EXPECT_FALSE(reducer->InitializeCollectiveParams(cp.get()).ok());
+
+  // One device per host.
+  for (int rank = 0; rank < cp->group.members.size(); ++rank) {
+    cp->group.members[rank].device.set_host_name(
+        strings::StrCat("host", rank));
+  }
+  EXPECT_FALSE(HierarchicalRingReducer::IsHierarchical(cp->group));
+
+  // Hosts with different numbers of devices.
+  SetHosts(/*num_hosts=*/2, &cp->group);
+  cp->group.members[3].device.set_host_name("host0");
+  EXPECT_FALSE(HierarchicalRingReducer::IsHierarchical(cp->group));
+}
+
+TEST(HierarchicalRingReducerResolverTest, SingleDeviceTasksOnSharedHosts) {
+  // One single-device task per core, four tasks on each host. The resolver
+  // picks the hierarchical reduction from the hosts that the devices report.
+  constexpr int kNumWorkers = 8;
+  constexpr int kNumHosts = 2;
+  constexpr int kTensorLen = 1001;
+  auto test_env = CreateCollectiveTestEnv(kNumWorkers,
+                                          /*num_devices_per_worker=*/1,
+                                          DEVICE_CPU);
+  CollectiveParamResolverLocal resolver(
+      ConfigProto(), test_env->device_mgr.get(),
+      test_env->device_resolver.get(), /*nccl_communicator=*/nullptr,
+      "/job:worker/replica:0/task:0");
+
+  std::vector<Device*> devices(kNumWorkers);
+  std::vector<core::RefCountPtr<CollectiveParams>> cps(kNumWorkers);
+  std::vector<Status> statuses(kNumWorkers);
+  BlockingCounter resolved(kNumWorkers);
+  for (int wi = 0; wi < kNumWorkers; ++wi) {
+    TF_ASSERT_OK(test_env->device_mgr->LookupDevice(
+        strings::StrCat("/job:worker/replica:0/task:", wi, "/device:CPU:0"),
+        &devices[wi]));
+    cps[wi].reset(new CollectiveParams());
+    CollectiveParams* cp = cps[wi].get();
+    cp->group.group_key = 1;
+    cp->group.group_size = kNumWorkers;
+    cp->group.device_type = DEVICE_CPU;
+    cp->instance.instance_key = 7;
+    cp->instance.type = REDUCTION_COLLECTIVE;
+    cp->instance.data_type = DT_FLOAT;
+    cp->instance.shape = TensorShape({kTensorLen});
+    DeviceAttributes attributes = devices[wi]->attributes();
+    attributes.set_host_name(strings::StrCat("host", wi % kNumHosts));
+    SchedClosure([&resolver, attributes, cp, &statuses, &resolved, wi] {
+      resolver.CompleteParamsAsync(attributes, cp,
+                                   /*cancel_mgr=*/nullptr,
+                                   [&statuses, &resolved, wi](const Status& s) {
+                                     statuses[wi] = s;
+                                     resolved.DecrementCount();
+                                   });
+    });
+  }
+  resolved.Wait();
+
+  std::vector<Tensor> tensors;
+  std::vector<std::unique_ptr<OpKernel>> kernels;
+  std::vector<float> expected(kTensorLen);
+  for (int wi = 0; wi < kNumWorkers; ++wi) {
+    TF_ASSERT_OK(statuses[wi]);
+    CollectiveParams* cp = cps[wi].get();
+    EXPECT_EQ(cp->instance.impl_details.collective_name,
+              "HierarchicalRingReduce");
+    EXPECT_EQ(cp->group.num_tasks, kNumWorkers);
+    // All tasks run in this process.
+    for (CollGroupMember& member : cp->group.members) {
+      member.is_local = true;
+    }
+    kernels.push_back(GetBinOp("Add", DT_FLOAT, devices[wi]));
+    cp->merge_op = kernels.back().get();
+    kernels.push_back(GetBinOp("Div", DT_FLOAT, devices[wi]));
+    cp->final_op = kernels.back().get();
+    Tensor tensor(DT_FLOAT, TensorShape({kTensorLen}));
+    auto values = tensor.flat<float>();
+    for (int i = 0; i < kTensorLen; ++i) {
+      values(i) = static_cast<float>(wi * 10 + i);
+      expected[i] += values(i);
+    }
+    tensors.push_back(tensor);
+  }
+  for (int i = 0; i < kTensorLen; ++i) {
+    expected[i] /= kNumWorkers;
+  }
+
+  BlockingCounter reduced(kNumWorkers);
+  for (int wi = 0; wi < kNumWorkers; ++wi) {
+    SchedClosure([&test_env, &cps, &devices, &tensors, &statuses, &reduced,
+                  wi] {
+      statuses[wi] = RunCollective(test_env.get(), cps[wi].get(), devices[wi],
+                                   &tensors[wi], &tensors[wi]);
+      reduced.DecrementCount();
+    });
+  }
+  reduced.Wait();
+  for (int wi = 0; wi < kNumWorkers; ++wi) {
+    TF_EXPECT_OK(statuses[wi]);
+    test::ExpectTensorEqual<float>(test::AsTensor<float>(expected),
+                                   tensors[wi]);
+  }
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,195 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/kernel_cost_sampler.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/lib/monitoring/gauge.h"
+#include "tensorflow/core/lib/monitoring/sampler.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/stringprintf.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace {
+
+// Number of samples that a thread buffers before flushing them.
+constexpr int kThreadBufferSize = 64;
+
+// Maximum number of nodes in the summary. Samples of further nodes are only
+// recorded in the histogram.
+constexpr int kMaxNumNodes = 10000;
+
+// Number of nodes in the summary exported by `kernel_cost_summary`.
+constexpr int kNumExportedNodes = 100;
+
+auto* kernel_cost = monitoring::Sampler<1>::New(
+    {"/tensorflow/core/kernel_cost_usecs",
+     "Sampled execution time of kernels in microseconds, by op type.",
+     "op_type"},
+    // Scale of 1 microsecond, power of 2, with 30 buckets.
+    monitoring::Buckets::Exponential(1, 2, 30));
+
+// Node names are not metric labels, since their number is unbounded. The
+// per-node costs are exported as text instead, rendered when collected.
+auto* kernel_cost_summary =
+    monitoring::Gauge<std::function<std::string()>, 0>::New(
+        "/tensorflow/core/kernel_cost_summary",
+        "Sampled execution time of the kernels of the nodes with the highest "
+        "total sampled time, one node per line.");
+
+}  // namespace
+
+struct KernelCostSampler::ThreadBuffer {
+  struct Sample {
+    std::string session_handle;
+    std::string op_type;
+    std::string node_name;
+    int64_t nanos;
+  };
+
+  ~ThreadBuffer() { KernelCostSampler::Global()->FlushBuffer(this); }
+
+  // Number of kernels until the next sample, and the state of the generator
+  // that randomizes the distance between samples.
+  int64_t countdown = 0;
+  uint64 random_state = random::New64() | 1;
+  std::vector<Sample> samples;
+};
+
+KernelCostSampler* KernelCostSampler::Global() {
+  static KernelCostSampler* sampler = new KernelCostSampler;
+  return sampler;
+}
+
+KernelCostSampler::KernelCostSampler() {
+  int64_t period;
+  Status s =
+      ReadInt64FromEnvVar("TF_KERNEL_COST_SAMPLING_PERIOD", 0, &period);
+  if (!s.ok()) {
+    LOG(WARNING) << "Kernel cost sampling is disabled: " << s;
+    period = 0;
+  }
+  SetSamplingPeriod(period);
+  kernel_cost_summary->GetCell()->Set(
+      [this]() { return Summary(kNumExportedNodes); });
+}
+
+KernelCostSampler::ThreadBuffer* KernelCostSampler::GetThreadBuffer() {
+  static thread_local ThreadBuffer buffer;
+  return &buffer;
+}
+
+bool KernelCostSampler::ShouldSampleSlow(int64_t period) {
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (--buffer->countdown > 0) {
+    return false;
+  }
+  // Draws the distance to the next sample uniformly from [1, 2 * period - 1],
+  // so that the samples of graphs whose length is a multiple of the period do
+  // not always fall on the same nodes.
+  uint64 x = buffer->random_state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  buffer->random_state = x;
+  buffer->countdown = 1 + x % (2 * period - 1);
+  return true;
+}
+
+void KernelCostSampler::Record(StringPiece session_handle,
+                               StringPiece op_type, StringPiece node_name,
+                               int64_t nanos) {
+  ThreadBuffer* buffer = GetThreadBuffer();
+  buffer->samples.push_back({std::string(session_handle), std::string(op_type),
+                             std::string(node_name), nanos});
+  if (buffer->samples.size() >= kThreadBufferSize) {
+    FlushBuffer(buffer);
+  }
+}
+
+void KernelCostSampler::Flush() { FlushBuffer(GetThreadBuffer()); }
+
+void KernelCostSampler::FlushBuffer(ThreadBuffer* buffer) {
+  if (buffer->samples.empty()) {
+    return;
+  }
+  for (const ThreadBuffer::Sample& sample : buffer->samples) {
+    const double usecs = sample.nanos / 1000.0;
+    kernel_cost->GetCell(sample.op_type)->Add(usecs);
+  }
+  {
+    mutex_lock l(mu_);
+    for (ThreadBuffer::Sample& sample : buffer->samples) {
+      std::pair<std::string, std::string> key(std::move(sample.session_handle),
+                                              std::move(sample.node_name));
+      auto it = node_stats_.find(key);
+      if (it == node_stats_.end()) {
+        if (node_stats_.size() >= kMaxNumNodes) {
+          continue;
+        }
+        it = node_stats_.emplace(std::move(key), NodeStats()).first;
+        it->second.op_type = std::move(sample.op_type);
+      }
+      NodeStats& stats = it->second;
+      ++stats.num_samples;
+      stats.total_nanos += sample.nanos;
+      stats.max_nanos = std::max(stats.max_nanos, sample.nanos);
+    }
+  }
+  buffer->samples.clear();
+}
+
+std::string KernelCostSampler::Summary(int max_nodes) const {
+  using Node = std::pair<std::pair<std::string, std::string>, NodeStats>;
+  std::vector<Node> nodes;
+  {
+    mutex_lock l(mu_);
+    nodes.assign(node_stats_.begin(), node_stats_.end());
+  }
+  auto by_total_time = [](const Node& a, const Node& b) {
+    return a.second.total_nanos > b.second.total_nanos;
+  };
+  if (nodes.size() > max_nodes) {
+    std::partial_sort(nodes.begin(), nodes.begin() + max_nodes, nodes.end(),
+                      by_total_time);
+    nodes.resize(max_nodes);
+  } else {
+    std::sort(nodes.begin(), nodes.end(), by_total_time);
+  }
+
+  std::string summary;
+  for (const auto& [key, stats] : nodes) {
+    const auto& [session_handle, node_name] = key;
+    strings::Appendf(&summary, "%s %s %s %lld %.1f %.1f\n",
+                     session_handle.empty() ? "-" : session_handle.c_str(),
+                     node_name.c_str(), stats.op_type.c_str(),
+                     static_cast<long long>(stats.num_samples),  // NOLINT
+                     stats.total_nanos / 1000.0 / stats.num_samples,
+                     stats.max_nanos / 1000.0);
+  }
+  return summary;
+}
+
+void KernelCostSampler::SetSamplingPeriod(int64_t period) {
+  sampling_period_.store(period, std::memory_order_relaxed);
+}
+
+}  // namespace tensorflow
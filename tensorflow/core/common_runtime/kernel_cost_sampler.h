@@ -0,0 +1,106 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_KERNEL_COST_SAMPLER_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_KERNEL_COST_SAMPLER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/stringpiece.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+
+// Samples the execution time of kernels, cheaply enough to stay enabled in
+// production.
+//
+// When the sampling period N is positive, each thread times every N-th kernel
+// that it executes. Samples are buffered per thread, without synchronization,
+// and are periodically flushed into the "/tensorflow/core/kernel_cost_usecs"
+// histogram (by op type), and into the per-node summary returned by
+// Summary(). Nodes are identified by their name and the handle of the session
+// that runs them, since different graphs commonly share node names. The
+// summary of the 100 costliest nodes is exported as the
+// "/tensorflow/core/kernel_cost_summary" text gauge.
+//
+// The sampling period is read from the TF_KERNEL_COST_SAMPLING_PERIOD
+// environment variable. Sampling is disabled by default.
+//
+// This class is thread-safe.
+class KernelCostSampler {
+ public:
+  static KernelCostSampler* Global();
+
+  // Returns true if the calling thread should time the next kernel, and pass
+  // its execution time to Record().
+  bool ShouldSample() {
+    const int64_t period = sampling_period_.load(std::memory_order_relaxed);
+    if (TF_PREDICT_TRUE(period <= 0)) {
+      return false;
+    }
+    return ShouldSampleSlow(period);
+  }
+
+  // Records a sample of the node `node_name` run by the session
+  // `session_handle`, which is empty outside of sessions.
+  void Record(StringPiece session_handle, StringPiece op_type,
+              StringPiece node_name, int64_t nanos);
+
+  // Returns a text summary of the samples, with one line for each of the
+  // `max_nodes` nodes with the highest total sampled time, in the format
+  // "<session handle> <node name> <op type> <samples> <mean usecs> <max usecs>",
+  // where the session handle is "-" outside of sessions. Samples that have not
+  // been flushed from the buffer of their thread are not included.
+  std::string Summary(int max_nodes) const;
+
+  // Flushes the samples buffered by the calling thread.
+  void Flush();
+
+  void SetSamplingPeriod(int64_t period);
+
+ private:
+  struct NodeStats {
+    std::string op_type;
+    int64_t num_samples = 0;
+    int64_t total_nanos = 0;
+    int64_t max_nanos = 0;
+  };
+  struct ThreadBuffer;
+
+  KernelCostSampler();
+
+  bool ShouldSampleSlow(int64_t period);
+  void FlushBuffer(ThreadBuffer* buffer);
+  static ThreadBuffer* GetThreadBuffer();
+
+  std::atomic<int64_t> sampling_period_{0};
+
+  mutable mutex mu_;
+  // Keyed by session handle and node name.
+  absl::flat_hash_map<std::pair<std::string, std::string>, NodeStats>
+      node_stats_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(KernelCostSampler);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_KERNEL_COST_SAMPLER_H_
@@ -0,0 +1,104 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/kernel_cost_sampler.h"
+
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
+#include "tensorflow/core/lib/monitoring/test_utils.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+using monitoring::testing::CellReader;
+using monitoring::testing::Histogram;
+
+TEST(KernelCostSamplerTest, SamplesEveryPeriodOnAverage) {
+  KernelCostSampler* sampler = KernelCostSampler::Global();
+  sampler->SetSamplingPeriod(0);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(sampler->ShouldSample());
+  }
+
+  sampler->SetSamplingPeriod(1);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(sampler->ShouldSample());
+  }
+
+  sampler->SetSamplingPeriod(10);
+  int num_samples = 0;
+  for (int i = 0; i < 100000; ++i) {
+    num_samples += sampler->ShouldSample();
+  }
+  EXPECT_GT(num_samples, 9000);
+  EXPECT_LT(num_samples, 11000);
+  sampler->SetSamplingPeriod(0);
+}
+
+TEST(KernelCostSamplerTest, ExportsSamples) {
+  CellReader<Histogram> by_op("/tensorflow/core/kernel_cost_usecs");
+  KernelCostSampler* sampler = KernelCostSampler::Global();
+  sampler->Record("", "TestOpA", "test/a", 2000);
+  sampler->Record("", "TestOpA", "test/a", 4000);
+  sampler->Record("", "TestOpA", "test/b", 1000);
+  sampler->Record("", "TestOpB", "test/c", 5000);
+  sampler->Flush();
+
+  Histogram a = by_op.Delta("TestOpA");
+  EXPECT_FLOAT_EQ(a.num(), 3.0);
+  EXPECT_FLOAT_EQ(a.sum(), 7.0);
+  EXPECT_FLOAT_EQ(by_op.Delta("TestOpB").num(), 1.0);
+
+  EXPECT_EQ(sampler->Summary(2),
+            "- test/a TestOpA 2 3.0 4.0\n"
+            "- test/c TestOpB 1 5.0 5.0\n");
+
+  // The summary is also exported as a text gauge.
+  CellReader<std::string> summary("/tensorflow/core/kernel_cost_summary");
+  EXPECT_EQ(summary.Read(),
+            "- test/a TestOpA 2 3.0 4.0\n"
+            "- test/c TestOpB 1 5.0 5.0\n"
+            "- test/b TestOpA 1 1.0 1.0\n");
+}
+
+TEST(KernelCostSamplerTest, SeparatesNodesBySession) {
+  KernelCostSampler* sampler = KernelCostSampler::Global();
+  sampler->Record("session1", "TestOpA", "test/d", 7000);
+  sampler->Record("session2", "TestOpB", "test/d", 6500);
+  sampler->Flush();
+  EXPECT_EQ(sampler->Summary(2),
+            "session1 test/d TestOpA 1 7.0 7.0\n"
+            "session2 test/d TestOpB 1 6.5 6.5\n");
+}
+
+void BM_ShouldSample(::testing::benchmark::State& state) {
+  KernelCostSampler* sampler = KernelCostSampler::Global();
+  sampler->SetSamplingPeriod(state.range(0));
+  int64_t num_samples = 0;
+  for (auto s : state) {
+    if (sampler->ShouldSample()) {
+      sampler->Record("", "BenchmarkOp", "benchmark", 1000);
+      ++num_samples;
+    }
+  }
+  sampler->Flush();
+  sampler->SetSamplingPeriod(0);
+  testing::DoNotOptimize(num_samples);
+}
+BENCHMARK(BM_ShouldSample)->Arg(0)->Arg(100)->Arg(1000);
+
+}  // namespace
+}  // namespace tensorflow
@@ -103,6 +103,8 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
 
       BFCAllocator::Options allocator_opts;
       allocator_opts.allow_growth = true;
+      // Host allocations are made concurrently by many inter-op threads.
+      allocator_opts.thread_cache = true;
       allocator = new BFCAllocator(
           absl::WrapUnique(sub_allocator), cpu_mem_limit,
           /*name=*/"bfc_cpu_allocator_for_gpu", allocator_opts);
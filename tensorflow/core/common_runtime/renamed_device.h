@@ -32,7 +32,8 @@ class RenamedDevice : public Device {
   static std::unique_ptr<Device> NewRenamedDevice(
       const string& new_base, Device* underlying, bool owns_underlying,
       bool isolate_session_state,
-      thread::ThreadPoolInterface* underlying_threadpool = nullptr);
+      thread::ThreadPoolInterface* underlying_threadpool = nullptr,
+      Allocator* underlying_allocator = nullptr);
 
   ~RenamedDevice() override;
 
@@ -56,6 +57,10 @@ class RenamedDevice : public Device {
   }
 
   Allocator* GetAllocator(AllocatorAttributes attr) override {
+    // Only plain device memory allocations use the underlying allocator.
+    if (underlying_allocator_ != nullptr && attr.value == 0) {
+      return underlying_allocator_;
+    }
     return underlying_device_->GetAllocator(attr);
   }
 
@@ -157,7 +162,8 @@ class RenamedDevice : public Device {
  private:
   RenamedDevice(Device* underlying, const DeviceAttributes& attributes,
                 bool owns_underlying, bool isolate_session_state,
-                thread::ThreadPoolInterface* underlying_threadpool);
+                thread::ThreadPoolInterface* underlying_threadpool,
+                Allocator* underlying_allocator);
   Device* const underlying_device_;
   const bool owns_underlying_device_;
   const bool isolate_session_state_;
@@ -166,6 +172,9 @@ class RenamedDevice : public Device {
   // eigen_worker_threads_ is stored here so that we can pass the pointer
   // of eigen_worker_threads_.workers to the parent class.
   DeviceBase::CpuWorkerThreads eigen_worker_threads_;
+  // If not null, used instead of the allocator of the underlying device for
+  // allocations with default attributes. Not owned.
+  Allocator* const underlying_allocator_;
 };
 
 }  // namespace tensorflow
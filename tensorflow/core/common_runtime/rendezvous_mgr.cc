@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 
+#include <algorithm>
 #include <unordered_set>
 
 #include "tensorflow/core/common_runtime/copy_tensor.h"
@@ -35,6 +36,13 @@ limitations under the License.
 namespace tensorflow {
 
 namespace {
+
+// Minimum number of table shards of a RefCountedIntraProcessRendezvous. Its
+// Send and Recv calls come from the inter-op threads running all partitions
+// of a step, so one shard per device leads to contention on graphs with many
+// cross-device edges.
+constexpr int kMinNumSharedShards = 16;
+
 void SameWorkerRecvDone(const DeviceMgr* device_mgr,
                         const Rendezvous::ParsedKey& parsed,
                         const Rendezvous::Args& send_args,
@@ -169,7 +177,8 @@ void IntraProcessRecvAsyncImpl(const DeviceMgr* device_mgr,
 RefCountedIntraProcessRendezvous::RefCountedIntraProcessRendezvous(
     const DeviceMgr* device_mgr)
     : device_mgr_(device_mgr),
-      local_(this, /* num_shards= */ device_mgr->NumDevices()) {}
+      local_(this, /* num_shards= */ std::max(device_mgr->NumDevices(),
+                                              kMinNumSharedShards)) {}
 
 RefCountedIntraProcessRendezvous::~RefCountedIntraProcessRendezvous() {}
 
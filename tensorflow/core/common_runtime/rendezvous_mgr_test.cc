@@ -0,0 +1,219 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/rendezvous_mgr.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/framework/cancellation.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/platform/strcat.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr char kDeviceName[] = "/job:localhost/replica:0/task:0/device:CPU:0";
+
+class FakeDevice : public Device {
+ public:
+  explicit FakeDevice(const DeviceAttributes& attrs) : Device(nullptr, attrs) {}
+  Status Sync() override { return OkStatus(); }
+  Allocator* GetAllocator(AllocatorAttributes) override { return nullptr; }
+};
+
+std::unique_ptr<DeviceMgr> NewDeviceMgr() {
+  DeviceAttributes attrs;
+  attrs.set_name(kDeviceName);
+  attrs.set_device_type("CPU");
+  attrs.set_incarnation(1);
+  std::vector<std::unique_ptr<Device>> devices;
+  devices.push_back(std::make_unique<FakeDevice>(attrs));
+  return std::make_unique<StaticDeviceMgr>(std::move(devices));
+}
+
+Rendezvous::ParsedKey MakeKey(const string& name) {
+  Rendezvous::ParsedKey key;
+  TF_CHECK_OK(Rendezvous::ParseKey(
+      Rendezvous::CreateKey(kDeviceName, 1, kDeviceName, name,
+                            FrameAndIter(0, 0)),
+      &key));
+  return key;
+}
+
+Tensor V(int64_t value) { return test::AsScalar<int64_t>(value); }
+
+TEST(IntraProcessRendezvousTest, ConcurrentSendRecv) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumKeys = 100;
+  auto device_mgr = NewDeviceMgr();
+  core::RefCountPtr<RefCountedIntraProcessRendezvous> rendez(
+      new RefCountedIntraProcessRendezvous(device_mgr.get()));
+  std::vector<Rendezvous::ParsedKey> keys;
+  for (int i = 0; i < kNumThreads * kNumKeys; ++i) {
+    keys.push_back(MakeKey(strings::StrCat("key", i)));
+  }
+  {
+    thread::ThreadPool pool(Env::Default(), "test", 2 * kNumThreads);
+    for (int t = 0; t < kNumThreads; ++t) {
+      pool.Schedule([&, t]() {
+        for (int i = t * kNumKeys; i < (t + 1) * kNumKeys; ++i) {
+          TF_ASSERT_OK(rendez->Send(keys[i], Rendezvous::Args(), V(i),
+                                    /*is_dead=*/false));
+        }
+      });
+      pool.Schedule([&, t]() {
+        for (int i = t * kNumKeys; i < (t + 1) * kNumKeys; ++i) {
+          Tensor val;
+          bool is_dead = true;
+          TF_ASSERT_OK(
+              rendez->Recv(keys[i], Rendezvous::Args(), &val, &is_dead));
+          EXPECT_FALSE(is_dead);
+          EXPECT_EQ(val.scalar<int64_t>()(), i);
+        }
+      });
+    }
+  }
+  TF_EXPECT_OK(rendez->GetLocalRendezvousStatus());
+}
+
+TEST(IntraProcessRendezvousTest, Abort) {
+  auto device_mgr = NewDeviceMgr();
+  core::RefCountPtr<RefCountedIntraProcessRendezvous> rendez(
+      new RefCountedIntraProcessRendezvous(device_mgr.get()));
+  Status recv_status;
+  rendez->RecvAsync(MakeKey("pending"), Rendezvous::Args(),
+                    [&recv_status](const Status& s, const Rendezvous::Args&,
+                                   const Rendezvous::Args&, const Tensor&,
+                                   bool) { recv_status = s; });
+  rendez->StartAbort(errors::Aborted("aborted"));
+  EXPECT_TRUE(errors::IsAborted(recv_status)) << recv_status;
+  EXPECT_TRUE(errors::IsAborted(rendez->GetLocalRendezvousStatus()));
+  EXPECT_TRUE(errors::IsAborted(rendez->Send(
+      MakeKey("after_abort"), Rendezvous::Args(), V(0), /*is_dead=*/false)));
+}
+
+TEST(IntraProcessRendezvousTest, DestroyWhileCallbackFinishes) {
+  // PrivateIntraProcessRendezvous holds no reference on itself while a
+  // done-callback runs, so its destructor must wait for the callback.
+  auto device_mgr = NewDeviceMgr();
+  auto* rendez = new PrivateIntraProcessRendezvous(device_mgr.get());
+  Notification callback_started;
+  Notification release_callback;
+  rendez->RecvAsync(MakeKey("pending"), Rendezvous::Args(),
+                    [&](const Status& s, const Rendezvous::Args&,
+                        const Rendezvous::Args&, const Tensor&, bool) {
+                      TF_EXPECT_OK(s);
+                      callback_started.Notify();
+                      release_callback.WaitForNotification();
+                    });
+  Notification deleted;
+  {
+    thread::ThreadPool pool(Env::Default(), "test", 2);
+    pool.Schedule([&]() {
+      TF_EXPECT_OK(rendez->Send(MakeKey("pending"), Rendezvous::Args(), V(1),
+                                /*is_dead=*/false));
+    });
+    callback_started.WaitForNotification();
+    pool.Schedule([&]() {
+      delete rendez;
+      deleted.Notify();
+    });
+    Env::Default()->SleepForMicroseconds(10000);
+    EXPECT_FALSE(deleted.HasBeenNotified());
+    release_callback.Notify();
+    deleted.WaitForNotification();
+  }
+}
+
+TEST(IntraProcessRendezvousTest, CancelRecv) {
+  auto device_mgr = NewDeviceMgr();
+  core::RefCountPtr<RefCountedIntraProcessRendezvous> rendez(
+      new RefCountedIntraProcessRendezvous(device_mgr.get()));
+  CancellationManager cm;
+  Rendezvous::Args args;
+  args.cancellation_manager = &cm;
+  Status recv_status;
+  rendez->RecvAsync(MakeKey("cancelled"), args,
+                    [&recv_status](const Status& s, const Rendezvous::Args&,
+                                   const Rendezvous::Args&, const Tensor&,
+                                   bool) { recv_status = s; });
+  cm.StartCancel();
+  EXPECT_TRUE(errors::IsCancelled(recv_status)) << recv_status;
+  // Cancelling a Recv does not abort the rendezvous.
+  Tensor val;
+  bool is_dead;
+  TF_ASSERT_OK(rendez->Send(MakeKey("other"), Rendezvous::Args(), V(1),
+                            /*is_dead=*/false));
+  TF_ASSERT_OK(
+      rendez->Recv(MakeKey("other"), Rendezvous::Args(), &val, &is_dead));
+  EXPECT_EQ(val.scalar<int64_t>()(), 1);
+}
+
+// Measures Send/Recv pairs per second on a rendezvous shared by
+// `state.range(0)` threads, each of which sends and receives its own keys.
+void BM_SendRecvThreaded(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  constexpr int kNumKeysPerThread = 16;
+  constexpr int kNumPairsPerThread = 10000;
+  auto device_mgr = NewDeviceMgr();
+  std::vector<Rendezvous::ParsedKey> keys;
+  for (int i = 0; i < num_threads * kNumKeysPerThread; ++i) {
+    keys.push_back(MakeKey(strings::StrCat("key", i)));
+  }
+  const Tensor val = V(1);
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  for (auto s : state) {
+    core::RefCountPtr<RefCountedIntraProcessRendezvous> rendez(
+        new RefCountedIntraProcessRendezvous(device_mgr.get()));
+    BlockingCounter counter(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      pool.Schedule([&, t]() {
+        const Rendezvous::ParsedKey* thread_keys =
+            &keys[t * kNumKeysPerThread];
+        Tensor received;
+        bool is_dead;
+        for (int i = 0; i < kNumPairsPerThread; ++i) {
+          const Rendezvous::ParsedKey& key =
+              thread_keys[i % kNumKeysPerThread];
+          TF_CHECK_OK(rendez->Send(key, Rendezvous::Args(), val, false));
+          TF_CHECK_OK(
+              rendez->Recv(key, Rendezvous::Args(), &received, &is_dead));
+        }
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads *
+                          kNumPairsPerThread);
+}
+BENCHMARK(BM_SendRecvThreaded)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+}  // namespace
+}  // namespace tensorflow
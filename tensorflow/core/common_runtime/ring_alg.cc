@@ -104,7 +104,8 @@ RingAlg::RingAlg(CollectiveType type, const string& name)
       col_params_(nullptr),
       done_(nullptr),
       group_size_(-1),
-      num_subdivs_(-1) {}
+      num_subdivs_(-1),
+      num_pieces_(1) {}
 
 namespace {
 Status GenerateSubdivsInCollectiveParams(CollectiveParams* col_params) {
@@ -331,8 +332,10 @@ void RingAlg::InitRingField(RingField* rf, int chunk_idx, int subdiv_idx,
   // a device can simultaneously send data by 2 or more independent
   // channels we can speed up the transfer by subdividing chunks and
   // processing multiple subdivisions at once.  So the actual number
-  // of RingFields is group_size_ * num_subdivs_.
-  DCHECK_EQ(field_idx, (chunk_idx * num_subdivs_) + subdiv_idx);
+  // of RingFields is group_size_ * num_subdivs_.  Each of them may further
+  // be split into num_pieces_ consecutive fields that are pipelined, i.e.
+  // sent, received and reduced independently of each other.
+  DCHECK_EQ(field_idx / num_pieces_, (chunk_idx * num_subdivs_) + subdiv_idx);
   rf->chunk_idx = chunk_idx;
   rf->subdiv_idx = subdiv_idx;
   rf->sc_idx = field_idx;
@@ -108,6 +108,7 @@ class RingAlg : public CollectiveImplementationInterface {
   StatusCallback done_;
   int group_size_;
   int num_subdivs_;
+  int num_pieces_;  // pipelined pieces per subdivision of a chunk
   Tensor group_size_tensor_;
   Notification group_size_tensor_ready_;
   std::unique_ptr<CollectiveAdapter> ca_;
@@ -16,8 +16,10 @@ limitations under the License.
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
+#include <limits>
 #include <utility>
 
 #include "tensorflow/core/common_runtime/collective_rma_local.h"
@@ -42,6 +44,27 @@ limitations under the License.
 #include "tensorflow/core/profiler/lib/traceme.h"
 
 namespace tensorflow {
+namespace {
+
+// On CPU, the chunks of large tensors are pipelined in pieces of about this
+// size, so that the merge of each piece overlaps the transfers of others and
+// the piece is still in cache when it is merged.
+constexpr int64_t kPipelinedPieceBytes = 256 * 1024;
+// Bounds the number of transfers per chunk.
+constexpr int kMaxPipelinedPieces = 16;
+
+// Returns the number of pieces that each of the `num_fields` fields of a
+// tensor of `total_bytes` bytes should be pipelined in.
+int NumPipelinedPieces(int64_t total_bytes, int num_fields) {
+  int64_t num_pieces = std::min<int64_t>(
+      kMaxPipelinedPieces, total_bytes / num_fields / kPipelinedPieceBytes);
+  // RingField indices must fit in an int16.
+  num_pieces = std::min<int64_t>(
+      num_pieces, std::numeric_limits<int16>::max() / num_fields);
+  return std::max<int64_t>(1, num_pieces);
+}
+
+}  // namespace
 
 RingReducer::~RingReducer() { group_size_tensor_ready_.WaitForNotification(); }
 
@@ -64,6 +87,11 @@ void RingReducer::Run(StatusCallback done) {
   num_subdivs_ = static_cast<int>(
       col_params_->instance.impl_details.subdiv_permutations.size());
   CHECK_GT(num_subdivs_, 0);
+  if (col_params_->group.device_type == "CPU") {
+    host_merge_fn_ = collective_util::GetHostMergeFn(col_params_->merge_op);
+    num_pieces_ = NumPipelinedPieces(col_ctx_->output->TotalBytes(),
+                                     group_size_ * num_subdivs_);
+  }
 
   if (VLOG_IS_ON(1)) {
     string buf;
@@ -81,7 +109,8 @@ void RingReducer::Run(StatusCallback done) {
       }
     }
     VLOG(1) << "RingReducer::Run for device " << col_ctx_->device_name
-            << " default_rank " << col_params_->default_rank << "\n"
+            << " default_rank " << col_params_->default_rank << " num_pieces "
+            << num_pieces_ << "\n"
             << buf;
   }
 
@@ -117,7 +146,8 @@ void RingReducer::Run(StatusCallback done) {
 // which cannot be blocked.
 void RingReducer::ContinueAfterInputCopy() {
   AllocatorAttributes attr = col_ctx_->op_ctx->output_alloc_attr(0);
-  ca_.reset(MakeCollectiveAdapter(col_ctx_->output, group_size_ * num_subdivs_,
+  ca_.reset(MakeCollectiveAdapter(col_ctx_->output,
+                                  group_size_ * num_subdivs_ * num_pieces_,
                                   col_ctx_->device->GetAllocator(attr)));
 
   if (col_params_->final_op) {
@@ -178,13 +208,17 @@ bool RingReducer::RunAsyncParts() {
   // complete. Hence function local variables are accessible only by that
   // one thread and do not require an explicit mutex.
   rfv_.clear();
-  rfv_.resize(group_size_ * num_subdivs_);
+  rfv_.resize(group_size_ * num_subdivs_ * num_pieces_);
   PCQueue ready_queue;
   for (int chunk_idx = 0; chunk_idx < group_size_; ++chunk_idx) {
     for (int subdiv_idx = 0; subdiv_idx < num_subdivs_; ++subdiv_idx) {
-      int rf_index = (chunk_idx * num_subdivs_) + subdiv_idx;
-      InitRingField(&rfv_[rf_index], chunk_idx, subdiv_idx, rf_index);
-      ready_queue.Enqueue(&rfv_[rf_index]);
+      for (int piece_idx = 0; piece_idx < num_pieces_; ++piece_idx) {
+        int rf_index =
+            ((chunk_idx * num_subdivs_) + subdiv_idx) * num_pieces_ +
+            piece_idx;
+        InitRingField(&rfv_[rf_index], chunk_idx, subdiv_idx, rf_index);
+        ready_queue.Enqueue(&rfv_[rf_index]);
+      }
     }
   }
   const DeviceBase::AcceleratorDeviceInfo* gpu_info =
@@ -239,6 +273,10 @@ bool RingReducer::RunAsyncParts() {
                 if (!s.ok()) {
                   aborted = true;
                   StartAbort(s);
+                } else if (host_merge_fn_ && !rf->second_pass) {
+                  // Merge the received value while it is still in cache,
+                  // concurrently with the transfers of other fields.
+                  host_merge_fn_(rf->tmp_chunk, &rf->chunk);
                 }
                 ready_queue.Enqueue(rf);
               };
@@ -254,12 +292,14 @@ bool RingReducer::RunAsyncParts() {
             --recv_pending_count;
             if (!rf->second_pass) {
               rf->action = RF_REDUCE;
-              Status s = collective_util::ComputeBinOp(
-                  col_ctx_->op_ctx, col_ctx_->op_params, col_ctx_->device,
-                  col_params_->merge_op, &rf->chunk, &rf->tmp_chunk);
-              if (!s.ok()) {
-                aborted = true;
-                StartAbort(s);
+              if (!host_merge_fn_) {
+                Status s = collective_util::ComputeBinOp(
+                    col_ctx_->op_ctx, col_ctx_->op_params, col_ctx_->device,
+                    col_params_->merge_op, &rf->chunk, &rf->tmp_chunk);
+                if (!s.ok()) {
+                  aborted = true;
+                  StartAbort(s);
+                }
               }
             } else {
               rf->action = RF_SEND_READY;
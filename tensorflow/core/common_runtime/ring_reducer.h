@@ -21,6 +21,7 @@ limitations under the License.
 #include <vector>
 
 #include "tensorflow/core/common_runtime/base_collective_executor.h"
+#include "tensorflow/core/common_runtime/collective_util.h"
 #include "tensorflow/core/common_runtime/ring_alg.h"
 #include "tensorflow/core/framework/collective.h"
 
@@ -51,6 +52,9 @@ class RingReducer : public RingAlg {
 
   Tensor group_size_tensor_;
   Notification group_size_tensor_ready_;
+  // If set, merges received chunks on the receive path instead of with
+  // merge_op.
+  collective_util::HostMergeFn host_merge_fn_;
 
   friend class RingReducerTest;
   friend class RingReducerInitParamsTest;
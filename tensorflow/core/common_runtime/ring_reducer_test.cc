@@ -423,11 +423,15 @@ DEF_TEST(INT32, CPU, 1, 2, 1, 1001, 0)
 DEF_TEST(INT32, CPU, 2, 8, 3, 4095, 0)
 DEF_TEST(INT64, CPU, 1, 2, 1, 1001, 0)
 DEF_TEST(INT64, CPU, 2, 8, 3, 4095, 0)
+// Chunks pipelined in pieces.
+DEF_TEST(FLOAT, CPU, 1, 2, 1, 1048576, 0)
+DEF_TEST(INT32, CPU, 2, 2, 2, 1048576, 0)
 
 // Failure tests
 DEF_TEST(FLOAT, CPU, 2, 8, 1, 9408, 1)
 DEF_TEST(FLOAT, CPU, 2, 8, 1, 9408, 7)
 DEF_TEST(FLOAT, CPU, 2, 8, 2, 9408, 11)
+DEF_TEST(FLOAT, CPU, 2, 2, 1, 1048576, 5)
 #endif
 
 #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
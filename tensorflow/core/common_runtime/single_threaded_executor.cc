@@ -298,10 +298,12 @@ class SingleThreadedExecutorImpl : public Executor {
     // Override intra op thread pool if requested.
     Device* device = params_.device;
     std::unique_ptr<Device> user_device;
-    if (args.user_intra_op_threadpool != nullptr) {
+    if (args.user_intra_op_threadpool != nullptr ||
+        args.step_allocator != nullptr) {
       user_device = RenamedDevice::NewRenamedDevice(
           device->name(), device, /*owns_underlying=*/false,
-          /*isolate_session_state=*/false, args.user_intra_op_threadpool);
+          /*isolate_session_state=*/false, args.user_intra_op_threadpool,
+          args.step_allocator);
       device = user_device.get();
     }
 
@@ -0,0 +1,771 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/static_schedule_executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/common_runtime/entry.h"
+#include "tensorflow/core/common_runtime/executor.h"
+#include "tensorflow/core/common_runtime/executor_factory.h"
+#include "tensorflow/core/common_runtime/renamed_device.h"
+#include "tensorflow/core/common_runtime/single_threaded_executor.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env_time.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/notification.h"
+
+namespace tensorflow {
+namespace {
+
+typedef gtl::InlinedVector<TensorValue, 4> TensorValueVec;
+typedef gtl::InlinedVector<AllocatorAttributes, 4> AllocatorAttributeVec;
+
+static const string& kStaticScheduleExecutor =
+    *new string("STATIC_SCHEDULE_EXECUTOR");
+
+// Number of steps whose kernel costs are recorded before compiling the
+// schedule.
+constexpr int kNumWarmupSteps = 10;
+// Maximum number of lanes of a schedule.
+constexpr int kMaxNumLanes = 8;
+// Estimated delay of a kernel that waits for a kernel on another lane, which
+// accounts for handing the lane over to another thread.
+constexpr int64_t kCrossLaneDelayNsec = 5000;
+// A schedule only gets another lane if it decreases the estimated step time by
+// at least this fraction.
+constexpr double kMinLaneGain = 0.05;
+
+// A static schedule of the kernels of a graph.
+struct Schedule {
+  // `lanes[l]` lists the kernels that lane `l` runs, in order.
+  std::vector<std::vector<int>> lanes;
+  // The lane of each kernel and its position in the lane.
+  std::vector<int> lane;
+  std::vector<int> position;
+  // For each kernel, the kernels on other lanes that depend on it.
+  std::vector<std::vector<int>> cross_lane_successors;
+  // For each kernel, the number of kernels on other lanes it depends on.
+  std::vector<int> num_cross_lane_predecessors;
+  // Estimated step time in nanoseconds.
+  int64_t makespan_nsec = 0;
+};
+
+// Computes a schedule of the kernels on `num_lanes` lanes with list
+// scheduling: kernels are placed in decreasing order of the cost of the
+// longest path from them to the end of the graph, each on the lane where it
+// can start the earliest.
+//
+// `predecessors` must only refer to kernels with smaller indices.
+Schedule ComputeSchedule(const std::vector<std::vector<int>>& predecessors,
+                         const std::vector<std::vector<int>>& successors,
+                         const std::vector<int64_t>& costs, int num_lanes) {
+  const int num_kernels = costs.size();
+  // Costs are at least 1ns, so that kernels come after their predecessors.
+  std::vector<int64_t> path_costs(num_kernels);
+  for (int i = num_kernels - 1; i >= 0; --i) {
+    int64_t successor_path_cost = 0;
+    for (int j : successors[i]) {
+      successor_path_cost = std::max(successor_path_cost, path_costs[j]);
+    }
+    path_costs[i] = std::max<int64_t>(costs[i], 1) + successor_path_cost;
+  }
+  std::vector<int> order(num_kernels);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&path_costs](int a, int b) {
+    return path_costs[a] > path_costs[b];
+  });
+
+  Schedule schedule;
+  schedule.lanes.resize(num_lanes);
+  schedule.lane.resize(num_kernels);
+  schedule.position.resize(num_kernels);
+  schedule.cross_lane_successors.resize(num_kernels);
+  schedule.num_cross_lane_predecessors.resize(num_kernels);
+  std::vector<int64_t> finish_times(num_kernels);
+  std::vector<int64_t> lane_times(num_lanes, 0);
+  for (int i : order) {
+    int best_lane = 0;
+    int64_t best_start_time = std::numeric_limits<int64_t>::max();
+    for (int lane = 0; lane < num_lanes; ++lane) {
+      int64_t start_time = lane_times[lane];
+      for (int j : predecessors[i]) {
+        start_time = std::max(
+            start_time, finish_times[j] + (schedule.lane[j] == lane
+                                               ? 0
+                                               : kCrossLaneDelayNsec));
+      }
+      if (start_time < best_start_time) {
+        best_start_time = start_time;
+        best_lane = lane;
+      }
+    }
+    schedule.lane[i] = best_lane;
+    schedule.position[i] = schedule.lanes[best_lane].size();
+    schedule.lanes[best_lane].push_back(i);
+    finish_times[i] = best_start_time + costs[i];
+    lane_times[best_lane] = finish_times[i];
+    schedule.makespan_nsec =
+        std::max(schedule.makespan_nsec, lane_times[best_lane]);
+    for (int j : predecessors[i]) {
+      if (schedule.lane[j] != best_lane) {
+        schedule.cross_lane_successors[j].push_back(i);
+        ++schedule.num_cross_lane_predecessors[i];
+      }
+    }
+  }
+  // Drops lanes without kernels.
+  schedule.lanes.erase(
+      std::remove_if(schedule.lanes.begin(), schedule.lanes.end(),
+                     [](const std::vector<int>& lane) { return lane.empty(); }),
+      schedule.lanes.end());
+  for (int lane = 0; lane < schedule.lanes.size(); ++lane) {
+    for (int i : schedule.lanes[lane]) {
+      schedule.lane[i] = lane;
+    }
+  }
+  return schedule;
+}
+
+class StaticScheduleExecutorImpl : public Executor {
+ public:
+  explicit StaticScheduleExecutorImpl(const LocalExecutorParams& params)
+      : params_(params) {}
+
+  ~StaticScheduleExecutorImpl() override {
+    for (const KernelState& kernel_state : kernels_) {
+      params_.delete_kernel(kernel_state.kernel);
+    }
+    for (const ConstTensorKernelState& kernel_state : const_tensor_kernels_) {
+      params_.delete_kernel(kernel_state.kernel);
+    }
+  }
+
+  Status Initialize(const Graph& graph) {
+    // Topologicially sort `graph` to get a sequence of OpKernels.
+    std::vector<Node*> ordered_nodes;
+    ordered_nodes.reserve(graph.num_nodes());
+    GetReversePostOrder(graph, &ordered_nodes);
+    if (static_cast<int>(ordered_nodes.size()) != graph.num_nodes()) {
+      return errors::InvalidArgument("Graph had ", graph.num_nodes(),
+                                     " but reverse post-order had ",
+                                     ordered_nodes.size());
+    }
+
+    std::vector<Node*> nodes_with_kernels;
+    std::vector<Node*> nodes_with_const_tensor_kernels;
+    std::map<size_t, Node*> arg_index_to_node_map;
+    absl::flat_hash_map<const Node*, int> node_to_index_map;
+    for (Node* n : ordered_nodes) {
+      if (n->IsSource() || n->IsSink()) {
+        continue;
+      }
+      TF_RETURN_IF_ERROR(ValidateOpIsSafeForSyncExecution(
+          *n, params_.allow_control_flow_sync_execution));
+      if (n->IsArg()) {
+        int32_t arg_index;
+        TF_RETURN_IF_ERROR(GetNodeAttr(n->attrs(), "index", &arg_index));
+        if (arg_index < 0) {
+          return errors::InvalidArgument("Invalid argument index ", arg_index,
+                                         " in node ", n->name());
+        }
+        arg_index_to_node_map[arg_index] = n;
+        continue;
+      }
+
+      OpKernel* kernel;
+      TF_RETURN_IF_ERROR(params_.create_kernel(n->properties(), &kernel));
+      if (kernel->AsAsync() != nullptr) {
+        params_.delete_kernel(kernel);
+        return errors::Unimplemented(
+            "Static schedule executor does not support asynchronous kernels, "
+            "but saw node ",
+            n->name(), " of type ", n->type_string(), ".");
+      }
+      const Tensor* const_tensor;
+      if (n->num_outputs() == 1 && (const_tensor = kernel->const_tensor())) {
+        // Single constant tensors are evaluated once and forwarded to their
+        // consumers at the start of each step.
+        const_tensor_kernels_.push_back({});
+        nodes_with_const_tensor_kernels.push_back(n);
+        ConstTensorKernelState& kernel_state = const_tensor_kernels_.back();
+        kernel_state.kernel = kernel;
+        kernel_state.const_tensor = *const_tensor;
+      } else {
+        const int kernel_index = kernels_.size();
+        kernels_.push_back({});
+        nodes_with_kernels.push_back(n);
+        KernelState& kernel_state = kernels_.back();
+        kernel_state.kernel = kernel;
+        kernel_state.num_inputs = n->num_inputs();
+        kernel_state.num_outputs = n->num_outputs();
+        kernel_state.input_start_index =
+            kernel_index == 0 ? 0
+                              : kernels_[kernel_index - 1].input_start_index +
+                                    kernels_[kernel_index - 1].num_inputs;
+        node_to_index_map[n] = kernel_index;
+      }
+    }
+    total_num_inputs_ =
+        kernels_.empty()
+            ? 0
+            : kernels_.back().input_start_index + kernels_.back().num_inputs;
+
+    auto input_location = [&](const Edge* e) {
+      return kernels_[node_to_index_map.at(e->dst())].input_start_index +
+             e->dst_input();
+    };
+
+    if (!arg_index_to_node_map.empty()) {
+      arg_output_locations_.resize(arg_index_to_node_map.rbegin()->first + 1);
+      for (const auto& [arg_index, arg_node] : arg_index_to_node_map) {
+        for (const Edge* e : arg_node->out_edges()) {
+          if (e->IsControlEdge()) {
+            continue;
+          } else if (e->src_output() != 0) {
+            return errors::Internal("Invalid output index ", e->src_output(),
+                                    " from argument node ", arg_index);
+          }
+          arg_output_locations_[arg_index].push_back(input_location(e));
+        }
+      }
+    }
+
+    for (size_t i = 0; i < const_tensor_kernels_.size(); ++i) {
+      Node* n = nodes_with_const_tensor_kernels[i];
+      ConstTensorKernelState& kernel_state = const_tensor_kernels_[i];
+      for (const Edge* e : n->out_edges()) {
+        if (e->IsControlEdge()) {
+          continue;
+        } else if (e->src_output() != 0) {
+          return errors::Internal("Invalid output index ", e->src_output(),
+                                  " from node ", n->DebugString());
+        }
+        kernel_state.output_locations.push_back(input_location(e));
+      }
+    }
+
+    input_alloc_attrs_.resize(total_num_inputs_);
+    predecessors_.resize(kernels_.size());
+    successors_.resize(kernels_.size());
+    for (size_t i = 0; i < kernels_.size(); ++i) {
+      Node* n = nodes_with_kernels[i];
+      KernelState& kernel_state = kernels_[i];
+      kernel_state.output_locations.resize(kernel_state.num_outputs);
+      kernel_state.output_alloc_attrs.resize(kernel_state.num_outputs);
+      for (int out = 0; out < n->num_outputs(); ++out) {
+        if (kernel_state.kernel->output_memory_types()[out] == HOST_MEMORY) {
+          kernel_state.output_alloc_attrs[out].set_on_host(true);
+        }
+      }
+      for (const Edge* e : n->out_edges()) {
+        auto it = node_to_index_map.find(e->dst());
+        if (it == node_to_index_map.end()) {
+          continue;
+        }
+        // Both data and control edges order the kernels.
+        successors_[i].push_back(it->second);
+        predecessors_[it->second].push_back(i);
+        if (!e->IsControlEdge()) {
+          const size_t location = input_location(e);
+          kernel_state.output_locations[e->src_output()].push_back(location);
+          input_alloc_attrs_[location] =
+              kernel_state.output_alloc_attrs[e->src_output()];
+        }
+      }
+    }
+    for (auto* edges : {&predecessors_, &successors_}) {
+      for (std::vector<int>& kernel_edges : *edges) {
+        std::sort(kernel_edges.begin(), kernel_edges.end());
+        kernel_edges.erase(
+            std::unique(kernel_edges.begin(), kernel_edges.end()),
+            kernel_edges.end());
+      }
+    }
+    warmup_costs_.resize(kernels_.size());
+    return OkStatus();
+  }
+
+  Status Run(const Args& args) override {
+    std::shared_ptr<const Schedule> schedule;
+    {
+      tf_shared_lock l(mu_);
+      schedule = schedule_;
+    }
+    auto state = std::make_shared<StepState>(args.runner);
+    // Override intra op thread pool if requested.
+    state->device = params_.device;
+    if (args.user_intra_op_threadpool != nullptr ||
+        args.step_allocator != nullptr) {
+      state->user_device = RenamedDevice::NewRenamedDevice(
+          state->device->name(), state->device, /*owns_underlying=*/false,
+          /*isolate_session_state=*/false, args.user_intra_op_threadpool,
+          args.step_allocator);
+      state->device = state->user_device.get();
+    }
+    TF_RETURN_IF_ERROR(PrepareStep(args, state.get()));
+
+    if (schedule == nullptr) {
+      std::vector<int64_t> costs(kernels_.size());
+      TF_RETURN_IF_ERROR(RunSerially(state.get(), &costs));
+      RecordWarmupStep(costs);
+      return OkStatus();
+    }
+    if (schedule->lanes.size() <= 1) {
+      return RunSerially(state.get(), /*costs=*/nullptr);
+    }
+    return RunLanes(std::move(schedule), std::move(state));
+  }
+
+  // Execute all operations in the calling thread when asynchronous execution
+  // is requested, as the single-threaded executor does.
+  void RunAsync(const Args& args, DoneCallback done) override {
+    args.runner([this, args, done]() { done(Run(args)); });
+  }
+
+ private:
+  // State of a step, shared by the threads running its lanes.
+  struct StepState {
+    explicit StepState(Args::Runner runner) : runner(std::move(runner)) {}
+
+    ~StepState() {
+      if (params.op_device_context != nullptr) {
+        params.op_device_context->Unref();
+      }
+    }
+
+    Args::Runner runner;
+    Device* device = nullptr;
+    std::unique_ptr<Device> user_device;
+    // Parameters shared by all kernels. Each thread makes its own copy.
+    OpKernelContext::Params params;
+    // The inputs of all kernels, laid out as in the single-threaded executor.
+    std::vector<Entry> inputs;
+
+    // The following are only used when running more than one lane.
+    //
+    // Number of unsatisfied dependencies of each kernel on kernels on other
+    // lanes, plus one for the arrival of its own lane.
+    std::unique_ptr<std::atomic<int>[]> num_pending;
+    // Whether the lane continuation starting at each kernel has been claimed
+    // by a thread.
+    std::unique_ptr<std::atomic<bool>[]> claimed;
+    // Whether the start of each lane has been claimed by a thread.
+    std::unique_ptr<std::atomic<bool>[]> lane_started;
+    std::atomic<int> num_unfinished_lanes{0};
+    std::atomic<bool> aborted{false};
+    mutex mu;
+    Status status TF_GUARDED_BY(mu);
+    Notification done;
+
+    // Returns true if the calling thread gets to run lane `lane` from its
+    // start.
+    bool ClaimLane(int lane) { return !lane_started[lane].exchange(true); }
+
+    // Returns true if the calling thread gets to resume a lane at kernel `i`.
+    bool ClaimContinuation(int i) { return !claimed[i].exchange(true); }
+  };
+
+  // Fills in the step parameters and forwards arguments and constants to the
+  // inputs of the kernels that consume them.
+  Status PrepareStep(const Args& args, StepState* state) {
+    OpKernelContext::Params& params = state->params;
+    params.step_id = args.step_id;
+    params.device = state->device;
+    params.log_memory = false;
+    params.rendezvous = args.rendezvous;
+    params.session_state = args.session_state;
+    params.session_metadata = params_.session_metadata;
+    params.tensor_store = args.tensor_store;
+    params.cancellation_manager = args.cancellation_manager;
+    params.call_frame = args.call_frame;
+    params.function_library = params_.function_library;
+    params.resource_manager = state->device->resource_manager();
+    params.step_container = args.step_container;
+    params.collective_executor = args.collective_executor;
+    params.stack_trace = args.stack_trace;
+    params.slice_reader_cache = nullptr;
+    params.runner = &state->runner;
+    params.run_all_kernels_inline = args.run_all_kernels_inline;
+    params.stats_collector = args.stats_collector;
+    params.executor_type = &kStaticScheduleExecutor;
+    params.frame_iter = FrameAndIter(0, 0);
+    params.is_input_dead = false;
+    params.forward_from_array = nullptr;
+    state->device->TryGetDeviceContext(&params.op_device_context)
+        .IgnoreError();
+
+    std::vector<Entry>& inputs = state->inputs;
+    inputs.resize(total_num_inputs_);
+    const size_t received_args =
+        args.call_frame ? args.call_frame->num_args() : 0;
+    if (TF_PREDICT_FALSE(arg_output_locations_.size() > received_args)) {
+      return errors::InvalidArgument("Expected ", arg_output_locations_.size(),
+                                     " arguments, but only received ",
+                                     received_args, ".");
+    }
+    for (size_t i = 0; i < arg_output_locations_.size(); ++i) {
+      const std::vector<size_t>& locations = arg_output_locations_[i];
+      if (locations.empty()) {
+        continue;
+      }
+      if (args.call_frame->CanConsumeArg(i)) {
+        Entry& first_input = inputs[locations[0]];
+        first_input.state = Entry::State::HAS_VALUE;
+        first_input.val.Init();
+        args.call_frame->ConsumeArg(i, first_input.val.get());
+        for (size_t j = 1; j < locations.size(); ++j) {
+          Entry& input = inputs[locations[j]];
+          input.state = Entry::State::HAS_VALUE;
+          input.val.Init(*first_input.val);
+        }
+      } else {
+        const Tensor* arg;
+        TF_RETURN_IF_ERROR(args.call_frame->GetArg(i, &arg));
+        for (size_t location : locations) {
+          Entry& input = inputs[location];
+          input.state = Entry::State::HAS_VALUE;
+          input.val.Init(*arg);
+        }
+      }
+    }
+    for (const ConstTensorKernelState& kernel_state : const_tensor_kernels_) {
+      for (size_t location : kernel_state.output_locations) {
+        Entry& input = inputs[location];
+        input.state = Entry::State::HAS_CONST_TENSOR;
+        input.const_tensor = &kernel_state.const_tensor;
+      }
+    }
+    return OkStatus();
+  }
+
+  // Runs the `i`th kernel and forwards its outputs to the inputs of its
+  // consumers.
+  Status RunKernel(int i, OpKernelContext::Params* params,
+                   std::vector<Entry>* inputs, TensorValueVec* node_inputs,
+                   AllocatorAttributeVec* input_alloc_attrs) {
+    const KernelState& kernel_state = kernels_[i];
+    const size_t input_start_index = kernel_state.input_start_index;
+    const size_t num_inputs = kernel_state.num_inputs;
+    const size_t num_outputs = kernel_state.num_outputs;
+
+    node_inputs->clear();
+    node_inputs->resize(num_inputs);
+    input_alloc_attrs->clear();
+    input_alloc_attrs->resize(num_inputs);
+    for (size_t j = 0; j < num_inputs; ++j) {
+      Entry& input = (*inputs)[input_start_index + j];
+      switch (input.state) {
+        case Entry::State::HAS_CONST_TENSOR:
+          (*node_inputs)[j].tensor = const_cast<Tensor*>(input.const_tensor);
+          break;
+        case Entry::State::HAS_VALUE:
+          (*node_inputs)[j].tensor = input.val.get();
+          break;
+        default:
+          DCHECK(false) << "Input did not have a valid value.";
+      }
+      (*input_alloc_attrs)[j] = input_alloc_attrs_[input_start_index + j];
+    }
+    params->inputs = *node_inputs;
+    params->input_alloc_attrs = *input_alloc_attrs;
+    params->op_kernel = kernel_state.kernel;
+    params->output_attr_array = kernel_state.output_alloc_attrs.data();
+    OpKernelContext ctx(params, num_outputs);
+    down_cast<Device*>(params->device)->Compute(kernel_state.kernel, &ctx);
+    TF_RETURN_IF_ERROR(ctx.status());
+
+    for (size_t j = 0; j < num_inputs; ++j) {
+      (*inputs)[input_start_index + j].ClearVal();
+    }
+    for (size_t j = 0; j < num_outputs; ++j) {
+      TensorValue val = ctx.release_output(j);
+      const std::vector<size_t>& locations = kernel_state.output_locations[j];
+      for (size_t k = 0; k < locations.size(); ++k) {
+        Entry& input = (*inputs)[locations[k]];
+        input.state = Entry::State::HAS_VALUE;
+        if (val.tensor == nullptr) {
+          input.val.Init(Tensor(kernel_state.kernel->output_type(j)));
+        } else if (k + 1 < locations.size()) {
+          input.val.Init(*val.tensor);
+        } else {
+          // Moves the output to the last consumer to avoid copying it.
+          input.val.Init(std::move(*val.tensor));
+        }
+      }
+      delete val.tensor;
+    }
+    return OkStatus();
+  }
+
+  // Runs all kernels in topological order on the calling thread. Records the
+  // cost of each kernel in `costs` if it is not `nullptr`.
+  Status RunSerially(StepState* state, std::vector<int64_t>* costs) {
+    TensorValueVec node_inputs;
+    AllocatorAttributeVec input_alloc_attrs;
+    for (int i = 0; i < kernels_.size(); ++i) {
+      const uint64 start_nsec = costs ? EnvTime::NowNanos() : 0;
+      TF_RETURN_IF_ERROR(RunKernel(i, &state->params, &state->inputs,
+                                   &node_inputs, &input_alloc_attrs));
+      if (costs) {
+        (*costs)[i] = EnvTime::NowNanos() - start_nsec;
+      }
+    }
+    return OkStatus();
+  }
+
+  // Adds the kernel costs of a warm-up step, and compiles the schedule once
+  // enough warm-up steps have run.
+  void RecordWarmupStep(const std::vector<int64_t>& costs) {
+    mutex_lock l(mu_);
+    if (schedule_ != nullptr) {
+      return;
+    }
+    for (size_t i = 0; i < costs.size(); ++i) {
+      warmup_costs_[i] += costs[i];
+    }
+    if (++num_warmup_steps_ < kNumWarmupSteps) {
+      return;
+    }
+    // Uses the mean cost of each kernel.
+    for (int64_t& cost : warmup_costs_) {
+      cost /= num_warmup_steps_;
+    }
+    const int max_num_lanes =
+        std::min<int>({kMaxNumLanes, port::MaxParallelism(),
+                       std::max<int>(kernels_.size(), 1)});
+    Schedule schedule =
+        ComputeSchedule(predecessors_, successors_, warmup_costs_, 1);
+    for (int num_lanes = 2; num_lanes <= max_num_lanes; ++num_lanes) {
+      Schedule candidate = ComputeSchedule(predecessors_, successors_,
+                                           warmup_costs_, num_lanes);
+      if (candidate.makespan_nsec <
+          (1.0 - kMinLaneGain) * schedule.makespan_nsec) {
+        schedule = std::move(candidate);
+      }
+    }
+    VLOG(1) << "Compiled a static schedule of " << kernels_.size()
+            << " kernels on " << schedule.lanes.size()
+            << " lanes, with an estimated step time of "
+            << schedule.makespan_nsec << "ns.";
+    schedule_ = std::make_shared<const Schedule>(std::move(schedule));
+    warmup_costs_.clear();
+  }
+
+  // Runs the lanes of `schedule`. The calling thread runs the first lane and
+  // then any lane that no other thread has started.
+  //
+  // A lane that reaches a kernel whose dependencies on other lanes are not
+  // satisfied stops, and the thread that satisfies the last dependency hands
+  // the rest of the lane to another thread. Threads never wait for each other
+  // except for the calling thread at the end of the step, so the step cannot
+  // deadlock even if the runner has no threads available.
+  Status RunLanes(std::shared_ptr<const Schedule> schedule,
+                  std::shared_ptr<StepState> state) {
+    const int num_kernels = kernels_.size();
+    const int num_lanes = schedule->lanes.size();
+    state->num_pending.reset(new std::atomic<int>[num_kernels]);
+    state->claimed.reset(new std::atomic<bool>[num_kernels]);
+    state->lane_started.reset(new std::atomic<bool>[num_lanes]);
+    for (int i = 0; i < num_kernels; ++i) {
+      const int num_predecessors = schedule->num_cross_lane_predecessors[i];
+      state->num_pending[i].store(
+          num_predecessors == 0 ? 0 : num_predecessors + 1,
+          std::memory_order_relaxed);
+      state->claimed[i].store(false, std::memory_order_relaxed);
+    }
+    for (int lane = 0; lane < num_lanes; ++lane) {
+      state->lane_started[lane].store(false, std::memory_order_relaxed);
+    }
+    state->num_unfinished_lanes.store(num_lanes, std::memory_order_relaxed);
+
+    // Closures only touch the executor after claiming work, which cannot
+    // happen once the step is done.
+    for (int lane = 1; lane < num_lanes; ++lane) {
+      state->runner([this, schedule, state, lane]() {
+        if (state->ClaimLane(lane)) {
+          RunLane(*schedule, state, lane, /*position=*/0, /*arrived=*/false);
+        }
+      });
+    }
+    for (int lane = 0; lane < num_lanes; ++lane) {
+      if (state->ClaimLane(lane)) {
+        RunLane(*schedule, state, lane, /*position=*/0, /*arrived=*/false);
+      }
+    }
+    state->done.WaitForNotification();
+    mutex_lock l(state->mu);
+    return state->status;
+  }
+
+  // Runs lane `lane` from `position`, where `arrived` indicates whether the
+  // lane has already arrived at the kernel at `position`.
+  void RunLane(const Schedule& schedule,
+               const std::shared_ptr<StepState>& state, int lane, int position,
+               bool arrived) {
+    OpKernelContext::Params params = state->params;
+    TensorValueVec node_inputs;
+    AllocatorAttributeVec input_alloc_attrs;
+    // Continuations of other lanes that this thread also offers to run, in
+    // case no other thread picks them up.
+    std::vector<int> continuations;
+    const std::vector<int>& kernels = schedule.lanes[lane];
+    for (; position < kernels.size(); ++position, arrived = false) {
+      const int i = kernels[position];
+      if (!arrived && schedule.num_cross_lane_predecessors[i] > 0 &&
+          state->num_pending[i].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        // The thread that satisfies the last dependency resumes the lane.
+        break;
+      }
+      if (!state->aborted.load(std::memory_order_relaxed)) {
+        Status s = RunKernel(i, &params, &state->inputs, &node_inputs,
+                             &input_alloc_attrs);
+        if (!s.ok()) {
+          mutex_lock l(state->mu);
+          state->status.Update(s);
+          state->aborted.store(true, std::memory_order_relaxed);
+        }
+      }
+      // After an error, the remaining kernels are skipped but dependencies
+      // are still propagated, so that every lane runs to its end.
+      for (int j : schedule.cross_lane_successors[i]) {
+        if (state->num_pending[j].fetch_sub(1, std::memory_order_acq_rel) ==
+            1) {
+          continuations.push_back(j);
+          state->runner([this, &schedule, state, j]() {
+            if (state->ClaimContinuation(j)) {
+              RunLane(schedule, state, schedule.lane[j], schedule.position[j],
+                      /*arrived=*/true);
+            }
+          });
+        }
+      }
+    }
+    if (position == kernels.size() &&
+        state->num_unfinished_lanes.fetch_sub(1, std::memory_order_acq_rel) ==
+            1) {
+      state->done.Notify();
+    }
+    for (int j : continuations) {
+      if (state->ClaimContinuation(j)) {
+        RunLane(schedule, state, schedule.lane[j], schedule.position[j],
+                /*arrived=*/true);
+      }
+    }
+  }
+
+  const LocalExecutorParams params_;
+
+  // All following members are read-only after Initialize().
+
+  // The sum of the number of inputs for each kernel, which determines the
+  // length of the flat `inputs` vector of a step.
+  size_t total_num_inputs_;
+
+  // Represents cached graph structure state for each kernel.
+  struct KernelState {
+    // The kernel object. Not owned.
+    OpKernel* kernel;
+    // The range of elements in `inputs` that corresponds to the inputs of
+    // `kernel`.
+    size_t input_start_index;
+    size_t num_inputs;
+    size_t num_outputs;
+    // For the `j`th output of `kernel`, `output_locations[j]` contains the
+    // locations in the flat `inputs` vector to which that output is copied.
+    std::vector<std::vector<size_t>> output_locations;
+    // Memory space information for each output of `kernel`.
+    std::vector<AllocatorAttributes> output_alloc_attrs;
+  };
+  // Kernels in topological order.
+  std::vector<KernelState> kernels_;
+
+  // For the `i`th argument, `arg_output_locations_[i]` contains the locations
+  // in the flat `inputs` vector to which that argument is copied.
+  std::vector<std::vector<size_t>> arg_output_locations_;
+
+  // Represents cached graph structure state for each kernel that produces a
+  // single constant-valued tensor.
+  struct ConstTensorKernelState {
+    // The kernel object. Not owned.
+    OpKernel* kernel;
+    // The cached value of `kernel->const_tensor()`.
+    Tensor const_tensor;
+    // The locations in the flat `inputs` vector to which the tensor is copied.
+    std::vector<size_t> output_locations;
+  };
+  std::vector<ConstTensorKernelState> const_tensor_kernels_;
+
+  // Memory space information for each input, in the order of the flat
+  // `inputs` vector.
+  std::vector<AllocatorAttributes> input_alloc_attrs_;
+
+  // The kernels that each kernel depends on, and the kernels that depend on
+  // it, through data or control edges.
+  std::vector<std::vector<int>> predecessors_;
+  std::vector<std::vector<int>> successors_;
+
+  mutex mu_;
+  // Sums of the costs of each kernel in nanoseconds over the warm-up steps.
+  std::vector<int64_t> warmup_costs_ TF_GUARDED_BY(mu_);
+  int num_warmup_steps_ TF_GUARDED_BY(mu_) = 0;
+  // The compiled schedule, or `nullptr` while warming up.
+  std::shared_ptr<const Schedule> schedule_ TF_GUARDED_BY(mu_);
+};
+
+class StaticScheduleExecutorRegistrar {
+ public:
+  StaticScheduleExecutorRegistrar() {
+    ExecutorFactory::Register(kStaticScheduleExecutor, new Factory());
+  }
+
+ private:
+  class Factory : public ExecutorFactory {
+    Status NewExecutor(const LocalExecutorParams& params, const Graph& graph,
+                       std::unique_ptr<Executor>* out_executor) override {
+      Executor* ret;
+      TF_RETURN_IF_ERROR(NewStaticScheduleExecutor(params, graph, &ret));
+      out_executor->reset(ret);
+      return OkStatus();
+    }
+  };
+};
+static StaticScheduleExecutorRegistrar registrar;
+
+}  // namespace
+
+Status NewStaticScheduleExecutor(const LocalExecutorParams& params,
+                                 const Graph& graph, Executor** executor) {
+  auto impl = std::make_unique<StaticScheduleExecutorImpl>(params);
+  TF_RETURN_IF_ERROR(impl->Initialize(graph));
+  *executor = impl.release();
+  return OkStatus();
+}
+
+}  // namespace tensorflow
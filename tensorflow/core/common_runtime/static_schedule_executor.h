@@ -0,0 +1,46 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_SCHEDULE_EXECUTOR_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_SCHEDULE_EXECUTOR_H_
+
+#include "tensorflow/core/common_runtime/executor.h"
+
+namespace tensorflow {
+
+// Creates a new `Executor` for executing `graph` according to a static
+// schedule, which is registered as "STATIC_SCHEDULE_EXECUTOR" and can be
+// chosen with `ConfigProto.Experimental.executor_type`.
+//
+// The executor runs the first steps one kernel at a time in topological order
+// and records the cost of each kernel. It then compiles the graph into a fixed
+// set of per-thread task lists ("lanes"), using list scheduling on the
+// recorded costs, and only adds lanes while they shorten the estimated step
+// time. Later steps run each lane in order and only synchronize on the
+// precomputed dependencies between kernels on different lanes, so there is no
+// per-node ready queue traffic. Graphs of many small kernels typically end up
+// with a single lane and run with no synchronization at all.
+//
+// The executor has the same limitations as the single-threaded executor (see
+// single_threaded_executor.h), and validates nodes with the same
+// `ValidateOpIsSafeForSyncExecution()`: it supports neither reference-typed
+// tensors, low level control flow, asynchronous kernels, nor partitioned
+// graphs, and it is suitable for CPU devices only.
+Status NewStaticScheduleExecutor(const LocalExecutorParams& params,
+                                 const Graph& graph, Executor** executor);
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_SCHEDULE_EXECUTOR_H_
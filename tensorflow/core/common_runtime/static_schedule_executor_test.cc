@@ -0,0 +1,267 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/common_runtime/executor.h"
+#include "tensorflow/core/common_runtime/executor_factory.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace {
+
+// Number of steps after which the executor runs a compiled schedule.
+constexpr int kNumWarmupSteps = 10;
+
+class MockOp : public OpKernel {
+ public:
+  using OpKernel::OpKernel;
+
+  void SetCompute(std::function<void(OpKernelContext*)> compute) {
+    compute_ = std::move(compute);
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    OP_REQUIRES(ctx, compute_ != nullptr,
+                errors::FailedPrecondition("Compute() is not set"));
+    compute_(ctx);
+  }
+
+ private:
+  std::function<void(OpKernelContext* ctx)> compute_;
+};
+REGISTER_OP("Mock")
+    .Input("x: float")
+    .Output("y: float")
+    .Output("empty_output: string")
+    .SetIsStateful();
+REGISTER_KERNEL_BUILDER(Name("Mock").Device(DEVICE_CPU), MockOp);
+
+class MockAsyncOp : public AsyncOpKernel {
+ public:
+  using AsyncOpKernel::AsyncOpKernel;
+
+  void ComputeAsync(OpKernelContext* ctx, DoneCallback done) override {
+    ctx->set_output(0, ctx->input(0));
+    done();
+  }
+};
+REGISTER_OP("MockAsync").Input("x: float").Output("y: float");
+REGISTER_KERNEL_BUILDER(Name("MockAsync").Device(DEVICE_CPU), MockAsyncOp);
+
+class StaticScheduleExecutorTest : public ::testing::Test {
+ protected:
+  StaticScheduleExecutorTest()
+      : device_(DeviceFactory::NewDevice("CPU", {},
+                                         "/job:localhost/replica:0/task:0")),
+        thread_pool_(Env::Default(), "static_schedule_executor_test", 4) {}
+
+  void Create(std::unique_ptr<const Graph> graph,
+              std::function<void(OpKernelContext*)> mock_fn = nullptr) {
+    const int version = graph->versions().producer();
+    LocalExecutorParams params;
+    params.device = device_.get();
+    params.create_kernel =
+        [this, mock_fn = std::move(mock_fn), version](
+            const std::shared_ptr<const NodeProperties>& props,
+            OpKernel** kernel) {
+          TF_RETURN_IF_ERROR(CreateNonCachedKernel(device_.get(), nullptr,
+                                                   props, version, kernel));
+          if ((*kernel)->type_string_view() == "Mock") {
+            down_cast<MockOp*>(*kernel)->SetCompute(mock_fn);
+          }
+          return OkStatus();
+        };
+    params.delete_kernel = [](OpKernel* kernel) {
+      DeleteNonCachedKernel(kernel);
+    };
+    TF_CHECK_OK(
+        NewExecutor("STATIC_SCHEDULE_EXECUTOR", params, *graph, &exec_));
+  }
+
+  Status Run(CallFrameInterface* call_frame) {
+    Executor::Args args;
+    args.call_frame = call_frame;
+    args.runner = [this](std::function<void()> fn) {
+      thread_pool_.Schedule(std::move(fn));
+    };
+    return exec_->Run(args);
+  }
+
+  std::unique_ptr<Device> device_;
+  thread::ThreadPool thread_pool_;
+  std::unique_ptr<Executor> exec_;
+};
+
+Tensor V(const float val) {
+  Tensor tensor(DT_FLOAT, TensorShape({}));
+  tensor.scalar<float>()() = val;
+  return tensor;
+}
+
+float V(const Tensor& tensor) {
+  CHECK_EQ(tensor.dtype(), DT_FLOAT);
+  CHECK(TensorShapeUtils::IsScalar(tensor.shape()));
+  return tensor.scalar<float>()();
+}
+
+TEST_F(StaticScheduleExecutorTest, SimpleAdd) {
+  // c = a + b
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  auto in0 = test::graph::Arg(g.get(), 0, DT_FLOAT);
+  auto in1 = test::graph::Arg(g.get(), 1, DT_FLOAT);
+  auto tmp = test::graph::Add(g.get(), in0, in1);
+  test::graph::Retval(g.get(), 0, tmp);
+  FixupSourceAndSinkEdges(g.get());
+  Create(std::move(g));
+  // Runs the warm-up steps and then steps with the compiled schedule.
+  for (int i = 0; i < 2 * kNumWarmupSteps; ++i) {
+    FunctionCallFrame call_frame({DT_FLOAT, DT_FLOAT}, {DT_FLOAT});
+    TF_ASSERT_OK(call_frame.SetArgs({V(static_cast<float>(i)), V(2.0)}));
+    TF_ASSERT_OK(Run(&call_frame));
+    std::vector<Tensor> retvals;
+    TF_ASSERT_OK(call_frame.ConsumeRetvals(&retvals, false));
+    EXPECT_EQ(i + 2.0, V(retvals[0]));
+  }
+}
+
+// Builds `num_branches` independent chains of `chain_length` Mock nodes that
+// all consume argument 0, and sums up their results into return value 0.
+std::unique_ptr<Graph> BranchesGraph(int num_branches, int chain_length) {
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  Node* arg = test::graph::Arg(g.get(), 0, DT_FLOAT);
+  Node* sum = nullptr;
+  for (int i = 0; i < num_branches; ++i) {
+    Node* node = arg;
+    for (int j = 0; j < chain_length; ++j) {
+      TF_CHECK_OK(NodeBuilder(g->NewName("n"), "Mock")
+                      .Input(node)
+                      .Finalize(g.get(), &node));
+    }
+    sum = sum == nullptr ? node : test::graph::Add(g.get(), sum, node);
+  }
+  test::graph::Retval(g.get(), 0, sum);
+  FixupSourceAndSinkEdges(g.get());
+  return g;
+}
+
+TEST_F(StaticScheduleExecutorTest, ParallelBranches) {
+  constexpr int kNumBranches = 4;
+  constexpr int kChainLength = 3;
+  std::atomic<int> num_calls{0};
+  Create(BranchesGraph(kNumBranches, kChainLength),
+         [&num_calls](OpKernelContext* ctx) {
+           // Expensive enough for the branches to run on several lanes.
+           Env::Default()->SleepForMicroseconds(1000);
+           ++num_calls;
+           ctx->set_output(0, V(V(ctx->input(0)) + 1.0f));
+         });
+  for (int i = 0; i < 2 * kNumWarmupSteps; ++i) {
+    FunctionCallFrame call_frame({DT_FLOAT}, {DT_FLOAT});
+    TF_ASSERT_OK(call_frame.SetArgs({V(1.0)}));
+    TF_ASSERT_OK(Run(&call_frame));
+    std::vector<Tensor> retvals;
+    TF_ASSERT_OK(call_frame.ConsumeRetvals(&retvals, false));
+    EXPECT_EQ(kNumBranches * (1.0 + kChainLength), V(retvals[0]));
+  }
+  EXPECT_EQ(num_calls.load(),
+            2 * kNumWarmupSteps * kNumBranches * kChainLength);
+}
+
+TEST_F(StaticScheduleExecutorTest, OpError) {
+  std::atomic<int> num_calls{0};
+  Create(BranchesGraph(/*num_branches=*/4, /*chain_length=*/3),
+         [&num_calls](OpKernelContext* ctx) {
+           Env::Default()->SleepForMicroseconds(1000);
+           // Fails once the schedule is compiled.
+           if (++num_calls > kNumWarmupSteps * 4 * 3) {
+             ctx->SetStatus(errors::Internal("Mock failure"));
+             return;
+           }
+           ctx->set_output(0, ctx->input(0));
+         });
+  for (int i = 0; i < kNumWarmupSteps; ++i) {
+    FunctionCallFrame call_frame({DT_FLOAT}, {DT_FLOAT});
+    TF_ASSERT_OK(call_frame.SetArgs({V(1.0)}));
+    TF_ASSERT_OK(Run(&call_frame));
+  }
+  FunctionCallFrame call_frame({DT_FLOAT}, {DT_FLOAT});
+  TF_ASSERT_OK(call_frame.SetArgs({V(1.0)}));
+  Status s = Run(&call_frame);
+  EXPECT_TRUE(errors::IsInternal(s)) << s;
+}
+
+TEST_F(StaticScheduleExecutorTest, ControlFlowNotSupported) {
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  Node* arg = test::graph::Arg(g.get(), 0, DT_FLOAT);
+  Node* pred = test::graph::Arg(g.get(), 1, DT_BOOL);
+  test::graph::Switch(g.get(), arg, pred);
+  FixupSourceAndSinkEdges(g.get());
+  LocalExecutorParams params;
+  params.device = device_.get();
+  params.create_kernel = [](const std::shared_ptr<const NodeProperties>& props,
+                            OpKernel** kernel) {
+    return errors::Internal("Kernels should not be created");
+  };
+  params.delete_kernel = [](OpKernel* kernel) {};
+  EXPECT_TRUE(errors::IsFailedPrecondition(
+      NewExecutor("STATIC_SCHEDULE_EXECUTOR", params, *g, &exec_)));
+}
+
+TEST_F(StaticScheduleExecutorTest, AsyncKernelsNotSupported) {
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  Node* arg = test::graph::Arg(g.get(), 0, DT_FLOAT);
+  Node* async;
+  TF_ASSERT_OK(NodeBuilder(g->NewName("n"), "MockAsync")
+                   .Input(arg)
+                   .Finalize(g.get(), &async));
+  test::graph::Retval(g.get(), 0, async);
+  FixupSourceAndSinkEdges(g.get());
+  const int version = g->versions().producer();
+  LocalExecutorParams params;
+  params.device = device_.get();
+  params.create_kernel =
+      [this, version](const std::shared_ptr<const NodeProperties>& props,
+                      OpKernel** kernel) {
+        return CreateNonCachedKernel(device_.get(), nullptr, props, version,
+                                     kernel);
+      };
+  params.delete_kernel = [](OpKernel* kernel) {
+    DeleteNonCachedKernel(kernel);
+  };
+  EXPECT_TRUE(errors::IsUnimplemented(
+      NewExecutor("STATIC_SCHEDULE_EXECUTOR", params, *g, &exec_)));
+}
+
+}  // namespace
+}  // namespace tensorflow
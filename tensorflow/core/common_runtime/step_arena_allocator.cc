@@ -0,0 +1,344 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace {
+
+auto* step_arena_plans = monitoring::Counter<0>::New(
+    "/tensorflow/core/step_arena_plans",
+    "The number of step arena plans that serve allocations from an arena.");
+
+// Number of consecutive recorded steps with allocations of the same sizes after
+// which the planner builds a plan.
+constexpr int kNumMatchingSteps = 2;
+
+// Number of recorded steps, and number of plans, after which the planner gives
+// up on graphs whose allocations do not settle.
+constexpr int kMaxNumRecordedSteps = 10;
+constexpr int kMaxNumPlans = 3;
+
+// Maximum number of arena buffers that are alive at any time. Arenas outlive
+// their step while tensors allocated in them are alive, and steps beyond the
+// limit use the device allocator.
+constexpr int kMaxNumArenas = 4;
+
+size_t AlignedSize(size_t num_bytes) {
+  constexpr size_t kAlignment = Allocator::kAllocatorAlignment;
+  return (num_bytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // namespace
+
+struct StepArenaPlan {
+  struct Slot {
+    size_t offset = 0;
+    size_t size = 0;
+    // Slots whose memory overlaps with the memory of this slot.
+    std::vector<int> conflicts;
+  };
+  std::vector<Slot> slots;
+
+  // The slots of the allocations of each size, in allocation order.
+  absl::flat_hash_map<size_t, int> size_to_group;
+  std::vector<std::vector<int>> groups;
+
+  absl::flat_hash_map<size_t, std::vector<int>> offset_to_slots;
+  size_t arena_size = 0;
+
+  // Number of arena buffers allocated for this plan that are alive.
+  mutable std::atomic<int> num_arenas{0};
+};
+
+namespace {
+
+// Assigns offsets to the allocations that were freed within the recorded step,
+// greedily by decreasing size: each allocation is placed at the lowest offset
+// where it does not overlap with any already placed allocation whose lifetime
+// overlaps with its own.
+template <typename Allocation>
+std::shared_ptr<const StepArenaPlan> BuildPlan(
+    const std::vector<Allocation>& allocations) {
+  std::vector<int> indices;
+  for (int i = 0; i < allocations.size(); ++i) {
+    if (allocations[i].deallocated_at >= 0 && allocations[i].num_bytes > 0) {
+      indices.push_back(i);
+    }
+  }
+
+  std::vector<int> order = indices;
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return allocations[a].num_bytes > allocations[b].num_bytes;
+  });
+  std::vector<size_t> offsets(allocations.size());
+  std::vector<int> placed;
+  std::vector<std::pair<size_t, size_t>> in_use;
+  for (int i : order) {
+    const Allocation& allocation = allocations[i];
+    in_use.clear();
+    for (int j : placed) {
+      if (allocations[j].allocated_at < allocation.deallocated_at &&
+          allocation.allocated_at < allocations[j].deallocated_at) {
+        in_use.emplace_back(offsets[j],
+                            offsets[j] + AlignedSize(allocations[j].num_bytes));
+      }
+    }
+    std::sort(in_use.begin(), in_use.end());
+    const size_t size = AlignedSize(allocation.num_bytes);
+    size_t offset = 0;
+    for (const auto& [start, end] : in_use) {
+      if (offset + size <= start) break;
+      offset = std::max(offset, end);
+    }
+    offsets[i] = offset;
+    placed.push_back(i);
+  }
+
+  auto plan = std::make_shared<StepArenaPlan>();
+  for (int i : indices) {
+    StepArenaPlan::Slot slot;
+    slot.offset = offsets[i];
+    slot.size = AlignedSize(allocations[i].num_bytes);
+    const int slot_index = plan->slots.size();
+    for (int j = 0; j < slot_index; ++j) {
+      StepArenaPlan::Slot& other = plan->slots[j];
+      if (other.offset < slot.offset + slot.size &&
+          slot.offset < other.offset + other.size) {
+        slot.conflicts.push_back(j);
+        other.conflicts.push_back(slot_index);
+      }
+    }
+    plan->arena_size = std::max(plan->arena_size, slot.offset + slot.size);
+    plan->offset_to_slots[slot.offset].push_back(slot_index);
+    auto it = plan->size_to_group
+                  .emplace(allocations[i].num_bytes, plan->groups.size())
+                  .first;
+    if (it->second == plan->groups.size()) {
+      plan->groups.emplace_back();
+    }
+    plan->groups[it->second].push_back(slot_index);
+    plan->slots.push_back(std::move(slot));
+  }
+  return plan;
+}
+
+}  // namespace
+
+StepArenaAllocator::StepArenaAllocator(
+    Allocator* allocator, std::shared_ptr<const StepArenaPlan> plan)
+    : allocator_(allocator), plan_(std::move(plan)) {
+  if (plan_ == nullptr) {
+    return;
+  }
+  plan_->num_arenas.fetch_add(1);
+  arena_ = static_cast<char*>(
+      allocator_->AllocateRaw(Allocator::kAllocatorAlignment,
+                              plan_->arena_size, AllocationAttributes()));
+  slot_in_use_ = std::make_unique<std::atomic<bool>[]>(plan_->slots.size());
+  group_allocations_ =
+      std::make_unique<std::atomic<int>[]>(plan_->groups.size());
+}
+
+StepArenaAllocator::~StepArenaAllocator() {
+  if (plan_ != nullptr) {
+    if (arena_ != nullptr) {
+      allocator_->DeallocateRaw(arena_);
+    }
+    plan_->num_arenas.fetch_sub(1);
+  }
+}
+
+void* StepArenaAllocator::AllocateRaw(
+    size_t alignment, size_t num_bytes,
+    const AllocationAttributes& allocation_attr) {
+  void* ptr = nullptr;
+  if (plan_ == nullptr) {
+    ptr = allocator_->AllocateRaw(alignment, num_bytes, allocation_attr);
+    if (ptr != nullptr) {
+      mutex_lock l(mu_);
+      live_allocations_[ptr] = allocations_.size();
+      Allocation allocation;
+      allocation.num_bytes = num_bytes;
+      allocation.allocated_at = clock_++;
+      allocations_.push_back(allocation);
+    }
+  } else {
+    num_allocations_.fetch_add(1, std::memory_order_relaxed);
+    ptr = AllocateFromArena(alignment, num_bytes);
+    if (ptr == nullptr) {
+      num_fallbacks_.fetch_add(1, std::memory_order_relaxed);
+      ptr = allocator_->AllocateRaw(alignment, num_bytes, allocation_attr);
+    }
+  }
+  if (ptr != nullptr) {
+    Ref();
+  }
+  return ptr;
+}
+
+void* StepArenaAllocator::AllocateFromArena(size_t alignment,
+                                            size_t num_bytes) {
+  if (arena_ == nullptr || num_bytes == 0 ||
+      alignment > Allocator::kAllocatorAlignment) {
+    return nullptr;
+  }
+  auto it = plan_->size_to_group.find(num_bytes);
+  if (it == plan_->size_to_group.end()) {
+    return nullptr;
+  }
+  const std::vector<int>& group = plan_->groups[it->second];
+  const int index =
+      group_allocations_[it->second].fetch_add(1, std::memory_order_relaxed);
+  if (index >= group.size()) {
+    return nullptr;
+  }
+  // Claims the slot before checking the slots that share its memory, so that
+  // of two concurrent allocations of conflicting slots at least one observes
+  // the other and falls back.
+  const int slot = group[index];
+  slot_in_use_[slot].store(true);
+  for (int conflict : plan_->slots[slot].conflicts) {
+    if (slot_in_use_[conflict].load()) {
+      slot_in_use_[slot].store(false);
+      return nullptr;
+    }
+  }
+  return arena_ + plan_->slots[slot].offset;
+}
+
+bool StepArenaAllocator::InArena(const void* ptr) const {
+  const char* p = static_cast<const char*>(ptr);
+  return arena_ != nullptr && p >= arena_ && p < arena_ + plan_->arena_size;
+}
+
+void StepArenaAllocator::DeallocateRaw(void* ptr) {
+  if (InArena(ptr)) {
+    // Slots at the same offset share memory, so at most one of them is in use.
+    const auto& slots = plan_->offset_to_slots.at(static_cast<char*>(ptr) -
+                                                  arena_);
+    for (int slot : slots) {
+      bool in_use = true;
+      if (slot_in_use_[slot].compare_exchange_strong(in_use, false)) {
+        break;
+      }
+    }
+  } else {
+    if (plan_ == nullptr) {
+      mutex_lock l(mu_);
+      auto it = live_allocations_.find(ptr);
+      if (it != live_allocations_.end()) {
+        allocations_[it->second].deallocated_at = clock_++;
+        live_allocations_.erase(it);
+      }
+    }
+    allocator_->DeallocateRaw(ptr);
+  }
+  Unref();
+}
+
+std::vector<StepArenaAllocator::Allocation>
+StepArenaAllocator::RecordedAllocations() {
+  mutex_lock l(mu_);
+  return allocations_;
+}
+
+StepArenaPlanner::StepArenaPlanner(Allocator* allocator)
+    : allocator_(allocator) {}
+
+StepArenaPlanner::~StepArenaPlanner() {}
+
+core::RefCountPtr<StepArenaAllocator> StepArenaPlanner::StartStep() {
+  mutex_lock l(mu_);
+  if (disabled_) {
+    return nullptr;
+  }
+  if (plan_ != nullptr && plan_->num_arenas.load() >= kMaxNumArenas) {
+    return nullptr;
+  }
+  return core::RefCountPtr<StepArenaAllocator>(
+      new StepArenaAllocator(allocator_, plan_));
+}
+
+void StepArenaPlanner::EndStep(StepArenaAllocator* step_allocator,
+                               const Status& status) {
+  if (step_allocator->plan_ != nullptr) {
+    const int64_t num_allocations = step_allocator->num_allocations_.load();
+    const int64_t num_fallbacks = step_allocator->num_fallbacks_.load();
+    if (num_fallbacks * 2 <= num_allocations) {
+      return;
+    }
+    mutex_lock l(mu_);
+    if (plan_ == step_allocator->plan_) {
+      VLOG(1) << num_fallbacks << " of " << num_allocations
+              << " allocations did not match the step arena plan; recording "
+                 "allocations again.";
+      plan_.reset();
+      recorded_sizes_.clear();
+      num_matching_steps_ = 0;
+      num_recorded_steps_ = 0;
+      disabled_ = num_plans_ >= kMaxNumPlans;
+    }
+    return;
+  }
+  if (!status.ok()) {
+    return;
+  }
+
+  std::vector<StepArenaAllocator::Allocation> allocations =
+      step_allocator->RecordedAllocations();
+  std::vector<size_t> sizes;
+  sizes.reserve(allocations.size());
+  for (const auto& allocation : allocations) {
+    sizes.push_back(allocation.num_bytes);
+  }
+  std::sort(sizes.begin(), sizes.end());
+
+  mutex_lock l(mu_);
+  if (plan_ != nullptr || disabled_) {
+    return;
+  }
+  if (sizes == recorded_sizes_) {
+    ++num_matching_steps_;
+  } else {
+    recorded_sizes_ = std::move(sizes);
+    num_matching_steps_ = 1;
+  }
+  ++num_recorded_steps_;
+  if (num_matching_steps_ >= kNumMatchingSteps) {
+    plan_ = BuildPlan(allocations);
+    ++num_plans_;
+    VLOG(1) << "Planned " << plan_->slots.size() << " of "
+            << allocations.size() << " allocations into a step arena of "
+            << plan_->arena_size << " bytes.";
+    // Nothing to serve from an arena.
+    disabled_ = plan_->slots.empty();
+    if (!disabled_) {
+      step_arena_plans->GetCell()->IncrementBy(1);
+    }
+  } else if (num_recorded_steps_ >= kMaxNumRecordedSteps) {
+    VLOG(1) << "Allocations did not settle after " << num_recorded_steps_
+            << " steps; disabling the step arena.";
+    disabled_ = true;
+  }
+}
+
+}  // namespace tensorflow
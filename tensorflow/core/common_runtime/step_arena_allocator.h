@@ -0,0 +1,153 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_ALLOCATOR_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_ALLOCATOR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+
+struct StepArenaPlan;
+
+// Allocator for the tensors of a single step, created by a StepArenaPlanner.
+//
+// Until the planner has a plan, the allocator forwards to the device allocator
+// and records the lifetime of every allocation. Afterwards, allocations that
+// match the plan are served from a single arena buffer at precomputed offsets,
+// and all others are forwarded to the device allocator.
+//
+// Every live allocation holds a reference on the allocator, so that tensors
+// which outlive the step (e.g. fetched outputs) remain valid.
+class StepArenaAllocator : public Allocator, public core::RefCounted {
+ public:
+  ~StepArenaAllocator() override;
+
+  string Name() override { return "step_arena"; }
+
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override {
+    return AllocateRaw(alignment, num_bytes, AllocationAttributes());
+  }
+
+  void* AllocateRaw(size_t alignment, size_t num_bytes,
+                    const AllocationAttributes& allocation_attr) override;
+
+  void DeallocateRaw(void* ptr) override;
+
+  AllocatorMemoryType GetMemoryType() const override {
+    return allocator_->GetMemoryType();
+  }
+
+ private:
+  friend class StepArenaPlanner;
+
+  // The lifetime of an allocation in a recorded step, in logical time.
+  struct Allocation {
+    size_t num_bytes = 0;
+    int64_t allocated_at = 0;
+    int64_t deallocated_at = -1;
+  };
+
+  StepArenaAllocator(Allocator* allocator,
+                     std::shared_ptr<const StepArenaPlan> plan);
+
+  // Returns memory for the allocation from the arena, or nullptr if the
+  // allocation does not match the plan or its slot is not free.
+  void* AllocateFromArena(size_t alignment, size_t num_bytes);
+
+  bool InArena(const void* ptr) const;
+
+  // Returns the allocations of the step, in the order that they were made.
+  std::vector<Allocation> RecordedAllocations();
+
+  Allocator* const allocator_;  // Not owned.
+  const std::shared_ptr<const StepArenaPlan> plan_;
+
+  // Recording state, used while `plan_` is null.
+  mutex mu_;
+  int64_t clock_ TF_GUARDED_BY(mu_) = 0;
+  std::vector<Allocation> allocations_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<const void*, int> live_allocations_ TF_GUARDED_BY(mu_);
+
+  // Arena state, used while `plan_` is not null.
+  char* arena_ = nullptr;
+  // Whether each slot of the plan is in use.
+  std::unique_ptr<std::atomic<bool>[]> slot_in_use_;
+  // The number of allocations made from each group of the plan.
+  std::unique_ptr<std::atomic<int>[]> group_allocations_;
+  std::atomic<int64_t> num_allocations_{0};
+  std::atomic<int64_t> num_fallbacks_{0};
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepArenaAllocator);
+};
+
+// Plans the memory of the intermediate tensors of the steps of one executor, in
+// the spirit of TFLite's ArenaPlanner.
+//
+// The first steps record the sizes and lifetimes of their allocations. Once two
+// consecutive steps made allocations of the same sizes, the planner assigns
+// each allocation that was freed within its step an offset into a single
+// buffer, such that allocations with overlapping lifetimes do not overlap in
+// memory. Later steps match their allocations to the plan by size and order,
+// and fall back to the device allocator for allocations that do not match
+// (e.g. because shapes changed) or whose memory is still in use. If most
+// allocations of a step fall back, the planner records again, and it gives up
+// if the allocations of the graph do not settle.
+//
+// This class is thread-safe.
+class StepArenaPlanner {
+ public:
+  // `allocator` is the device allocator, which must outlive the planner and
+  // all allocators returned by StartStep().
+  explicit StepArenaPlanner(Allocator* allocator);
+  ~StepArenaPlanner();
+
+  // Returns the allocator for the tensors of a new step, or nullptr if the
+  // step should use the device allocator directly.
+  core::RefCountPtr<StepArenaAllocator> StartStep();
+
+  // Must be called with the allocator returned by StartStep() once the step
+  // completes.
+  void EndStep(StepArenaAllocator* step_allocator, const Status& status);
+
+ private:
+  Allocator* const allocator_;  // Not owned.
+
+  mutex mu_;
+  std::shared_ptr<const StepArenaPlan> plan_ TF_GUARDED_BY(mu_);
+  // Sorted sizes of the allocations of the last recorded step, and the number
+  // of consecutive recorded steps that made allocations of those sizes.
+  std::vector<size_t> recorded_sizes_ TF_GUARDED_BY(mu_);
+  int num_matching_steps_ TF_GUARDED_BY(mu_) = 0;
+  int num_recorded_steps_ TF_GUARDED_BY(mu_) = 0;
+  int num_plans_ TF_GUARDED_BY(mu_) = 0;
+  bool disabled_ TF_GUARDED_BY(mu_) = false;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepArenaPlanner);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_ALLOCATOR_H_
@@ -0,0 +1,140 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/step_arena_allocator.h"
+
+#include <cstring>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+struct StepPointers {
+  void* a = nullptr;
+  void* b = nullptr;
+  void* c = nullptr;
+};
+
+// Runs a step in which `c` is allocated after `a` is freed, so that the two can
+// share memory, while `b` is live throughout.
+StepPointers RunStep(StepArenaPlanner* planner, size_t a_size = 1000) {
+  core::RefCountPtr<StepArenaAllocator> allocator = planner->StartStep();
+  EXPECT_NE(allocator, nullptr);
+  StepPointers step;
+  step.a = allocator->AllocateRaw(Allocator::kAllocatorAlignment, a_size);
+  step.b = allocator->AllocateRaw(Allocator::kAllocatorAlignment, 2000);
+  memset(step.a, 1, a_size);
+  allocator->DeallocateRaw(step.a);
+  step.c = allocator->AllocateRaw(Allocator::kAllocatorAlignment, a_size);
+  memset(step.b, 2, 2000);
+  memset(step.c, 3, a_size);
+  allocator->DeallocateRaw(step.b);
+  allocator->DeallocateRaw(step.c);
+  planner->EndStep(allocator.get(), OkStatus());
+  return step;
+}
+
+// Returns whether the step was served from an arena, with `b` at offset 0 and
+// `a` and `c` sharing the memory after it.
+bool ServedFromArena(const StepPointers& step) {
+  return step.a == step.c &&
+         static_cast<char*>(step.a) - static_cast<char*>(step.b) == 2048;
+}
+
+TEST(StepArenaAllocatorTest, PlansAfterMatchingSteps) {
+  StepArenaPlanner planner(cpu_allocator());
+  RunStep(&planner);
+  RunStep(&planner);
+  EXPECT_TRUE(ServedFromArena(RunStep(&planner)));
+  EXPECT_TRUE(ServedFromArena(RunStep(&planner)));
+}
+
+TEST(StepArenaAllocatorTest, AllocationsOutliveStep) {
+  StepArenaPlanner planner(cpu_allocator());
+  RunStep(&planner);
+  RunStep(&planner);
+  StepArenaAllocator* raw_allocator;
+  char* a;
+  char* unplanned;
+  {
+    core::RefCountPtr<StepArenaAllocator> allocator = planner.StartStep();
+    ASSERT_NE(allocator, nullptr);
+    raw_allocator = allocator.get();
+    a = static_cast<char*>(
+        allocator->AllocateRaw(Allocator::kAllocatorAlignment, 1000));
+    unplanned = static_cast<char*>(
+        allocator->AllocateRaw(Allocator::kAllocatorAlignment, 123));
+    planner.EndStep(allocator.get(), OkStatus());
+  }
+  // The allocations keep the arena alive after the step.
+  memset(a, 1, 1000);
+  memset(unplanned, 1, 123);
+  StepPointers step = RunStep(&planner);
+  EXPECT_TRUE(ServedFromArena(step));
+  EXPECT_NE(step.a, a);
+  // Releases the last references on the allocator.
+  raw_allocator->DeallocateRaw(a);
+  raw_allocator->DeallocateRaw(unplanned);
+}
+
+TEST(StepArenaAllocatorTest, ConflictingSlotFallsBack) {
+  StepArenaPlanner planner(cpu_allocator());
+  RunStep(&planner);
+  RunStep(&planner);
+  core::RefCountPtr<StepArenaAllocator> allocator = planner.StartStep();
+  ASSERT_NE(allocator, nullptr);
+  void* a = allocator->AllocateRaw(Allocator::kAllocatorAlignment, 1000);
+  void* b = allocator->AllocateRaw(Allocator::kAllocatorAlignment, 2000);
+  // `a` is still in use, so `c` cannot take its slot.
+  void* c = allocator->AllocateRaw(Allocator::kAllocatorAlignment, 1000);
+  EXPECT_NE(c, a);
+  memset(a, 1, 1000);
+  memset(c, 3, 1000);
+  EXPECT_EQ(static_cast<char*>(a)[999], 1);
+  allocator->DeallocateRaw(a);
+  allocator->DeallocateRaw(b);
+  allocator->DeallocateRaw(c);
+  planner.EndStep(allocator.get(), OkStatus());
+}
+
+TEST(StepArenaAllocatorTest, ReplansWhenAllocationsChange) {
+  StepArenaPlanner planner(cpu_allocator());
+  RunStep(&planner);
+  RunStep(&planner);
+  EXPECT_TRUE(ServedFromArena(RunStep(&planner)));
+
+  // Most allocations fall back, which discards the plan.
+  RunStep(&planner, /*a_size=*/500);
+  RunStep(&planner, /*a_size=*/500);
+  RunStep(&planner, /*a_size=*/500);
+  EXPECT_TRUE(ServedFromArena(RunStep(&planner, /*a_size=*/500)));
+}
+
+TEST(StepArenaAllocatorTest, FailedStepsAreNotRecorded) {
+  StepArenaPlanner planner(cpu_allocator());
+  RunStep(&planner);
+  core::RefCountPtr<StepArenaAllocator> allocator = planner.StartStep();
+  ASSERT_NE(allocator, nullptr);
+  planner.EndStep(allocator.get(), errors::Internal("failed"));
+  RunStep(&planner);
+  EXPECT_TRUE(ServedFromArena(RunStep(&planner)));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,247 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/unary_op_fusion.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_join.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_def.pb.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace {
+
+// Returns the types for which each op can be part of a composition.
+//
+// WARN: This should be consistent with unary_ops_composition.cc.
+const absl::flat_hash_map<string, DataTypeVector>& SupportedOps() {
+  // clang-format off
+  static const auto* supported_ops =
+      new absl::flat_hash_map<string, DataTypeVector>({
+          // Ops defined via Eigen scalar ops.
+          {"Abs",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Acos",       {DT_FLOAT,          DT_DOUBLE}},
+          {"Acosh",      {DT_FLOAT,          DT_DOUBLE}},
+          {"Asin",       {DT_FLOAT,          DT_DOUBLE}},
+          {"Asinh",      {DT_FLOAT,          DT_DOUBLE}},
+          {"Atan",       {DT_FLOAT,          DT_DOUBLE}},
+          {"Atanh",      {DT_FLOAT,          DT_DOUBLE}},
+          {"Ceil",       {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Cos",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Cosh",       {DT_FLOAT,          DT_DOUBLE}},
+          {"Expm1",      {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Exp",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Floor",      {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Inv",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Log",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Log1p",      {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Neg",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Reciprocal", {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Rint",       {DT_FLOAT,          DT_DOUBLE}},
+          {"Round",      {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Rsqrt",      {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Sigmoid",    {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Sin",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Sinh",       {DT_FLOAT,          DT_DOUBLE}},
+          {"Sqrt",       {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Square",     {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Tan",        {DT_FLOAT,          DT_DOUBLE}},
+          {"Tanh",       {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          // Additional ops that are not part of the Eigen.
+          {"Elu",        {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Relu",       {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Relu6",      {DT_FLOAT, DT_HALF, DT_DOUBLE}},
+          {"Selu",       {DT_FLOAT, DT_HALF, DT_DOUBLE}}});
+  // clang-format on
+  return *supported_ops;
+}
+
+// Returns true and sets `*dtype` to the type of "n" if it can be part of a
+// composition.
+bool IsFusible(const Node* n, DataType* dtype) {
+  if (!n->IsOp() || n->num_inputs() != 1 || n->num_outputs() != 1) {
+    return false;
+  }
+  auto it = SupportedOps().find(n->type_string());
+  if (it == SupportedOps().end()) {
+    return false;
+  }
+  return TryGetNodeAttr(n->attrs(), "T", dtype) &&
+         absl::c_linear_search(it->second, *dtype);
+}
+
+bool HasControlInputs(const Node* n) {
+  for (const Edge* e : n->in_edges()) {
+    if (e->IsControlEdge() && !e->src()->IsSource()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the only consumer of the output of "n", or nullptr if "n" has no
+// consumers, several consumers or outgoing control edges.
+Node* SoleConsumer(const Node* n) {
+  Node* consumer = nullptr;
+  for (const Edge* e : n->out_edges()) {
+    if (e->dst()->IsSink()) {
+      continue;
+    }
+    if (e->IsControlEdge() || consumer != nullptr) {
+      return nullptr;
+    }
+    consumer = e->dst();
+  }
+  return consumer;
+}
+
+// A chain of unary ops, in evaluation order, and the composition that
+// replaces it.
+struct ChainFusion {
+  std::vector<Node*> chain;
+  NodeDef composition;
+};
+
+// Builds and validates the composition of "fusion->chain" without mutating
+// "graph", so that a failure leaves "graph" as it was.
+Status PrepareChainFusion(const Graph& graph, ChainFusion* fusion) {
+  const Node* head = fusion->chain.front();
+  const Node* tail = fusion->chain.back();
+  const Edge* input_edge;
+  TF_RETURN_IF_ERROR(head->input_edge(0, &input_edge));
+  DataType dtype;
+  TF_RETURN_IF_ERROR(GetNodeAttr(head->attrs(), "T", &dtype));
+  std::vector<string> op_names;
+  op_names.reserve(fusion->chain.size());
+  for (const Node* n : fusion->chain) {
+    op_names.push_back(n->type_string());
+  }
+
+  const OpDef* op_def;
+  TF_RETURN_IF_ERROR(
+      graph.op_registry()->LookUpOpDef("_UnaryOpsComposition", &op_def));
+  TF_RETURN_IF_ERROR(
+      NodeDefBuilder(strings::StrCat(tail->name(), "/unary_ops_composition"),
+                     op_def)
+          .Input(input_edge->src()->name(), input_edge->src_output(), dtype)
+          .Attr("T", dtype)
+          .Attr("op_names", op_names)
+          .Device(tail->requested_device())
+          .Finalize(&fusion->composition));
+  return ValidateNodeDef(fusion->composition, *op_def);
+}
+
+// Replaces the nodes of "fusion.chain" with the prepared composition.
+Status ReplaceChain(Graph* graph, const ChainFusion& fusion) {
+  Node* head = fusion.chain.front();
+  Node* tail = fusion.chain.back();
+  VLOG(2) << "Fuse unary ops: root=" << tail->name() << " op_names=["
+          << absl::StrJoin(fusion.chain, ", ",
+                           [](string* out, const Node* n) {
+                             out->append(n->type_string());
+                           })
+          << "]";
+
+  // The input is looked up again, as it is the composition of another chain if
+  // that chain ended with the former input.
+  const Edge* input_edge;
+  TF_RETURN_IF_ERROR(head->input_edge(0, &input_edge));
+  Status status;
+  Node* composition = graph->AddNode(fusion.composition, &status);
+  TF_RETURN_IF_ERROR(status);
+  composition->set_assigned_device_name(tail->assigned_device_name());
+  graph->AddEdge(input_edge->src(), input_edge->src_output(), composition, 0);
+  for (const Edge* e : head->in_edges()) {
+    if (e->IsControlEdge()) {
+      graph->AddControlEdge(e->src(), composition);
+    }
+  }
+  std::vector<const Edge*> out_edges(tail->out_edges().begin(),
+                                     tail->out_edges().end());
+  for (const Edge* e : out_edges) {
+    if (e->IsControlEdge()) {
+      graph->AddControlEdge(composition, e->dst());
+    } else {
+      TF_RETURN_IF_ERROR(
+          graph->UpdateEdge(composition, 0, e->dst(), e->dst_input()));
+    }
+  }
+  for (Node* n : fusion.chain) {
+    graph->RemoveNode(n);
+  }
+  return OkStatus();
+}
+
+}  // namespace
+
+Status FuseUnaryOpChains(Graph* graph, bool* was_mutated) {
+  *was_mutated = false;
+  std::vector<Node*> order;
+  GetReversePostOrder(*graph, &order);
+
+  // Visiting the nodes in topological order makes every chain start at its
+  // first op.
+  std::vector<ChainFusion> fusions;
+  absl::flat_hash_set<const Node*> fused;
+  for (Node* n : order) {
+    DataType dtype;
+    if (fused.contains(n) || !IsFusible(n, &dtype)) {
+      continue;
+    }
+    std::vector<Node*> chain = {n};
+    for (Node* next = SoleConsumer(n); next != nullptr;
+         next = SoleConsumer(next)) {
+      DataType next_dtype;
+      if (!IsFusible(next, &next_dtype) || next_dtype != dtype ||
+          HasControlInputs(next) ||
+          next->assigned_device_name() != n->assigned_device_name()) {
+        break;
+      }
+      chain.push_back(next);
+    }
+    if (chain.size() < 2) {
+      continue;
+    }
+    fused.insert(chain.begin(), chain.end());
+    fusions.emplace_back();
+    fusions.back().chain = std::move(chain);
+  }
+
+  // Every composition is validated before the first chain is replaced, so
+  // that an error does not leave "graph" partially rewritten.
+  for (ChainFusion& fusion : fusions) {
+    TF_RETURN_IF_ERROR(PrepareChainFusion(*graph, &fusion));
+  }
+  for (const ChainFusion& fusion : fusions) {
+    TF_RETURN_IF_ERROR(ReplaceChain(graph, fusion));
+    *was_mutated = true;
+  }
+  return OkStatus();
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,39 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_UNARY_OP_FUSION_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_UNARY_OP_FUSION_H_
+
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/platform/status.h"
+
+namespace tensorflow {
+
+// Replaces each chain of two or more element-wise unary ops (e.g.
+// Neg -> Exp -> Sigmoid) in "graph", in which every op but the last has no
+// other consumers, with a single _UnaryOpsComposition node. The composition
+// evaluates the whole chain in one pass over its input, without allocating the
+// intermediate tensors or dispatching the intermediate kernels.
+//
+// All nodes of "graph" are assumed to execute on a CPU device, e.g. because it
+// is a partition of a placed graph. Ops with control dependencies between the
+// first and last op of a chain are not fused.
+//
+// Sets `was_mutated` to true if and only if "graph" has been mutated.
+Status FuseUnaryOpChains(Graph* graph, bool* was_mutated);
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_UNARY_OP_FUSION_H_
@@ -0,0 +1,218 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/common_runtime/unary_op_fusion.h"
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/cc/framework/scope.h"
+#include "tensorflow/cc/ops/standard_ops.h"
+#include "tensorflow/core/common_runtime/graph_constructor.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_def.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace {
+
+// Returns the _UnaryOpsComposition nodes of "graph".
+std::vector<const Node*> Compositions(const Graph& graph) {
+  std::vector<const Node*> compositions;
+  for (const Node* n : graph.op_nodes()) {
+    if (n->type_string() == "_UnaryOpsComposition") {
+      compositions.push_back(n);
+    }
+  }
+  return compositions;
+}
+
+std::vector<string> OpNames(const Node* n) {
+  std::vector<string> op_names;
+  TF_CHECK_OK(GetNodeAttr(n->attrs(), "op_names", &op_names));
+  return op_names;
+}
+
+const Node* Input(const Node* n) {
+  const Node* input;
+  TF_CHECK_OK(n->input_node(0, &input));
+  return input;
+}
+
+TEST(UnaryOpFusionTest, FusesChain) {
+  Scope root = Scope::NewRootScope();
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_FLOAT);
+  auto neg = ops::Neg(root.WithOpName("neg"), x);
+  auto exp = ops::Exp(root.WithOpName("exp"), neg);
+  auto tanh = ops::Tanh(root.WithOpName("tanh"), exp);
+  auto out = ops::Identity(root.WithOpName("out"), tanh);
+  Graph graph(OpRegistry::Global());
+  TF_ASSERT_OK(root.ToGraph(&graph));
+
+  bool was_mutated;
+  TF_ASSERT_OK(FuseUnaryOpChains(&graph, &was_mutated));
+  EXPECT_TRUE(was_mutated);
+
+  std::vector<const Node*> compositions = Compositions(graph);
+  ASSERT_EQ(compositions.size(), 1);
+  const Node* composition = compositions[0];
+  EXPECT_EQ(composition->name(), "tanh/unary_ops_composition");
+  EXPECT_EQ(OpNames(composition),
+            std::vector<string>({"Neg", "Exp", "Tanh"}));
+  EXPECT_EQ(Input(composition)->name(), "x");
+  for (const Node* n : graph.op_nodes()) {
+    if (n->name() == "out") {
+      EXPECT_EQ(Input(n), composition);
+    }
+  }
+  EXPECT_EQ(graph.num_op_nodes(), 3);
+}
+
+TEST(UnaryOpFusionTest, ChainsEndAtOpsWithSeveralConsumers) {
+  Scope root = Scope::NewRootScope();
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_FLOAT);
+  auto neg = ops::Neg(root.WithOpName("neg"), x);
+  auto exp = ops::Exp(root.WithOpName("exp"), neg);
+  auto sqrt = ops::Sqrt(root.WithOpName("sqrt"), neg);
+  auto tanh = ops::Tanh(root.WithOpName("tanh"), exp);
+  auto sigmoid = ops::Sigmoid(root.WithOpName("sigmoid"), tanh);
+  auto out1 = ops::Identity(root.WithOpName("out1"), sigmoid);
+  auto out2 = ops::Identity(root.WithOpName("out2"), sqrt);
+  Graph graph(OpRegistry::Global());
+  TF_ASSERT_OK(root.ToGraph(&graph));
+
+  bool was_mutated;
+  TF_ASSERT_OK(FuseUnaryOpChains(&graph, &was_mutated));
+  EXPECT_TRUE(was_mutated);
+
+  // "neg" has two consumers, so only the chain after "exp" is fused.
+  std::vector<const Node*> compositions = Compositions(graph);
+  ASSERT_EQ(compositions.size(), 1);
+  EXPECT_EQ(OpNames(compositions[0]),
+            std::vector<string>({"Exp", "Tanh", "Sigmoid"}));
+  EXPECT_EQ(Input(compositions[0])->name(), "neg");
+}
+
+TEST(UnaryOpFusionTest, DoesNotFuseUnsupportedOps) {
+  Scope root = Scope::NewRootScope();
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_INT32);
+  auto neg = ops::Neg(root.WithOpName("neg"), x);
+  auto abs = ops::Abs(root.WithOpName("abs"), neg);
+  auto y = ops::Placeholder(root.WithOpName("y"), DT_FLOAT);
+  auto exp = ops::Exp(root.WithOpName("exp"), y);
+  auto log = ops::Log(root.WithOpName("log").WithControlDependencies(abs), exp);
+  auto out1 = ops::Identity(root.WithOpName("out1"), abs);
+  auto out2 = ops::Identity(root.WithOpName("out2"), log);
+  Graph graph(OpRegistry::Global());
+  TF_ASSERT_OK(root.ToGraph(&graph));
+
+  // The int32 chain is not supported, and "log" has a control input.
+  bool was_mutated;
+  TF_ASSERT_OK(FuseUnaryOpChains(&graph, &was_mutated));
+  EXPECT_FALSE(was_mutated);
+  EXPECT_TRUE(Compositions(graph).empty());
+}
+
+TEST(UnaryOpFusionTest, FailureLeavesGraphUnchanged) {
+  Scope root = Scope::NewRootScope();
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_FLOAT);
+  auto neg = ops::Neg(root.WithOpName("neg"), x);
+  auto exp = ops::Exp(root.WithOpName("exp"), neg);
+  auto y = ops::Placeholder(root.WithOpName("y"), DT_FLOAT);
+  auto sin = ops::Sin(root.WithOpName("sin"), y);
+  auto cos = ops::Cos(root.WithOpName("cos"), sin);
+  auto out1 = ops::Identity(root.WithOpName("out1"), exp);
+  auto out2 = ops::Identity(root.WithOpName("out2"), cos);
+  GraphDef graph_def;
+  TF_ASSERT_OK(root.ToGraphDef(&graph_def));
+
+  // The graph's registry does not know _UnaryOpsComposition.
+  OpList op_list;
+  for (const string& op : {"Placeholder", "Neg", "Exp", "Sin", "Cos",
+                           "Identity"}) {
+    const OpDef* op_def;
+    TF_ASSERT_OK(OpRegistry::Global()->LookUpOpDef(op, &op_def));
+    *op_list.add_op() = *op_def;
+  }
+  OpListOpRegistry op_registry(&op_list);
+  Graph graph(&op_registry);
+  TF_ASSERT_OK(ConvertGraphDefToGraph(GraphConstructorOptions(), graph_def,
+                                      &graph));
+  const int num_nodes = graph.num_nodes();
+
+  bool was_mutated;
+  EXPECT_FALSE(FuseUnaryOpChains(&graph, &was_mutated).ok());
+  EXPECT_FALSE(was_mutated);
+  EXPECT_EQ(graph.num_nodes(), num_nodes);
+  EXPECT_TRUE(Compositions(graph).empty());
+}
+
+TEST(UnaryOpFusionTest, FusedChainInSession) {
+  Scope root = Scope::NewRootScope();
+  auto x = ops::Placeholder(root.WithOpName("x"), DT_FLOAT);
+  auto neg = ops::Neg(root.WithOpName("neg"), x);
+  auto exp = ops::Exp(root.WithOpName("exp"), neg);
+  auto sigmoid = ops::Sigmoid(root.WithOpName("sigmoid"), exp);
+  GraphDef graph_def;
+  TF_ASSERT_OK(root.ToGraphDef(&graph_def));
+
+  SessionOptions options;
+  OptimizerOptions* optimizer_options =
+      options.config.mutable_graph_options()->mutable_optimizer_options();
+  optimizer_options->set_opt_level(OptimizerOptions::L0);
+  optimizer_options->set_do_unary_op_fusion(true);
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_ASSERT_OK(session->Create(graph_def));
+
+  // Large enough to span several cache-sized slices of the kernel.
+  constexpr int kNumElements = 100000;
+  Tensor x_tensor(DT_FLOAT, TensorShape({kNumElements}));
+  Tensor expected(DT_FLOAT, TensorShape({kNumElements}));
+  for (int i = 0; i < kNumElements; ++i) {
+    const float value = (i % 200 - 100) / 50.0f;
+    x_tensor.flat<float>()(i) = value;
+    expected.flat<float>()(i) = 1.0f / (1.0f + std::exp(-std::exp(-value)));
+  }
+
+  RunOptions run_options;
+  run_options.set_output_partition_graphs(true);
+  RunMetadata run_metadata;
+  std::vector<Tensor> outputs;
+  TF_ASSERT_OK(session->Run(run_options, {{"x", x_tensor}}, {"sigmoid"}, {},
+                            &outputs, &run_metadata));
+  ASSERT_EQ(outputs.size(), 1);
+  test::ExpectClose(outputs[0], expected);
+
+  int num_compositions = 0;
+  for (const GraphDef& partition : run_metadata.partition_graphs()) {
+    for (const NodeDef& node : partition.node()) {
+      num_compositions += node.op() == "_UnaryOpsComposition";
+    }
+  }
+  EXPECT_EQ(num_compositions, 1);
+}
+
+}  // namespace
+}  // namespace tensorflow
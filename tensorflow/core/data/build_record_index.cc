@@ -0,0 +1,79 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Builds record index sidecars for existing TFRecord files, which lets
+// `TFRecordDataset` skip records and restore iterators without scanning the
+// files from the start.
+//
+// Usage: build_record_index [--compression_type=GZIP] file1.tfrecord ...
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/command_line_flags.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+int Main(int argc, char** argv) {
+  string compression_type;
+  std::vector<Flag> flag_list = {
+      Flag("compression_type", &compression_type,
+           "Compression of the TFRecord files: \"\", \"ZLIB\", \"GZIP\" or "
+           "\"SNAPPY\"."),
+  };
+  const string usage = Flags::Usage(argv[0], flag_list);
+  const bool parse_result = Flags::Parse(&argc, argv, flag_list);
+  if (!parse_result || argc < 2) {
+    std::cerr << "Writes <file>" << io::RecordIndexFilename("")
+              << " next to every given TFRecord file.\n\n"
+              << "Usage: " << argv[0] << " [flags] <file>...\n"
+              << usage;
+    return 1;
+  }
+  port::InitMain(argv[0], &argc, &argv);
+
+  Env* env = Env::Default();
+  const io::RecordReaderOptions options =
+      io::RecordReaderOptions::CreateRecordReaderOptions(compression_type);
+  int num_failures = 0;
+  for (int i = 1; i < argc; ++i) {
+    const string filename = argv[i];
+    Status s = io::BuildRecordIndex(env, filename, options,
+                                    io::RecordIndexFilename(filename));
+    if (!s.ok()) {
+      LOG(ERROR) << "Failed to build the record index of " << filename << ": "
+                 << s;
+      ++num_failures;
+      continue;
+    }
+    LOG(INFO) << "Wrote " << io::RecordIndexFilename(filename);
+  }
+  return num_failures == 0 ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
+
+int main(int argc, char** argv) {
+  return tensorflow::data::Main(argc, argv);
+}
@@ -140,6 +140,13 @@ struct InstantiateCapturedFunctionParams {
     runner = ctx->runner();
   }
 
+  explicit InstantiateCapturedFunctionParams(AnyContext ctx)
+      : InstantiateCapturedFunctionParams(
+            ctx.iterator_context() != nullptr
+                ? InstantiateCapturedFunctionParams(ctx.iterator_context())
+                : InstantiateCapturedFunctionParams(ctx.op_kernel_context())) {
+  }
+
   FunctionLibraryRuntime* flr;
   FunctionHandleCache* function_handle_cache;
   std::function<void(std::function<void()>)>* runner;
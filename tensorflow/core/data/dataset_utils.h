@@ -295,6 +295,11 @@ struct CopyBatchParams {
     runner = ctx->runner();
     runner_threadpool_size = GetRunnerThreadpoolSizeFromOpKernelContext(ctx);
   }
+
+  explicit CopyBatchParams(AnyContext ctx)
+      : CopyBatchParams(ctx.iterator_context() != nullptr
+                            ? CopyBatchParams(ctx.iterator_context())
+                            : CopyBatchParams(ctx.op_kernel_context())) {}
 };
 
 // Copies the input elements to a batch.
@@ -0,0 +1,136 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/data/numa_thread_pools.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
+#include "tensorflow/core/platform/strcat.h"
+
+namespace tensorflow {
+namespace data {
+
+namespace {
+
+std::atomic<NumaThreadPools*> global_pools_for_testing{nullptr};
+
+// Creates pools with `num_threads` threads in total, or with as many threads
+// as cores if `num_threads` is not positive or exceeds them. Returns nullptr if the host has
+// a single NUMA node or NUMA is not supported.
+NumaThreadPools* CreateGlobalPools(int num_threads) {
+  const int num_nodes = port::NUMANumNodes();
+  if (num_nodes <= 1 || !port::NUMAEnabled()) {
+    return nullptr;
+  }
+  std::vector<int> cores_per_node(num_nodes);
+  int num_cores = 0;
+  for (int node = 0; node < num_nodes; ++node) {
+    cores_per_node[node] = std::max(1, port::MaxParallelism(node));
+    num_cores += cores_per_node[node];
+  }
+  const int budget =
+      num_threads > 0 ? std::min(num_threads, num_cores) : num_cores;
+  std::vector<int> threads_per_node(num_nodes);
+  for (int node = 0; node < num_nodes; ++node) {
+    threads_per_node[node] =
+        std::max(1, budget * cores_per_node[node] / num_cores);
+  }
+  return new NumaThreadPools(Env::Default(),
+                             strings::StrCat("tf_data_numa_", budget),
+                             threads_per_node);
+}
+
+}  // namespace
+
+NumaThreadPools* NumaThreadPools::Global(int num_threads) {
+  NumaThreadPools* pools_for_testing = global_pools_for_testing.load();
+  if (pools_for_testing != nullptr) {
+    return pools_for_testing;
+  }
+  static mutex* mu = new mutex();
+  // The pools are never destroyed, since iterators may run until the process
+  // exits.
+  static auto* pools_by_budget =
+      new absl::flat_hash_map<int, NumaThreadPools*>();
+  // Budgets of at least as many threads as cores share the same pools.
+  if (num_threads <= 0 || num_threads >= port::MaxParallelism()) {
+    num_threads = 0;
+  }
+  mutex_lock l(*mu);
+  auto it = pools_by_budget->find(num_threads);
+  if (it == pools_by_budget->end()) {
+    it = pools_by_budget->emplace(num_threads, CreateGlobalPools(num_threads))
+             .first;
+  }
+  return it->second;
+}
+
+void NumaThreadPools::SetGlobalForTesting(NumaThreadPools* pools) {
+  global_pools_for_testing.store(pools);
+}
+
+NumaThreadPools::NumaThreadPools(Env* env, const std::string& name,
+                                 const std::vector<int>& threads_per_node) {
+  nodes_.reserve(threads_per_node.size());
+  for (size_t node = 0; node < threads_per_node.size(); ++node) {
+    ThreadOptions options;
+    options.numa_node = node;
+    auto n = std::make_unique<Node>();
+    n->pool = std::make_unique<thread::ThreadPool>(
+        env, options, strings::StrCat(name, "_", node),
+        threads_per_node[node]);
+    n->first_thread_id = num_threads_;
+    num_threads_ += n->pool->NumThreads();
+    nodes_.push_back(std::move(n));
+  }
+}
+
+int NumaThreadPools::CurrentThreadId() const {
+  for (const auto& node : nodes_) {
+    const int id = node->pool->CurrentThreadId();
+    if (id >= 0) {
+      return node->first_thread_id + id;
+    }
+  }
+  return -1;
+}
+
+void NumaThreadPools::Schedule(std::function<void()> fn) {
+  // Starts the search at a different node each time, so that nodes with the
+  // same load take turns.
+  const int64_t start = next_node_++;
+  Node* node = nodes_[start % NumNodes()].get();
+  for (int i = 1; i < NumNodes(); ++i) {
+    Node* other = nodes_[(start + i) % NumNodes()].get();
+    if (other->load.load(std::memory_order_relaxed) <
+        node->load.load(std::memory_order_relaxed)) {
+      node = other;
+    }
+  }
+  node->load.fetch_add(1, std::memory_order_relaxed);
+  node->pool->Schedule([node, fn = std::move(fn)]() {
+    fn();
+    node->load.fetch_sub(1, std::memory_order_relaxed);
+  });
+}
+
+}  // namespace data
+}  // namespace tensorflow
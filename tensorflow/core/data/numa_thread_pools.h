@@ -0,0 +1,88 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_NUMA_THREAD_POOLS_H_
+#define TENSORFLOW_CORE_DATA_NUMA_THREAD_POOLS_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+
+// Runs closures on one thread pool per NUMA node, whose threads are bound to
+// that node. Each closure is queued on the node with the fewest queued and
+// running closures, and then only runs on the threads of that node, which
+// take work from each other when they run out of their own. Balancing the
+// nodes when closures are scheduled, rather than letting idle nodes run the
+// closures queued on busy ones, keeps each closure and the memory it touches
+// on one node.
+class NumaThreadPools {
+ public:
+  // Returns the pools shared by the tf.data iterators of the process that run
+  // closures which would otherwise run on an inter-op thread pool of
+  // `num_threads` threads. The pools have that many threads in total, but no
+  // more than there are cores, split across the nodes in proportion to their
+  // schedulable cores, so iterators with different thread budgets get
+  // different pools. Returns nullptr if the
+  // host has a single NUMA node or NUMA is not supported.
+  static NumaThreadPools* Global(int num_threads);
+
+  // Makes `Global` return `pools` instead, or restores the default if `pools`
+  // is nullptr. Does not take ownership.
+  static void SetGlobalForTesting(NumaThreadPools* pools);
+
+  // Creates pools with `threads_per_node[i]` threads bound to node `i`.
+  NumaThreadPools(Env* env, const std::string& name,
+                  const std::vector<int>& threads_per_node);
+
+  int NumNodes() const { return nodes_.size(); }
+
+  // Returns the number of threads of all nodes.
+  int NumThreads() const { return num_threads_; }
+
+  // Returns the index, in [0, NumThreads()), of the calling thread among the
+  // threads of all nodes, or -1 if it is not one of them.
+  int CurrentThreadId() const;
+
+  void Schedule(std::function<void()> fn);
+
+  // Returns the number of closures scheduled so far.
+  int64_t NumScheduled() const { return next_node_; }
+
+ private:
+  struct Node {
+    // Closures scheduled on the node that have not finished. Declared before
+    // `pool`, whose destruction runs the closures that are still queued.
+    std::atomic<int64_t> load{0};
+    std::unique_ptr<thread::ThreadPool> pool;
+    // Index of the first thread of the node among the threads of all nodes.
+    int first_thread_id = 0;
+  };
+
+  std::vector<std::unique_ptr<Node>> nodes_;
+  int num_threads_ = 0;
+  std::atomic<int64_t> next_node_{0};
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_NUMA_THREAD_POOLS_H_
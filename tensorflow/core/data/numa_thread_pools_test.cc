@@ -0,0 +1,117 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/data/numa_thread_pools.h"
+
+#include <atomic>
+
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+TEST(NumaThreadPools, RunsAllClosures) {
+  NumaThreadPools pools(Env::Default(), "test", {2, 2});
+  EXPECT_EQ(pools.NumNodes(), 2);
+  const int kNumClosures = 1000;
+  std::atomic<int> num_runs(0);
+  BlockingCounter counter(kNumClosures);
+  for (int i = 0; i < kNumClosures; ++i) {
+    pools.Schedule([&num_runs, &counter]() {
+      ++num_runs;
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  EXPECT_EQ(num_runs, kNumClosures);
+}
+
+TEST(NumaThreadPools, ThreadIds) {
+  NumaThreadPools pools(Env::Default(), "test", {1, 2});
+  EXPECT_EQ(pools.NumThreads(), 3);
+  EXPECT_EQ(pools.CurrentThreadId(), -1);
+  const int kNumClosures = 100;
+  std::atomic<bool> ids_in_range(true);
+  BlockingCounter counter(kNumClosures);
+  for (int i = 0; i < kNumClosures; ++i) {
+    pools.Schedule([&pools, &ids_in_range, &counter]() {
+      const int id = pools.CurrentThreadId();
+      if (id < 0 || id >= pools.NumThreads()) {
+        ids_in_range = false;
+      }
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  EXPECT_TRUE(ids_in_range);
+}
+
+TEST(NumaThreadPools, SchedulesOnLeastLoadedNode) {
+  NumaThreadPools pools(Env::Default(), "test", {1, 1});
+  // The closures block until they are all scheduled, so each is scheduled on
+  // the node with fewer of them.
+  const int kNumClosures = 10;
+  Notification unblock;
+  std::atomic<int> num_runs_on_node_0(0);
+  BlockingCounter counter(kNumClosures);
+  for (int i = 0; i < kNumClosures; ++i) {
+    pools.Schedule([&pools, &unblock, &num_runs_on_node_0, &counter]() {
+      unblock.WaitForNotification();
+      if (pools.CurrentThreadId() == 0) {
+        ++num_runs_on_node_0;
+      }
+      counter.DecrementCount();
+    });
+  }
+  unblock.Notify();
+  counter.Wait();
+  EXPECT_EQ(num_runs_on_node_0, kNumClosures / 2);
+}
+
+TEST(NumaThreadPools, BlockedNodeKeepsItsClosures) {
+  NumaThreadPools pools(Env::Default(), "test", {1, 1});
+  // Blocks the only thread of node 0.
+  Notification unblock_first;
+  pools.Schedule([&unblock_first]() { unblock_first.WaitForNotification(); });
+  // Goes to node 1, which has nothing scheduled.
+  Notification unblock_second;
+  Notification second_done;
+  pools.Schedule([&unblock_second, &second_done]() {
+    unblock_second.WaitForNotification();
+    second_done.Notify();
+  });
+  // Both nodes have one closure, so this one is queued on node 0 behind the
+  // blocked closure, and must not be run by node 1 once that is idle.
+  Notification third_done;
+  std::atomic<int> third_thread_id(-1);
+  pools.Schedule([&pools, &third_done, &third_thread_id]() {
+    third_thread_id = pools.CurrentThreadId();
+    third_done.Notify();
+  });
+  unblock_second.Notify();
+  second_done.WaitForNotification();
+  EXPECT_FALSE(WaitForNotificationWithTimeout(&third_done,
+                                              /*timeout_in_us=*/100000));
+  unblock_first.Notify();
+  third_done.WaitForNotification();
+  EXPECT_EQ(third_thread_id, 0);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
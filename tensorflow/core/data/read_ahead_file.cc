@@ -0,0 +1,195 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/read_ahead_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "tensorflow/core/platform/errors.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// Number of threads that issue reads for all read-ahead files in the process.
+// The threads mostly block on I/O, so this is not tied to the number of cores.
+constexpr int kNumReadAheadThreads = 16;
+
+}  // namespace
+
+ReadAheadRandomAccessFile::ReadAheadRandomAccessFile(
+    Env* env, std::unique_ptr<RandomAccessFile> file, int64_t block_size,
+    int num_outstanding_reads)
+    : env_(env),
+      file_(std::move(file)),
+      block_size_(std::max<int64_t>(block_size, 1)),
+      num_outstanding_reads_(std::max(num_outstanding_reads, 1)) {}
+
+ReadAheadRandomAccessFile::~ReadAheadRandomAccessFile() {
+  // Waits for in-flight reads before the window and `file_` go away.
+  mutex_lock l(mu_);
+  while (num_in_flight_reads_ > 0) {
+    cond_var_.wait(l);
+  }
+}
+
+thread::ThreadPool* ReadAheadRandomAccessFile::SharedThreadPool(Env* env) {
+  static thread::ThreadPool* thread_pool = new thread::ThreadPool(
+      env, ThreadOptions(), "tf_data_read_ahead", kNumReadAheadThreads,
+      /*low_latency_hint=*/false);
+  return thread_pool;
+}
+
+Status ReadAheadRandomAccessFile::Name(StringPiece* result) const {
+  return file_->Name(result);
+}
+
+Status ReadAheadRandomAccessFile::Read(uint64 offset, size_t n,
+                                       StringPiece* result,
+                                       char* scratch) const {
+  size_t bytes_read = 0;
+  while (bytes_read < n) {
+    std::shared_ptr<Block> block;
+    StringPiece data;
+    Status s =
+        ReadFromBlock(offset + bytes_read, n - bytes_read, &block, &data);
+    if (!s.ok()) {
+      *result = StringPiece(scratch, bytes_read);
+      return errors::IsOutOfRange(s)
+                 ? errors::OutOfRange("Reached end of file after reading ",
+                                      bytes_read, " of ", n,
+                                      " requested bytes")
+                 : s;
+    }
+    memcpy(scratch + bytes_read, data.data(), data.size());
+    bytes_read += data.size();
+  }
+  *result = StringPiece(scratch, bytes_read);
+  return OkStatus();
+}
+
+#if defined(TF_CORD_SUPPORT)
+Status ReadAheadRandomAccessFile::Read(uint64 offset, size_t n,
+                                       absl::Cord* cord) const {
+  size_t bytes_read = 0;
+  while (bytes_read < n) {
+    std::shared_ptr<Block> block;
+    StringPiece data;
+    Status s =
+        ReadFromBlock(offset + bytes_read, n - bytes_read, &block, &data);
+    if (!s.ok()) {
+      return errors::IsOutOfRange(s)
+                 ? errors::OutOfRange("Reached end of file after reading ",
+                                      bytes_read, " of ", n,
+                                      " requested bytes")
+                 : s;
+    }
+    // The cord keeps the block alive instead of copying out of it.
+    cord->Append(absl::MakeCordFromExternal(
+        absl::string_view(data.data(), data.size()),
+        [block](absl::string_view) {}));
+    bytes_read += data.size();
+  }
+  return OkStatus();
+}
+#endif
+
+Status ReadAheadRandomAccessFile::ReadFromBlock(uint64 position, size_t n,
+                                                std::shared_ptr<Block>* block,
+                                                StringPiece* data) const {
+  {
+    mutex_lock l(mu_);
+    while (!window_.empty() &&
+           window_.front()->offset + block_size_ <= position) {
+      window_.pop_front();
+    }
+    if (window_.empty() || window_.front()->offset > position) {
+      ResetWindowLocked(position);
+    }
+    ScheduleReadsLocked();
+    *block = window_.front();
+  }
+
+  // Waits without holding `mu_`, so that other readers of this file and the
+  // completion of other block reads are not held up.
+  Block& current = **block;
+  current.done.WaitForNotification();
+  if (!current.status.ok() && !errors::IsOutOfRange(current.status)) {
+    // Drop the failed block so that a retry re-issues the read.
+    mutex_lock l(mu_);
+    if (std::find(window_.begin(), window_.end(), *block) != window_.end()) {
+      window_.clear();
+    }
+    return current.status;
+  }
+  const uint64 offset_in_block = position - current.offset;
+  if (offset_in_block >= current.data.size()) {
+    return errors::OutOfRange("Reached end of file");
+  }
+  const size_t size =
+      std::min<size_t>(n, current.data.size() - offset_in_block);
+  *data = StringPiece(current.data.data() + offset_in_block, size);
+  return OkStatus();
+}
+
+void ReadAheadRandomAccessFile::ResetWindowLocked(uint64 offset) const {
+  // In-flight blocks hold their own reference and are dropped when done.
+  window_.clear();
+  next_block_offset_ = offset - offset % block_size_;
+  end_of_file_ = false;
+}
+
+void ReadAheadRandomAccessFile::ScheduleReadsLocked() const {
+  while (!end_of_file_ &&
+         window_.size() < static_cast<size_t>(num_outstanding_reads_)) {
+    auto block = std::make_shared<Block>(next_block_offset_);
+    next_block_offset_ += block_size_;
+    window_.push_back(block);
+    ++num_in_flight_reads_;
+    SharedThreadPool(env_)->Schedule([this, block]() { ReadBlock(block); });
+  }
+}
+
+void ReadAheadRandomAccessFile::ReadBlock(std::shared_ptr<Block> block) const {
+  std::string data;
+  data.resize(block_size_);
+  StringPiece read_result;
+  Status status =
+      file_->Read(block->offset, block_size_, &read_result, &data[0]);
+  if (read_result.data() != data.data()) {
+    // Some file systems return a view into their own buffers.
+    data.assign(read_result.data(), read_result.size());
+  } else {
+    data.resize(read_result.size());
+  }
+
+  block->data = std::move(data);
+  block->status = std::move(status);
+  block->done.Notify();
+
+  mutex_lock l(mu_);
+  // Blocks from a discarded window must not stop reads in the current one.
+  if (errors::IsOutOfRange(block->status) &&
+      std::find(window_.begin(), window_.end(), block) != window_.end()) {
+    end_of_file_ = true;
+  }
+  --num_in_flight_reads_;
+  cond_var_.notify_all();
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,126 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_READ_AHEAD_FILE_H_
+#define TENSORFLOW_CORE_DATA_READ_AHEAD_FILE_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/cord.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/stringpiece.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace data {
+
+// A `RandomAccessFile` that keeps up to `num_outstanding_reads` reads of
+// `block_size` bytes in flight ahead of the current read position, so that
+// sequential readers (e.g. `io::SequentialRecordReader`) do not block on one
+// read at a time.
+//
+// Reads are issued against the wrapped file on a thread pool that is shared by
+// all read-ahead files in the process, so the number of I/O threads does not
+// grow with the number of open files. A read that is not contiguous with the
+// previous one discards the read-ahead window and restarts it at the new
+// position, so random access is still correct but does not benefit from
+// read-ahead.
+//
+// The file only moves bytes: record framing and CRC checks are left to the
+// reader on top of it, which also still hands out one record at a time.
+//
+// `Read` into a cord appends the buffered blocks to the cord without copying
+// them. `Read` into `scratch` copies out of the blocks, because the window may
+// drop a block while the caller still uses the result.
+//
+// At most `num_outstanding_reads * block_size` bytes are buffered at a time,
+// plus the blocks still referenced by cords. Destroying the file waits for its
+// outstanding reads to finish.
+class ReadAheadRandomAccessFile : public RandomAccessFile {
+ public:
+  ReadAheadRandomAccessFile(Env* env, std::unique_ptr<RandomAccessFile> file,
+                            int64_t block_size, int num_outstanding_reads);
+  ~ReadAheadRandomAccessFile() override;
+
+  Status Name(StringPiece* result) const override;
+
+  Status Read(uint64 offset, size_t n, StringPiece* result,
+              char* scratch) const override;
+
+#if defined(TF_CORD_SUPPORT)
+  Status Read(uint64 offset, size_t n, absl::Cord* cord) const override;
+#endif
+
+ private:
+  // A block of the file, read asynchronously. `data` and `status` are set
+  // before `done` is notified and are immutable afterwards.
+  struct Block {
+    explicit Block(uint64 offset) : offset(offset) {}
+
+    const uint64 offset;
+    std::string data;
+    Status status;
+    Notification done;
+  };
+
+  // Waits for the block containing `position` and sets `*data` to at most `n`
+  // of its bytes starting at `position`. `*data` points into `*block`. Returns
+  // OutOfRange if `position` is at or past the end of the file.
+  Status ReadFromBlock(uint64 position, size_t n,
+                       std::shared_ptr<Block>* block, StringPiece* data) const;
+
+  // Discards the read-ahead window and restarts it at the block containing
+  // `offset`.
+  void ResetWindowLocked(uint64 offset) const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Issues reads until `num_outstanding_reads_` blocks are buffered or in
+  // flight, or the end of the file has been reached.
+  void ScheduleReadsLocked() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Reads `block` from the underlying file. Runs on the shared thread pool.
+  void ReadBlock(std::shared_ptr<Block> block) const;
+
+  // Returns the thread pool shared by all read-ahead files.
+  static thread::ThreadPool* SharedThreadPool(Env* env);
+
+  Env* const env_;
+  const std::unique_ptr<RandomAccessFile> file_;
+  const uint64 block_size_;
+  const int num_outstanding_reads_;
+
+  mutable mutex mu_;
+  mutable condition_variable cond_var_;
+  // Blocks in file order, starting with the one containing the last read
+  // position.
+  mutable std::deque<std::shared_ptr<Block>> window_ TF_GUARDED_BY(mu_);
+  // Offset of the next block to schedule.
+  mutable uint64 next_block_offset_ TF_GUARDED_BY(mu_) = 0;
+  // Set once a block read hits the end of the file.
+  mutable bool end_of_file_ TF_GUARDED_BY(mu_) = false;
+  // Number of scheduled block reads, including those of discarded windows,
+  // that have not finished yet.
+  mutable int64_t num_in_flight_reads_ TF_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_READ_AHEAD_FILE_H_
@@ -0,0 +1,236 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/read_ahead_file.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/cord.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/tsl/platform/status_matchers.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::tsl::testing::StatusIs;
+
+std::string TestContents(size_t size) {
+  std::string contents(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    contents[i] = static_cast<char>('a' + i % 26);
+  }
+  return contents;
+}
+
+class ReadAheadRandomAccessFileTest : public ::testing::Test {
+ protected:
+  ~ReadAheadRandomAccessFileTest() override {
+    for (const std::string& filename : filenames_) {
+      TF_EXPECT_OK(Env::Default()->DeleteFile(filename));
+    }
+  }
+
+  // Returns a new temporary file name, deleted at the end of the test.
+  std::string TempFilename() {
+    std::string filename;
+    CHECK(Env::Default()->LocalTempFilename(&filename));
+    filenames_.push_back(filename);
+    return filename;
+  }
+
+  Status CreateReadAheadFile(const std::string& contents, int64_t block_size,
+                             int num_outstanding_reads,
+                             std::unique_ptr<RandomAccessFile>* file) {
+    Env* env = Env::Default();
+    const std::string filename = TempFilename();
+    TF_RETURN_IF_ERROR(WriteStringToFile(env, filename, contents));
+    std::unique_ptr<RandomAccessFile> base_file;
+    TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filename, &base_file));
+    *file = std::make_unique<ReadAheadRandomAccessFile>(
+        env, std::move(base_file), block_size, num_outstanding_reads);
+    return OkStatus();
+  }
+
+ private:
+  std::vector<std::string> filenames_;
+};
+
+TEST_F(ReadAheadRandomAccessFileTest, SequentialReads) {
+  const std::string contents = TestContents(10000);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(CreateReadAheadFile(contents, /*block_size=*/64,
+                                   /*num_outstanding_reads=*/4, &file));
+  // Read sizes that do not line up with the block size.
+  std::string scratch(333, '\0');
+  std::string read_back;
+  uint64 offset = 0;
+  Status status;
+  while (status.ok()) {
+    StringPiece result;
+    status = file->Read(offset, scratch.size(), &result, &scratch[0]);
+    read_back.append(result.data(), result.size());
+    offset += result.size();
+  }
+  EXPECT_THAT(status, StatusIs(error::OUT_OF_RANGE));
+  EXPECT_EQ(read_back, contents);
+}
+
+TEST_F(ReadAheadRandomAccessFileTest, RandomReads) {
+  const std::string contents = TestContents(10000);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(CreateReadAheadFile(contents, /*block_size=*/100,
+                                   /*num_outstanding_reads=*/2, &file));
+  std::string scratch(250, '\0');
+  for (uint64 offset : {5000, 10, 9700, 0, 4999, 310}) {
+    StringPiece result;
+    TF_ASSERT_OK(file->Read(offset, scratch.size(), &result, &scratch[0]));
+    EXPECT_EQ(result, StringPiece(contents).substr(offset, scratch.size()));
+  }
+}
+
+TEST_F(ReadAheadRandomAccessFileTest, ReadPastEndOfFile) {
+  const std::string contents = TestContents(1000);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(CreateReadAheadFile(contents, /*block_size=*/128,
+                                   /*num_outstanding_reads=*/3, &file));
+  std::string scratch(200, '\0');
+  StringPiece result;
+  EXPECT_THAT(file->Read(900, scratch.size(), &result, &scratch[0]),
+              StatusIs(error::OUT_OF_RANGE));
+  EXPECT_EQ(result, StringPiece(contents).substr(900));
+  EXPECT_THAT(file->Read(5000, scratch.size(), &result, &scratch[0]),
+              StatusIs(error::OUT_OF_RANGE));
+  EXPECT_TRUE(result.empty());
+  // Reading after hitting the end of the file restarts read-ahead.
+  TF_ASSERT_OK(file->Read(0, scratch.size(), &result, &scratch[0]));
+  EXPECT_EQ(result, StringPiece(contents).substr(0, scratch.size()));
+}
+
+TEST_F(ReadAheadRandomAccessFileTest, EmptyFile) {
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(CreateReadAheadFile("", /*block_size=*/16,
+                                   /*num_outstanding_reads=*/2, &file));
+  char scratch[8];
+  StringPiece result;
+  EXPECT_THAT(file->Read(0, sizeof(scratch), &result, scratch),
+              StatusIs(error::OUT_OF_RANGE));
+  EXPECT_TRUE(result.empty());
+}
+
+// Files share one bounded thread pool, so many open files with interleaved
+// reads must all make progress.
+TEST_F(ReadAheadRandomAccessFileTest, ManyFilesShareThreadPool) {
+  const int kNumFiles = 64;
+  const std::string contents = TestContents(5000);
+  std::vector<std::unique_ptr<RandomAccessFile>> files(kNumFiles);
+  for (auto& file : files) {
+    TF_ASSERT_OK(CreateReadAheadFile(contents, /*block_size=*/128,
+                                     /*num_outstanding_reads=*/4, &file));
+  }
+  std::string scratch(100, '\0');
+  for (uint64 offset = 0; offset < contents.size(); offset += scratch.size()) {
+    for (const auto& file : files) {
+      StringPiece result;
+      TF_ASSERT_OK(file->Read(offset, scratch.size(), &result, &scratch[0]));
+      EXPECT_EQ(result, StringPiece(contents).substr(offset, scratch.size()));
+    }
+  }
+  // Destroying the files while reads are still in flight is safe.
+  files.clear();
+}
+
+TEST_F(ReadAheadRandomAccessFileTest, SequentialRecordReader) {
+  Env* env = Env::Default();
+  const std::string filename = TempFilename();
+  const int kNumRecords = 1000;
+  {
+    std::unique_ptr<WritableFile> file;
+    TF_ASSERT_OK(env->NewWritableFile(filename, &file));
+    io::RecordWriter writer(file.get());
+    for (int i = 0; i < kNumRecords; ++i) {
+      TF_ASSERT_OK(writer.WriteRecord(TestContents(i)));
+    }
+    TF_ASSERT_OK(writer.Close());
+  }
+
+  std::unique_ptr<RandomAccessFile> base_file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(filename, &base_file));
+  ReadAheadRandomAccessFile file(env, std::move(base_file),
+                                 /*block_size=*/4096,
+                                 /*num_outstanding_reads=*/4);
+  io::SequentialRecordReader reader(&file);
+  tstring record;
+  for (int i = 0; i < kNumRecords; ++i) {
+    TF_ASSERT_OK(reader.ReadRecord(&record));
+    EXPECT_EQ(record, TestContents(i));
+  }
+  EXPECT_THAT(reader.ReadRecord(&record), StatusIs(error::OUT_OF_RANGE));
+}
+
+// Readers of different parts of one file do not wait for each other's blocks
+// while holding the file's lock.
+TEST_F(ReadAheadRandomAccessFileTest, ConcurrentReads) {
+  const std::string contents = TestContents(20000);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(CreateReadAheadFile(contents, /*block_size=*/256,
+                                   /*num_outstanding_reads=*/4, &file));
+  const int kNumThreads = 8;
+  {
+    thread::ThreadPool pool(Env::Default(), "concurrent_reads", kNumThreads);
+    for (int i = 0; i < kNumThreads; ++i) {
+      pool.Schedule([&file, &contents, i]() {
+        std::string scratch(300, '\0');
+        for (uint64 offset = i * 100;
+             offset + scratch.size() <= contents.size(); offset += 1000) {
+          StringPiece result;
+          TF_EXPECT_OK(
+              file->Read(offset, scratch.size(), &result, &scratch[0]));
+          EXPECT_EQ(result,
+                    StringPiece(contents).substr(offset, scratch.size()));
+        }
+      });
+    }
+  }
+}
+
+#if defined(TF_CORD_SUPPORT)
+TEST_F(ReadAheadRandomAccessFileTest, ReadIntoCord) {
+  const std::string contents = TestContents(1000);
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(CreateReadAheadFile(contents, /*block_size=*/128,
+                                   /*num_outstanding_reads=*/2, &file));
+  absl::Cord cord;
+  TF_ASSERT_OK(file->Read(100, 500, &cord));
+  // The cord outlives the blocks' place in the read-ahead window.
+  absl::Cord rest;
+  EXPECT_THAT(file->Read(900, 200, &rest), StatusIs(error::OUT_OF_RANGE));
+  EXPECT_EQ(std::string(cord), contents.substr(100, 500));
+  EXPECT_EQ(std::string(rest), contents.substr(900));
+}
+#endif
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
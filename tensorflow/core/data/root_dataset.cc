@@ -244,6 +244,7 @@ class RootDataset::Iterator : public DatasetIterator<RootDataset> {
  private:
   IteratorContext::Params CreateParams(IteratorContext* ctx) {
     IteratorContext::Params params(ctx);
+    params.options = &dataset()->input_->options();
     if (dataset()->params_.autotune) {
       params.model = model_;
     }
@@ -340,7 +341,7 @@ int64_t RootDataset::CardinalityInternal(CardinalityOptions options) const {
   return input_->Cardinality(options);
 }
 
-Status RootDataset::Get(OpKernelContext* ctx, int64 index,
+Status RootDataset::Get(AnyContext ctx, int64 index,
                         std::vector<Tensor>* out_tensors) const {
   std::vector<const DatasetBase*> inputs;
   TF_RETURN_IF_ERROR(this->InputDatasets(&inputs));
@@ -47,7 +47,7 @@ class RootDataset : public DatasetBase {
 
   int64_t CardinalityInternal() const override;
   int64_t CardinalityInternal(CardinalityOptions options) const override;
-  Status Get(OpKernelContext* ctx, int64 index,
+  Status Get(AnyContext ctx, int64 index,
              std::vector<Tensor>* out_tensors) const override;
   Status CheckExternalState() const override;
   string DebugString() const override;
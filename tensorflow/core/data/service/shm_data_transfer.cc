@@ -0,0 +1,845 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shm_data_transfer.h"
+
+// Support for memfd_create(2) was added in glibc v2.27.
+#if defined(__linux__) && defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 27)
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define TF_DATA_SERVICE_ENABLE_SHM_TRANSFER
+#endif  // __GLIBC_PREREQ(2, 27)
+#endif  // __linux__ and __GLIBC__ and __GLIBC_PREREQ
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/variant.h"
+#include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace data {
+
+#if defined(TF_DATA_SERVICE_ENABLE_SHM_TRANSFER)
+
+namespace {
+
+constexpr char kSegmentBytesEnvVar[] = "TF_DATA_SERVICE_SHM_SEGMENT_BYTES";
+constexpr int kMaxBindAttempts = 10;
+
+// Bounds the messages that each side reads, so that a corrupt length cannot
+// make it allocate arbitrary amounts of memory. Requests are small, and
+// responses are bounded by the protobuf limit.
+constexpr uint64 kMaxRequestBytes = 1 << 20;
+constexpr uint64 kMaxResponseBytes = INT_MAX;
+
+// Tensor contents are aligned like the allocations of the CPU allocator.
+constexpr uint64 kRegionAlignment = Allocator::kAllocatorAlignment;
+
+// Each region of a segment starts with a header, followed by the tensor
+// contents at offset `kRegionAlignment`. The client sets `released` once it
+// no longer references the contents, after which the server may reuse the
+// region.
+struct RegionHeader {
+  std::atomic<uint32_t> released;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Region headers are shared between processes.");
+static_assert(sizeof(RegionHeader) <= kRegionAlignment,
+              "Region headers must fit in front of the region contents.");
+
+RegionHeader* GetRegionHeader(char* region) {
+  return reinterpret_cast<RegionHeader*>(region);
+}
+
+uint64 RoundUpToAlignment(uint64 size) {
+  return (size + kRegionAlignment - 1) / kRegionAlignment * kRegionAlignment;
+}
+
+Status SocketError(absl::string_view operation) {
+  return errors::Unavailable("Failed to ", operation,
+                             " the shm data transfer socket: ",
+                             strerror(errno));
+}
+
+// Fills `address` with the abstract Unix domain socket address of the server
+// with `port`, and returns the length of the address.
+socklen_t MakeSocketAddress(int port, sockaddr_un* address) {
+  const std::string name = absl::StrCat("tf_data_service_shm_", port);
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  // The leading null byte places the socket in the abstract namespace, so it
+  // needs no file and goes away with the server.
+  memcpy(address->sun_path + 1, name.data(), name.size());
+  return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+}
+
+Status WriteAll(int socket, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = send(socket, data, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return SocketError("write to");
+    }
+    data += n;
+    size -= n;
+  }
+  return OkStatus();
+}
+
+Status ReadAll(int socket, char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = recv(socket, data, size, 0);
+    if (n == 0) {
+      return errors::Unavailable("The shm data transfer connection was closed.");
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return SocketError("read from");
+    }
+    data += n;
+    size -= n;
+  }
+  return OkStatus();
+}
+
+// Messages are sent as their fixed64 length followed by their serialization.
+Status WriteMessage(int socket, const protobuf::MessageLite& message) {
+  std::string buffer;
+  core::PutFixed64(&buffer, message.ByteSizeLong());
+  if (!message.AppendToString(&buffer)) {
+    return errors::Internal("Failed to serialize a shm data transfer message.");
+  }
+  return WriteAll(socket, buffer.data(), buffer.size());
+}
+
+Status ReadMessage(int socket, uint64 max_bytes,
+                   protobuf::MessageLite* message) {
+  char length[sizeof(uint64)];
+  TF_RETURN_IF_ERROR(ReadAll(socket, length, sizeof(length)));
+  const uint64 num_bytes = core::DecodeFixed64(length);
+  if (num_bytes > max_bytes) {
+    return errors::DataLoss("Got a shm data transfer message of ", num_bytes,
+                            " bytes, more than the limit of ", max_bytes,
+                            " bytes.");
+  }
+  std::string buffer(num_bytes, '\0');
+  TF_RETURN_IF_ERROR(ReadAll(socket, &buffer[0], buffer.size()));
+  if (!message->ParseFromString(buffer)) {
+    return errors::DataLoss("Failed to parse a shm data transfer message.");
+  }
+  return OkStatus();
+}
+
+// Checks that the process at the other end of `socket` runs as the same user
+// as this one. The socket is in the abstract namespace, which has no file
+// permissions, so any local process could connect to it otherwise.
+Status CheckPeerCredentials(int socket) {
+  ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) !=
+      0) {
+    return SocketError("get the peer credentials of");
+  }
+  if (credentials.uid != geteuid()) {
+    return errors::PermissionDenied(
+        "The peer of the shm data transfer connection runs as user ",
+        credentials.uid, ", not as user ", geteuid(), ".");
+  }
+  return OkStatus();
+}
+
+// A memfd-backed shared memory segment, mapped into this process.
+class SharedMemorySegment {
+ public:
+  // Creates a new zero-filled segment of `size` bytes.
+  static Status Create(uint64 size, std::unique_ptr<SharedMemorySegment>* out) {
+    const int fd = memfd_create("tf_data_service_shm", MFD_CLOEXEC);
+    if (fd < 0) {
+      return errors::IOError("Failed to create a shared memory segment", errno);
+    }
+    if (ftruncate(fd, size) != 0) {
+      Status s = errors::IOError("Failed to resize a shared memory segment to " +
+                                     std::to_string(size) + " bytes",
+                                 errno);
+      close(fd);
+      return s;
+    }
+    return Map(fd, size, out);
+  }
+
+  // Maps the segment of `size` bytes behind `fd`, taking ownership of `fd`.
+  static Status Map(int fd, uint64 size,
+                    std::unique_ptr<SharedMemorySegment>* out) {
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      Status s = errors::IOError("Failed to map a shared memory segment", errno);
+      close(fd);
+      return s;
+    }
+    out->reset(new SharedMemorySegment(fd, static_cast<char*>(data), size));
+    return OkStatus();
+  }
+
+  ~SharedMemorySegment() {
+    munmap(data_, size_);
+    close(fd_);
+  }
+
+  int fd() const { return fd_; }
+  char* data() const { return data_; }
+  uint64 size() const { return size_; }
+
+ private:
+  SharedMemorySegment(int fd, char* data, uint64 size)
+      : fd_(fd), data_(data), size_(size) {}
+
+  const int fd_;
+  char* const data_;
+  const uint64 size_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(SharedMemorySegment);
+};
+
+// Sends the file descriptor and size of `segment` over `socket`.
+Status SendSegment(int socket, const SharedMemorySegment& segment) {
+  char size[sizeof(uint64)];
+  core::EncodeFixed64(size, segment.size());
+  iovec iov = {size, sizeof(size)};
+  char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  const int fd = segment.fd();
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+  ssize_t n;
+  do {
+    n = sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return SocketError("send the shared memory segment over");
+  }
+  if (n != sizeof(size)) {
+    return errors::Unavailable("Failed to send the shared memory segment.");
+  }
+  return OkStatus();
+}
+
+// Receives and maps a segment sent with `SendSegment`.
+Status ReceiveSegment(int socket, std::unique_ptr<SharedMemorySegment>* out) {
+  char size[sizeof(uint64)];
+  iovec iov = {size, sizeof(size)};
+  char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n;
+  do {
+    n = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return SocketError("receive the shared memory segment from");
+  }
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (n != sizeof(size) || cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    return errors::Unavailable(
+        "Failed to receive the shared memory segment of the shm data transfer "
+        "connection.");
+  }
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+  return SharedMemorySegment::Map(fd, core::DecodeFixed64(size), out);
+}
+
+// Allocates regions of a segment in ring order. Regions are reclaimed in
+// allocation order once the client has released them, so a tensor that the
+// client keeps alive also keeps the regions allocated after it from being
+// reused.
+class RegionAllocator {
+ public:
+  explicit RegionAllocator(SharedMemorySegment* segment) : segment_(segment) {}
+
+  // Allocates a region for `size` bytes of contents and returns the offset of
+  // the contents in `content_offset`. Returns false if the part of the segment
+  // that the client has released is too small.
+  bool Allocate(uint64 size, uint64* content_offset) {
+    Reclaim();
+    const uint64 region_size = kRegionAlignment + RoundUpToAlignment(size);
+    uint64 offset = 0;
+    if (regions_.empty()) {
+      if (region_size > segment_->size()) {
+        return false;
+      }
+    } else {
+      const uint64 head = regions_.back().end;
+      const uint64 tail = regions_.front().begin;
+      if (head > tail && segment_->size() - head >= region_size) {
+        offset = head;
+      } else if (head > tail && tail >= region_size) {
+        offset = 0;
+      } else if (head <= tail && tail - head >= region_size) {
+        offset = head;
+      } else {
+        return false;
+      }
+    }
+    GetRegionHeader(segment_->data() + offset)
+        ->released.store(0, std::memory_order_relaxed);
+    regions_.push_back({offset, offset + region_size});
+    *content_offset = offset + kRegionAlignment;
+    return true;
+  }
+
+ private:
+  struct Region {
+    uint64 begin;
+    uint64 end;
+  };
+
+  void Reclaim() {
+    while (!regions_.empty() &&
+           GetRegionHeader(segment_->data() + regions_.front().begin)
+               ->released.load(std::memory_order_acquire)) {
+      regions_.pop_front();
+    }
+  }
+
+  SharedMemorySegment* const segment_;
+  // Allocated regions that have not been reclaimed, in allocation order.
+  std::deque<Region> regions_;
+};
+
+// Moves `result` into `response`. The contents of memcpy-able tensors are
+// copied into regions of the connection's segment when they fit; all other
+// components are serialized as protos.
+Status MoveElementToResponse(GetElementResult&& result,
+                             SharedMemorySegment& segment,
+                             RegionAllocator& allocator,
+                             SharedMemoryGetElementResponse& response) {
+  GetElementResponse* element = response.mutable_response();
+  element->set_element_index(result.element_index);
+  element->set_end_of_sequence(result.end_of_sequence);
+  element->set_skip_task(result.skip);
+  if (result.end_of_sequence || result.skip) {
+    return OkStatus();
+  }
+  std::vector<Tensor>& components = result.components;
+  if (components.size() == 1 && components[0].dtype() == DT_VARIANT &&
+      TensorShapeUtils::IsScalar(components[0].shape())) {
+    Variant& variant = components[0].scalar<Variant>()();
+    CompressedElement* compressed = variant.get<CompressedElement>();
+    if (compressed == nullptr) {
+      return errors::FailedPrecondition(
+          "Expected dataset to produce a CompressedElement variant tensor, but "
+          "it produced ",
+          variant.TypeName());
+    }
+    *element->mutable_compressed() = std::move(*compressed);
+    return OkStatus();
+  }
+  UncompressedElement* uncompressed = element->mutable_uncompressed();
+  for (int i = 0; i < components.size(); ++i) {
+    const Tensor& component = components[i];
+    TensorProto* proto = uncompressed->add_components();
+    uint64 offset;
+    if (DataTypeCanUseMemcpy(component.dtype()) &&
+        !component.tensor_data().empty() &&
+        allocator.Allocate(component.tensor_data().size(), &offset)) {
+      const StringPiece data = component.tensor_data();
+      memcpy(segment.data() + offset, data.data(), data.size());
+      proto->set_dtype(component.dtype());
+      component.shape().AsProto(proto->mutable_tensor_shape());
+      SharedMemoryRegion& region = (*response.mutable_regions())[i];
+      region.set_offset(offset);
+      region.set_size(data.size());
+    } else {
+      component.AsProtoTensorContent(proto);
+    }
+  }
+  return OkStatus();
+}
+
+// Buffer of a tensor whose contents are in a shared memory segment. Releases
+// its region to the server when the last tensor referencing it goes away.
+class SharedMemoryTensorBuffer : public TensorBuffer {
+ public:
+  SharedMemoryTensorBuffer(std::shared_ptr<SharedMemorySegment> segment,
+                           uint64 offset, uint64 size)
+      : TensorBuffer(segment->data() + offset),
+        segment_(std::move(segment)),
+        offset_(offset),
+        size_(size) {}
+
+  ~SharedMemoryTensorBuffer() override {
+    GetRegionHeader(segment_->data() + offset_ - kRegionAlignment)
+        ->released.store(1, std::memory_order_release);
+  }
+
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("SharedMemoryDataTransfer");
+  }
+
+ private:
+  const std::shared_ptr<SharedMemorySegment> segment_;
+  const uint64 offset_;
+  const uint64 size_;
+};
+
+class ShmDataTransferClient : public DataTransferClient {
+ public:
+  explicit ShmDataTransferClient(int port) : port_(port) {
+    VLOG(2) << "Create ShmDataTransferClient for port " << port_ << ".";
+  }
+
+  ~ShmDataTransferClient() override {
+    mutex_lock l(socket_mu_);
+    if (socket_ >= 0) {
+      close(socket_);
+    }
+  }
+
+  Status GetElement(const GetElementRequest& req,
+                    GetElementResult& result) override {
+    VLOG(3) << "GetElement for task " << req.task_id() << " from shm worker "
+            << "server.";
+    mutex_lock l(mu_);
+    int socket;
+    TF_RETURN_IF_ERROR(EnsureConnectedLocked(&socket));
+    SharedMemoryGetElementResponse resp;
+    Status s = WriteMessage(socket, req);
+    if (s.ok()) {
+      s = ReadMessage(socket, kMaxResponseBytes, &resp);
+    }
+    if (s.ok() && resp.error_code() == error::OK) {
+      s = ParseResponse(resp, result);
+    }
+    if (!s.ok()) {
+      // The connection is in an unknown state, so start over on the next
+      // request.
+      DisconnectLocked();
+      return s;
+    }
+    if (resp.error_code() != error::OK) {
+      return Status(static_cast<error::Code>(resp.error_code()),
+                    resp.error_message());
+    }
+    return OkStatus();
+  }
+
+  void TryCancel() override {
+    VLOG(2) << "Cancel ShmDataTransferClient.";
+    mutex_lock l(socket_mu_);
+    cancelled_ = true;
+    if (socket_ >= 0) {
+      // Unblocks in-flight requests. The socket is closed by `GetElement`.
+      shutdown(socket_, SHUT_RDWR);
+    }
+  }
+
+ private:
+  // Connects to the server unless already connected, and returns the socket
+  // of the connection.
+  Status EnsureConnectedLocked(int* socket) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    {
+      mutex_lock l(socket_mu_);
+      if (cancelled_) {
+        return errors::Cancelled("Client was cancelled.");
+      }
+      if (socket_ >= 0) {
+        *socket = socket_;
+        return OkStatus();
+      }
+    }
+    const int new_socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (new_socket < 0) {
+      return SocketError("create");
+    }
+    sockaddr_un address;
+    const socklen_t address_length = MakeSocketAddress(port_, &address);
+    Status s;
+    if (connect(new_socket, reinterpret_cast<sockaddr*>(&address),
+                address_length) != 0) {
+      s = SocketError("connect to");
+    }
+    if (s.ok()) {
+      // The segment of another user's server must not be mapped.
+      s = CheckPeerCredentials(new_socket);
+    }
+    std::unique_ptr<SharedMemorySegment> segment;
+    if (s.ok()) {
+      s = ReceiveSegment(new_socket, &segment);
+    }
+    if (!s.ok()) {
+      close(new_socket);
+      return s;
+    }
+    segment_ = std::move(segment);
+    mutex_lock l(socket_mu_);
+    if (cancelled_) {
+      close(new_socket);
+      return errors::Cancelled("Client was cancelled.");
+    }
+    socket_ = new_socket;
+    *socket = socket_;
+    return OkStatus();
+  }
+
+  void DisconnectLocked() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    // Tensors that are still alive keep the segment mapped.
+    segment_.reset();
+    mutex_lock l(socket_mu_);
+    if (socket_ >= 0) {
+      close(socket_);
+      socket_ = -1;
+    }
+  }
+
+  Status ParseResponse(const SharedMemoryGetElementResponse& resp,
+                       GetElementResult& result)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const GetElementResponse& element = resp.response();
+    result.element_index = element.element_index();
+    result.end_of_sequence = element.end_of_sequence();
+    result.skip = element.skip_task();
+    switch (element.element_case()) {
+      case GetElementResponse::kCompressed: {
+        Tensor tensor(DT_VARIANT, TensorShape{});
+        tensor.scalar<Variant>()() = element.compressed();
+        result.components.push_back(tensor);
+        break;
+      }
+      case GetElementResponse::kUncompressed: {
+        const auto& components = element.uncompressed().components();
+        // Wraps all regions first, so that they are released even if a later
+        // component fails to parse.
+        for (const auto& region : resp.regions()) {
+          if (region.first < 0 || region.first >= components.size()) {
+            return errors::DataLoss("Got a shared memory region for component ",
+                                    region.first, " of an element with ",
+                                    components.size(), " components.");
+          }
+        }
+        result.components.resize(components.size());
+        for (const auto& region : resp.regions()) {
+          TF_RETURN_IF_ERROR(MakeTensor(components[region.first], region.second,
+                                        result.components[region.first]));
+        }
+        for (int i = 0; i < components.size(); ++i) {
+          if (resp.regions().count(i) > 0) {
+            continue;
+          }
+          if (!result.components[i].FromProto(components[i])) {
+            return errors::Internal("Failed to parse tensor.");
+          }
+        }
+        break;
+      }
+      case GetElementResponse::ELEMENT_NOT_SET:
+        break;
+    }
+    return OkStatus();
+  }
+
+  // Makes `tensor` with the dtype and shape of `proto` and the contents in
+  // `region` of the segment, without copying.
+  Status MakeTensor(const TensorProto& proto, const SharedMemoryRegion& region,
+                    Tensor& tensor) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (region.offset() < kRegionAlignment ||
+        region.offset() > segment_->size() ||
+        region.size() > segment_->size() - region.offset()) {
+      return errors::DataLoss("Shared memory region [", region.offset(), ", ",
+                              region.offset() + region.size(),
+                              ") is outside of the segment of ",
+                              segment_->size(), " bytes.");
+    }
+    // Takes over the region before validating the rest, so that it is
+    // released on errors as well.
+    core::RefCountPtr<SharedMemoryTensorBuffer> buffer(
+        new SharedMemoryTensorBuffer(segment_, region.offset(), region.size()));
+    if (!TensorShape::IsValid(proto.tensor_shape()) ||
+        !DataTypeCanUseMemcpy(proto.dtype())) {
+      return errors::DataLoss("Got an invalid tensor in shared memory: ",
+                              proto.ShortDebugString());
+    }
+    TensorShape shape(proto.tensor_shape());
+    if (shape.num_elements() * DataTypeSize(proto.dtype()) != region.size()) {
+      return errors::DataLoss("Shared memory region of ", region.size(),
+                              " bytes does not match tensor of shape ",
+                              shape.DebugString(), " and type ",
+                              DataTypeString(proto.dtype()));
+    }
+    tensor = Tensor(proto.dtype(), shape, buffer.get());
+    return OkStatus();
+  }
+
+  const int port_;
+
+  // Serializes requests, which share the connection.
+  mutex mu_;
+  std::shared_ptr<SharedMemorySegment> segment_ TF_GUARDED_BY(mu_);
+
+  mutex socket_mu_;
+  // Only closed while holding `mu_` as well, so that `TryCancel` can shut it
+  // down while a request is in flight.
+  int socket_ TF_GUARDED_BY(socket_mu_) = -1;
+  bool cancelled_ TF_GUARDED_BY(socket_mu_) = false;
+};
+
+class ShmTransferServerRegistrar {
+ public:
+  ShmTransferServerRegistrar() {
+    DataTransferServer::Register(
+        kShmTransferProtocol, [](DataTransferServer::GetElementT get_element) {
+          int64_t segment_bytes;
+          Status s = ReadInt64FromEnvVar(
+              kSegmentBytesEnvVar, kDefaultShmSegmentBytes, &segment_bytes);
+          if (!s.ok()) {
+            LOG(WARNING) << "Ignoring " << kSegmentBytesEnvVar << ": " << s;
+            segment_bytes = kDefaultShmSegmentBytes;
+          }
+          return std::make_shared<ShmDataTransferServer>(get_element,
+                                                         segment_bytes);
+        });
+  }
+};
+static ShmTransferServerRegistrar shm_server_registrar;
+
+class ShmTransferClientRegistrar {
+ public:
+  ShmTransferClientRegistrar() {
+    DataTransferClient::Register(
+        kShmTransferProtocol, [](DataTransferClient::Config config,
+                                 std::unique_ptr<DataTransferClient>* out) {
+          // The host is ignored: the server must run on this host.
+          absl::string_view address = config.address;
+          const size_t colon = address.rfind(':');
+          int port;
+          if (colon == absl::string_view::npos ||
+              !absl::SimpleAtoi(address.substr(colon + 1), &port)) {
+            return errors::InvalidArgument(
+                "Expected a shm data transfer address of the form "
+                "<host>:<port>, but got ",
+                config.address);
+          }
+          *out = std::make_unique<ShmDataTransferClient>(port);
+          return OkStatus();
+        });
+  }
+};
+static ShmTransferClientRegistrar shm_client_registrar;
+
+}  // namespace
+
+ShmDataTransferServer::ShmDataTransferServer(GetElementT get_element,
+                                             int64_t segment_bytes)
+    : get_element_(std::move(get_element)), segment_bytes_(segment_bytes) {}
+
+ShmDataTransferServer::~ShmDataTransferServer() {
+  {
+    mutex_lock l(mu_);
+    cancelled_ = true;
+    if (listen_socket_ >= 0) {
+      shutdown(listen_socket_, SHUT_RDWR);
+    }
+    for (int socket : connection_sockets_) {
+      shutdown(socket, SHUT_RDWR);
+    }
+  }
+  accept_thread_.reset();
+  mutex_lock l(mu_);
+  while (!connection_sockets_.empty()) {
+    cv_.wait(l);
+  }
+  if (listen_socket_ >= 0) {
+    close(listen_socket_);
+  }
+}
+
+Status ShmDataTransferServer::Start() {
+  const int listen_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_socket < 0) {
+    return SocketError("create");
+  }
+  // Abstract socket names are not tied to TCP ports, so any number works as
+  // the port. Retries if another server on this host already uses it.
+  int port = 0;
+  bool bound = false;
+  for (int i = 0; i < kMaxBindAttempts && !bound; ++i) {
+    port = 1 + random::New64() % (INT_MAX - 1);
+    sockaddr_un address;
+    const socklen_t address_length = MakeSocketAddress(port, &address);
+    bound = bind(listen_socket, reinterpret_cast<sockaddr*>(&address),
+                 address_length) == 0;
+    if (!bound && errno != EADDRINUSE) {
+      break;
+    }
+  }
+  if (!bound || listen(listen_socket, SOMAXCONN) != 0) {
+    Status s = SocketError(bound ? "listen on" : "bind");
+    close(listen_socket);
+    return s;
+  }
+  {
+    mutex_lock l(mu_);
+    port_ = port;
+    listen_socket_ = listen_socket;
+  }
+  accept_thread_.reset(Env::Default()->StartThread(
+      {}, "tf_data_service_shm_accept", [this]() { AcceptConnections(); }));
+  return OkStatus();
+}
+
+int ShmDataTransferServer::get_port() {
+  mutex_lock l(mu_);
+  return port_;
+}
+
+void ShmDataTransferServer::AcceptConnections() {
+  int listen_socket;
+  {
+    mutex_lock l(mu_);
+    listen_socket = listen_socket_;
+  }
+  while (true) {
+    const int socket = accept4(listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    mutex_lock l(mu_);
+    if (cancelled_) {
+      if (socket >= 0) {
+        close(socket);
+      }
+      return;
+    }
+    if (socket < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      LOG(ERROR) << "Stopped accepting shm data transfer connections: "
+                 << strerror(errno);
+      return;
+    }
+    connection_sockets_.insert(socket);
+    Env::Default()->SchedClosure([this, socket]() { ServeConnection(socket); });
+  }
+}
+
+void ShmDataTransferServer::ServeConnection(int socket) {
+  std::unique_ptr<SharedMemorySegment> segment;
+  Status s = CheckPeerCredentials(socket);
+  if (s.ok()) {
+    s = SharedMemorySegment::Create(segment_bytes_, &segment);
+  }
+  if (s.ok()) {
+    s = SendSegment(socket, *segment);
+  }
+  if (s.ok()) {
+    RegionAllocator allocator(segment.get());
+    while (true) {
+      GetElementRequest request;
+      s = ReadMessage(socket, kMaxRequestBytes, &request);
+      if (!s.ok()) {
+        break;
+      }
+      GetElementResult result;
+      SharedMemoryGetElementResponse response;
+      Status element_status = get_element_(&request, &result);
+      if (element_status.ok()) {
+        element_status = MoveElementToResponse(std::move(result), *segment,
+                                               allocator, response);
+      }
+      if (!element_status.ok()) {
+        response.Clear();
+        response.set_error_code(element_status.code());
+        response.set_error_message(element_status.error_message());
+      }
+      s = WriteMessage(socket, response);
+      if (!s.ok()) {
+        break;
+      }
+    }
+  }
+  VLOG(2) << "Closing shm data transfer connection: " << s;
+  mutex_lock l(mu_);
+  close(socket);
+  connection_sockets_.erase(socket);
+  cv_.notify_all();
+}
+
+#else  // TF_DATA_SERVICE_ENABLE_SHM_TRANSFER
+
+ShmDataTransferServer::ShmDataTransferServer(GetElementT get_element,
+                                             int64_t segment_bytes)
+    : get_element_(std::move(get_element)), segment_bytes_(segment_bytes) {}
+
+ShmDataTransferServer::~ShmDataTransferServer() = default;
+
+Status ShmDataTransferServer::Start() {
+  return errors::Unimplemented(
+      "The shm data transfer protocol requires Linux with memfd_create.");
+}
+
+int ShmDataTransferServer::get_port() { return 0; }
+
+void ShmDataTransferServer::AcceptConnections() {}
+
+void ShmDataTransferServer::ServeConnection(int socket) {}
+
+#endif  // TF_DATA_SERVICE_ENABLE_SHM_TRANSFER
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,86 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace data {
+
+// Data transfer protocol for clients running on the same host as the worker.
+//
+// Each client connection gets its own shared memory segment (a memfd, passed
+// to the client over a Unix domain socket). The worker copies the contents of
+// each produced tensor into a ring of regions in the segment, and the client
+// wraps the regions in tensors without copying them again. A region is
+// released for reuse once the client drops the last reference to its tensor.
+//
+// Elements are not serialized, so the dataset should be registered without
+// compression to avoid compressing and uncompressing elements on the same
+// host. Tensors that cannot be memcpy-ed (e.g. strings), compressed elements,
+// and tensors that do not fit in the unreleased part of the segment are sent
+// over the socket as protos instead.
+constexpr const char kShmTransferProtocol[] = "shm";
+
+// Default size of the shared memory segment of each client connection. Can be
+// overridden with the TF_DATA_SERVICE_SHM_SEGMENT_BYTES environment variable.
+constexpr int64_t kDefaultShmSegmentBytes = 256LL << 20;  // 256MB.
+
+// Server side of the "shm" data transfer protocol. Listens on an abstract Unix
+// domain socket named after `get_port()`, so that clients can find it from the
+// worker's transfer address.
+class ShmDataTransferServer : public DataTransferServer {
+ public:
+  ShmDataTransferServer(GetElementT get_element, int64_t segment_bytes);
+  ~ShmDataTransferServer() override;
+
+  Status Start() override;
+
+  int get_port() override;
+
+ private:
+  // Accepts client connections until the server is destroyed.
+  void AcceptConnections();
+
+  // Serves the requests of a connected client until either side closes the
+  // connection.
+  void ServeConnection(int socket);
+
+  const GetElementT get_element_;
+  const int64_t segment_bytes_;
+
+  mutex mu_;
+  condition_variable cv_;
+  int port_ TF_GUARDED_BY(mu_) = 0;
+  int listen_socket_ TF_GUARDED_BY(mu_) = -1;
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+  // Sockets of the connections being served.
+  absl::flat_hash_set<int> connection_sockets_ TF_GUARDED_BY(mu_);
+  std::unique_ptr<Thread> accept_thread_;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
@@ -0,0 +1,267 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shm_data_transfer.h"
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif  // __linux__
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_description.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/variant.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/tsl/platform/status_matchers.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::tsl::testing::StatusIs;
+
+constexpr int64_t kSegmentBytes = 64 << 10;  // 64KB.
+
+// Whether the contents of `tensor` are in a shared memory segment.
+bool InSharedMemory(const Tensor& tensor) {
+  TensorDescription description;
+  tensor.FillDescription(&description);
+  return description.allocation_description().allocator_name() ==
+         "SharedMemoryDataTransfer";
+}
+
+class ShmDataTransferTest : public ::testing::Test {
+ protected:
+  // Starts a server that produces the results of `get_element`, and connects
+  // a client to it.
+  void StartServer(DataTransferServer::GetElementT get_element) {
+    server_ = std::make_shared<ShmDataTransferServer>(std::move(get_element),
+                                                      kSegmentBytes);
+    TF_ASSERT_OK(server_->Start());
+    TF_ASSERT_OK(DataTransferClient::Build(
+        kShmTransferProtocol,
+        {/*protocol=*/"grpc", absl::StrCat("localhost:", server_->get_port())},
+        &client_));
+  }
+
+  std::shared_ptr<DataTransferServer> server_;
+  std::unique_ptr<DataTransferClient> client_;
+};
+
+TEST_F(ShmDataTransferTest, GetElement) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    result->components.push_back(
+        test::AsTensor<int64_t>({request->task_id(), 2, 3}, {3}));
+    result->components.push_back(test::AsScalar<tstring>("hello"));
+    result->element_index = 7;
+    return OkStatus();
+  });
+
+  GetElementRequest request;
+  request.set_task_id(1);
+  GetElementResult result;
+  TF_ASSERT_OK(client_->GetElement(request, result));
+  EXPECT_FALSE(result.end_of_sequence);
+  EXPECT_FALSE(result.skip);
+  EXPECT_EQ(result.element_index, 7);
+  ASSERT_EQ(result.components.size(), 2);
+  test::ExpectEqual(result.components[0],
+                    test::AsTensor<int64_t>({1, 2, 3}, {3}));
+  EXPECT_TRUE(InSharedMemory(result.components[0]));
+  test::ExpectEqual(result.components[1], test::AsScalar<tstring>("hello"));
+  EXPECT_FALSE(InSharedMemory(result.components[1]));
+}
+
+TEST_F(ShmDataTransferTest, ReusesReleasedRegions) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    Tensor tensor(DT_FLOAT, TensorShape({kSegmentBytes / 16}));
+    tensor.flat<float>().setConstant(request->task_id());
+    result->components.push_back(std::move(tensor));
+    return OkStatus();
+  });
+
+  // Fetches more data than fits in the segment, one element at a time.
+  for (int i = 0; i < 100; ++i) {
+    GetElementRequest request;
+    request.set_task_id(i);
+    GetElementResult result;
+    TF_ASSERT_OK(client_->GetElement(request, result));
+    ASSERT_EQ(result.components.size(), 1);
+    EXPECT_TRUE(InSharedMemory(result.components[0]));
+    EXPECT_EQ(result.components[0].flat<float>()(0), i);
+  }
+}
+
+TEST_F(ShmDataTransferTest, FallsBackToProtosWhenSegmentIsFull) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    Tensor tensor(DT_INT32, TensorShape({kSegmentBytes / 16}));
+    tensor.flat<int32_t>().setConstant(request->task_id());
+    result->components.push_back(std::move(tensor));
+    return OkStatus();
+  });
+
+  // Holds on to all elements, so that the segment fills up.
+  std::vector<GetElementResult> results(10);
+  for (int i = 0; i < results.size(); ++i) {
+    GetElementRequest request;
+    request.set_task_id(i);
+    TF_ASSERT_OK(client_->GetElement(request, results[i]));
+  }
+  EXPECT_TRUE(InSharedMemory(results.front().components[0]));
+  EXPECT_FALSE(InSharedMemory(results.back().components[0]));
+  for (int i = 0; i < results.size(); ++i) {
+    ASSERT_EQ(results[i].components.size(), 1);
+    EXPECT_EQ(results[i].components[0].NumElements(), kSegmentBytes / 16);
+    EXPECT_EQ(results[i].components[0].flat<int32_t>()(0), i);
+  }
+}
+
+TEST_F(ShmDataTransferTest, CompressedElement) {
+  CompressedElement compressed;
+  compressed.set_data("compressed");
+  compressed.set_version(1);
+  StartServer([&compressed](const GetElementRequest* request,
+                            GetElementResult* result) {
+    Tensor tensor(DT_VARIANT, TensorShape({}));
+    tensor.scalar<Variant>()() = compressed;
+    result->components.push_back(std::move(tensor));
+    return OkStatus();
+  });
+
+  GetElementResult result;
+  TF_ASSERT_OK(client_->GetElement(GetElementRequest(), result));
+  ASSERT_EQ(result.components.size(), 1);
+  const CompressedElement* received =
+      result.components[0].scalar<Variant>()().get<CompressedElement>();
+  ASSERT_NE(received, nullptr);
+  EXPECT_EQ(received->data(), "compressed");
+  EXPECT_EQ(received->version(), 1);
+}
+
+TEST_F(ShmDataTransferTest, EndOfSequence) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    result->end_of_sequence = true;
+    return OkStatus();
+  });
+
+  GetElementResult result;
+  TF_ASSERT_OK(client_->GetElement(GetElementRequest(), result));
+  EXPECT_TRUE(result.end_of_sequence);
+  EXPECT_TRUE(result.components.empty());
+}
+
+TEST_F(ShmDataTransferTest, PropagatesErrors) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    return errors::NotFound("Task ", request->task_id(), " not found");
+  });
+
+  GetElementRequest request;
+  request.set_task_id(5);
+  GetElementResult result;
+  EXPECT_THAT(client_->GetElement(request, result),
+              StatusIs(error::NOT_FOUND, "Task 5 not found"));
+  // The connection remains usable after errors.
+  EXPECT_THAT(client_->GetElement(request, result),
+              StatusIs(error::NOT_FOUND, "Task 5 not found"));
+}
+
+TEST_F(ShmDataTransferTest, Cancel) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    result->components.push_back(test::AsScalar<int64_t>(1));
+    return OkStatus();
+  });
+
+  GetElementResult result;
+  TF_ASSERT_OK(client_->GetElement(GetElementRequest(), result));
+  client_->TryCancel();
+  EXPECT_THAT(client_->GetElement(GetElementRequest(), result),
+              StatusIs(error::CANCELLED));
+}
+
+#if defined(__linux__)
+TEST_F(ShmDataTransferTest, RejectsOversizedRequests) {
+  StartServer([](const GetElementRequest* request, GetElementResult* result) {
+    result->components.push_back(test::AsScalar<int64_t>(1));
+    return OkStatus();
+  });
+
+  // Connects without a client, and announces a request of 1TB.
+  const int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  ASSERT_GE(socket, 0);
+  const std::string name =
+      absl::StrCat("tf_data_service_shm_", server_->get_port());
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path + 1, name.data(), name.size());
+  ASSERT_EQ(connect(socket, reinterpret_cast<sockaddr*>(&address),
+                    offsetof(sockaddr_un, sun_path) + 1 + name.size()),
+            0);
+  char segment_size[sizeof(uint64)];
+  ASSERT_EQ(recv(socket, segment_size, sizeof(segment_size), MSG_WAITALL),
+            static_cast<ssize_t>(sizeof(segment_size)));
+  char length[sizeof(uint64)];
+  core::EncodeFixed64(length, 1ULL << 40);
+  ASSERT_EQ(send(socket, length, sizeof(length), MSG_NOSIGNAL),
+            static_cast<ssize_t>(sizeof(length)));
+  // The server closes the connection instead of allocating the request.
+  char response;
+  EXPECT_EQ(recv(socket, &response, 1, 0), 0);
+  close(socket);
+
+  // Other connections are not affected.
+  GetElementResult result;
+  TF_ASSERT_OK(client_->GetElement(GetElementRequest(), result));
+  EXPECT_EQ(result.components.size(), 1);
+}
+#endif  // __linux__
+
+TEST_F(ShmDataTransferTest, ServerNotFound) {
+  std::unique_ptr<DataTransferClient> client;
+  TF_ASSERT_OK(DataTransferClient::Build(kShmTransferProtocol,
+                                         {/*protocol=*/"grpc", "localhost:0"},
+                                         &client));
+  GetElementResult result;
+  EXPECT_THAT(client->GetElement(GetElementRequest(), result),
+              StatusIs(error::UNAVAILABLE));
+}
+
+TEST_F(ShmDataTransferTest, InvalidAddress) {
+  std::unique_ptr<DataTransferClient> client;
+  EXPECT_THAT(DataTransferClient::Build(kShmTransferProtocol,
+                                        {/*protocol=*/"grpc", "localhost"},
+                                        &client),
+              StatusIs(error::INVALID_ARGUMENT));
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -17,9 +17,12 @@ limitations under the License.
 
 #include <algorithm>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <queue>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
@@ -34,8 +37,11 @@ limitations under the License.
 #include "tensorflow/core/lib/io/zlib_inputstream.h"
 #include "tensorflow/core/lib/io/zlib_outputbuffer.h"
 #include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env_time.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/notification.h"
 #include "tensorflow/core/platform/path.h"
 #include "tensorflow/core/platform/random.h"
 #include "tensorflow/core/platform/strcat.h"
@@ -58,6 +64,60 @@ constexpr const char* const kCurrentCheckpointID = "current_checkpoint_id";
 constexpr const char* const kIndex = "index";
 constexpr const char* const kStartIndex = "start_index";
 
+// Compression is skipped for records whose compressed size is above this
+// fraction of their uncompressed size.
+constexpr double kMaxCompressionRatio = 0.95;
+// Compression is skipped if it saves fewer bytes per microsecond of compression
+// time than this, which is about what a single stream writes to storage.
+constexpr double kMinSavedBytesPerMicro = 64.0;  // 64MB/s.
+// Weight of the latest measurement in the moving averages of
+// `AdaptiveCompressionPolicy`.
+constexpr double kMeasurementWeight = 0.25;
+
+// Returns the thread pool shared by all snapshot writers to compress records.
+thread::ThreadPool* GetCompressionThreadPool() {
+  static thread::ThreadPool* thread_pool = new thread::ThreadPool(
+      Env::Default(), ThreadOptions(), "tf_data_snapshot_compression",
+      port::MaxParallelism(), /*low_latency_hint=*/false);
+  return thread_pool;
+}
+
+// Returns the start of a snappy stream that holds `size` bytes as a single
+// literal: the uncompressed length, followed by a literal tag. Completed with
+// the bytes themselves, the stream is read by any snappy decoder, so readers
+// that predate uncompressed records still read them.
+std::string SnappyLiteralHeader(uint32 size) {
+  std::string header;
+  core::PutVarint32(&header, size);
+  if (size == 0) {
+    return header;
+  }
+  // Tags store the literal length minus one, inline below 60 and otherwise in
+  // the 1 to 4 bytes that follow the tag.
+  const uint32 length = size - 1;
+  if (length < 60) {
+    header.push_back(static_cast<char>(length << 2));
+    return header;
+  }
+  int num_length_bytes = 1;
+  while (num_length_bytes < 4 && (length >> (8 * num_length_bytes)) != 0) {
+    ++num_length_bytes;
+  }
+  header.push_back(static_cast<char>((59 + num_length_bytes) << 2));
+  for (int i = 0; i < num_length_bytes; ++i) {
+    header.push_back(static_cast<char>((length >> (8 * i)) & 0xff));
+  }
+  return header;
+}
+
+double UpdateMovingAverage(double average, double measurement) {
+  if (average < 0.0) {
+    return measurement;
+  }
+  return (1.0 - kMeasurementWeight) * average +
+         kMeasurementWeight * measurement;
+}
+
 }  // namespace
 
 /* static */ constexpr const int64_t
@@ -101,8 +161,11 @@ Status Writer::Create(Env* env, const std::string& filename,
                       std::unique_ptr<Writer>* out_writer) {
   switch (version) {
     case 1:
-      *out_writer =
-          std::make_unique<CustomWriter>(filename, compression_type, dtypes);
+      *out_writer = std::make_unique<CustomWriter>(
+          filename, compression_type, dtypes,
+          compression_type == io::compression::kSnappy
+              ? GetCompressionThreadPool()
+              : nullptr);
       break;
     case 2:
       *out_writer =
@@ -173,12 +236,67 @@ TFRecordWriter::~TFRecordWriter() {
   }
 }
 
+AdaptiveCompressionPolicy::AdaptiveCompressionPolicy(
+    int num_compression_threads)
+    : num_compression_threads_(num_compression_threads) {}
+
+bool AdaptiveCompressionPolicy::ShouldCompress() {
+  const bool probe = num_records_++ % kProbeInterval == 0;
+  if (probe || compression_ratio_ < 0.0) {
+    return true;
+  }
+  if (compression_ratio_ > kMaxCompressionRatio) {
+    return false;
+  }
+  // Records compressed in parallel overlap with each other and with writes.
+  const double compression_bytes_per_micro =
+      compression_bytes_per_micro_ * std::max(num_compression_threads_, 1);
+  return (1.0 - compression_ratio_) * compression_bytes_per_micro >=
+         kMinSavedBytesPerMicro;
+}
+
+void AdaptiveCompressionPolicy::RecordCompression(uint64 uncompressed_bytes,
+                                                  uint64 compressed_bytes,
+                                                  uint64 compression_micros) {
+  if (uncompressed_bytes == 0) {
+    return;
+  }
+  compression_ratio_ = UpdateMovingAverage(
+      compression_ratio_,
+      static_cast<double>(compressed_bytes) / uncompressed_bytes);
+  compression_bytes_per_micro_ = UpdateMovingAverage(
+      compression_bytes_per_micro_,
+      static_cast<double>(uncompressed_bytes) /
+          std::max<uint64>(compression_micros, 1));
+}
+
+struct CustomWriter::PendingRecord {
+  experimental::SnapshotTensorMetadata metadata;
+  std::string uncompressed;
+  std::string compressed;
+  // Whether to store `compressed` rather than `uncompressed`.
+  bool compress = false;
+  uint64 compression_micros = 0;
+};
+
+struct CustomWriter::PendingChunk {
+  std::vector<PendingRecord> records;
+  size_t uncompressed_bytes = 0;
+  Status status;
+  Notification done;
+};
+
 CustomWriter::CustomWriter(const std::string& filename,
                            const std::string& compression_type,
-                           const DataTypeVector& dtypes)
+                           const DataTypeVector& dtypes,
+                           thread::ThreadPool* compression_thread_pool)
     : filename_(filename),
       compression_type_(compression_type),
-      dtypes_(dtypes) {}
+      dtypes_(dtypes),
+      compression_thread_pool_(compression_thread_pool),
+      compression_policy_(compression_thread_pool
+                              ? compression_thread_pool->NumThreads()
+                              : 0) {}
 
 Status CustomWriter::Initialize(tensorflow::Env* env) {
   TF_RETURN_IF_ERROR(env->NewAppendableFile(filename_, &dest_));
@@ -233,11 +351,34 @@ Status CustomWriter::WriteTensors(const std::vector<Tensor>& tensors) {
 #endif  // TF_CORD_SUPPORT
   }
 
+  PendingRecord record;
+  TF_RETURN_IF_ERROR(SerializeTensors(tensors, record));
+  record.compress = compression_policy_.ShouldCompress();
+  if (compression_thread_pool_ == nullptr) {
+    TF_RETURN_IF_ERROR(CompressRecord(record));
+    return WriteCompressedRecord(record);
+  }
+  if (current_chunk_ == nullptr) {
+    current_chunk_ = std::make_shared<PendingChunk>();
+  }
+  current_chunk_->uncompressed_bytes += record.uncompressed.size();
+  current_chunk_->records.push_back(std::move(record));
+  if (current_chunk_->uncompressed_bytes < kCompressionChunkBytes) {
+    return OkStatus();
+  }
+  ScheduleCurrentChunk();
+  // Bounds the memory held by chunks that have not been written yet.
+  return WritePendingChunks(kMaxPendingChunksPerThread *
+                            compression_thread_pool_->NumThreads());
+}
+
+Status CustomWriter::SerializeTensors(const std::vector<Tensor>& tensors,
+                                      PendingRecord& record) {
   std::vector<const TensorBuffer*> tensor_buffers;
   tensor_buffers.reserve(num_simple_);
   std::vector<TensorProto> tensor_protos;
   tensor_protos.reserve(num_complex_);
-  experimental::SnapshotTensorMetadata metadata;
+  experimental::SnapshotTensorMetadata& metadata = record.metadata;
   int64_t total_size = 0;
   for (int i = 0, end = tensors.size(); i < end; ++i) {
     const Tensor& tensor = tensors[i];
@@ -259,8 +400,9 @@ Status CustomWriter::WriteTensors(const std::vector<Tensor>& tensors) {
     total_size += size;
   }
 
-  std::vector<char> uncompressed(total_size);
-  char* position = uncompressed.data();
+  std::string& uncompressed = record.uncompressed;
+  uncompressed.resize(total_size);
+  char* position = &uncompressed[0];
   int buffer_index = 0;
   int proto_index = 0;
   for (int i = 0, end = tensors.size(); i < end; ++i) {
@@ -277,30 +419,116 @@ Status CustomWriter::WriteTensors(const std::vector<Tensor>& tensors) {
     position += tensor_metadata.tensor_size_bytes();
   }
   DCHECK_EQ(position, uncompressed.data() + total_size);
+  return OkStatus();
+}
 
-  string output;
-  if (!tsl::port::Snappy_Compress(uncompressed.data(), total_size, &output)) {
+Status CustomWriter::CompressRecord(PendingRecord& record) {
+  if (!record.compress) {
+    return OkStatus();
+  }
+  const uint64 start_micros = EnvTime::NowMicros();
+  if (!tsl::port::Snappy_Compress(record.uncompressed.data(),
+                                  record.uncompressed.size(),
+                                  &record.compressed)) {
     return errors::Internal("Failed to compress using snappy.");
   }
+  record.compression_micros = EnvTime::NowMicros() - start_micros;
+  return OkStatus();
+}
+
+void CustomWriter::CompressChunk(PendingChunk& chunk) {
+  for (PendingRecord& record : chunk.records) {
+    chunk.status = CompressRecord(record);
+    if (!chunk.status.ok()) {
+      break;
+    }
+  }
+  chunk.done.Notify();
+}
+
+void CustomWriter::ScheduleCurrentChunk() {
+  if (current_chunk_ == nullptr) {
+    return;
+  }
+  compression_thread_pool_->Schedule(
+      [chunk = current_chunk_]() { CompressChunk(*chunk); });
+  pending_chunks_.push_back(std::move(current_chunk_));
+  current_chunk_ = nullptr;
+}
+
+Status CustomWriter::WritePendingChunks(size_t max_pending) {
+  while (!pending_chunks_.empty()) {
+    std::shared_ptr<PendingChunk> chunk = pending_chunks_.front();
+    if (pending_chunks_.size() <= max_pending &&
+        !chunk->done.HasBeenNotified()) {
+      break;
+    }
+    chunk->done.WaitForNotification();
+    pending_chunks_.pop_front();
+    TF_RETURN_IF_ERROR(chunk->status);
+    for (PendingRecord& record : chunk->records) {
+      TF_RETURN_IF_ERROR(WriteCompressedRecord(record));
+    }
+  }
+  return OkStatus();
+}
+
+Status CustomWriter::WriteCompressedRecord(PendingRecord& record) {
+  if (record.compress) {
+    compression_policy_.RecordCompression(record.uncompressed.size(),
+                                          record.compressed.size(),
+                                          record.compression_micros);
+  }
+  const bool store_uncompressed =
+      !record.compress ||
+      record.compressed.size() >= record.uncompressed.size();
+  record.metadata.set_uncompressed(store_uncompressed);
 
 #if defined(TF_CORD_SUPPORT)
   auto metadata_buffer = new std::string();
-  metadata.SerializeToString(metadata_buffer);
+  record.metadata.SerializeToString(metadata_buffer);
   absl::Cord metadata_serialized = absl::MakeCordFromExternal(
       *metadata_buffer,
       [metadata_buffer](absl::string_view) { delete metadata_buffer; });
 #else
-  std::string metadata_serialized = metadata.SerializeAsString();
+  std::string metadata_serialized = record.metadata.SerializeAsString();
 #endif  // TF_CORD_SUPPORT
   TF_RETURN_IF_ERROR(WriteRecord(metadata_serialized));
-  TF_RETURN_IF_ERROR(WriteRecord(output));
-  return OkStatus();
+  if (!store_uncompressed) {
+    return WriteRecord(record.compressed);
+  }
+  if (record.uncompressed.size() > std::numeric_limits<uint32>::max()) {
+    return errors::InvalidArgument("Snapshot record of ",
+                                   record.uncompressed.size(),
+                                   " bytes is too large for snappy.");
+  }
+  // Stores the contents as a snappy literal, which costs a copy on read
+  // instead of a decompression.
+  const std::string literal_header =
+      SnappyLiteralHeader(record.uncompressed.size());
+  char header[kHeaderSize];
+  core::EncodeFixed64(header,
+                      literal_header.size() + record.uncompressed.size());
+  TF_RETURN_IF_ERROR(dest_->Append(StringPiece(header, sizeof(header))));
+  TF_RETURN_IF_ERROR(dest_->Append(literal_header));
+  return dest_->Append(record.uncompressed);
 }
 
-Status CustomWriter::Sync() { return dest_->Sync(); }
+Status CustomWriter::Sync() {
+  ScheduleCurrentChunk();
+  TF_RETURN_IF_ERROR(WritePendingChunks(/*max_pending=*/0));
+  return dest_->Sync();
+}
 
 Status CustomWriter::Close() {
   if (dest_ != nullptr) {
+    ScheduleCurrentChunk();
+    Status s = WritePendingChunks(/*max_pending=*/0);
+    if (!s.ok()) {
+      // Records after a failed one must not be written.
+      pending_chunks_.clear();
+      return s;
+    }
     TF_RETURN_IF_ERROR(dest_->Close());
     dest_ = nullptr;
   }
@@ -16,6 +16,11 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DATA_SNAPSHOT_UTILS_H_
 #define TENSORFLOW_CORE_DATA_SNAPSHOT_UTILS_H_
 
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -24,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/lib/io/inputstream_interface.h"
 #include "tensorflow/core/lib/io/record_reader.h"
 #include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/file_system.h"
 #include "tensorflow/core/platform/path.h"
@@ -119,7 +125,47 @@ class TFRecordWriter : public Writer {
   std::unique_ptr<io::RecordWriter> record_writer_;
 };
 
+// Decides whether to snappy-compress the next record of a snapshot, based on
+// the compression ratio and throughput measured on previous records.
+// Compression is skipped when it saves too little space, or saves bytes more
+// slowly than a single stream can write them. Every `kProbeInterval`-th record
+// is compressed regardless, so that the estimates follow changes in the data.
+//
+// Not thread-safe.
+class AdaptiveCompressionPolicy {
+ public:
+  static constexpr int kProbeInterval = 16;
+
+  // `num_compression_threads` is the number of records compressed in
+  // parallel, or 0 if records are compressed inline.
+  explicit AdaptiveCompressionPolicy(int num_compression_threads);
+
+  // Returns whether the next record should be compressed.
+  bool ShouldCompress();
+
+  // Records that compressing `uncompressed_bytes` into `compressed_bytes` took
+  // `compression_micros` on a single thread.
+  void RecordCompression(uint64 uncompressed_bytes, uint64 compressed_bytes,
+                         uint64 compression_micros);
+
+ private:
+  const int num_compression_threads_;
+  int64_t num_records_ = 0;
+  // Moving averages of the compressed-to-uncompressed size ratio and of the
+  // single-thread compression throughput. Negative until measured.
+  double compression_ratio_ = -1.0;
+  double compression_bytes_per_micro_ = -1.0;
+};
+
 // Writes snapshot with a custom (legacy) file format.
+//
+// With snappy compression and a `compression_thread_pool`, records are batched
+// into chunks of at least `kCompressionChunkBytes`, whose records are
+// compressed on one thread of the pool. Chunks are compressed in parallel and
+// written to the file in order. Records
+// that `AdaptiveCompressionPolicy` decides not to compress are written as
+// snappy streams that hold their contents as a single literal, which all
+// snappy readers can read.
 class CustomWriter : public Writer {
  public:
   static constexpr const size_t kHeaderSize = sizeof(uint64);
@@ -129,8 +175,17 @@ class CustomWriter : public Writer {
   static constexpr const char* const kWriteCord = "WriteCord";
   static constexpr const char* const kSeparator = "::";
 
+  // Uncompressed bytes of records that are batched into a chunk before the
+  // chunk is compressed, so that small records do not each cost a closure.
+  static constexpr const size_t kCompressionChunkBytes = 1 << 20;
+
+  // Chunks waiting to be written per thread of the compression thread pool.
+  static constexpr const int kMaxPendingChunksPerThread = 2;
+
+  // `compression_thread_pool` is not owned and must outlive the writer.
   CustomWriter(const std::string& filename, const std::string& compression_type,
-               const DataTypeVector& dtypes);
+               const DataTypeVector& dtypes,
+               thread::ThreadPool* compression_thread_pool = nullptr);
 
   Status WriteTensors(const std::vector<Tensor>& tensors) override;
 
@@ -144,6 +199,31 @@ class CustomWriter : public Writer {
   Status Initialize(tensorflow::Env* env) override;
 
  private:
+  // A record of the snappy path.
+  struct PendingRecord;
+  // Records of the snappy path that are compressed together, asynchronously.
+  struct PendingChunk;
+
+  // Serializes `tensors` into the metadata and uncompressed data of `record`.
+  Status SerializeTensors(const std::vector<Tensor>& tensors,
+                          PendingRecord& record);
+
+  // Compresses `record` if requested.
+  static Status CompressRecord(PendingRecord& record);
+
+  // Compresses the records of `chunk`, and notifies `chunk.done`.
+  static void CompressChunk(PendingChunk& chunk);
+
+  // Schedules the compression of `current_chunk_`, if any.
+  void ScheduleCurrentChunk();
+
+  // Writes the compressed chunks at the front of `pending_chunks_`, waiting
+  // for the compression of chunks while more than `max_pending` remain.
+  Status WritePendingChunks(size_t max_pending);
+
+  // Writes the metadata and data records of a compressed `record`.
+  Status WriteCompressedRecord(PendingRecord& record);
+
   Status WriteRecord(const StringPiece& data);
 
 #if defined(TF_CORD_SUPPORT)
@@ -161,6 +241,13 @@ class CustomWriter : public Writer {
   std::vector<bool> simple_tensor_mask_;  // true for simple, false for complex.
   int num_simple_ = 0;
   int num_complex_ = 0;
+
+  thread::ThreadPool* const compression_thread_pool_;
+  AdaptiveCompressionPolicy compression_policy_;
+  // Records batched for the next chunk.
+  std::shared_ptr<PendingChunk> current_chunk_;
+  // Chunks being compressed or waiting to be written, in write order.
+  std::deque<std::shared_ptr<PendingChunk>> pending_chunks_;
 };
 
 // Interface class for reading snapshot files previous written with Writer.
@@ -15,13 +15,24 @@ limitations under the License.
 
 #include "tensorflow/core/data/snapshot_utils.h"
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
 #include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/coding.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/io/compression.h"
+#include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/snappy.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/protobuf/snapshot.pb.h"
 
 namespace tensorflow {
 namespace data {
@@ -91,6 +102,131 @@ TEST(SnapshotUtilTest, CombinationRoundTripTest) {
   SnapshotRoundTrip(io::compression::kSnappy, 2);
 }
 
+TEST(SnapshotUtilTest, IncompressibleRoundTrip) {
+  // Random bytes do not compress, so the writer stores most records as is.
+  random::PhiloxRandom philox(/*seed=*/42);
+  random::SimplePhilox rng(&philox);
+  std::vector<std::vector<Tensor>> elements;
+  for (int i = 0; i < 100; ++i) {
+    Tensor simple(DT_INT64, TensorShape({1024}));
+    for (int j = 0; j < simple.NumElements(); ++j) {
+      simple.flat<int64_t>()(j) = rng.Rand64();
+    }
+    Tensor complex(tstring(absl::StrCat("element ", i)));
+    elements.push_back({simple, complex});
+  }
+  const DataTypeVector dtypes = {DT_INT64, DT_STRING};
+
+  std::string filename;
+  ASSERT_TRUE(Env::Default()->LocalTempFilename(&filename));
+  std::unique_ptr<Writer> writer;
+  TF_ASSERT_OK(Writer::Create(Env::Default(), filename,
+                              io::compression::kSnappy, /*version=*/1, dtypes,
+                              &writer));
+  for (const auto& element : elements) {
+    TF_ASSERT_OK(writer->WriteTensors(element));
+  }
+  TF_ASSERT_OK(writer->Close());
+
+  // Every data record is a snappy stream. The ones that were not compressed
+  // end with their contents, which start with the simple tensor, as is.
+  std::string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), filename, &contents));
+  StringPiece input(contents);
+  auto read_record = [&input](StringPiece* record) {
+    if (input.size() < CustomWriter::kHeaderSize) return false;
+    const uint64 length = core::DecodeFixed64(input.data());
+    input.remove_prefix(CustomWriter::kHeaderSize);
+    if (input.size() < length) return false;
+    *record = input.substr(0, length);
+    input.remove_prefix(length);
+    return true;
+  };
+  int num_uncompressed = 0;
+  for (const auto& element : elements) {
+    StringPiece metadata_record;
+    StringPiece data_record;
+    ASSERT_TRUE(read_record(&metadata_record));
+    ASSERT_TRUE(read_record(&data_record));
+    experimental::SnapshotTensorMetadata metadata;
+    ASSERT_TRUE(metadata.ParseFromArray(metadata_record.data(),
+                                        metadata_record.size()));
+    size_t total_size = 0;
+    for (const auto& tensor_metadata : metadata.tensor_metadata()) {
+      total_size += tensor_metadata.tensor_size_bytes();
+    }
+    size_t uncompressed_size;
+    ASSERT_TRUE(port::Snappy_GetUncompressedLength(
+        data_record.data(), data_record.size(), &uncompressed_size));
+    EXPECT_EQ(uncompressed_size, total_size);
+    if (!metadata.uncompressed()) continue;
+    ++num_uncompressed;
+    ASSERT_GE(data_record.size(), total_size);
+    const StringPiece stored =
+        data_record.substr(data_record.size() - total_size);
+    EXPECT_EQ(stored.substr(0, element[0].TotalBytes()),
+              element[0].tensor_data());
+  }
+  EXPECT_TRUE(input.empty());
+  EXPECT_GT(num_uncompressed, 0);
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), filename,
+                              io::compression::kSnappy, /*version=*/1, dtypes,
+                              &reader));
+  for (const auto& element : elements) {
+    std::vector<Tensor> read_tensors;
+    TF_ASSERT_OK(reader->ReadTensors(&read_tensors));
+    ASSERT_EQ(read_tensors.size(), 2);
+    test::ExpectEqual(read_tensors[0], element[0]);
+    test::ExpectEqual(read_tensors[1], element[1]);
+  }
+  TF_ASSERT_OK(Env::Default()->DeleteFile(filename));
+}
+
+TEST(AdaptiveCompressionPolicyTest, CompressesUntilMeasured) {
+  AdaptiveCompressionPolicy policy(/*num_compression_threads=*/0);
+  for (int i = 0; i < 2 * AdaptiveCompressionPolicy::kProbeInterval; ++i) {
+    EXPECT_TRUE(policy.ShouldCompress());
+  }
+}
+
+TEST(AdaptiveCompressionPolicyTest, SkipsIncompressibleData) {
+  AdaptiveCompressionPolicy policy(/*num_compression_threads=*/0);
+  EXPECT_TRUE(policy.ShouldCompress());
+  policy.RecordCompression(/*uncompressed_bytes=*/1 << 20,
+                           /*compressed_bytes=*/(1 << 20) - 10,
+                           /*compression_micros=*/100);
+  int num_compressed = 0;
+  for (int i = 1; i < AdaptiveCompressionPolicy::kProbeInterval; ++i) {
+    num_compressed += policy.ShouldCompress();
+  }
+  EXPECT_EQ(num_compressed, 0);
+  // Probes the data again.
+  EXPECT_TRUE(policy.ShouldCompress());
+  policy.RecordCompression(/*uncompressed_bytes=*/1 << 20,
+                           /*compressed_bytes=*/1 << 10,
+                           /*compression_micros=*/100);
+  policy.RecordCompression(/*uncompressed_bytes=*/1 << 20,
+                           /*compressed_bytes=*/1 << 10,
+                           /*compression_micros=*/100);
+  EXPECT_TRUE(policy.ShouldCompress());
+}
+
+TEST(AdaptiveCompressionPolicyTest, AccountsForParallelCompression) {
+  // Saves 20% of 100MB/s, which is too slow on one thread but not on four.
+  AdaptiveCompressionPolicy inline_policy(/*num_compression_threads=*/0);
+  AdaptiveCompressionPolicy parallel_policy(/*num_compression_threads=*/4);
+  for (AdaptiveCompressionPolicy* policy : {&inline_policy, &parallel_policy}) {
+    EXPECT_TRUE(policy->ShouldCompress());
+    policy->RecordCompression(/*uncompressed_bytes=*/100 << 20,
+                              /*compressed_bytes=*/80 << 20,
+                              /*compression_micros=*/1000000);
+  }
+  EXPECT_FALSE(inline_policy.ShouldCompress());
+  EXPECT_TRUE(parallel_policy.ShouldCompress());
+}
+
 void SnapshotReaderBenchmarkLoop(::testing::benchmark::State& state,
                                  std::string compression_type, int version) {
   tensorflow::DataTypeVector dtypes;
@@ -0,0 +1,92 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SPSC_RING_H_
+#define TENSORFLOW_CORE_DATA_SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace tensorflow {
+namespace data {
+
+// A bounded, lock-free queue with a single producer and a single consumer.
+// `Push()` must not be called concurrently with itself, nor `Pop()` with
+// itself, but the producer and the consumer may run concurrently.
+//
+// `Push()` publishes an element, and `Empty()` observes it, with sequentially
+// consistent ordering. A producer that pushes and then reads a flag, and a
+// consumer that sets the flag and then checks `Empty()`, therefore cannot both
+// miss each other, which lets the consumer sleep until it is woken.
+template <typename T>
+class SpscRing {
+ public:
+  // Creates a ring that holds up to `capacity` elements.
+  explicit SpscRing(size_t capacity) : slots_(capacity + 1) {}
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Appends `value`. Returns false, and leaves `value` unchanged, if the ring
+  // is full. Must only be called by the producer.
+  bool Push(T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t next = Next(tail);
+    if (next == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots_[tail] = std::move(value);
+    tail_.store(next, std::memory_order_seq_cst);
+    return true;
+  }
+
+  // Moves the oldest element to `value`. Returns false if the ring is empty.
+  // Must only be called by the consumer.
+  bool Pop(T* value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *value = std::move(slots_[head]);
+    slots_[head] = T();
+    head_.store(Next(head), std::memory_order_release);
+    return true;
+  }
+
+  // Returns true if the ring holds no element. Must only be called by the
+  // consumer.
+  bool Empty() const {
+    return head_.load(std::memory_order_relaxed) ==
+           tail_.load(std::memory_order_seq_cst);
+  }
+
+ private:
+  size_t Next(size_t index) const {
+    return index + 1 == slots_.size() ? 0 : index + 1;
+  }
+
+  // One slot is always left empty, to tell a full ring from an empty one.
+  std::vector<T> slots_;
+  // The producer and the consumer each write one of the indices, so they are
+  // kept on separate cache lines.
+  alignas(64) std::atomic<size_t> head_{0};  // Next slot to pop.
+  alignas(64) std::atomic<size_t> tail_{0};  // Next slot to push.
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SPSC_RING_H_
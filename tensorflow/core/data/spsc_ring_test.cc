@@ -0,0 +1,92 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/data/spsc_ring.h"
+
+#include <memory>
+#include <thread>  // NOLINT
+
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+TEST(SpscRing, PushAndPopInOrder) {
+  SpscRing<int> ring(/*capacity=*/3);
+  EXPECT_TRUE(ring.Empty());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(ring.Push(i));
+  }
+  int value = 3;
+  EXPECT_FALSE(ring.Push(value));
+  EXPECT_EQ(value, 3);
+  EXPECT_FALSE(ring.Empty());
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(ring.Pop(&value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(ring.Pop(&value));
+  EXPECT_TRUE(ring.Empty());
+}
+
+TEST(SpscRing, WrapsAround) {
+  SpscRing<int> ring(/*capacity=*/2);
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(ring.Push(i));
+    int value;
+    ASSERT_TRUE(ring.Pop(&value));
+    EXPECT_EQ(value, i);
+  }
+}
+
+TEST(SpscRing, ReleasesPoppedElements) {
+  SpscRing<std::shared_ptr<int>> ring(/*capacity=*/1);
+  auto element = std::make_shared<int>(1);
+  std::weak_ptr<int> weak = element;
+  ASSERT_TRUE(ring.Push(element));
+  std::shared_ptr<int> popped;
+  ASSERT_TRUE(ring.Pop(&popped));
+  popped.reset();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(SpscRing, ConcurrentProducerAndConsumer) {
+  const int kNumElements = 100000;
+  SpscRing<int> ring(/*capacity=*/16);
+  std::unique_ptr<Thread> producer(Env::Default()->StartThread(
+      ThreadOptions(), "producer", [&ring]() {
+        for (int i = 0; i < kNumElements; ++i) {
+          int value = i;
+          while (!ring.Push(value)) {
+            std::this_thread::yield();
+          }
+        }
+      }));
+  for (int i = 0; i < kNumElements; ++i) {
+    int value;
+    while (!ring.Pop(&value)) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(value, i);
+  }
+  producer.reset();
+  EXPECT_TRUE(ring.Empty());
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -35,7 +35,8 @@ namespace tensorflow {
 namespace {
 
 static std::unique_ptr<Device> NewDevice(const string& type,
-                                         const string& name) {
+                                         const string& name,
+                                         const string& host_name = "") {
   class FakeDevice : public Device {
    public:
     explicit FakeDevice(const DeviceAttributes& attr) : Device(nullptr, attr) {}
@@ -47,6 +48,7 @@ static std::unique_ptr<Device> NewDevice(const string& type,
   attr.set_device_type(type);
   attr.mutable_locality()->set_numa_node(3);  // a non-default value
   attr.set_incarnation(random::New64());
+  attr.set_host_name(host_name);
   return std::make_unique<FakeDevice>(attr);
 }
 
@@ -113,16 +115,21 @@ class DeviceResDistTest : public ::testing::Test {
   }
 
  protected:
+  // If `num_hosts` is positive, the workers are placed on that many hosts in
+  // turn. Otherwise their devices do not report a host.
   void DefineWorkers(int num_workers, int num_devices,
-                     const string& device_type, bool nccl) {
+                     const string& device_type, bool nccl, int num_hosts = 0) {
     for (int w = 0; w < num_workers; ++w) {
       string name = strings::StrCat("/job:worker/replica:0/task:", w);
-      DefineWorker(name, device_type, num_devices, nccl);
+      DefineWorker(name, device_type, num_devices, nccl,
+                   num_hosts > 0 ? strings::StrCat("host", w % num_hosts)
+                                 : "");
     }
   }
 
   void DefineWorker(const string& worker_name, const string& device_type,
-                    int num_devices, bool nccl) {
+                    int num_devices, bool nccl,
+                    const string& host_name = "") {
     ConfigProto config;
     config.mutable_experimental()->set_collective_group_leader(
         "/job:worker/replica:0/task:0");
@@ -132,7 +139,8 @@ class DeviceResDistTest : public ::testing::Test {
     for (int i = 0; i < num_devices; ++i) {
       devices.push_back(NewDevice(
           device_type,
-          strings::StrCat(worker_name, "/device:", device_type, ":", i)));
+          strings::StrCat(worker_name, "/device:", device_type, ":", i),
+          host_name));
     }
     device_mgrs_[worker_name] =
         std::make_unique<StaticDeviceMgr>(std::move(devices));
@@ -337,6 +345,49 @@ TEST_F(DeviceResDistTest, Workers2Devices2) {
   ValidateCollectiveParams(num_workers, num_devices);
 }
 
+TEST_F(DeviceResDistTest, ReduceHierarchicallyAcrossHosts) {
+  // Single-device workers, two on each host.
+  const int num_workers = 4;
+  const int num_devices = 1;
+  DefineWorkers(num_workers, num_devices, "CPU", /*nccl*/ false,
+                /*num_hosts=*/2);
+  DefineCollectiveParams(num_workers, num_devices, "CPU");
+  IssueRequests(num_workers, num_devices);
+  ValidateCollectiveParams(num_workers, num_devices);
+  for (const auto& it : cp_) {
+    EXPECT_EQ(it.second->instance.impl_details.collective_name,
+              "HierarchicalRingReduce");
+  }
+}
+
+TEST_F(DeviceResDistTest, ReduceInFlatRingWithoutHosts) {
+  const int num_workers = 2;
+  const int num_devices = 2;
+  DefineWorkers(num_workers, num_devices, "CPU", /*nccl*/ false);
+  DefineCollectiveParams(num_workers, num_devices, "CPU");
+  IssueRequests(num_workers, num_devices);
+  ValidateCollectiveParams(num_workers, num_devices);
+  for (const auto& it : cp_) {
+    EXPECT_EQ(it.second->instance.impl_details.collective_name, "RingReduce");
+  }
+}
+
+TEST_F(DeviceResDistTest, ReduceInFlatRingIfRequested) {
+  const int num_workers = 4;
+  const int num_devices = 1;
+  DefineWorkers(num_workers, num_devices, "CPU", /*nccl*/ false,
+                /*num_hosts=*/2);
+  DefineCollectiveParams(num_workers, num_devices, "CPU");
+  for (const auto& it : cp_) {
+    it.second->instance.impl_details.communication_hint = "ring";
+  }
+  IssueRequests(num_workers, num_devices);
+  ValidateCollectiveParams(num_workers, num_devices);
+  for (const auto& it : cp_) {
+    EXPECT_EQ(it.second->instance.impl_details.collective_name, "RingReduce");
+  }
+}
+
 TEST_F(DeviceResDistTest, DifferentIncarnation) {
   const int num_workers = 2;
   const int num_devices = 1;
@@ -16,6 +16,8 @@ limitations under the License.
 
 #include <memory>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "tensorflow/core/common_runtime/base_collective_executor.h"
 #include "tensorflow/core/common_runtime/copy_tensor.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
@@ -24,9 +26,11 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/call_options.h"
 #include "tensorflow/core/distributed_runtime/cancellable_call.h"
 #include "tensorflow/core/distributed_runtime/request_id.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_recv_buf.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/protobuf_internal.h"
 #include "tensorflow/core/profiler/lib/scoped_memory_debug_annotation.h"
 #include "tensorflow/core/protobuf/transport_options.pb.h"
@@ -78,7 +82,27 @@ void PopulateTensorFromExtra(const RecvBufRespExtra& extra,
   }
 }
 
+// Returns true if the tensor content of `response` was written to a
+// shared-memory segment.
+bool InSharedMemory(const RecvBufResponse& response) {
+  RecvBufRespExtra extra;
+  return response.has_transport_options() &&
+         response.transport_options().UnpackTo(&extra) &&
+         extra.in_shared_memory();
+}
+
+// Returns true if the server of `response` runs on another host than the
+// shared-memory segment offered to it.
+bool OnRemoteHost(const RecvBufResponse& response) {
+  RecvBufRespExtra extra;
+  return response.has_transport_options() &&
+         response.transport_options().UnpackTo(&extra) &&
+         extra.shared_memory_remote_host();
+}
+
+// `segment` is the shared-memory segment offered in the request, if any.
 Status PopulateTensorFromResponse(const RecvBufResponse& response,
+                                  const SharedMemorySegment* segment,
                                   Tensor* cpu_tensor) {
   const bool has_transport_options = response.has_transport_options();
 
@@ -90,6 +114,16 @@ Status PopulateTensorFromResponse(const RecvBufResponse& response,
   int64_t num_bytes = 0;
   RecvBufRespExtra extra;
   response.transport_options().UnpackTo(&extra);
+  if (extra.in_shared_memory()) {
+    if (segment == nullptr ||
+        segment->size() < static_cast<size_t>(total_bytes)) {
+      return errors::Internal(
+          "RecvBufResponse refers to a shared memory segment that was not "
+          "offered");
+    }
+    memcpy(DMAHelper::base(cpu_tensor), segment->data(), total_bytes);
+    return OkStatus();
+  }
   for (const auto& chunk : extra.tensor_content()) {
     num_bytes += chunk.size();
   }
@@ -103,6 +137,38 @@ Status PopulateTensorFromResponse(const RecvBufResponse& response,
   return OkStatus();
 }
 
+// Peer tasks that did not use the shared-memory segments offered to them and
+// are not offered any more: for good if they run on another host, and for
+// `kDeclinedRetryMicros` otherwise, since e.g. a failure to map a segment may
+// be transient.
+class DecliningPeers {
+ public:
+  static constexpr uint64 kDeclinedRetryMicros = 60 * 1000 * 1000;
+
+  static DecliningPeers* Global() {
+    static DecliningPeers* peers = new DecliningPeers;
+    return peers;
+  }
+
+  bool Contains(const string& task) {
+    tf_shared_lock l(mu_);
+    auto it = tasks_.find(task);
+    return it != tasks_.end() && Env::Default()->NowMicros() < it->second;
+  }
+
+  void Insert(const string& task, bool remote_host) {
+    mutex_lock l(mu_);
+    tasks_[task] = remote_host
+                       ? kuint64max
+                       : Env::Default()->NowMicros() + kDeclinedRetryMicros;
+  }
+
+ private:
+  mutex mu_;
+  // The time until which each task is not offered segments.
+  absl::flat_hash_map<string, uint64> tasks_ TF_GUARDED_BY(mu_);
+};
+
 }  // namespace
 
 void CollectiveRemoteAccessDistributed::RecvFromPeer(
@@ -125,6 +191,7 @@ void CollectiveRemoteAccessDistributed::RecvFromPeer(
     DeviceAttributes server_attributes;
     std::unique_ptr<RecvBufCall> call;
     std::unique_ptr<Tensor> cpu_tensor;
+    std::unique_ptr<SharedMemorySegment> segment;
   };
   State* state = new State;
 
@@ -168,8 +235,9 @@ void CollectiveRemoteAccessDistributed::RecvFromPeer(
 
   // Logic to be executed on the RecvBufAsync callback.
   auto recv_buf_callback =
-      [this, state, to_device, to_alloc_attr, to_device_ctx, to_tensor, cpu_dev,
-       dev_to_dev_stream_index, dst_tensor, done](const Status& s) {
+      [this, state, peer_task, to_device, to_alloc_attr, to_device_ctx,
+       to_tensor, cpu_dev, dev_to_dev_stream_index, dst_tensor,
+       done](const Status& s) {
         if (s.ok()) {
           // In this generic implementation the bytes come back in one of 2
           // ways:
@@ -179,12 +247,24 @@ void CollectiveRemoteAccessDistributed::RecvFromPeer(
           // either the temporary cpu_tensor in case to_device is a GPU device
           // OR directly to to_tensor if to_device is not a GPU device.
           //
-          // PopulateTensorFromResponse handles both cases.
+          // A server on the same host may also have written the bytes to
+          // the shared-memory segment offered in the request.
+          //
+          // PopulateTensorFromResponse handles all cases.
           // (NOP in 2nd case) In case the final to_tensor is on GPU, buf_ptr
           // points to a tmp CPU buffer and needs to be copied over to
           // to_tensor.
-          Status status =
-              PopulateTensorFromResponse(state->call->resp_, dst_tensor);
+          Status status = PopulateTensorFromResponse(
+              state->call->resp_, state->segment.get(), dst_tensor);
+          // The segment of a failed call, which the server may still write
+          // to, is not reused.
+          if (state->segment != nullptr && status.ok()) {
+            if (!InSharedMemory(state->call->resp_)) {
+              DecliningPeers::Global()->Insert(
+                  peer_task, OnRemoteHost(state->call->resp_));
+            }
+            ReleaseRecvBufSegment(std::move(state->segment));
+          }
           if (!status.ok()) {
             done(status);
             delete state;
@@ -215,6 +295,12 @@ void CollectiveRemoteAccessDistributed::RecvFromPeer(
       step_id_, peer_device, peer_task, key, to_device, to_device_ctx,
       to_alloc_attr, dst_tensor, client_locality, state->server_attributes,
       cancellation_manager, worker_cache_));
+  if (!DecliningPeers::Global()->Contains(peer_task)) {
+    state->segment = AcquireRecvBufSegment(dst_tensor->TotalBytes());
+    if (state->segment != nullptr) {
+      OfferRecvBufSegment(*state->segment, &state->call->req_);
+    }
+  }
   CancellationToken abortion_token =
       abortion_cancel_mgr_.get_cancellation_token();
   bool already_aborted = !abortion_cancel_mgr_.RegisterCallback(
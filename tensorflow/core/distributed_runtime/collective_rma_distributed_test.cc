@@ -20,10 +20,12 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/dma_helper.h"
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/distributed_runtime/device_resolver_distributed.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_recv_buf.h"
 #include "tensorflow/core/distributed_runtime/test_utils.h"
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/device_attributes.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/random.h"
@@ -138,6 +140,12 @@ class FakeWorker : public TestWorkerInterface {
             int64_t num_bytes = h->prod_value->TotalBytes();
 
             if (set_tensor_in_extra_) {
+              if (SetTensorInRecvBufSegment(*request, *h->prod_value,
+                                            response)) {
+                done(s);
+                BufRendezvous::DoneWithHook(h);
+                return;
+              }
               // Since this is not really RDMA into pre-allocated memory send
               // the bytes in the response.
               RecvBufRespExtra extra;
@@ -408,6 +416,53 @@ TEST_P(CollRMADistTest, ProdFirstOK) {
   ValidateResultTensor();
 }
 
+TEST_P(CollRMADistTest, ProdFirstLargeOK) {
+  // Large enough to be offered a shared memory segment.
+  ResolveDeviceAttributes();
+  const int kNumElts = 1 << 16;
+  Tensor expected_value(DT_FLOAT, {kNumElts});
+  Tensor to_tensor(DT_FLOAT, {kNumElts});
+  for (int i = 0; i < kNumElts; ++i) {
+    expected_value.flat<float>()(i) = i;
+    to_tensor.flat<float>()(i) = -1;
+  }
+  Notification consumer_note;
+  Notification producer_note;
+  Status consumer_status;
+  Status producer_status;
+  FakeWorker* wi = workers_[1];
+  const string kBufKey = "fake_buf_key";
+  wi->buf_rendezvous()->ProvideBuf(
+      kBufKey, nullptr /*device*/, nullptr /*dev_ctx*/, &expected_value,
+      AllocatorAttributes(),
+      [&producer_note, &producer_status](const Status& s) {
+        producer_status.Update(s);
+        producer_note.Notify();
+      },
+      nullptr /*cancellation_manager*/);
+  Device* dst_device = nullptr;
+  string dev_name = "CPU:0";
+  TF_EXPECT_OK(device_mgrs_[0]->LookupDevice(dev_name, &dst_device));
+  DeviceContext* to_device_ctx = nullptr;
+  MaybeSetGPUDevice(dst_device);
+  rma_->RecvFromPeer(
+      "/job:worker/replica:0/task:1/device:" + dev_name,  // peer_dev
+      "/job:worker/replica:0/task:1",                     // peer_task
+      false,                                              // peer_is_local
+      kBufKey, dst_device, to_device_ctx, alloc_attr_, &to_tensor,
+      device_locality_, 0 /*dev_to_dev_stream_index*/,
+      nullptr /*cancellation_manager*/,
+      [&consumer_status, &consumer_note](const Status& s) {
+        consumer_status = s;
+        consumer_note.Notify();
+      });
+  consumer_note.WaitForNotification();
+  TF_EXPECT_OK(consumer_status);
+  producer_note.WaitForNotification();
+  TF_EXPECT_OK(producer_status);
+  test::ExpectTensorEqual<float>(expected_value, to_tensor);
+}
+
 TEST_P(CollRMADistTest, ConsFirstOK) {
   ResolveDeviceAttributes();
   Notification consumer_note;
@@ -15,20 +15,34 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/grpc_tensor_coding.h"
 
+#include <algorithm>
+#include <memory>
+
 #include "grpcpp/support/byte_buffer.h"
 #include "grpcpp/support/slice.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/distributed_runtime/tensor_coding.h"
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_reference.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/io/proto_encode_helper.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
 
 namespace tensorflow {
 namespace grpc {
+namespace {
+
+auto* recv_tensor_content_bytes = monitoring::Counter<1>::New(
+    "/tensorflow/core/recv_tensor_content_bytes",
+    "Bytes of tensor contents sent in RecvTensor responses, by encoding.",
+    "encoding");
+
+}  // namespace
 
 void EncodeRecvTensorResponseToByteBuffer(const RecvTensorResponse& proto,
                                           ::grpc::ByteBuffer* result) {
@@ -134,9 +148,122 @@ static void EncodeSkeleton(const Tensor& val, io::ProtoEncodeHelper* e) {
 #endif
 }
 
+// Encodes "response" with a tensor() holding the skeleton of "val" and
+// "tdata" as its contents. "tdata" is either in "content", which is handed
+// over to the result, or in the backing store of "val".
+static void EncodeTensorContentToByteBuffer(const RecvTensorResponse& response,
+                                            const Tensor& val,
+                                            StringPiece tdata,
+                                            std::unique_ptr<string> content,
+                                            ::grpc::ByteBuffer* result) {
+  const int kLargeTensorBytes = 1024;
+
+  // skeleton is the encoded TensorProto contents (dtype and shape), but
+  // not the actual data
+  gtl::InlinedVector<char, 128> skeleton(SkeletonEncodingSizeUpperBound(val));
+  io::ProtoEncodeHelper e_skeleton(skeleton.data(), skeleton.size());
+  EncodeSkeleton(val, &e_skeleton);
+
+  recv_tensor_content_bytes
+      ->GetCell(RecvTensorEncoding_Name(response.encoding()))
+      ->IncrementBy(tdata.size());
+  uint32 overall_tensor_proto_bytesize =
+      (e_skeleton.size() +
+       VarLengthEncodingSize(TensorProto::kTensorContentFieldNumber,
+                             tdata.size()));
+  string header;  // All of RecvTensorResponse except the tensor() field
+  response.AppendToString(&header);
+
+  size_t expected_size =
+      (header.size() +
+       VarLengthEncodingSize(RecvTensorResponse::kTensorFieldNumber,
+                             overall_tensor_proto_bytesize));
+  // If "share_tensor_slice_memory == false", we copy the tensor data to
+  // the end of the buffer we are preparing that holds the rest of the
+  // RecvTensorResponse protocol buffer.
+  //
+  // If "share_tensor_slice_memory == true", we arrange to share the
+  // backing store of the data by creating a slice that also points to the
+  // backing store, with appropriate reference counts to keep the
+  // backing store alive as needed.
+  //
+  // We enable this behavior if the tensor is large.
+  bool share_tensor_slice_memory = (tdata.size() > kLargeTensorBytes);
+
+  size_t encoder_size = expected_size - tdata.size();
+
+  // Encode all but the actual "tdata", but including the tag and
+  // varlength header for the "tdata"
+  gtl::InlinedVector<char, 1024> space(encoder_size);
+  io::ProtoEncodeHelper e(space.data(), space.size());
+  // (A)
+  e.WriteRawBytes(header);
+
+  // (B1) & (B2)
+  e.WriteVarlengthBeginning(RecvTensorResponse::kTensorFieldNumber,
+                            overall_tensor_proto_bytesize);
+  // (C)
+  e.WriteRawBytes(StringPiece(e_skeleton.data(), e_skeleton.size()));
+  // (D1) & (D2)
+  e.WriteVarlengthBeginning(TensorProto::kTensorContentFieldNumber,
+                            tdata.size());
+
+  // All but the tensor backing store are serialized now
+
+  // Now allocate memory and put into the ByteBuffer
+  ::grpc::Slice slices[2];
+  int num_slices = 0;
+  {
+    size_t slice_len =
+        e.size() + (share_tensor_slice_memory ? 0 : tdata.size());
+    slices[0] = ::grpc::Slice(slice_len);
+    memcpy(const_cast<uint8_t*>(slices[0].begin()), e.data(), e.size());
+    if (!share_tensor_slice_memory) {
+      // (E)
+      memcpy(const_cast<uint8_t*>(slices[0].begin()) + e.size(), tdata.data(),
+             tdata.size());
+    }
+    num_slices += 1;
+  }
+
+  if (share_tensor_slice_memory && content) {
+    // (E) Encode tensor data, by handing the encoded contents over to the
+    // slice
+    slices[1] = ::grpc::Slice(
+        const_cast<char*>(tdata.data()), tdata.size(),
+        [](void* backing) { delete static_cast<string*>(backing); },
+        content.release());
+    num_slices += 1;
+  } else if (share_tensor_slice_memory) {
+    // (E) Encode tensor data, but by sharing backing store
+    const TensorBuffer* buf = DMAHelper::buffer(&val);
+    buf->Ref();
+    slices[1] = ::grpc::Slice(
+        const_cast<void*>(static_cast<const void*>(tdata.data())),
+        tdata.size(),
+        [](void* backing) { static_cast<TensorBuffer*>(backing)->Unref(); },
+        const_cast<TensorBuffer*>(buf));
+    num_slices += 1;
+  }
+  size_t total_bytes = 0;
+  for (int i = 0; i < num_slices; i++) {
+    total_bytes += slices[i].size();
+  }
+  CHECK_EQ(total_bytes, expected_size);
+
+  ::grpc::ByteBuffer tmp(&slices[0], num_slices);
+  result->Swap(&tmp);
+}
+
 void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
                               ::grpc::ByteBuffer* result) {
-  const int kLargeTensorBytes = 1024;
+  EncodeTensorToByteBuffer(is_dead, val, require_ack, RECV_TENSOR_ENCODING_RAW,
+                           result);
+}
+
+void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
+                              RecvTensorEncoding encoding,
+                              ::grpc::ByteBuffer* result) {
   const int64_t kProtoBufLimitBytes = 1LL << 31;
 
   if (val.TotalBytes() > kProtoBufLimitBytes) {
@@ -157,96 +284,63 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
     // TODO(jeff,sanjay): If this becomes an issue, we could
     // go directly from val -> ByteBuffer, with some effort.
     val.AsProtoTensorContent(response.mutable_tensor());
+    recv_tensor_content_bytes
+        ->GetCell(RecvTensorEncoding_Name(RECV_TENSOR_ENCODING_RAW))
+        ->IncrementBy(response.tensor().ByteSizeLong());
 
     // Encode full protocol buffer to a ByteBuffer
     EncodeRecvTensorResponseToByteBuffer(response, result);
   } else {
-    // skeleton is the encoded TensorProto contents (dtype and shape), but
-    // not the actual data
-    gtl::InlinedVector<char, 128> skeleton(SkeletonEncodingSizeUpperBound(val));
-    io::ProtoEncodeHelper e_skeleton(skeleton.data(), skeleton.size());
-    EncodeSkeleton(val, &e_skeleton);
-
-    StringPiece tdata = val.tensor_data();
-    uint32 overall_tensor_proto_bytesize =
-        (e_skeleton.size() +
-         VarLengthEncodingSize(TensorProto::kTensorContentFieldNumber,
-                               tdata.size()));
-    string header;  // All of RecvTensorResponse except the tensor() field
-    response.AppendToString(&header);
-
-    size_t expected_size =
-        (header.size() +
-         VarLengthEncodingSize(RecvTensorResponse::kTensorFieldNumber,
-                               overall_tensor_proto_bytesize));
-    // If "share_tensor_slice_memory == false", we copy the tensor data to
-    // the end of the buffer we are preparing that holds the rest of the
-    // RecvTensorResponse protocol buffer.
-    //
-    // If "share_tensor_slice_memory == true", we arrange to share the
-    // backing store of the data by creating a slice that also points to the
-    // backing store, with appropriate reference counts to keep the
-    // backing store alive as needed.
-    //
-    // We enable this behavior if the tensor is large.
-    bool share_tensor_slice_memory = (tdata.size() > kLargeTensorBytes);
-
-    size_t encoder_size = expected_size - tdata.size();
-
-    // Encode all but the actual "tdata", but including the tag and
-    // varlength header for the "tdata"
-    gtl::InlinedVector<char, 1024> space(encoder_size);
-    io::ProtoEncodeHelper e(space.data(), space.size());
-    // (A)
-    e.WriteRawBytes(header);
-
-    // (B1) & (B2)
-    e.WriteVarlengthBeginning(RecvTensorResponse::kTensorFieldNumber,
-                              overall_tensor_proto_bytesize);
-    // (C)
-    e.WriteRawBytes(StringPiece(e_skeleton.data(), e_skeleton.size()));
-    // (D1) & (D2)
-    e.WriteVarlengthBeginning(TensorProto::kTensorContentFieldNumber,
-                              tdata.size());
-
-    // All but the tensor backing store are serialized now
-
-    // Now allocate memory and put into the ByteBuffer
-    ::grpc::Slice slices[2];
-    int num_slices = 0;
-    {
-      size_t slice_len =
-          e.size() + (share_tensor_slice_memory ? 0 : tdata.size());
-      slices[0] = ::grpc::Slice(slice_len);
-      memcpy(const_cast<uint8_t*>(slices[0].begin()), e.data(), e.size());
-      if (!share_tensor_slice_memory) {
-        // (E)
-        memcpy(const_cast<uint8_t*>(slices[0].begin()) + e.size(), tdata.data(),
-               tdata.size());
+    // If the contents are encoded, "content" holds them until they are sent.
+    std::unique_ptr<string> content;
+    if (encoding != RECV_TENSOR_ENCODING_RAW) {
+      content = std::make_unique<string>();
+      if (EncodeTensorContent(encoding, val, content.get())) {
+        response.set_encoding(encoding);
+      } else {
+        content.reset();
       }
-      num_slices += 1;
     }
+    StringPiece tdata = content ? StringPiece(*content) : val.tensor_data();
+    EncodeTensorContentToByteBuffer(response, val, tdata, std::move(content),
+                                    result);
+  }
+}
 
-    if (share_tensor_slice_memory) {
-      // (E) Encode tensor data, but by sharing backing store
-      const TensorBuffer* buf = DMAHelper::buffer(&val);
-      buf->Ref();
-      slices[1] = ::grpc::Slice(
-          const_cast<void*>(static_cast<const void*>(tdata.data())),
-          tdata.size(),
-          [](void* backing) { static_cast<TensorBuffer*>(backing)->Unref(); },
-          const_cast<TensorBuffer*>(buf));
-      num_slices += 1;
-    }
-    size_t total_bytes = 0;
-    for (int i = 0; i < num_slices; i++) {
-      total_bytes += slices[i].size();
-    }
-    CHECK_EQ(total_bytes, expected_size);
+// Returns the size of the parts in which the contents of a tensor are
+// streamed to a receiver that accepts "max_content_bytes" per response. The
+// receiver sets the value, so it is clamped here: larger parts would overflow
+// the encoded size of the response.
+static int64_t ContentPartBytes(int64_t max_content_bytes) {
+  return std::min(max_content_bytes, kMaxRecvTensorContentPartBytes);
+}
 
-    ::grpc::ByteBuffer tmp(&slices[0], num_slices);
-    result->Swap(&tmp);
-  }
+bool StreamsTensorContent(bool is_dead, const Tensor& val,
+                          int64_t max_content_bytes) {
+  return max_content_bytes > 0 && !is_dead &&
+         DataTypeCanUseMemcpy(val.dtype()) &&
+         static_cast<int64_t>(val.TotalBytes()) >
+             ContentPartBytes(max_content_bytes);
+}
+
+void EncodeTensorContentPartToByteBuffer(const Tensor& val,
+                                         int64_t content_offset,
+                                         int64_t max_content_bytes,
+                                         ::grpc::ByteBuffer* result) {
+  const int64_t total_bytes = val.TotalBytes();
+  DCHECK_GE(content_offset, 0);
+  DCHECK_LT(content_offset, total_bytes);
+  const int64_t num_bytes = std::min(ContentPartBytes(max_content_bytes),
+                                     total_bytes - content_offset);
+
+  RecvTensorResponse response;
+  // The receiver acks the last part, which releases the tensor.
+  response.set_require_ack(content_offset + num_bytes == total_bytes);
+  response.set_send_start_micros(Env::Default()->NowMicros());
+  response.set_total_content_bytes(total_bytes);
+  EncodeTensorContentToByteBuffer(
+      response, val, val.tensor_data().substr(content_offset, num_bytes),
+      nullptr, result);
 }
 
 }  // namespace grpc
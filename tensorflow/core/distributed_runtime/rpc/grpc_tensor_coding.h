@@ -17,10 +17,10 @@ limitations under the License.
 #define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_GRPC_TENSOR_CODING_H_
 
 #include "grpcpp/impl/codegen/byte_buffer.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
 
 namespace tensorflow {
 class Tensor;
-class RecvTensorResponse;
 
 // TODO(jeff,sanjay): this should not be grpc specific.  Instead of
 // grpc::ByteBuffer*, it should accept an object of an interface type
@@ -49,6 +49,32 @@ void EncodeRecvTensorResponseToByteBuffer(const RecvTensorResponse& proto,
 void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
                               ::grpc::ByteBuffer* result);
 
+// As above, but sends the contents of "val" in "encoding" if that makes
+// them smaller (see tensor_encoding.h), and raw otherwise.
+void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
+                              RecvTensorEncoding encoding,
+                              ::grpc::ByteBuffer* result);
+
+// Returns true if the contents of "val" are streamed to a receiver that
+// accepts at most "max_content_bytes" of them per response (see
+// RecvTensorRequest.max_content_bytes). Parts are never larger than
+// kMaxRecvTensorContentPartBytes (see tensor_coding.h), whatever
+// "max_content_bytes".
+bool StreamsTensorContent(bool is_dead, const Tensor& val,
+                          int64_t max_content_bytes);
+
+// Encode the part of the raw contents of "val" that starts at
+// "content_offset", up to "max_content_bytes" of them, into a byte buffer
+// in a format that is parseable as a streamed RecvTensorResponse.  The
+// response requires an ack if it holds the last part.
+//
+// Requires StreamsTensorContent() and an offset within the contents.
+// Discards original contents of *result.
+void EncodeTensorContentPartToByteBuffer(const Tensor& val,
+                                         int64_t content_offset,
+                                         int64_t max_content_bytes,
+                                         ::grpc::ByteBuffer* result);
+
 }  // namespace grpc
 }  // namespace tensorflow
 
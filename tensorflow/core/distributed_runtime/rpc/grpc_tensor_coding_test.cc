@@ -17,8 +17,10 @@ limitations under the License.
 
 #include "grpcpp/support/byte_buffer.h"
 #include "grpcpp/support/slice.h"
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/test.h"
@@ -100,4 +102,92 @@ TEST_F(GrpcTensorCodingTest, Simple) {
 
 TEST_F(GrpcTensorCodingTest, StringTensor) { DoTestForStrings(DT_STRING); }
 
+TEST_F(GrpcTensorCodingTest, EncodedTensor) {
+  // Small integers, which bfloat16 represents exactly.
+  Tensor t(DT_FLOAT, TensorShape({100, 100}));
+  auto flat = t.flat<float>();
+  for (int64_t i = 0; i < flat.size(); ++i) {
+    flat(i) = i % 100;
+  }
+  for (RecvTensorEncoding encoding :
+       {RECV_TENSOR_ENCODING_RAW, RECV_TENSOR_ENCODING_BFLOAT16}) {
+    ::grpc::ByteBuffer buf;
+    grpc::EncodeTensorToByteBuffer(false, t, false, encoding, &buf);
+    std::vector<::grpc::Slice> slices;
+    (void)buf.Dump(&slices);
+    string tmp;
+    for (const auto& s : slices) {
+      tmp.append(reinterpret_cast<const char*>(s.begin()), s.size());
+    }
+
+    RecvTensorResponse response;
+    ASSERT_TRUE(response.ParseFromString(tmp));
+    EXPECT_EQ(response.encoding(), encoding);
+    EXPECT_EQ(response.tensor().tensor_content().size(),
+              encoding == RECV_TENSOR_ENCODING_RAW ? t.TotalBytes()
+                                                   : t.TotalBytes() / 2);
+    TF_ASSERT_OK(
+        DecodeTensorProtoContent(encoding, response.mutable_tensor()));
+    Tensor result;
+    ASSERT_TRUE(result.FromProto(response.tensor()));
+    test::ExpectTensorEqual<float>(result, t);
+  }
+
+  // Tensors that cannot be encoded are sent raw.
+  Tensor ints(DT_INT32, TensorShape({100, 100}));
+  ::grpc::ByteBuffer buf;
+  grpc::EncodeTensorToByteBuffer(false, ints, false,
+                                 RECV_TENSOR_ENCODING_BFLOAT16, &buf);
+  std::vector<::grpc::Slice> slices;
+  (void)buf.Dump(&slices);
+  string tmp;
+  for (const auto& s : slices) {
+    tmp.append(reinterpret_cast<const char*>(s.begin()), s.size());
+  }
+  RecvTensorResponse response;
+  ASSERT_TRUE(response.ParseFromString(tmp));
+  EXPECT_EQ(response.encoding(), RECV_TENSOR_ENCODING_RAW);
+}
+
+TEST_F(GrpcTensorCodingTest, StreamedTensor) {
+  Tensor t(DT_INT32, TensorShape({100, 100}));
+  auto flat = t.flat<int32>();
+  for (int64_t i = 0; i < flat.size(); ++i) {
+    flat(i) = i;
+  }
+  const int64_t max_content_bytes = 15000;
+  EXPECT_TRUE(grpc::StreamsTensorContent(false, t, max_content_bytes));
+  EXPECT_FALSE(grpc::StreamsTensorContent(true, t, max_content_bytes));
+  EXPECT_FALSE(grpc::StreamsTensorContent(false, t, 0));
+  EXPECT_FALSE(grpc::StreamsTensorContent(false, t, t.TotalBytes()));
+  EXPECT_FALSE(grpc::StreamsTensorContent(
+      false, Tensor(DT_STRING, TensorShape({10000})), max_content_bytes));
+
+  string content;
+  for (int64_t offset = 0; offset < t.TotalBytes();
+       offset += max_content_bytes) {
+    ::grpc::ByteBuffer buf;
+    grpc::EncodeTensorContentPartToByteBuffer(t, offset, max_content_bytes,
+                                              &buf);
+    std::vector<::grpc::Slice> slices;
+    (void)buf.Dump(&slices);
+    string tmp;
+    for (const auto& s : slices) {
+      tmp.append(reinterpret_cast<const char*>(s.begin()), s.size());
+    }
+
+    RecvTensorResponse response;
+    ASSERT_TRUE(response.ParseFromString(tmp));
+    EXPECT_EQ(response.total_content_bytes(), t.TotalBytes());
+    EXPECT_EQ(response.encoding(), RECV_TENSOR_ENCODING_RAW);
+    EXPECT_EQ(response.tensor().dtype(), DT_INT32);
+    EXPECT_EQ(TensorShape(response.tensor().tensor_shape()), t.shape());
+    // Only the last part releases the tensor.
+    EXPECT_EQ(response.require_ack(),
+              offset + max_content_bytes >= t.TotalBytes());
+    content.append(response.tensor().tensor_content());
+  }
+  EXPECT_EQ(content, t.tensor_data());
+}
+
 }  // namespace tensorflow
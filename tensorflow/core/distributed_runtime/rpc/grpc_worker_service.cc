@@ -37,6 +37,8 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/rpc/grpc_tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service_impl.h"
+#include "tensorflow/core/distributed_runtime/shared_memory_recv_buf.h"
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
 #include "tensorflow/core/distributed_runtime/worker.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/distributed_runtime/worker_session.h"
@@ -449,19 +451,53 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
 
   bool cache_enabled = (response_cache_ != nullptr && request_id != 0);
 
-  auto do_response = [response, done, cache_enabled](const Tensor& tensor,
-                                                     bool is_dead,
-                                                     const Status& status) {
-    if (status.ok()) {
-      grpc::EncodeTensorToByteBuffer(is_dead, tensor, cache_enabled, response);
+  // Large tensors are streamed from the response cache if there is one, and
+  // from `streamed_tensors_` otherwise, which hold them until the receiver
+  // acks the last part.
+  const int64_t max_content_bytes =
+      request_id != 0 ? request->max_content_bytes() : 0;
+  auto do_response = [this, response, done, cache_enabled, max_content_bytes,
+                      request_id, step_id,
+                      content_offset = request->content_offset(),
+                      accepted_encodings = request->accepted_encodings()](
+                         const Tensor& tensor, bool is_dead,
+                         const Status& status) {
+    if (!status.ok()) {
+      done(status);
+      return;
     }
-    done(status);
+    if (grpc::StreamsTensorContent(is_dead, tensor, max_content_bytes)) {
+      if (content_offset < 0 ||
+          content_offset >= static_cast<int64_t>(tensor.TotalBytes())) {
+        done(errors::InvalidArgument("Content offset ", content_offset,
+                                     " is out of range for a tensor of ",
+                                     tensor.TotalBytes(), " bytes"));
+        return;
+      }
+      if (!cache_enabled && content_offset == 0) {
+        mutex_lock l(streamed_tensors_mu_);
+        streamed_tensors_[request_id] = {step_id, tensor};
+      }
+      grpc::EncodeTensorContentPartToByteBuffer(tensor, content_offset,
+                                                max_content_bytes, response);
+    } else if (content_offset != 0) {
+      done(errors::InvalidArgument(
+          "Content offset ", content_offset,
+          " is set for a tensor whose contents are not streamed"));
+      return;
+    } else {
+      grpc::EncodeTensorToByteBuffer(
+          is_dead, tensor, cache_enabled,
+          ChooseRecvTensorEncoding(tensor, accepted_encodings), response);
+    }
+    done(OkStatus());
   };
 
   // If response cache is enabled and the response cache already contains the
   // request, we delegate this retry request to the response cache. Otherwise,
   // we add the request to the response cache and start the computation to
-  // retrieve the requested data.
+  // retrieve the requested data. The requests for the following parts of
+  // streamed contents are served from the response cache as well.
   if (cache_enabled &&
       response_cache_->QueueRequest(request_id, step_id, do_response)) {
     return;
@@ -482,6 +518,34 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
     rendezvous_done(Tensor(), false, status);
   };
 
+  // The following parts of streamed contents can only be served from the
+  // tensor held since the first part: the tensor has already been consumed
+  // from the rendezvous, so if it is not held any more, its entry must have
+  // been dropped, e.g. when the step was cleaned up.
+  if (request->content_offset() > 0) {
+    if (!cache_enabled) {
+      Tensor tensor;
+      bool found = false;
+      {
+        mutex_lock l(streamed_tensors_mu_);
+        auto it = streamed_tensors_.find(request_id);
+        if (it != streamed_tensors_.end()) {
+          tensor = it->second.tensor;
+          found = true;
+        }
+      }
+      if (found) {
+        do_response(tensor, /*is_dead=*/false, OkStatus());
+        return;
+      }
+    }
+    fail(errors::FailedPrecondition(
+        "RecvTensor request ", request_id, " of step ", step_id,
+        " continues at content offset ", request->content_offset(),
+        " but its tensor is no longer cached"));
+    return;
+  }
+
   Status s = recent_request_ids_.TrackUnique(
       request_id, "RecvTensor (GrpcWorker)", *request);
   if (!s.ok()) {
@@ -578,8 +642,10 @@ namespace {
 // RecvBufRespExtra.tensor_content to a cord instead of a repeated string,
 // and remove this function.
 void SetTensorInRecvBufResp(int64_t max_chunk_bytes, const Tensor* tensor,
+                            const RecvBufRequest& request,
                             RecvBufResponse* response) {
   RecvBufRespExtra extra;
+  extra.set_shared_memory_remote_host(RecvBufSegmentOnOtherHost(request));
   int64_t num_bytes = tensor->TotalBytes();
   const char* head = reinterpret_cast<const char*>(DMAHelper::base(tensor));
   while (num_bytes > 0) {
@@ -599,11 +665,14 @@ void GrpcWorker::RecvBufAsync(CallOptions* opts, const RecvBufRequest* request,
   const int64_t step_id = request->step_id();
   bool cache_enabled = (response_cache_ != nullptr && request_id != 0);
 
-  auto do_response = [this, response, done, cache_enabled](
+  auto do_response = [this, request, response, done, cache_enabled](
                          const Tensor& tensor, bool is_dead,
                          const Status& status) {
-    if (status.ok()) {
-      SetTensorInRecvBufResp(recv_buf_max_chunk_, &tensor, response);
+    // Clients on the same host receive the tensor in shared memory.
+    if (status.ok() &&
+        !SetTensorInRecvBufSegment(*request, tensor, response)) {
+      SetTensorInRecvBufResp(recv_buf_max_chunk_, &tensor, *request,
+                             response);
     }
     response->set_send_start_micros(env_->env->NowMicros());
     response->set_require_ack(cache_enabled);
@@ -746,6 +815,16 @@ void GrpcWorker::CleanupGraphAsync(const CleanupGraphRequest* request,
     // a worker crashes before acking a request.
     response_cache_->CleanEntriesForStep(request->step_id());
   }
+  {
+    mutex_lock l(streamed_tensors_mu_);
+    for (auto it = streamed_tensors_.begin(); it != streamed_tensors_.end();) {
+      if (it->second.step_id == request->step_id()) {
+        streamed_tensors_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
   Worker::CleanupGraphAsync(request, response, done);
 }
 
@@ -755,6 +834,8 @@ void GrpcWorker::RemoveCacheEntryForId(int64_t request_id) {
   if (response_cache_) {
     response_cache_->EraseRequestId(request_id);
   }
+  mutex_lock l(streamed_tensors_mu_);
+  streamed_tensors_.erase(request_id);
 }
 
 std::unique_ptr<GrpcWorker> NewGrpcWorker(WorkerEnv* env,
@@ -20,9 +20,13 @@ limitations under the License.
 #include <unordered_map>
 
 #include "grpcpp/server_builder.h"
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_response_cache.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service_impl.h"
 #include "tensorflow/core/distributed_runtime/worker.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
 #include "tensorflow/tsl/distributed_runtime/rpc/async_service_interface.h"
 
@@ -68,8 +72,20 @@ class GrpcWorker : public Worker {
   void RemoveCacheEntryForId(int64_t request_id);
 
  private:
+  struct StreamedTensor {
+    int64_t step_id;
+    Tensor tensor;
+  };
+
   std::unique_ptr<GrpcResponseCache> response_cache_;
   const int32 recv_buf_max_chunk_;
+
+  // Without a response cache, holds the tensors whose contents are streamed
+  // to a receiver, by request id, until the receiver acks the last part or
+  // the step is cleaned up.
+  mutex streamed_tensors_mu_;
+  absl::flat_hash_map<int64_t, StreamedTensor> streamed_tensors_
+      TF_GUARDED_BY(streamed_tensors_mu_);
 };
 
 std::unique_ptr<GrpcWorker> NewGrpcWorker(WorkerEnv* worker_env,
@@ -21,6 +21,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/distributed_runtime/request_id.h"
 #include "tensorflow/core/distributed_runtime/tensor_coding.h"
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/distributed_runtime/worker_interface.h"
 #include "tensorflow/core/framework/types.h"
@@ -57,7 +58,8 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
  public:
   RpcRecvTensorCall() : wi_(nullptr), dst_device_(nullptr) {}
 
-  void Init(WorkerInterface* wi, int64_t step_id, StringPiece key,
+  void Init(WorkerInterface* wi, int64_t step_id,
+            const Rendezvous::ParsedKey& parsed,
             AllocatorAttributes alloc_attrs, Device* dst_device,
             const Rendezvous::Args& recv_args, Rendezvous::DoneCallback done) {
     wi_ = wi;
@@ -66,8 +68,13 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     recv_args_ = recv_args;
     done_ = std::move(done);
     req_.set_step_id(step_id);
+    StringPiece key = parsed.FullKey();
     req_.set_rendezvous_key(key.data(), key.size());
     req_.set_request_id(GetUniqueRequestId());
+    for (RecvTensorEncoding encoding :
+         AcceptedRecvTensorEncodings(parsed.edge_name)) {
+      req_.add_accepted_encodings(encoding);
+    }
   }
 
   void Reset() {
@@ -132,18 +139,37 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
  private:
   friend class RpcRemoteRendezvous;
 
-  // Start the main RecvTensor call, checking for an async abort.
+  // Start the main RecvTensor call.
   void StartRTCall(std::function<void()> recv_done) {
     resp_.InitAlloc(dst_device_, alloc_attrs_);
+    if (resp_.on_host()) {
+      // Larger tensors are streamed into the tensor of resp_, so that neither
+      // side buffers their whole response.
+      req_.set_max_content_bytes(RecvTensorStreamingBytes());
+    }
+    IssueRecvTensor(std::move(recv_done));
+  }
+
+  // Issue a RecvTensor request for the contents that resp_ lacks, checking
+  // for an async abort.
+  void IssueRecvTensor(std::function<void()> recv_done) {
     auto abort_checked = std::make_shared<Notification>();
     auto cb = [this, abort_checked,
-               recv_done = std::move(recv_done)](const Status& s) {
+               recv_done = std::move(recv_done)](const Status& s) mutable {
       // Make sure the Rendezvous abort checking is finished before running the
       // callback, which might destroy the current call object.
       abort_checked->WaitForNotification();
       if (!s.ok()) {
         mutex_lock l(mu_);
         status_.Update(s);
+      } else if (resp_.content_pending() && status().ok()) {
+        // The next part of the streamed contents is only requested once this
+        // one is in place, which bounds the memory of both sides to one part
+        // beyond the tensor.
+        req_.set_content_offset(resp_.content_end());
+        resp_.InitContinuation(resp_.content_end());
+        IssueRecvTensor(std::move(recv_done));
+        return;
       }
       recv_done();
     };
@@ -267,7 +293,7 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
     return;
   }
 
-  call->Init(rwi, step_id_, parsed.FullKey(), recv_args.alloc_attrs, dst_device,
+  call->Init(rwi, step_id_, parsed, recv_args.alloc_attrs, dst_device,
              recv_args, std::move(done));
 
   // Record "call" in calls_ so that it can be aborted cleanly.
@@ -15,10 +15,16 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/rpc_rendezvous_mgr.h"
 
+#include <atomic>
+
+#include "tensorflow/core/common_runtime/device_factory.h"
 #include "tensorflow/core/common_runtime/process_util.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service.h"
 #include "tensorflow/core/distributed_runtime/test_utils.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/control_flow.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
@@ -112,6 +118,67 @@ static Device* CreateDevice(const char* type, const char* name) {
   return new FakeDevice(attr);
 }
 
+// Serves RecvTensor calls with a GrpcWorker, through the gRPC encoding of its
+// responses. The parts of streamed tensor contents are capped at
+// `max_content_bytes`.
+class GrpcWorkerRecvTensorAdapter : public TestWorkerInterface {
+ public:
+  GrpcWorkerRecvTensorAdapter(GrpcWorker* worker, int64_t max_content_bytes,
+                              std::atomic<int>* num_calls)
+      : worker_(worker),
+        max_content_bytes_(max_content_bytes),
+        num_calls_(num_calls) {}
+
+  void RecvTensorAsync(CallOptions* opts, const RecvTensorRequest* request,
+                       TensorResponse* response, StatusCallback done) override {
+    num_calls_->fetch_add(1);
+    auto capped = std::make_shared<RecvTensorRequest>(*request);
+    capped->set_max_content_bytes(max_content_bytes_);
+    auto buffer = std::make_shared<::grpc::ByteBuffer>();
+    worker_->GrpcRecvTensorAsync(
+        opts, capped.get(), buffer.get(),
+        [worker = worker_, capped, buffer, response, done](const Status& s) {
+          if (!s.ok()) {
+            done(s);
+            return;
+          }
+          if (!GrpcMaybeParseTensorResponse(buffer.get(), response)) {
+            done(errors::Internal("Failed to parse RecvTensorResponse"));
+            return;
+          }
+          if (response->metadata().require_ack()) {
+            worker->RemoveCacheEntryForId(capped->request_id());
+          }
+          done(OkStatus());
+        });
+  }
+
+ private:
+  GrpcWorker* const worker_;  // Not owned.
+  const int64_t max_content_bytes_;
+  std::atomic<int>* const num_calls_;  // Not owned.
+};
+
+// Worker cache whose workers all forward to `worker`.
+class GrpcWorkerAdapterCache : public DummyWorkerCache {
+ public:
+  GrpcWorkerAdapterCache(GrpcWorker* worker, int64_t max_content_bytes,
+                         std::atomic<int>* num_calls)
+      : worker_(worker),
+        max_content_bytes_(max_content_bytes),
+        num_calls_(num_calls) {}
+
+  WorkerInterface* GetOrCreateWorker(const string& target) override {
+    return new GrpcWorkerRecvTensorAdapter(worker_, max_content_bytes_,
+                                           num_calls_);
+  }
+
+ private:
+  GrpcWorker* const worker_;  // Not owned.
+  const int64_t max_content_bytes_;
+  std::atomic<int>* const num_calls_;  // Not owned.
+};
+
 static DeviceMgr* CreateDeviceMgr() {
   std::unique_ptr<Device> d0(
       CreateDevice("CPU", "/job:mnist/replica:1/task:2/cpu:1"));
@@ -350,4 +417,146 @@ TEST_F(RpcRendezvousMgrTest, RemoteRecvAsyncMany) {
   rmgr_.Cleanup(step_id);
 }
 
+TEST(RpcRecvTensorCallTest, StreamsContentsFromGrpcWorker) {
+  const string server_name = "/job:mnist/replica:1/task:1";
+  const string client_name = "/job:mnist/replica:1/task:2";
+  std::unique_ptr<Device> server_device =
+      DeviceFactory::NewDevice("CPU", SessionOptions(), server_name);
+  std::unique_ptr<Device> client_device =
+      DeviceFactory::NewDevice("CPU", SessionOptions(), client_name);
+  ASSERT_NE(server_device, nullptr);
+  ASSERT_NE(client_device, nullptr);
+  const string src_device = server_device->name();
+  const uint64 src_incarnation = server_device->attributes().incarnation();
+  const string dst_device = client_device->name();
+  StaticDeviceMgr server_devices(std::move(server_device));
+  StaticDeviceMgr client_devices(std::move(client_device));
+
+  auto create_session = [](const string& name, WorkerCacheInterface* cache,
+                           DeviceMgr* device_mgr) {
+    return WorkerSession::CreateWithBorrowedDeviceMgr(
+        "rpc_session", name, std::unique_ptr<WorkerCacheInterface>(cache),
+        device_mgr, std::unique_ptr<GraphMgr>(), nullptr,
+        [](WorkerSession* worker_session, bool called,
+           DeviceMgr* remote_device_mgr) { return nullptr; });
+  };
+
+  WorkerEnv server_env;
+  server_env.env = Env::Default();
+  server_env.device_mgr = &server_devices;
+  RpcRendezvousMgr server_rmgr(&server_env);
+  server_env.rendezvous_mgr = &server_rmgr;
+  std::shared_ptr<WorkerSession> server_session =
+      create_session(server_name, new DummyWorkerCache, &server_devices);
+  GrpcWorker server_worker(&server_env, ConfigProto());
+  server_worker.EnableResponseCache();
+
+  // Streams the contents in parts of 4KB, which takes 10 RecvTensor calls.
+  const int64_t kPartBytes = 4096;
+  const int kNumElements = 10000;
+  std::atomic<int> num_calls(0);
+  WorkerEnv client_env;
+  client_env.env = Env::Default();
+  RpcRendezvousMgr client_rmgr(&client_env);
+  std::shared_ptr<WorkerSession> client_session = create_session(
+      client_name,
+      new GrpcWorkerAdapterCache(&server_worker, kPartBytes, &num_calls),
+      &client_devices);
+
+  const int64_t step_id = 123;
+  const Rendezvous::ParsedKey key = MakeKey(Rendezvous::CreateKey(
+      src_device, src_incarnation, dst_device, "foo", FrameAndIter(0, 0)));
+  Tensor sent(DT_FLOAT, TensorShape({kNumElements}));
+  for (int i = 0; i < kNumElements; ++i) {
+    sent.flat<float>()(i) = i;
+  }
+  {
+    RemoteRendezvous* rendez = server_rmgr.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(server_session.get()));
+    core::ScopedUnref unref(rendez);
+    TF_ASSERT_OK(rendez->Send(key, Rendezvous::Args(), sent, false));
+  }
+  {
+    RemoteRendezvous* rendez = client_rmgr.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(client_session.get()));
+    core::ScopedUnref unref(rendez);
+    Tensor received;
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez->Recv(key, Rendezvous::Args(), &received, &is_dead));
+    EXPECT_FALSE(is_dead);
+    test::ExpectTensorEqual<float>(sent, received);
+  }
+  const int64_t total_bytes = kNumElements * sizeof(float);
+  EXPECT_EQ(num_calls.load(), (total_bytes + kPartBytes - 1) / kPartBytes);
+  client_rmgr.Cleanup(step_id);
+  server_rmgr.Cleanup(step_id);
+}
+
+TEST(RpcRecvTensorCallTest, RejectsContinuationWithoutCachedTensor) {
+  const string server_name = "/job:mnist/replica:1/task:1";
+  std::unique_ptr<Device> server_device =
+      DeviceFactory::NewDevice("CPU", SessionOptions(), server_name);
+  ASSERT_NE(server_device, nullptr);
+  const string src_device = server_device->name();
+  const uint64 src_incarnation = server_device->attributes().incarnation();
+  StaticDeviceMgr server_devices(std::move(server_device));
+
+  WorkerEnv server_env;
+  server_env.env = Env::Default();
+  server_env.device_mgr = &server_devices;
+  RpcRendezvousMgr server_rmgr(&server_env);
+  server_env.rendezvous_mgr = &server_rmgr;
+  std::shared_ptr<WorkerSession> server_session =
+      WorkerSession::CreateWithBorrowedDeviceMgr(
+          "rpc_session", server_name,
+          std::unique_ptr<WorkerCacheInterface>(new DummyWorkerCache),
+          &server_devices, std::unique_ptr<GraphMgr>(), nullptr,
+          [](WorkerSession* worker_session, bool called,
+             DeviceMgr* remote_device_mgr) { return nullptr; });
+  GrpcWorker server_worker(&server_env, ConfigProto());
+  server_worker.EnableResponseCache();
+
+  const int64_t step_id = 123;
+  const string key = Rendezvous::CreateKey(
+      src_device, src_incarnation, "/job:mnist/replica:1/task:2/cpu:0", "foo",
+      FrameAndIter(0, 0));
+  Tensor sent(DT_FLOAT, TensorShape({10000}));
+  sent.flat<float>().setZero();
+  {
+    RemoteRendezvous* rendez = server_rmgr.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(server_session.get()));
+    core::ScopedUnref unref(rendez);
+    TF_ASSERT_OK(rendez->Send(MakeKey(key), Rendezvous::Args(), sent, false));
+  }
+
+  RecvTensorRequest request;
+  request.set_step_id(step_id);
+  request.set_rendezvous_key(key);
+  request.set_request_id(1);
+  request.set_max_content_bytes(4096);
+  auto recv = [&server_worker](const RecvTensorRequest& request) {
+    CallOptions opts;
+    ::grpc::ByteBuffer buffer;
+    Notification n;
+    Status status;
+    server_worker.GrpcRecvTensorAsync(&opts, &request, &buffer,
+                                      [&n, &status](const Status& s) {
+                                        status = s;
+                                        n.Notify();
+                                      });
+    n.WaitForNotification();
+    return status;
+  };
+
+  // A continuation whose cache entry is gone fails instead of waiting for the
+  // tensor again, and leaves the tensor in the rendezvous.
+  request.set_content_offset(4096);
+  EXPECT_TRUE(errors::IsFailedPrecondition(recv(request)));
+  request.set_request_id(2);
+  request.set_content_offset(0);
+  TF_EXPECT_OK(recv(request));
+  server_worker.RemoveCacheEntryForId(2);
+  server_rmgr.Cleanup(step_id);
+}
+
 }  // namespace tensorflow
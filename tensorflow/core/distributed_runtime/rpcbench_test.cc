@@ -26,6 +26,7 @@ limitations under the License.
 #include "tensorflow/core/graph/default_device.h"
 #include "tensorflow/core/graph/graph_def_builder.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/logging.h"
@@ -34,6 +35,7 @@ limitations under the License.
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/protobuf/cluster.pb.h"
 #include "tensorflow/core/protobuf/tensorflow_server.pb.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
 #include "tensorflow/core/public/session.h"
 
 namespace tensorflow {
@@ -165,7 +167,26 @@ string DebugString(const Tensor& x, const Tensor& y, int tensor_size) {
                          x_flat(1), y_flat(0), y_flat(1));
 }
 
+// Returns the bytes of tensor contents sent by RecvTensor calls since the
+// last call, in all encodings.
+int64_t RecvTensorContentBytes(
+    monitoring::testing::CellReader<int64_t>* content_bytes) {
+  int64_t bytes = 0;
+  for (int encoding = RecvTensorEncoding_MIN;
+       encoding <= RecvTensorEncoding_MAX; ++encoding) {
+    bytes += content_bytes->Delta(
+        RecvTensorEncoding_Name(static_cast<RecvTensorEncoding>(encoding)));
+  }
+  return bytes;
+}
+
 // TODO: Support sharding and depth.
+//
+// The label reports the tensor bytes that are sent over the wire per step.
+// Run with TF_RECV_TENSOR_ENCODINGS set (e.g. to "snappy" or "bfloat16") to
+// measure the effect of RecvTensor encodings on them and on the step time.
+// Lossy encodings also need TF_RECV_TENSOR_LOSSY_SCOPES to cover the names of
+// the benchmark's nodes.
 static void BM_Helper(::testing::benchmark::State& state, int width,
                       int num_stages, int tensor_size,
                       bool use_multiple_devices) {
@@ -181,11 +202,12 @@ static void BM_Helper(::testing::benchmark::State& state, int width,
 
   // Randomly initialize the input.
   Tensor x(DT_FLOAT, TensorShape({tensor_size, 1}));
+  x.flat<float>().setRandom();
 
-  state.SetLabel(
+  const string label =
       strings::StrCat(def.node_size(), " nodes; ",
                       use_multiple_devices ? "Multi device" : "Single device",
-                      "; tensor bytes/send: ", tensor_size * sizeof(float)));
+                      "; tensor bytes/send: ", tensor_size * sizeof(float));
 
   std::vector<Tensor> outputs;
 
@@ -203,12 +225,17 @@ static void BM_Helper(::testing::benchmark::State& state, int width,
   }
 
   // Iterations.
+  monitoring::testing::CellReader<int64_t> content_bytes(
+      "/tensorflow/core/recv_tensor_content_bytes");
   for (auto s : state) {
     outputs.clear();
     TF_CHECK_OK(session->Run({{"x", x}}, {"y:0"}, {}, &outputs));
     CHECK_EQ(size_t{1}, outputs.size());
   }
   TF_CHECK_OK(session->Close());
+  state.SetLabel(strings::StrCat(
+      label, "; tensor bytes/step on the wire: ",
+      RecvTensorContentBytes(&content_bytes) / state.iterations()));
 }
 static void BM_ShardedProgram(::testing::benchmark::State& state) {
   const int width = state.range(0);
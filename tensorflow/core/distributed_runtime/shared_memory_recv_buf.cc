@@ -0,0 +1,389 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/shared_memory_recv_buf.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TF_ENABLE_SHARED_MEMORY_RECV_BUF
+#endif  // __linux__
+
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/host_info.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace {
+
+// Segments are created in the tmpfs that backs POSIX shared memory, with
+// names that start with this prefix. Servers only map segments with such
+// names, so that clients cannot make them write to other files.
+constexpr char kSegmentDirectory[] = "/dev/shm/";
+constexpr char kSegmentPrefix[] = "tf_recv_buf_";
+
+// Smaller tensors are sent in the response, whose cost is dominated by the
+// RPC rather than by copying their contents.
+constexpr int64_t kMinSharedMemoryBytes = 64 << 10;
+
+// Bounds the total size of the segments that are kept for reuse. Larger
+// tensors are received in the response.
+constexpr size_t kMaxPooledBytes = 256 << 20;
+
+// Bounds the total size of the segments that a server keeps mapped.
+constexpr size_t kMaxMappedBytes = 1 << 30;
+
+bool SharedMemoryEnabled() {
+  static const bool enabled = [] {
+    bool enabled;
+    Status s =
+        ReadBoolFromEnvVar("TF_RECV_BUF_SHARED_MEMORY", true, &enabled);
+    if (!s.ok()) {
+      LOG(WARNING) << "Shared memory RecvBuf is disabled: " << s;
+      return false;
+    }
+    return enabled;
+  }();
+  return enabled;
+}
+
+bool IsSegmentName(const std::string& name) {
+  return absl::StartsWith(name, kSegmentPrefix) &&
+         name.find('/') == std::string::npos;
+}
+
+// Returns the capacity of the pooled segment that a tensor of `num_bytes`
+// bytes is received in: the next power of two, so that segments are reused
+// by tensors of similar sizes.
+size_t SegmentCapacity(int64_t num_bytes) {
+  size_t capacity = kMinSharedMemoryBytes;
+  while (capacity < static_cast<size_t>(num_bytes)) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+// Segments of clients that are not in use, by capacity.
+class SegmentPool {
+ public:
+  static SegmentPool* Global() {
+    static SegmentPool* pool = new SegmentPool;
+    return pool;
+  }
+
+  std::unique_ptr<SharedMemorySegment> Get(size_t capacity) {
+    mutex_lock l(mu_);
+    auto it = free_segments_.find(capacity);
+    if (it == free_segments_.end() || it->second.empty()) {
+      return nullptr;
+    }
+    std::unique_ptr<SharedMemorySegment> segment = std::move(it->second.back());
+    it->second.pop_back();
+    pooled_bytes_ -= capacity;
+    return segment;
+  }
+
+  void Put(std::unique_ptr<SharedMemorySegment> segment) {
+    mutex_lock l(mu_);
+    if (pooled_bytes_ + segment->size() > kMaxPooledBytes) {
+      return;
+    }
+    pooled_bytes_ += segment->size();
+    free_segments_[segment->size()].push_back(std::move(segment));
+  }
+
+ private:
+  mutex mu_;
+  absl::flat_hash_map<size_t, std::vector<std::unique_ptr<SharedMemorySegment>>>
+      free_segments_ TF_GUARDED_BY(mu_);
+  size_t pooled_bytes_ TF_GUARDED_BY(mu_) = 0;
+};
+
+// Segments of clients that servers have mapped, by name. Clients reuse their
+// segments, so the mappings are reused across calls. The least recently used
+// mappings are dropped when the mapped segments exceed `kMaxMappedBytes`.
+class MappedSegmentCache {
+ public:
+  static MappedSegmentCache* Global() {
+    static MappedSegmentCache* cache = new MappedSegmentCache;
+    return cache;
+  }
+
+  Status Map(const std::string& name, size_t size,
+             std::shared_ptr<SharedMemorySegment>* segment) {
+    std::shared_ptr<SharedMemorySegment> cached = Lookup(name);
+    if (cached != nullptr) {
+      // The client removes the segments that it no longer pools, which must
+      // not be written to any more.
+      if (cached->size() >= size && !cached->IsRemoved()) {
+        *segment = std::move(cached);
+        return OkStatus();
+      }
+      Erase(cached);
+    }
+    std::unique_ptr<SharedMemorySegment> opened;
+    TF_RETURN_IF_ERROR(SharedMemorySegment::Open(name, size, &opened));
+    *segment = std::move(opened);
+    Insert(*segment);
+    return OkStatus();
+  }
+
+ private:
+  using LruList = std::list<std::shared_ptr<SharedMemorySegment>>;
+
+  std::shared_ptr<SharedMemorySegment> Lookup(const std::string& name) {
+    mutex_lock l(mu_);
+    auto it = segments_.find(name);
+    if (it == segments_.end()) {
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return lru_.front();
+  }
+
+  void Insert(const std::shared_ptr<SharedMemorySegment>& segment) {
+    if (segment->size() > kMaxMappedBytes) {
+      return;
+    }
+    mutex_lock l(mu_);
+    auto it = segments_.find(segment->name());
+    if (it != segments_.end()) {
+      EraseLocked(it);
+    }
+    // The segments still referenced by a copy stay mapped until it ends.
+    while (mapped_bytes_ + segment->size() > kMaxMappedBytes) {
+      EraseLocked(segments_.find(lru_.back()->name()));
+    }
+    lru_.push_front(segment);
+    segments_[segment->name()] = lru_.begin();
+    mapped_bytes_ += segment->size();
+  }
+
+  void Erase(const std::shared_ptr<SharedMemorySegment>& segment) {
+    mutex_lock l(mu_);
+    auto it = segments_.find(segment->name());
+    if (it != segments_.end() && *it->second == segment) {
+      EraseLocked(it);
+    }
+  }
+
+  void EraseLocked(
+      absl::flat_hash_map<std::string, LruList::iterator>::iterator it)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    mapped_bytes_ -= (*it->second)->size();
+    lru_.erase(it->second);
+    segments_.erase(it);
+  }
+
+  mutex mu_;
+  // Most recently used first.
+  LruList lru_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, LruList::iterator> segments_
+      TF_GUARDED_BY(mu_);
+  size_t mapped_bytes_ TF_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace
+
+#if defined(TF_ENABLE_SHARED_MEMORY_RECV_BUF)
+
+Status SharedMemorySegment::Create(
+    size_t size, std::unique_ptr<SharedMemorySegment>* segment) {
+  const std::string name = strings::StrCat(kSegmentPrefix, getpid(), "_",
+                                           strings::Hex(random::New64()));
+  const std::string path = strings::StrCat(kSegmentDirectory, name);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return errors::Unavailable("Cannot create ", path, ": ", strerror(errno));
+  }
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (ftruncate(fd, size) == 0 && fstat(fd, &st) == 0) {
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  const int error = errno;
+  close(fd);
+  if (data == MAP_FAILED) {
+    unlink(path.c_str());
+    return errors::ResourceExhausted("Cannot map ", size, " bytes of ", path,
+                                     ": ", strerror(error));
+  }
+  segment->reset(new SharedMemorySegment(name, static_cast<char*>(data), size,
+                                         /*owned=*/true, st.st_dev,
+                                         st.st_ino));
+  return OkStatus();
+}
+
+Status SharedMemorySegment::Open(
+    const std::string& name, size_t size,
+    std::unique_ptr<SharedMemorySegment>* segment) {
+  if (!IsSegmentName(name)) {
+    return errors::InvalidArgument("Invalid shared memory segment ", name);
+  }
+  const std::string path = strings::StrCat(kSegmentDirectory, name);
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+  if (fd < 0) {
+    return errors::NotFound("Cannot open ", path, ": ", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    const int error = errno;
+    close(fd);
+    return errors::Unavailable("Cannot stat ", path, ": ", strerror(error));
+  }
+  // The segment is named by the peer, so only segments created by a process
+  // of the same user are written to.
+  if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+    close(fd);
+    return errors::PermissionDenied(
+        path, " is not a shared memory segment owned by this user");
+  }
+  void* data = MAP_FAILED;
+  if (static_cast<size_t>(st.st_size) >= size) {
+    size = st.st_size;
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return errors::Unavailable("Cannot map ", size, " bytes of ", path);
+  }
+  segment->reset(new SharedMemorySegment(name, static_cast<char*>(data), size,
+                                         /*owned=*/false, st.st_dev,
+                                         st.st_ino));
+  return OkStatus();
+}
+
+SharedMemorySegment::~SharedMemorySegment() {
+  munmap(data_, size_);
+  if (owned_) {
+    unlink(strings::StrCat(kSegmentDirectory, name_).c_str());
+  }
+}
+
+bool SharedMemorySegment::IsRemoved() const {
+  struct stat st;
+  if (stat(strings::StrCat(kSegmentDirectory, name_).c_str(), &st) != 0) {
+    return true;
+  }
+  return static_cast<uint64>(st.st_dev) != device_ ||
+         static_cast<uint64>(st.st_ino) != inode_;
+}
+
+#else  // TF_ENABLE_SHARED_MEMORY_RECV_BUF
+
+Status SharedMemorySegment::Create(
+    size_t size, std::unique_ptr<SharedMemorySegment>* segment) {
+  return errors::Unimplemented("Shared memory RecvBuf is not supported");
+}
+
+Status SharedMemorySegment::Open(
+    const std::string& name, size_t size,
+    std::unique_ptr<SharedMemorySegment>* segment) {
+  return errors::Unimplemented("Shared memory RecvBuf is not supported");
+}
+
+SharedMemorySegment::~SharedMemorySegment() {}
+
+bool SharedMemorySegment::IsRemoved() const { return true; }
+
+#endif  // TF_ENABLE_SHARED_MEMORY_RECV_BUF
+
+std::unique_ptr<SharedMemorySegment> AcquireRecvBufSegment(int64_t num_bytes) {
+  if (num_bytes < kMinSharedMemoryBytes || !SharedMemoryEnabled()) {
+    return nullptr;
+  }
+  const size_t capacity = SegmentCapacity(num_bytes);
+  // Segments that could not be pooled would be created for every call.
+  if (capacity > kMaxPooledBytes) {
+    return nullptr;
+  }
+  std::unique_ptr<SharedMemorySegment> segment =
+      SegmentPool::Global()->Get(capacity);
+  if (segment == nullptr) {
+    Status s = SharedMemorySegment::Create(capacity, &segment);
+    if (!s.ok()) {
+      VLOG(1) << "Receiving a tensor without shared memory: " << s;
+      return nullptr;
+    }
+  }
+  return segment;
+}
+
+void ReleaseRecvBufSegment(std::unique_ptr<SharedMemorySegment> segment) {
+  SegmentPool::Global()->Put(std::move(segment));
+}
+
+void OfferRecvBufSegment(const SharedMemorySegment& segment,
+                         RecvBufRequest* request) {
+  RecvBufReqExtra extra;
+  extra.set_shared_memory_host(port::Hostname());
+  extra.set_shared_memory_name(segment.name());
+  extra.set_shared_memory_size(segment.size());
+  request->mutable_transport_options()->PackFrom(extra);
+}
+
+bool SetTensorInRecvBufSegment(const RecvBufRequest& request,
+                               const Tensor& tensor,
+                               RecvBufResponse* response) {
+  RecvBufReqExtra extra;
+  if (!request.has_transport_options() ||
+      !request.transport_options().UnpackTo(&extra) ||
+      extra.shared_memory_name().empty() ||
+      extra.shared_memory_host() != port::Hostname()) {
+    return false;
+  }
+  const size_t num_bytes = tensor.TotalBytes();
+  if (num_bytes > static_cast<size_t>(extra.shared_memory_size())) {
+    return false;
+  }
+  std::shared_ptr<SharedMemorySegment> segment;
+  Status s = MappedSegmentCache::Global()->Map(extra.shared_memory_name(),
+                                               num_bytes, &segment);
+  if (!s.ok()) {
+    // E.g. the client has the same host name but runs in another container.
+    VLOG(1) << "Sending a tensor without shared memory: " << s;
+    return false;
+  }
+  memcpy(segment->data(), DMAHelper::base(&tensor), num_bytes);
+  RecvBufRespExtra resp_extra;
+  resp_extra.set_in_shared_memory(true);
+  response->mutable_transport_options()->PackFrom(resp_extra);
+  return true;
+}
+
+bool RecvBufSegmentOnOtherHost(const RecvBufRequest& request) {
+  RecvBufReqExtra extra;
+  return request.has_transport_options() &&
+         request.transport_options().UnpackTo(&extra) &&
+         !extra.shared_memory_name().empty() &&
+         extra.shared_memory_host() != port::Hostname();
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,117 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_SHARED_MEMORY_RECV_BUF_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_SHARED_MEMORY_RECV_BUF_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+
+namespace tensorflow {
+
+// Transfer of the tensor contents of RecvBuf calls between tasks on the same
+// host through shared memory.
+//
+// A client that receives a large tensor offers a shared-memory segment in
+// its RecvBufRequest. If the server runs on the same host and can map the
+// segment, it copies the tensor contents into it instead of serializing them
+// into the RecvBufResponse, whose arrival then only signals that the
+// contents are ready. Otherwise the contents are sent in the response as
+// usual.
+//
+// Servers only map segments that are regular files owned by their own user,
+// and drop the mapping of a segment once the client has removed it.
+
+// A shared-memory segment mapped into this process.
+class SharedMemorySegment {
+ public:
+  // Creates a new segment of `size` bytes with a unique name, which is
+  // removed when the returned object is destroyed.
+  static Status Create(size_t size,
+                       std::unique_ptr<SharedMemorySegment>* segment);
+
+  // Maps the existing segment called `name`, which must have at least `size`
+  // bytes.
+  static Status Open(const std::string& name, size_t size,
+                     std::unique_ptr<SharedMemorySegment>* segment);
+
+  ~SharedMemorySegment();
+
+  const std::string& name() const { return name_; }
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Returns true if the file of the segment has been removed, or replaced by
+  // another file with the same name.
+  bool IsRemoved() const;
+
+ private:
+  SharedMemorySegment(std::string name, char* data, size_t size, bool owned,
+                      uint64 device, uint64 inode)
+      : name_(std::move(name)),
+        data_(data),
+        size_(size),
+        owned_(owned),
+        device_(device),
+        inode_(inode) {}
+
+  const std::string name_;
+  char* const data_;
+  const size_t size_;
+  // True if the segment is removed on destruction.
+  const bool owned_;
+  // Identify the file of the segment.
+  const uint64 device_;
+  const uint64 inode_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(SharedMemorySegment);
+};
+
+// Returns a segment of at least `num_bytes` bytes to offer for a RecvBuf
+// call, from a pool of segments that are reused across calls, or nullptr if
+// the tensor should be received in the response (e.g. because it is too small
+// or too large to pool, or shared memory is disabled with the
+// TF_RECV_BUF_SHARED_MEMORY environment variable).
+std::unique_ptr<SharedMemorySegment> AcquireRecvBufSegment(int64_t num_bytes);
+
+// Returns `segment` to the pool, once the contents received in it have been
+// consumed.
+void ReleaseRecvBufSegment(std::unique_ptr<SharedMemorySegment> segment);
+
+// Offers `segment` to the server of `request`.
+void OfferRecvBufSegment(const SharedMemorySegment& segment,
+                         RecvBufRequest* request);
+
+// If `request` offers a segment that can be mapped on this host, copies the
+// contents of `tensor`, which must be in host memory, into it, records that
+// in `response` and returns true. Otherwise returns false, and the contents
+// must be sent in `response`.
+bool SetTensorInRecvBufSegment(const RecvBufRequest& request,
+                               const Tensor& tensor,
+                               RecvBufResponse* response);
+
+// Returns true if `request` offers a segment on another host, to which the
+// client should not offer segments any more.
+bool RecvBufSegmentOnOtherHost(const RecvBufRequest& request);
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_SHARED_MEMORY_RECV_BUF_H_
@@ -0,0 +1,154 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/shared_memory_recv_buf.h"
+
+#include <cstring>
+#include <memory>
+
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
+
+namespace tensorflow {
+namespace {
+
+bool SharedMemoryAvailable() {
+  std::unique_ptr<SharedMemorySegment> segment;
+  return SharedMemorySegment::Create(1, &segment).ok();
+}
+
+Tensor Iota(int64_t n) {
+  Tensor t(DT_FLOAT, TensorShape({n}));
+  for (int64_t i = 0; i < n; ++i) {
+    t.flat<float>()(i) = i;
+  }
+  return t;
+}
+
+TEST(SharedMemoryRecvBufTest, SegmentRoundTrip) {
+  if (!SharedMemoryAvailable()) {
+    GTEST_SKIP() << "shared memory is not available";
+  }
+  std::unique_ptr<SharedMemorySegment> created;
+  TF_ASSERT_OK(SharedMemorySegment::Create(4096, &created));
+  strcpy(created->data(), "contents");  // NOLINT
+  std::unique_ptr<SharedMemorySegment> opened;
+  TF_ASSERT_OK(SharedMemorySegment::Open(created->name(), 4096, &opened));
+  EXPECT_STREQ(opened->data(), "contents");
+  EXPECT_FALSE(SharedMemorySegment::Open(created->name(), 8192, &opened).ok());
+
+  const std::string name = created->name();
+  created.reset();
+  EXPECT_TRUE(
+      errors::IsNotFound(SharedMemorySegment::Open(name, 4096, &opened)));
+}
+
+TEST(SharedMemoryRecvBufTest, OpensOnlySegments) {
+  std::unique_ptr<SharedMemorySegment> segment;
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      SharedMemorySegment::Open("../../etc/passwd", 1, &segment)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      SharedMemorySegment::Open("other_segment", 1, &segment)));
+}
+
+TEST(SharedMemoryRecvBufTest, TransfersTensor) {
+  if (!SharedMemoryAvailable()) {
+    GTEST_SKIP() << "shared memory is not available";
+  }
+  const Tensor tensor = Iota(1 << 16);
+  std::unique_ptr<SharedMemorySegment> segment =
+      AcquireRecvBufSegment(tensor.TotalBytes());
+  ASSERT_NE(segment, nullptr);
+  RecvBufRequest request;
+  OfferRecvBufSegment(*segment, &request);
+  RecvBufResponse response;
+  ASSERT_TRUE(SetTensorInRecvBufSegment(request, tensor, &response));
+
+  RecvBufRespExtra extra;
+  ASSERT_TRUE(response.transport_options().UnpackTo(&extra));
+  EXPECT_TRUE(extra.in_shared_memory());
+  EXPECT_EQ(extra.tensor_content_size(), 0);
+  Tensor received(DT_FLOAT, tensor.shape());
+  memcpy(received.flat<float>().data(), segment->data(), tensor.TotalBytes());
+  test::ExpectTensorEqual<float>(received, tensor);
+
+  // The segment is reused for tensors of similar sizes.
+  const std::string name = segment->name();
+  ReleaseRecvBufSegment(std::move(segment));
+  segment = AcquireRecvBufSegment(tensor.TotalBytes() - 4);
+  ASSERT_NE(segment, nullptr);
+  EXPECT_EQ(segment->name(), name);
+  ReleaseRecvBufSegment(std::move(segment));
+}
+
+TEST(SharedMemoryRecvBufTest, SendsInResponse) {
+  if (!SharedMemoryAvailable()) {
+    GTEST_SKIP() << "shared memory is not available";
+  }
+  // Small tensors are not received in shared memory.
+  EXPECT_EQ(AcquireRecvBufSegment(1024), nullptr);
+
+  const Tensor tensor = Iota(1 << 16);
+  std::unique_ptr<SharedMemorySegment> segment =
+      AcquireRecvBufSegment(tensor.TotalBytes());
+  ASSERT_NE(segment, nullptr);
+  RecvBufRequest request;
+  RecvBufResponse response;
+  EXPECT_FALSE(SetTensorInRecvBufSegment(request, tensor, &response));
+
+  // The segment is too small.
+  OfferRecvBufSegment(*segment, &request);
+  EXPECT_FALSE(SetTensorInRecvBufSegment(request, Iota(1 << 20), &response));
+  EXPECT_FALSE(RecvBufSegmentOnOtherHost(request));
+
+  // The client is on another host.
+  RecvBufReqExtra extra;
+  ASSERT_TRUE(request.transport_options().UnpackTo(&extra));
+  extra.set_shared_memory_host("other-host");
+  request.mutable_transport_options()->PackFrom(extra);
+  EXPECT_FALSE(SetTensorInRecvBufSegment(request, tensor, &response));
+  EXPECT_FALSE(response.has_transport_options());
+  EXPECT_TRUE(RecvBufSegmentOnOtherHost(request));
+
+  // Tensors larger than the pooled segments are not received in shared
+  // memory.
+  EXPECT_EQ(AcquireRecvBufSegment((256 << 20) + 1), nullptr);
+}
+
+TEST(SharedMemoryRecvBufTest, DropsMappingOfRemovedSegment) {
+  if (!SharedMemoryAvailable()) {
+    GTEST_SKIP() << "shared memory is not available";
+  }
+  const Tensor tensor = Iota(1 << 16);
+  std::unique_ptr<SharedMemorySegment> segment;
+  TF_ASSERT_OK(SharedMemorySegment::Create(tensor.TotalBytes(), &segment));
+  RecvBufRequest request;
+  OfferRecvBufSegment(*segment, &request);
+  RecvBufResponse response;
+  ASSERT_TRUE(SetTensorInRecvBufSegment(request, tensor, &response));
+  EXPECT_FALSE(segment->IsRemoved());
+
+  // The server keeps the segment mapped, but does not write to it once the
+  // client has removed it.
+  segment.reset();
+  response.Clear();
+  EXPECT_FALSE(SetTensorInRecvBufSegment(request, tensor, &response));
+}
+
+}  // namespace
+}  // namespace tensorflow
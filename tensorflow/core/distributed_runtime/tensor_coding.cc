@@ -18,11 +18,35 @@ limitations under the License.
 #include "google/protobuf/any.pb.h"
 
 #include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
+int64_t RecvTensorStreamingBytes() {
+  static const int64_t streaming_bytes = [] {
+    int64_t streaming_bytes;
+    Status s = ReadInt64FromEnvVar("TF_RECV_TENSOR_STREAMING_BYTES", 64 << 20,
+                                   &streaming_bytes);
+    if (!s.ok() || streaming_bytes < 0) {
+      LOG(WARNING) << "RecvTensor streaming is disabled: " << s;
+      return int64_t{0};
+    }
+    if (streaming_bytes > kMaxRecvTensorContentPartBytes) {
+      LOG(WARNING) << "TF_RECV_TENSOR_STREAMING_BYTES=" << streaming_bytes
+                   << " exceeds the largest RecvTensor part of "
+                   << kMaxRecvTensorContentPartBytes << " bytes, using that.";
+      return kMaxRecvTensorContentPartBytes;
+    }
+    return streaming_bytes;
+  }();
+  return streaming_bytes;
+}
+
 TensorResponse::Source::~Source() {}
 
 void TensorResponse::Clear() {
@@ -36,6 +60,8 @@ void TensorResponse::Clear() {
 
 void TensorResponse::ClearTensor() {
   meta_.Clear();
+  content_offset_ = 0;
+  content_end_ = 0;
   tensor_ = Tensor();
 }
 
@@ -50,8 +76,19 @@ void TensorResponse::InitAlloc(DeviceBase* d, const AllocatorAttributes& aa) {
   allocator_ = device_->GetAllocator(alloc_attrs_);
 }
 
+void TensorResponse::InitContinuation(int64_t content_offset) {
+  meta_.Clear();
+  already_used_ = false;
+  content_offset_ = content_offset;
+  content_end_ = content_offset;
+}
+
 Status TensorResponse::InitFrom(RecvTensorResponse* response) {
-  Status s;
+  Status s = DecodeTensorProtoContent(response->encoding(),
+                                      response->mutable_tensor());
+  if (!s.ok()) {
+    return s;
+  }
   meta_.Swap(response);
   if (on_host_) {
     if (!tensor_.FromProto(allocator_, meta_.tensor())) {
@@ -87,8 +124,15 @@ Status TensorResponse::ParseFrom(Source* source) {
     if (!meta_.ParseFromCodedStream(&input) || !input.ConsumedEntireMessage()) {
       return errors::InvalidArgument("Cannot parse tensor from response");
     }
+    if (meta_.total_content_bytes() > 0) {
+      return errors::Unimplemented(
+          "Streamed tensor contents can only be received on the host");
+    }
     Status s =
-        device_->MakeTensorFromProto(meta_.tensor(), alloc_attrs_, &tensor_);
+        DecodeTensorProtoContent(meta_.encoding(), meta_.mutable_tensor());
+    if (s.ok()) {
+      s = device_->MakeTensorFromProto(meta_.tensor(), alloc_attrs_, &tensor_);
+    }
     // Reduce memory usage for big tensors.
     {
       TensorProto empty;
@@ -98,7 +142,12 @@ Status TensorResponse::ParseFrom(Source* source) {
     return s;
   }
   if (already_used_) {
-    ClearTensor();
+    if (content_offset_ > 0) {
+      // A retried continuation copies the same contents into tensor_ again.
+      meta_.Clear();
+    } else {
+      ClearTensor();
+    }
   }
   already_used_ = true;
   if (ParseFast(source)) return OkStatus();
@@ -152,6 +201,10 @@ bool TensorResponse::ParseTensorSubmessage(
     WireType wt = GetTagWireType(p.first);
     if (!p.second) {
       bool ok = (tag == 0);
+      if (ok && !seen_tensor_content && meta_.total_content_bytes() > 0) {
+        // Streamed responses always hold some contents.
+        return false;
+      }
       if (ok && !seen_tensor_content) {
         // No tensor content: could be because it's a zero-length tensor
         TensorShape shape(tensor_meta->tensor_shape());
@@ -194,14 +247,17 @@ bool TensorResponse::ParseTensorSubmessage(
         int num_bytes;
         if (!ReadVarintSizeAsInt(input, &num_bytes)) return false;
         seen_tensor_content = true;
+        if (meta_.total_content_bytes() > 0) {
+          char* buf = StreamedContentBuffer(*tensor_meta, num_bytes);
+          if (buf == nullptr || !input->ReadRaw(buf, num_bytes)) return false;
+          break;
+        }
         TensorShape shape(tensor_meta->tensor_shape());
         Tensor t(allocator_, tensor_meta->dtype(), shape);
-        StringPiece buf = t.tensor_data();
-        if (static_cast<size_t>(num_bytes) != buf.size()) return false;
         // TODO(jeff,sanjay): Figure out a way to avoid this copy if
         // the underlying ZeroCopyInputStream data is properly aligned
         // and compatible with what allocator_ wants.
-        if (!input->ReadRaw(const_cast<char*>(buf.data()), num_bytes))
+        if (!DecodeTensorContent(meta_.encoding(), num_bytes, input, &t))
           return false;
         tensor_ = std::move(t);
         break;
@@ -217,6 +273,7 @@ bool TensorResponse::ParseTensorSubmessage(
 
 bool TensorResponse::ParseFast(Source* source) {
   protobuf::io::CodedInputStream input(source->contents());
+  bool seen_tensor = false;
   while (true) {
     auto p = input.ReadTagWithCutoff(127);
     int tag = GetTagFieldNumber(p.first);
@@ -239,6 +296,7 @@ bool TensorResponse::ParseFast(Source* source) {
         if (!input.DecrementRecursionDepthAndPopLimit(p.first)) {
           return false;
         }
+        seen_tensor = true;
         break;
       }
       case RecvTensorResponse::kIsDeadFieldNumber: {
@@ -265,6 +323,24 @@ bool TensorResponse::ParseFast(Source* source) {
         meta_.set_require_ack(v != 0);
         break;
       }
+      case RecvTensorResponse::kEncodingFieldNumber: {
+        uint32 v;
+        if ((wt != WIRETYPE_VARINT) || !input.ReadVarint32(&v)) return false;
+        // The tensor contents can only be decoded on the fast path if their
+        // encoding precedes them.
+        if (seen_tensor && v != RECV_TENSOR_ENCODING_RAW) return false;
+        meta_.set_encoding(static_cast<RecvTensorEncoding>(v));
+        break;
+      }
+      case RecvTensorResponse::kTotalContentBytesFieldNumber: {
+        protobuf_uint64 v;
+        if ((wt != WIRETYPE_VARINT) || !input.ReadVarint64(&v)) return false;
+        // Streamed contents can only be copied into place on the fast path if
+        // their total size precedes them.
+        if (seen_tensor) return false;
+        meta_.set_total_content_bytes(static_cast<int64_t>(v));
+        break;
+      }
       default: {
         // Unknown tag, so don't handle we can't handle on the fast path
         return false;
@@ -276,15 +352,26 @@ bool TensorResponse::ParseFast(Source* source) {
 }
 
 bool TensorResponse::ParseSlow(Source* source) {
-  if (!meta_.ParseFromZeroCopyStream(source->contents())) {
+  if (!meta_.ParseFromZeroCopyStream(source->contents()) ||
+      !DecodeTensorProtoContent(meta_.encoding(), meta_.mutable_tensor())
+           .ok()) {
     return false;
   }
 
-  Tensor parsed(meta_.tensor().dtype());
-  if (!parsed.FromProto(allocator_, meta_.tensor())) {
-    return false;
+  if (meta_.total_content_bytes() > 0) {
+    const string& content = meta_.tensor().tensor_content();
+    char* buf = StreamedContentBuffer(meta_.tensor(), content.size());
+    if (buf == nullptr) {
+      return false;
+    }
+    memcpy(buf, content.data(), content.size());
+  } else {
+    Tensor parsed(meta_.tensor().dtype());
+    if (!parsed.FromProto(allocator_, meta_.tensor())) {
+      return false;
+    }
+    tensor_ = std::move(parsed);
   }
-  tensor_ = std::move(parsed);
 
   // Reduce memory usage for big tensors.
   {
@@ -296,4 +383,30 @@ bool TensorResponse::ParseSlow(Source* source) {
   return true;
 }
 
+char* TensorResponse::StreamedContentBuffer(const TensorProto& tensor_meta,
+                                            int64_t num_bytes) {
+  // Streamed contents are raw, so that each response is copied into place
+  // independently of the others.
+  if (meta_.encoding() != RECV_TENSOR_ENCODING_RAW ||
+      !DataTypeCanUseMemcpy(tensor_meta.dtype())) {
+    return nullptr;
+  }
+  TensorShape shape(tensor_meta.tensor_shape());
+  if (content_offset_ == 0) {
+    tensor_ = Tensor(allocator_, tensor_meta.dtype(), shape);
+  } else if (tensor_.dtype() != tensor_meta.dtype() ||
+             tensor_.shape() != shape) {
+    return nullptr;
+  }
+  const int64_t total_bytes = meta_.total_content_bytes();
+  // Every response must make progress, or the receiver would request the
+  // same contents forever.
+  if (!tensor_.IsInitialized() || tensor_.TotalBytes() != total_bytes ||
+      num_bytes <= 0 || num_bytes > total_bytes - content_offset_) {
+    return nullptr;
+  }
+  content_end_ = content_offset_ + num_bytes;
+  return static_cast<char*>(DMAHelper::base(&tensor_)) + content_offset_;
+}
+
 }  // namespace tensorflow
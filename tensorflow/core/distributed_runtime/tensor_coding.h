@@ -28,6 +28,19 @@ namespace tensorflow {
 class DeviceBase;
 class TensorProto;
 
+// The largest number of bytes of tensor contents in one streamed RecvTensor
+// response: half the 2GB protobuf limit, so that the whole response, whose
+// size is encoded in 32 bits and parsed as an int, stays below the limit.
+constexpr int64_t kMaxRecvTensorContentPartBytes = 1LL << 30;
+
+// Returns the largest number of bytes of tensor contents that this process
+// receives in one RecvTensor response, from the
+// TF_RECV_TENSOR_STREAMING_BYTES environment variable: larger tensors are
+// streamed in parts of this size into their destination. 64MiB by default,
+// and 0 disables streaming. Values above kMaxRecvTensorContentPartBytes are
+// rejected in favor of that limit.
+int64_t RecvTensorStreamingBytes();
+
 // TensorResponse can be used as the destination of an RPC that returns
 // a RecvTensorResponse.  It efficiently decodes the incoming data
 // into Tensor contents as well as associated metadata.
@@ -45,6 +58,11 @@ class TensorResponse {
   // Initialize memory allocation related members.
   void InitAlloc(DeviceBase* d, const AllocatorAttributes& aa);
 
+  // Prepares to parse a response that continues the streamed contents of the
+  // tensor (see RecvTensorRequest.max_content_bytes) from `content_offset`.
+  // The contents are copied into the tensor of the previous responses.
+  void InitContinuation(int64_t content_offset);
+
   // Source provides a way for a particular RPC implementation to provide
   // received data to ParseFrom.
   class Source {
@@ -90,9 +108,28 @@ class TensorResponse {
   // Return pointer to the device hosting the tensor.
   DeviceBase* device() const { return device_; }
 
+  // Returns true if the tensor is allocated in host memory, which streamed
+  // contents require.
+  bool on_host() const { return on_host_; }
+
+  // Returns true if the tensor contents are streamed and the responses
+  // parsed so far did not hold all of them. The next response must then be
+  // parsed after InitContinuation(content_end()).
+  bool content_pending() const {
+    return content_end_ < meta_.total_content_bytes();
+  }
+
+  // Returns the offset following the streamed contents parsed last.
+  int64_t content_end() const { return content_end_; }
+
  private:
   bool ParseTensorSubmessage(protobuf::io::CodedInputStream* input,
                              TensorProto* tensor_meta);
+  // Returns where `num_bytes` of streamed contents, described by
+  // `tensor_meta`, are copied into tensor_, allocating it for the first
+  // response.  Returns nullptr if they do not fit.
+  char* StreamedContentBuffer(const TensorProto& tensor_meta,
+                              int64_t num_bytes);
   bool ParseFast(Source* source);
   bool ParseSlow(Source* source);
 
@@ -101,6 +138,9 @@ class TensorResponse {
   AllocatorAttributes alloc_attrs_;
   Allocator* allocator_ = nullptr;
   bool already_used_ = false;
+  // Offsets of the streamed contents in the response parsed last.
+  int64_t content_offset_ = 0;
+  int64_t content_end_ = 0;
   Tensor tensor_;
   RecvTensorResponse meta_;
 };
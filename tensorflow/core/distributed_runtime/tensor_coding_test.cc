@@ -15,10 +15,14 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/tensor_coding.h"
 
+#include <algorithm>
+
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
 #include "tensorflow/core/framework/device_attributes.pb.h"
 #include "tensorflow/core/framework/device_base.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/env.h"
@@ -156,6 +160,113 @@ TEST_F(TensorResponseTest, Simple) {
 
 TEST_F(TensorResponseTest, StringTensor) { DoTestForStrings(DT_STRING); }
 
+TEST_F(TensorResponseTest, EncodedContents) {
+  // Small integers, which bfloat16 represents exactly.
+  Tensor src(DT_FLOAT, TensorShape({2, 10000}));
+  auto flat = src.flat<float>();
+  for (int64_t i = 0; i < flat.size(); ++i) {
+    flat(i) = i % 100;
+  }
+  string content;
+  ASSERT_TRUE(
+      EncodeTensorContent(RECV_TENSOR_ENCODING_BFLOAT16, src, &content));
+  RecvTensorResponse header;
+  header.set_send_start_micros(123456);
+  header.set_encoding(RECV_TENSOR_ENCODING_BFLOAT16);
+  RecvTensorResponse body;
+  src.AsProtoTensorContent(body.mutable_tensor());
+  body.mutable_tensor()->set_tensor_content(content);
+
+  DummyDevice cpu_device(Env::Default());
+  TensorResponse response;
+  response.InitAlloc(&cpu_device, AllocatorAttributes());
+  // The encoding precedes the contents when the sender encodes the response
+  // by hand, which the fast path decodes, and follows them when it is
+  // serialized by protobuf, which the slow path decodes.
+  string header_first;
+  header.AppendToString(&header_first);
+  body.AppendToString(&header_first);
+  string body_first;
+  body.AppendToString(&body_first);
+  header.AppendToString(&body_first);
+  for (const string* encoded : {&header_first, &body_first}) {
+    StringSource source(encoded, 1024);
+    TF_ASSERT_OK(response.ParseFrom(&source));
+    EXPECT_EQ(response.metadata().send_start_micros(), 123456);
+    EXPECT_EQ(response.metadata().encoding(), RECV_TENSOR_ENCODING_BFLOAT16);
+    test::ExpectTensorEqual<float>(response.tensor(), src);
+  }
+
+  // Contents that do not match the shape are rejected.
+  body.mutable_tensor()->mutable_tensor_content()->resize(content.size() - 2);
+  string truncated;
+  header.AppendToString(&truncated);
+  body.AppendToString(&truncated);
+  StringSource source(&truncated, 1024);
+  EXPECT_FALSE(response.ParseFrom(&source).ok());
+}
+
+TEST_F(TensorResponseTest, StreamedContents) {
+  Tensor src(DT_FLOAT, TensorShape({10, 1000}));
+  auto flat = src.flat<float>();
+  for (int64_t i = 0; i < flat.size(); ++i) {
+    flat(i) = i;
+  }
+  const int64_t total_bytes = src.TotalBytes();
+  const int64_t part_bytes = 12000;
+  // Returns the response holding the contents from `offset` on, with the
+  // total size preceding the tensor or, as protobuf serializes it, following
+  // it.
+  auto encode_part = [&](int64_t offset, bool header_first) {
+    RecvTensorResponse header;
+    header.set_send_start_micros(123456);
+    header.set_total_content_bytes(total_bytes);
+    RecvTensorResponse body;
+    src.AsProtoTensorContent(body.mutable_tensor());
+    body.mutable_tensor()->set_tensor_content(
+        src.tensor_data().substr(offset, part_bytes).data(),
+        std::min(part_bytes, total_bytes - offset));
+    string encoded;
+    (header_first ? header : body).AppendToString(&encoded);
+    (header_first ? body : header).AppendToString(&encoded);
+    return encoded;
+  };
+
+  DummyDevice cpu_device(Env::Default());
+  TensorResponse response;
+  response.InitAlloc(&cpu_device, AllocatorAttributes());
+  int64_t offset = 0;
+  int num_parts = 0;
+  do {
+    if (offset > 0) {
+      response.InitContinuation(offset);
+    }
+    string encoded = encode_part(offset, num_parts % 2 == 0);
+    StringSource source(&encoded, 1024);
+    TF_ASSERT_OK(response.ParseFrom(&source));
+    EXPECT_EQ(response.metadata().total_content_bytes(), total_bytes);
+    EXPECT_EQ(response.content_end(),
+              std::min(offset + part_bytes, total_bytes));
+    offset = response.content_end();
+    ++num_parts;
+  } while (response.content_pending());
+  EXPECT_EQ(num_parts, 4);
+  test::ExpectTensorEqual<float>(response.tensor(), src);
+
+  // Parts that overrun the contents are rejected.
+  response.InitContinuation(total_bytes - 4);
+  string overrun = encode_part(0, true);
+  StringSource overrun_source(&overrun, 1024);
+  EXPECT_FALSE(response.ParseFrom(&overrun_source).ok());
+
+  // As are continuations of another tensor.
+  response.InitContinuation(part_bytes);
+  src = Tensor(DT_FLOAT, TensorShape({1000, 10}));
+  string reshaped = encode_part(part_bytes, true);
+  StringSource reshaped_source(&reshaped, 1024);
+  EXPECT_FALSE(response.ParseFrom(&reshaped_source).ok());
+}
+
 string MakeFloatTensorTestCase(int num_elems) {
   std::vector<int8> v(num_elems);
   for (int i = 0; i < num_elems; i++) {
@@ -0,0 +1,375 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "tensorflow/core/framework/bfloat16.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/snappy.h"
+#include "tensorflow/core/platform/str_util.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace {
+
+// Tensors smaller than this are always sent raw: encoding them would save
+// little compared to the fixed cost of an RPC.
+constexpr size_t kMinEncodedTensorBytes = 16 << 10;
+
+// Number of raw bytes in each chunk of the snappy encoding.
+constexpr size_t kSnappyChunkBytes = 1 << 20;
+
+// Number of values that are converted at a time by the bfloat16 decoder.
+constexpr int64_t kBFloat16ChunkValues = 1 << 16;
+
+// Number of values that share a scale in the int8 encoding.
+constexpr int64_t kInt8BlockValues = 256;
+
+// Returns whether the name scope `component` is `scope` or one of its
+// uniquified names, e.g. "gradients_1" for "gradients".
+bool IsScope(StringPiece component, StringPiece scope) {
+  if (!absl::ConsumePrefix(&component, scope)) {
+    return false;
+  }
+  if (component.empty()) {
+    return true;
+  }
+  return absl::ConsumePrefix(&component, "_") && !component.empty() &&
+         std::all_of(component.begin(), component.end(), absl::ascii_isdigit);
+}
+
+int64_t Int8EncodedBytes(int64_t num_values) {
+  const int64_t num_blocks =
+      (num_values + kInt8BlockValues - 1) / kInt8BlockValues;
+  return num_blocks * sizeof(float) + num_values;
+}
+
+bool EncodeSnappy(StringPiece data, std::string* content) {
+  content->clear();
+  std::string compressed;
+  for (size_t offset = 0; offset < data.size(); offset += kSnappyChunkBytes) {
+    const size_t chunk_bytes =
+        std::min(kSnappyChunkBytes, data.size() - offset);
+    if (!port::Snappy_Compress(data.data() + offset, chunk_bytes,
+                               &compressed)) {
+      return false;
+    }
+    core::PutVarint32(content, compressed.size());
+    content->append(compressed);
+    if (content->size() >= data.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void EncodeBFloat16(const Tensor& val, std::string* content) {
+  const int64_t num_values = val.NumElements();
+  content->resize(num_values * sizeof(bfloat16));
+  RoundFloatToBFloat16(val.flat<float>().data(),
+                       reinterpret_cast<bfloat16*>(&(*content)[0]),
+                       num_values);
+}
+
+bool EncodeInt8(const Tensor& val, std::string* content) {
+  const int64_t num_values = val.NumElements();
+  const float* values = val.flat<float>().data();
+  content->resize(Int8EncodedBytes(num_values));
+  char* out = &(*content)[0];
+  for (int64_t start = 0; start < num_values; start += kInt8BlockValues) {
+    const int64_t end = std::min(num_values, start + kInt8BlockValues);
+    float max_abs = 0.0f;
+    for (int64_t i = start; i < end; ++i) {
+      if (!std::isfinite(values[i])) {
+        return false;
+      }
+      max_abs = std::max(max_abs, std::abs(values[i]));
+    }
+    const float scale = max_abs / 127.0f;
+    const float inverse_scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+    memcpy(out, &scale, sizeof(scale));
+    out += sizeof(scale);
+    for (int64_t i = start; i < end; ++i) {
+      const float q = std::round(values[i] * inverse_scale);
+      *out++ = static_cast<int8>(std::min(127.0f, std::max(-127.0f, q)));
+    }
+  }
+  return true;
+}
+
+bool DecodeSnappy(protobuf::io::CodedInputStream* input, StringPiece buf) {
+  char* out = const_cast<char*>(buf.data());
+  std::string compressed;
+  for (size_t offset = 0; offset < buf.size(); offset += kSnappyChunkBytes) {
+    const size_t chunk_bytes = std::min(kSnappyChunkBytes, buf.size() - offset);
+    uint32 compressed_bytes;
+    size_t uncompressed_bytes;
+    if (!input->ReadVarint32(&compressed_bytes) ||
+        !input->ReadString(&compressed, compressed_bytes) ||
+        !port::Snappy_GetUncompressedLength(
+            compressed.data(), compressed.size(), &uncompressed_bytes) ||
+        uncompressed_bytes != chunk_bytes ||
+        !port::Snappy_Uncompress(compressed.data(), compressed.size(),
+                                 out + offset)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DecodeBFloat16(protobuf::io::CodedInputStream* input, int num_bytes,
+                    Tensor* tensor) {
+  const int64_t num_values = tensor->NumElements();
+  if (num_bytes != num_values * static_cast<int64_t>(sizeof(bfloat16))) {
+    return false;
+  }
+  float* values = tensor->flat<float>().data();
+  std::vector<bfloat16> chunk(std::min(num_values, kBFloat16ChunkValues));
+  for (int64_t start = 0; start < num_values; start += kBFloat16ChunkValues) {
+    const int64_t count = std::min(kBFloat16ChunkValues, num_values - start);
+    if (!input->ReadRaw(chunk.data(), count * sizeof(bfloat16))) {
+      return false;
+    }
+    BFloat16ToFloat(chunk.data(), values + start, count);
+  }
+  return true;
+}
+
+bool DecodeInt8(protobuf::io::CodedInputStream* input, int num_bytes,
+                Tensor* tensor) {
+  const int64_t num_values = tensor->NumElements();
+  if (num_bytes != Int8EncodedBytes(num_values)) {
+    return false;
+  }
+  float* values = tensor->flat<float>().data();
+  int8 block[kInt8BlockValues];
+  for (int64_t start = 0; start < num_values; start += kInt8BlockValues) {
+    const int64_t count = std::min(kInt8BlockValues, num_values - start);
+    float scale;
+    if (!input->ReadRaw(&scale, sizeof(scale)) ||
+        !input->ReadRaw(block, count)) {
+      return false;
+    }
+    for (int64_t i = 0; i < count; ++i) {
+      values[start + i] = block[i] * scale;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+RecvTensorEncoding ChooseRecvTensorEncoding(
+    const Tensor& val, const protobuf::RepeatedField<int>& accepted_encodings) {
+  if (!DataTypeCanUseMemcpy(val.dtype()) ||
+      val.TotalBytes() < kMinEncodedTensorBytes) {
+    return RECV_TENSOR_ENCODING_RAW;
+  }
+  for (int encoding : accepted_encodings) {
+    switch (encoding) {
+      case RECV_TENSOR_ENCODING_SNAPPY:
+        return RECV_TENSOR_ENCODING_SNAPPY;
+      case RECV_TENSOR_ENCODING_BFLOAT16:
+      case RECV_TENSOR_ENCODING_INT8:
+        if (val.dtype() == DT_FLOAT) {
+          return static_cast<RecvTensorEncoding>(encoding);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return RECV_TENSOR_ENCODING_RAW;
+}
+
+bool EncodeTensorContent(RecvTensorEncoding encoding, const Tensor& val,
+                         std::string* content) {
+  if (!DataTypeCanUseMemcpy(val.dtype())) {
+    return false;
+  }
+  switch (encoding) {
+    case RECV_TENSOR_ENCODING_SNAPPY:
+      return EncodeSnappy(val.tensor_data(), content);
+    case RECV_TENSOR_ENCODING_BFLOAT16:
+      if (val.dtype() != DT_FLOAT) {
+        return false;
+      }
+      EncodeBFloat16(val, content);
+      return true;
+    case RECV_TENSOR_ENCODING_INT8:
+      return val.dtype() == DT_FLOAT && EncodeInt8(val, content);
+    default:
+      return false;
+  }
+}
+
+bool DecodeTensorContent(RecvTensorEncoding encoding, int num_bytes,
+                         protobuf::io::CodedInputStream* input,
+                         Tensor* tensor) {
+  if (!DataTypeCanUseMemcpy(tensor->dtype())) {
+    return false;
+  }
+  const protobuf::io::CodedInputStream::Limit limit =
+      input->PushLimit(num_bytes);
+  StringPiece buf = tensor->tensor_data();
+  bool ok;
+  switch (encoding) {
+    case RECV_TENSOR_ENCODING_RAW:
+      ok = static_cast<size_t>(num_bytes) == buf.size() &&
+           input->ReadRaw(const_cast<char*>(buf.data()), num_bytes);
+      break;
+    case RECV_TENSOR_ENCODING_SNAPPY:
+      ok = DecodeSnappy(input, buf);
+      break;
+    case RECV_TENSOR_ENCODING_BFLOAT16:
+      ok = tensor->dtype() == DT_FLOAT &&
+           DecodeBFloat16(input, num_bytes, tensor);
+      break;
+    case RECV_TENSOR_ENCODING_INT8:
+      ok = tensor->dtype() == DT_FLOAT && DecodeInt8(input, num_bytes, tensor);
+      break;
+    default:
+      ok = false;
+  }
+  ok = ok && input->BytesUntilLimit() == 0;
+  input->PopLimit(limit);
+  return ok;
+}
+
+Status DecodeTensorProtoContent(RecvTensorEncoding encoding,
+                                TensorProto* proto) {
+  if (encoding == RECV_TENSOR_ENCODING_RAW) {
+    return OkStatus();
+  }
+  if (!DataTypeCanUseMemcpy(proto->dtype()) ||
+      !TensorShape::IsValid(proto->tensor_shape()) ||
+      proto->tensor_content().size() > INT_MAX) {
+    return errors::InvalidArgument("Cannot decode tensor contents in ",
+                                   RecvTensorEncoding_Name(encoding));
+  }
+  Tensor tensor(proto->dtype(), TensorShape(proto->tensor_shape()));
+  const std::string& content = proto->tensor_content();
+  protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8*>(content.data()), content.size());
+  if (!DecodeTensorContent(encoding, content.size(), &input, &tensor)) {
+    return errors::DataLoss("Malformed tensor contents in ",
+                            RecvTensorEncoding_Name(encoding));
+  }
+  StringPiece raw = tensor.tensor_data();
+  proto->set_tensor_content(raw.data(), raw.size());
+  return OkStatus();
+}
+
+Status ParseRecvTensorEncodings(StringPiece spec,
+                                std::vector<RecvTensorEncoding>* encodings) {
+  encodings->clear();
+  for (const std::string& name :
+       str_util::Split(spec, ',', str_util::SkipEmpty())) {
+    if (name == "snappy") {
+      encodings->push_back(RECV_TENSOR_ENCODING_SNAPPY);
+    } else if (name == "bfloat16") {
+      encodings->push_back(RECV_TENSOR_ENCODING_BFLOAT16);
+    } else if (name == "int8") {
+      encodings->push_back(RECV_TENSOR_ENCODING_INT8);
+    } else {
+      return errors::InvalidArgument("Unknown RecvTensor encoding: ", name);
+    }
+  }
+  return OkStatus();
+}
+
+bool IsLossyRecvTensorEncoding(RecvTensorEncoding encoding) {
+  return encoding == RECV_TENSOR_ENCODING_BFLOAT16 ||
+         encoding == RECV_TENSOR_ENCODING_INT8;
+}
+
+bool IsEdgeInNameScopes(StringPiece edge_name,
+                        const std::vector<std::string>& scopes) {
+  // Strips the "edge_<id>_" prefix of the edges of partitioned graphs.
+  StringPiece tensor_name = edge_name;
+  if (absl::ConsumePrefix(&tensor_name, "edge_")) {
+    const size_t end_of_id = tensor_name.find('_');
+    if (end_of_id != StringPiece::npos && end_of_id > 0 &&
+        std::all_of(tensor_name.begin(), tensor_name.begin() + end_of_id,
+                    absl::ascii_isdigit)) {
+      tensor_name.remove_prefix(end_of_id + 1);
+    } else {
+      tensor_name = edge_name;
+    }
+  }
+  std::vector<absl::string_view> components = absl::StrSplit(tensor_name, '/');
+  // The last component is the node name, not a scope.
+  components.pop_back();
+  for (absl::string_view component : components) {
+    for (const std::string& scope : scopes) {
+      if (IsScope(component, scope)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<RecvTensorEncoding> AcceptedRecvTensorEncodings(
+    StringPiece edge_name) {
+  static const std::vector<RecvTensorEncoding>* encodings = [] {
+    auto* encodings = new std::vector<RecvTensorEncoding>;
+    std::string spec;
+    Status s = ReadStringFromEnvVar("TF_RECV_TENSOR_ENCODINGS", "", &spec);
+    if (s.ok()) {
+      s = ParseRecvTensorEncodings(spec, encodings);
+    }
+    if (!s.ok()) {
+      LOG(WARNING) << "RecvTensor encodings are disabled: " << s;
+      encodings->clear();
+    }
+    return encodings;
+  }();
+  static const std::vector<std::string>* lossy_scopes = [] {
+    std::string spec;
+    Status s = ReadStringFromEnvVar("TF_RECV_TENSOR_LOSSY_SCOPES",
+                                    "gradients,gradient_tape", &spec);
+    if (!s.ok()) {
+      LOG(WARNING) << "Lossy RecvTensor encodings are disabled: " << s;
+      spec.clear();
+    }
+    return new std::vector<std::string>(
+        str_util::Split(spec, ',', str_util::SkipEmpty()));
+  }();
+
+  std::vector<RecvTensorEncoding> accepted;
+  for (RecvTensorEncoding encoding : *encodings) {
+    if (!IsLossyRecvTensorEncoding(encoding) ||
+        IsEdgeInNameScopes(edge_name, *lossy_scopes)) {
+      accepted.push_back(encoding);
+    }
+  }
+  return accepted;
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,94 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_TENSOR_ENCODING_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_TENSOR_ENCODING_H_
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+
+namespace tensorflow {
+
+class TensorProto;
+
+// Encodings of the tensor contents sent in RecvTensorResponses, negotiated
+// for every RecvTensor call: the receiver lists the encodings it accepts in
+// the RecvTensorRequest, and the sender picks one of them for the tensor it
+// sends, or sends its raw contents. See RecvTensorEncoding in worker.proto
+// for the wire formats.
+
+// Returns the encoding among `accepted_encodings` that the contents of `val`
+// should be sent in: the first one, in the receiver's order of preference,
+// that supports the dtype of `val`. Small tensors and tensors whose dtype the
+// accepted encodings do not support are sent raw.
+RecvTensorEncoding ChooseRecvTensorEncoding(
+    const Tensor& val, const protobuf::RepeatedField<int>& accepted_encodings);
+
+// Sets `*content` to the contents of `val` in `encoding`. Returns false if
+// the contents are not smaller in `encoding` (or it is not available), in
+// which case they should be sent raw.
+bool EncodeTensorContent(RecvTensorEncoding encoding, const Tensor& val,
+                         std::string* content);
+
+// Decodes `num_bytes` bytes of tensor contents in `encoding` from `input`
+// into the buffer of `*tensor`, which must have the dtype and shape of the
+// sent tensor. The contents are decoded as they are read, a chunk at a time,
+// so that they are never buffered as a whole. Returns false if the contents
+// are malformed.
+bool DecodeTensorContent(RecvTensorEncoding encoding, int num_bytes,
+                         protobuf::io::CodedInputStream* input,
+                         Tensor* tensor);
+
+// Replaces the `tensor_content` of `*proto`, which is in `encoding`, with the
+// raw contents.
+Status DecodeTensorProtoContent(RecvTensorEncoding encoding,
+                                TensorProto* proto);
+
+// Parses a comma-separated list of encoding names ("snappy", "bfloat16" and
+// "int8") into `*encodings`.
+Status ParseRecvTensorEncodings(StringPiece spec,
+                                std::vector<RecvTensorEncoding>* encodings);
+
+// Returns whether `encoding` loses precision.
+bool IsLossyRecvTensorEncoding(RecvTensorEncoding encoding);
+
+// Returns whether the tensor sent on the edge named `edge_name`, as in
+// rendezvous keys, is produced in one of the name scopes `scopes`, at any
+// depth. Edges of partitioned graphs are named "edge_<id>_<src node name>".
+// A scope also matches its uniquified names, e.g. "gradients" matches
+// "gradients_1".
+bool IsEdgeInNameScopes(StringPiece edge_name,
+                        const std::vector<std::string>& scopes);
+
+// Returns the encodings that this process accepts in RecvTensor calls for
+// the edge named `edge_name`, in order of preference, from the
+// TF_RECV_TENSOR_ENCODINGS environment variable. None by default.
+//
+// Lossy encodings are only accepted for edges in the name scopes listed in
+// the TF_RECV_TENSOR_LOSSY_SCOPES environment variable, "gradients" and
+// "gradient_tape" by default, so that e.g. variable reads from parameter
+// servers are never received lossily.
+std::vector<RecvTensorEncoding> AcceptedRecvTensorEncodings(
+    StringPiece edge_name);
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_TENSOR_ENCODING_H_
@@ -0,0 +1,202 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/tensor_encoding.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/snappy.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+protobuf::RepeatedField<int> Accepted(
+    std::vector<RecvTensorEncoding> encodings) {
+  protobuf::RepeatedField<int> accepted;
+  for (RecvTensorEncoding encoding : encodings) {
+    accepted.Add(encoding);
+  }
+  return accepted;
+}
+
+bool SnappyAvailable() {
+  string compressed;
+  return port::Snappy_Compress("snappy", 6, &compressed);
+}
+
+// Returns a float tensor of `n` values in [-10, 10).
+Tensor RandomFloats(int64_t n) {
+  random::PhiloxRandom philox(301, 17);
+  random::SimplePhilox rnd(&philox);
+  Tensor t(DT_FLOAT, TensorShape({n}));
+  auto flat = t.flat<float>();
+  for (int64_t i = 0; i < n; ++i) {
+    flat(i) = rnd.RandFloat() * 20.0f - 10.0f;
+  }
+  return t;
+}
+
+// Encodes `val` in `encoding` and decodes the result.
+Tensor RoundTrip(RecvTensorEncoding encoding, const Tensor& val) {
+  TensorProto proto;
+  val.AsProtoTensorContent(&proto);
+  string content;
+  EXPECT_TRUE(EncodeTensorContent(encoding, val, &content));
+  proto.set_tensor_content(content);
+  TF_EXPECT_OK(DecodeTensorProtoContent(encoding, &proto));
+  Tensor result;
+  EXPECT_TRUE(result.FromProto(proto));
+  return result;
+}
+
+TEST(TensorEncodingTest, ChoosesEncoding) {
+  const Tensor small(DT_FLOAT, TensorShape({16}));
+  const Tensor floats(DT_FLOAT, TensorShape({1 << 16}));
+  const Tensor ints(DT_INT32, TensorShape({1 << 16}));
+  const auto all = Accepted({RECV_TENSOR_ENCODING_SNAPPY,
+                             RECV_TENSOR_ENCODING_BFLOAT16,
+                             RECV_TENSOR_ENCODING_INT8});
+
+  EXPECT_EQ(ChooseRecvTensorEncoding(floats, Accepted({})),
+            RECV_TENSOR_ENCODING_RAW);
+  EXPECT_EQ(ChooseRecvTensorEncoding(small, all), RECV_TENSOR_ENCODING_RAW);
+  // The receiver's order of preference is followed.
+  EXPECT_EQ(ChooseRecvTensorEncoding(floats, all),
+            RECV_TENSOR_ENCODING_SNAPPY);
+  EXPECT_EQ(ChooseRecvTensorEncoding(
+                floats, Accepted({RECV_TENSOR_ENCODING_BFLOAT16,
+                                  RECV_TENSOR_ENCODING_INT8})),
+            RECV_TENSOR_ENCODING_BFLOAT16);
+  EXPECT_EQ(ChooseRecvTensorEncoding(
+                floats, Accepted({RECV_TENSOR_ENCODING_INT8,
+                                  RECV_TENSOR_ENCODING_BFLOAT16})),
+            RECV_TENSOR_ENCODING_INT8);
+  // Encodings that do not support the dtype are skipped.
+  EXPECT_EQ(ChooseRecvTensorEncoding(
+                ints, Accepted({RECV_TENSOR_ENCODING_INT8,
+                                RECV_TENSOR_ENCODING_SNAPPY})),
+            RECV_TENSOR_ENCODING_SNAPPY);
+  EXPECT_EQ(
+      ChooseRecvTensorEncoding(ints, Accepted({RECV_TENSOR_ENCODING_INT8})),
+      RECV_TENSOR_ENCODING_RAW);
+}
+
+TEST(TensorEncodingTest, MatchesEdgesInNameScopes) {
+  const std::vector<std::string> scopes = {"gradients", "gradient_tape"};
+  EXPECT_TRUE(IsEdgeInNameScopes("edge_12_gradients/MatMul_grad/MatMul",
+                                 scopes));
+  EXPECT_TRUE(IsEdgeInNameScopes("edge_3_tower_0/gradients_1/Sum_grad/Tile",
+                                 scopes));
+  EXPECT_TRUE(IsEdgeInNameScopes("gradient_tape/dense/MatMul", scopes));
+  // Variable reads and other tensors are not in the scopes.
+  EXPECT_FALSE(IsEdgeInNameScopes("edge_7_dense/kernel/read", scopes));
+  EXPECT_FALSE(IsEdgeInNameScopes("edge_8_gradients", scopes));
+  EXPECT_FALSE(IsEdgeInNameScopes("edge_9_my_gradients/Sum", scopes));
+  EXPECT_FALSE(IsEdgeInNameScopes("edge_9_gradients_x/Sum", scopes));
+  EXPECT_FALSE(IsEdgeInNameScopes("edge_1_gradients/Sum", {}));
+}
+
+TEST(TensorEncodingTest, Snappy) {
+  if (!SnappyAvailable()) {
+    GTEST_SKIP() << "snappy is not available";
+  }
+  // More than one chunk of compressible values.
+  Tensor ints(DT_INT32, TensorShape({300000}));
+  auto flat = ints.flat<int32>();
+  for (int64_t i = 0; i < flat.size(); ++i) {
+    flat(i) = i % 7;
+  }
+  test::ExpectTensorEqual<int32>(RoundTrip(RECV_TENSOR_ENCODING_SNAPPY, ints),
+                                 ints);
+
+  // Random values do not compress, so they are sent raw.
+  string content;
+  EXPECT_FALSE(EncodeTensorContent(RECV_TENSOR_ENCODING_SNAPPY,
+                                   RandomFloats(10000), &content));
+}
+
+TEST(TensorEncodingTest, BFloat16) {
+  const Tensor val = RandomFloats(10000);
+  const Tensor result = RoundTrip(RECV_TENSOR_ENCODING_BFLOAT16, val);
+  for (int64_t i = 0; i < val.NumElements(); ++i) {
+    EXPECT_NEAR(result.flat<float>()(i), val.flat<float>()(i),
+                std::abs(val.flat<float>()(i)) / 256);
+  }
+}
+
+TEST(TensorEncodingTest, Int8) {
+  Tensor val = RandomFloats(1000);
+  // A block of zeros.
+  for (int64_t i = 256; i < 512; ++i) {
+    val.flat<float>()(i) = 0.0f;
+  }
+  const Tensor result = RoundTrip(RECV_TENSOR_ENCODING_INT8, val);
+  for (int64_t i = 0; i < val.NumElements(); ++i) {
+    // Each block is scaled by at most 10 / 127.
+    EXPECT_NEAR(result.flat<float>()(i), val.flat<float>()(i), 0.5 * 10 / 127);
+  }
+
+  string content;
+  EXPECT_FALSE(EncodeTensorContent(RECV_TENSOR_ENCODING_INT8,
+                                   test::AsTensor<int32>({1, 2}), &content));
+  val.flat<float>()(3) = std::numeric_limits<float>::quiet_NaN();
+  EXPECT_FALSE(EncodeTensorContent(RECV_TENSOR_ENCODING_INT8, val, &content));
+}
+
+TEST(TensorEncodingTest, RejectsMalformedContents) {
+  const Tensor val = RandomFloats(1000);
+  TensorProto proto;
+  val.AsProtoTensorContent(&proto);
+  string content;
+  ASSERT_TRUE(EncodeTensorContent(RECV_TENSOR_ENCODING_INT8, val, &content));
+  content.pop_back();
+  proto.set_tensor_content(content);
+  EXPECT_FALSE(
+      DecodeTensorProtoContent(RECV_TENSOR_ENCODING_INT8, &proto).ok());
+
+  proto.set_tensor_content("garbage");
+  EXPECT_FALSE(
+      DecodeTensorProtoContent(RECV_TENSOR_ENCODING_SNAPPY, &proto).ok());
+}
+
+TEST(TensorEncodingTest, LossyEncodings) {
+  EXPECT_FALSE(IsLossyRecvTensorEncoding(RECV_TENSOR_ENCODING_RAW));
+  EXPECT_FALSE(IsLossyRecvTensorEncoding(RECV_TENSOR_ENCODING_SNAPPY));
+  EXPECT_TRUE(IsLossyRecvTensorEncoding(RECV_TENSOR_ENCODING_BFLOAT16));
+  EXPECT_TRUE(IsLossyRecvTensorEncoding(RECV_TENSOR_ENCODING_INT8));
+}
+
+TEST(TensorEncodingTest, ParsesEncodings) {
+  std::vector<RecvTensorEncoding> encodings;
+  TF_ASSERT_OK(ParseRecvTensorEncodings("snappy,int8", &encodings));
+  EXPECT_EQ(encodings, std::vector<RecvTensorEncoding>(
+                           {RECV_TENSOR_ENCODING_SNAPPY,
+                            RECV_TENSOR_ENCODING_INT8}));
+  TF_ASSERT_OK(ParseRecvTensorEncodings("", &encodings));
+  EXPECT_TRUE(encodings.empty());
+  EXPECT_FALSE(ParseRecvTensorEncodings("snappy,lz4", &encodings).ok());
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -69,6 +69,24 @@ string CollGroupParams::ToString() const {
   return v;
 }
 
+bool CollGroupParams::MembersByHost(
+    std::vector<std::vector<int>>* hosts) const {
+  hosts->clear();
+  std::unordered_map<string, int> host_index;
+  for (int rank = 0; rank < members.size(); ++rank) {
+    const string& host_name = members[rank].device.host_name();
+    if (host_name.empty()) {
+      return false;
+    }
+    auto it = host_index.emplace(host_name, hosts->size()).first;
+    if (it->second == hosts->size()) {
+      hosts->emplace_back();
+    }
+    (*hosts)[it->second].push_back(rank);
+  }
+  return true;
+}
+
 CollInstanceParams& CollInstanceParams::operator=(
     const CollInstanceParams& other) {
   if (this != &other) {
@@ -86,6 +86,11 @@ struct CollGroupParams {
   int32 num_tasks;  // number of distinct tasks in group
   CollGroupRuntimeDetails runtime_details;
   string ToString() const;
+  // Sets `*hosts` to the ranks of the members on each host, as given by the
+  // host_name of their device attributes. Ranks are in increasing order, and
+  // hosts in the order of their lowest rank. Returns false if a member does
+  // not report its host.
+  bool MembersByHost(std::vector<std::vector<int>>* hosts) const;
   CollGroupParams()
       : group_key(0), group_size(0), device_type(DEVICE_CPU), num_tasks(0) {}
 };
@@ -622,6 +622,7 @@ class IteratorContext {
           interleave_depth(ctx->interleave_depth()),
           is_restoring(ctx->is_restoring()),
           model(ctx->model()),
+          options(ctx->options()),
           resource_mgr(ctx->resource_mgr()),
           runner(*(ctx->runner())),
           runner_threadpool_size(ctx->runner_threadpool_size()),
@@ -760,6 +761,8 @@ class IteratorContext {
 
   const std::shared_ptr<model::Model>& model() { return params_.model; }
 
+  const Options* options() { return params_.options; }
+
   ResourceMgr* resource_mgr() { return params_.resource_mgr; }
 
   std::function<void(std::function<void()>)>* runner() {
@@ -1072,6 +1075,21 @@ Status GetDatasetFromVariantTensor(const Tensor& tensor,
 // The ownership of `dataset` is transferred to `tensor`.
 Status StoreDatasetInVariantTensor(DatasetBase* dataset, Tensor* tensor);
 
+// The context of a random access to a dataset, which is made either by an op
+// kernel or by an iterator. Exactly one of the two contexts is set.
+class AnyContext {
+ public:
+  AnyContext(OpKernelContext* ctx) : op_kernel_ctx_(ctx) {}  // NOLINT
+  AnyContext(IteratorContext* ctx) : iterator_ctx_(ctx) {}   // NOLINT
+
+  OpKernelContext* op_kernel_context() const { return op_kernel_ctx_; }
+  IteratorContext* iterator_context() const { return iterator_ctx_; }
+
+ private:
+  OpKernelContext* op_kernel_ctx_ = nullptr;
+  IteratorContext* iterator_ctx_ = nullptr;
+};
+
 // Represents a (potentially infinite) range of outputs, where each
 // output is a tuple of tensors.
 class DatasetBase : public core::RefCounted {
@@ -1209,7 +1227,8 @@ class DatasetBase : public core::RefCounted {
   Status CheckRandomAccessCompatible(const int64 index) const;
 
   // Return the element at a particular index for a randomly accessible dataset.
-  virtual Status Get(OpKernelContext* ctx, int64 index,
+  // `ctx` is the context of the op kernel or iterator making the access.
+  virtual Status Get(AnyContext ctx, int64 index,
                      std::vector<Tensor>* out_tensors) const;
 
   // Return a finalized version of the dataset.  The returned DatasetBase is
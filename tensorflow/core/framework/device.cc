@@ -18,6 +18,7 @@ limitations under the License.
 #include "tensorflow/core/framework/device_factory.h"
 #include "tensorflow/core/framework/op_segment.h"
 #include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/host_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/random.h"
 #include "tensorflow/core/platform/types.h"
@@ -53,6 +54,7 @@ DeviceAttributes Device::BuildDeviceAttributes(
   *da.mutable_locality() = locality;
   da.set_physical_device_desc(physical_device_desc);
   da.set_xla_global_id(-1);  // Unknown / not set
+  da.set_host_name(port::Hostname());
   return da;
 }
 
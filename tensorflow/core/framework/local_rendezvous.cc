@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/framework/local_rendezvous.h"
 
+#include <memory>
+
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/lib/core/errors.h"
@@ -123,6 +125,14 @@ namespace {
 uint64 KeyHash(const StringPiece& k) { return Hash64(k.data(), k.size()); }
 }  // namespace
 
+/* static */
+void LocalRendezvous::FinishPendingCallback(TableBucket* bucket) {
+  mutex_lock l(bucket->mu);
+  if (--bucket->pending_callback_counter == 0) {
+    bucket->pending_callback_cond_var.notify_all();
+  }
+}
+
 Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
                              const Rendezvous::Args& send_args,
                              const Tensor& val, const bool is_dead) {
@@ -143,6 +153,10 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
 
   int bucket_index = key_hash % table_buckets_.size();
   auto& bucket = table_buckets_[bucket_index];
+  // Only send-related fields need to be filled. The item is allocated before
+  // taking the lock to keep the critical section short; it is discarded if a
+  // waiter is already queued.
+  std::unique_ptr<Item> send_item(new Item(send_args, val, is_dead));
   bucket.mu.lock();
 
   auto it = bucket.table.insert({key_hash, ItemQueue()}).first;
@@ -150,11 +164,8 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
   if (queue->head == nullptr || queue->head->type == Item::kSend) {
     // There is no waiter for this message. Append the message
     // into the queue. The waiter will pick it up when arrives.
-    // Only send-related fields need to be filled.
-    // TODO(b/143786186): Investigate moving the allocation of `Item` outside
-    // the lock.
     DVLOG(2) << "Enqueue Send Item (key:" << key.FullKey() << "). ";
-    queue->push_back(new Item(send_args, val, is_dead));
+    queue->push_back(send_item.release());
     bucket.mu.unlock();
     return OkStatus();
   }
@@ -186,13 +197,7 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
   DCHECK_EQ(item->type, Item::kRecv);
   (*item->recv_state.waiter)(OkStatus(), send_args, item->args, val, is_dead);
   delete item;
-  {
-    mutex_lock l(bucket.mu);
-    bucket.pending_callback_counter--;
-    if (bucket.pending_callback_counter == 0) {
-      bucket.pending_callback_cond_var.notify_all();
-    }
-  }
+  FinishPendingCallback(&bucket);
   return OkStatus();
 }
 
@@ -356,13 +361,7 @@ void LocalRendezvous::RecvAsync(const Rendezvous::ParsedKey& key,
   done(OkStatus(), item->args, recv_args, *item->send_state.value,
        item->send_state.is_dead);
   delete item;
-  {
-    mutex_lock l(bucket.mu);
-    bucket.pending_callback_counter--;
-    if (bucket.pending_callback_counter == 0) {
-      bucket.pending_callback_cond_var.notify_all();
-    }
-  }
+  FinishPendingCallback(&bucket);
 }
 
 void LocalRendezvous::StartAbort(const Status& status) {
@@ -370,6 +369,7 @@ void LocalRendezvous::StartAbort(const Status& status) {
   {
     mutex_lock l(mu_);
     status_.Update(status);
+    aborted_.store(true, std::memory_order_release);
   }
   for (int i = 0; i < table_buckets_.size(); ++i) {
     auto& bucket = table_buckets_[i];
@@ -394,6 +394,9 @@ void LocalRendezvous::StartAbort(const Status& status) {
 }
 
 Status LocalRendezvous::status() {
+  if (TF_PREDICT_TRUE(!aborted_.load(std::memory_order_acquire))) {
+    return OkStatus();
+  }
   tf_shared_lock ml(mu_);
   return status_;
 }
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_FRAMEWORK_LOCAL_RENDEZVOUS_H_
 #define TENSORFLOW_CORE_FRAMEWORK_LOCAL_RENDEZVOUS_H_
 
+#include <atomic>
 #include <vector>
 
 #include "tensorflow/core/framework/rendezvous.h"
@@ -73,19 +74,28 @@ class LocalRendezvous {
   // Pointer to the owner class of this LocalRendezvous if it is refcounted.
   const Rendezvous* rc_owner_;
 
-  struct TableBucket {
+  // Buckets are aligned to cache lines, so that Send and Recv calls on
+  // different buckets do not contend on the same line.
+  struct alignas(64) TableBucket {
     mutex mu;
     Table table TF_GUARDED_BY(mu);
 
-    // Track the number of pening callbacks using a counter.
+    // Track the number of pending callbacks using a counter.
     int pending_callback_counter TF_GUARDED_BY(mu) = 0;
     condition_variable pending_callback_cond_var TF_GUARDED_BY(mu);
   };
 
+  // Decrements the pending callback counter of `bucket` once a done-callback
+  // invoked outside of `bucket.mu` has returned.
+  static void FinishPendingCallback(TableBucket* bucket);
+
   // Immutable vector.
   std::vector<TableBucket> table_buckets_;
   mutex mu_;
   Status status_ TF_GUARDED_BY(mu_);
+  // Whether `status_` is not OK, so that Send and Recv calls do not need to
+  // acquire `mu_` until the rendezvous is aborted.
+  std::atomic<bool> aborted_{false};
 
   TF_DISALLOW_COPY_AND_ASSIGN(LocalRendezvous);
 };
@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <memory>
 #include <queue>
 
@@ -46,6 +47,15 @@ constexpr uint64_t kGapDurationThresholdUsec = 10000000;  // 10 seconds
 // In outlier computation, points that are larger than `kOutlierSigmas` standard
 // deviations are considered outliers.
 constexpr double kOutlierSigmas = 2.0;
+// The cost model optimization re-optimizes the tunable parameters once a
+// per-element cost, a budget or the target time changes by more than this
+// fraction.
+constexpr double kCostDriftThreshold = 0.25;
+// Weight of the latest measurement in the moving average of per-element costs.
+constexpr double kCostEmaWeight = 0.5;
+// The cost model optimization only spends resources on changes that decrease
+// the output time by more than this fraction.
+constexpr double kCostModelMinGain = 0.01;
 
 // A class to prune outliers given a set of points. To use it, instantiate an
 // object and call the `GetCleanPoints()` method.
@@ -191,6 +201,22 @@ void RecordAutotuneRamUsage(int64 ram_budget, double max_buffered_bytes) {
       max_buffered_bytes / static_cast<double>(ram_budget));
 }
 
+// Returns true if `a` and `b` differ by more than `kCostDriftThreshold`.
+bool HasDrifted(double a, double b) {
+  return std::abs(a - b) > kCostDriftThreshold * std::max(a, b);
+}
+
+// Returns the number of threads used by the given parameters.
+double ParallelismUsage(const Model::ModelParameters& parameters) {
+  double usage = 0.0;
+  for (const auto& pair : parameters) {
+    if (pair.second->name == kParallelism) {
+      usage += pair.second->value;
+    }
+  }
+  return usage;
+}
+
 // Helper function for node traversal that doesn't skip any nodes.
 inline bool IsAnyNode(const std::shared_ptr<Node> node) { return true; }
 
@@ -2203,6 +2229,9 @@ void Model::Optimize(AutotuneAlgorithm algorithm, int64_t cpu_budget,
     case AutotuneAlgorithm::STAGE_BASED:
       OptimizeStageBased(snapshot, optimization_params, cancellation_manager);
       break;
+    case AutotuneAlgorithm::COST_MODEL:
+      OptimizeCostModel(snapshot, optimization_params, cancellation_manager);
+      break;
     default:
       VLOG(2) << "Autotuning algorithm was not recognized. Aborting "
                  "optimization.";
@@ -2313,10 +2342,11 @@ Status Model::OptimizeLoop(AutotuneAlgorithm algorithm, int64_t cpu_budget,
     int64_t start_ms = EnvTime::NowMicros() / EnvTime::kMillisToMicros;
     double model_input_time = 0.0;
     // Model input time is set to 0 for all optimization algorithms except for
-    // stage-based optimization algorithm for historical reason. In stage-based
-    // optimization algorithm, the model input time is used as a target
-    // optimization time of all stages in the pipeline.
-    if (algorithm == AutotuneAlgorithm::STAGE_BASED) {
+    // stage-based and cost model optimization algorithms for historical
+    // reason. In these algorithms, the model input time is used as a target
+    // optimization time of the pipeline.
+    if (algorithm == AutotuneAlgorithm::STAGE_BASED ||
+        algorithm == AutotuneAlgorithm::COST_MODEL) {
       model_input_time = ComputeTargetTimeNsec();
     }
     Optimize(algorithm, cpu_budget, ram_budget, model_input_time,
@@ -2585,6 +2615,191 @@ void Model::OptimizeStageBasedParallelism(
   UpdateStateValues(&tunable_parameters);
 }
 
+bool Model::UpdateCostModel(std::shared_ptr<Node> snapshot,
+                            const OptimizationParams& optimization_params) {
+  bool drifted =
+      node_costs_.empty() ||
+      optimization_params.cpu_budget() != cost_model_params_.cpu_budget() ||
+      optimization_params.ram_budget() != cost_model_params_.ram_budget() ||
+      HasDrifted(optimization_params.model_input_time(),
+                 cost_model_params_.model_input_time());
+  Node::NodeVector nodes =
+      snapshot->CollectNodes(TraversalOrder::BFS, IsAutotuneNode);
+  nodes.push_back(snapshot);
+  absl::flat_hash_map<std::string, NodeCost> node_costs;
+  for (const auto& node : nodes) {
+    NodeCost& cost = node_costs[node->long_name()];
+    cost.processing_time = node->processing_time();
+    cost.num_elements = node->num_elements();
+    auto it = node_costs_.find(node->long_name());
+    if (it == node_costs_.end()) {
+      cost.self_time_nsec = node->SelfProcessingTime();
+      drifted = true;
+      continue;
+    }
+    // Fits the cost to the elements produced since the last update rather than
+    // to all elements, so that changes in processing time are noticed.
+    const NodeCost& previous_cost = it->second;
+    cost.self_time_nsec = previous_cost.self_time_nsec;
+    const int64_t num_elements =
+        cost.num_elements - previous_cost.num_elements;
+    if (num_elements <= 0) {
+      continue;
+    }
+    const double self_time_nsec =
+        static_cast<double>(cost.processing_time -
+                            previous_cost.processing_time) /
+        static_cast<double>(num_elements);
+    if (HasDrifted(self_time_nsec, previous_cost.self_time_nsec)) {
+      VLOG(2) << "Per-element processing time of " << node->long_name()
+              << " drifted from " << previous_cost.self_time_nsec << " to "
+              << self_time_nsec << " nanoseconds.";
+      drifted = true;
+    }
+    cost.self_time_nsec = (1.0 - kCostEmaWeight) * cost.self_time_nsec +
+                          kCostEmaWeight * self_time_nsec;
+  }
+  // Nodes removed from the model also invalidate the previous solution.
+  drifted |= node_costs.size() != node_costs_.size();
+  node_costs_ = std::move(node_costs);
+  if (drifted) {
+    cost_model_params_ = optimization_params;
+  }
+  return drifted;
+}
+
+void Model::ApplyCostModel(std::shared_ptr<Node> snapshot) {
+  Node::NodeVector nodes =
+      snapshot->CollectNodes(TraversalOrder::BFS, IsAutotuneNode);
+  nodes.push_back(snapshot);
+  for (const auto& node : nodes) {
+    auto it = node_costs_.find(node->long_name());
+    const int64_t num_elements = node->num_elements();
+    if (it == node_costs_.end() || num_elements <= 0) {
+      continue;
+    }
+    // The snapshot is private to the optimization, so its processing time is
+    // overwritten such that its per-element processing time is the fitted one.
+    const int64_t processing_time = static_cast<int64_t>(
+        std::llround(it->second.self_time_nsec * num_elements));
+    node->add_processing_time(processing_time - node->processing_time());
+  }
+}
+
+void Model::OptimizeCostModel(std::shared_ptr<Node> snapshot,
+                              const OptimizationParams& optimization_params,
+                              CancellationManager* cancellation_manager) {
+  VLOG(2) << "Starting optimization of tunable parameters with Cost Model.";
+  Node::ModelParameters parameters = CollectTunableParameters(snapshot);
+  if (parameters.empty()) {
+    VLOG(2) << "There are no tunable parameters.";
+    return;
+  }
+  const bool warm_start = !node_costs_.empty();
+  const bool over_ram_budget = TotalMaximumBufferedBytes(snapshot) >
+                               optimization_params.ram_budget();
+  if (!UpdateCostModel(snapshot, optimization_params) && !over_ram_budget) {
+    VLOG(2) << "Skipping optimization since the costs have not drifted.";
+    return;
+  }
+  if (!warm_start) {
+    for (auto& pair : parameters) {
+      pair.second->value = pair.second->min;
+    }
+  }
+  ApplyCostModel(snapshot);
+
+  const double cpu_budget =
+      std::max<double>(optimization_params.cpu_budget(), 1.0);
+  const double ram_budget = optimization_params.ram_budget();
+  // There is no benefit in producing elements faster than they are consumed,
+  // nor in producing them faster than the CPU budget allows.
+  const double target_time =
+      std::max(optimization_params.model_input_time(),
+               TotalProcessingTime(snapshot) / cpu_budget);
+  auto output_time = [&]() {
+    return OutputTime(snapshot, /*model_input_time=*/0.0,
+                      /*gradients=*/nullptr);
+  };
+  auto within_budget = [&]() {
+    return ParallelismUsage(parameters) <= cpu_budget &&
+           TotalMaximumBufferedBytes(snapshot) <= ram_budget;
+  };
+
+  // Releases resources, one step at a time, as long as the parameters exceed
+  // a budget or the release keeps the output time within the target time or
+  // increases it negligibly. The tolerance is relative to the output time at
+  // the start of the release so that it does not compound across steps.
+  double current_output_time = output_time();
+  const double max_release_output_time =
+      std::max(optimization_params.model_input_time(),
+               current_output_time * (1.0 + kCostModelMinGain));
+  while (!cancellation_manager->IsCancelled()) {
+    Parameter* best_parameter = nullptr;
+    double best_output_time = 0.0;
+    for (auto& pair : parameters) {
+      if (pair.second->value <= pair.second->min) {
+        continue;
+      }
+      pair.second->value--;
+      const double new_output_time = output_time();
+      if (!best_parameter || new_output_time < best_output_time) {
+        best_output_time = new_output_time;
+        best_parameter = pair.second.get();
+      }
+      pair.second->value++;
+    }
+    if (!best_parameter ||
+        (within_budget() && best_output_time > max_release_output_time)) {
+      break;
+    }
+    best_parameter->value--;
+    current_output_time = best_output_time;
+  }
+
+  // Spends the remaining budgets on the parameter with the largest decrease in
+  // output time per unit of budget.
+  while (!cancellation_manager->IsCancelled() &&
+         current_output_time > target_time) {
+    const double parallelism_usage = ParallelismUsage(parameters);
+    const double buffered_bytes = TotalMaximumBufferedBytes(snapshot);
+    Parameter* best_parameter = nullptr;
+    double best_output_time = 0.0;
+    double best_gain_per_cost = 0.0;
+    for (auto& pair : parameters) {
+      if (pair.second->value >= pair.second->max) {
+        continue;
+      }
+      pair.second->value++;
+      const double new_output_time = output_time();
+      const double new_buffered_bytes = TotalMaximumBufferedBytes(snapshot);
+      const double gain = current_output_time - new_output_time;
+      if (within_budget() && gain > kCostModelMinGain * current_output_time) {
+        // The cost of the step is the share of the budgets it uses.
+        const double cost =
+            (ParallelismUsage(parameters) - parallelism_usage) / cpu_budget +
+            (new_buffered_bytes - buffered_bytes) /
+                std::max(ram_budget, 1.0) +
+            std::numeric_limits<double>::epsilon();
+        if (gain / cost > best_gain_per_cost) {
+          best_gain_per_cost = gain / cost;
+          best_output_time = new_output_time;
+          best_parameter = pair.second.get();
+        }
+      }
+      pair.second->value--;
+    }
+    if (!best_parameter) {
+      VLOG(2) << "Stopping the cost model optimization since no parameter "
+                 "change within the budgets decreases the output time.";
+      break;
+    }
+    best_parameter->value++;
+    current_output_time = best_output_time;
+  }
+  UpdateStateValues(&parameters);
+}
+
 void Model::OptimizeBuffers(std::shared_ptr<Node> snapshot,
                             int64_t ram_budget) {
   VLOG(2) << "Starting optimization of buffer_size parameters.";
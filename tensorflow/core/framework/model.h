@@ -928,6 +928,29 @@ class Model {
                           const OptimizationParams& optimization_params,
                           CancellationManager* cancellation_manager);
 
+  // This optimization fits a cost model to the metrics collected since the
+  // previous optimization and only re-optimizes when the fitted per-element
+  // costs, the budgets or the target time drift. Starting from the current
+  // parameter values, it first releases parallelism and buffers that are not
+  // needed to meet the target time, and then repeatedly increments the
+  // parameter with the largest decrease in output time per unit of CPU and RAM
+  // budget, without ever exceeding either budget.
+  void OptimizeCostModel(std::shared_ptr<Node> snapshot,
+                         const OptimizationParams& optimization_params,
+                         CancellationManager* cancellation_manager);
+
+  // Updates the per-element costs of the nodes in the tree rooted in the given
+  // node from the metrics collected since the previous update. Returns true if
+  // the costs, the budgets or the target time have drifted enough to warrant
+  // re-optimizing the tunable parameters.
+  bool UpdateCostModel(std::shared_ptr<Node> snapshot,
+                       const OptimizationParams& optimization_params);
+
+  // Sets the per-element processing time of the nodes in the given snapshot to
+  // the costs fitted by `UpdateCostModel`, so that the output time estimates
+  // of the `COST_MODEL` optimization are based on the fitted costs.
+  void ApplyCostModel(std::shared_ptr<Node> snapshot);
+
   // This is the first part of the stage-based optimization that optimizes
   // tunable parallelism parameters.
   void OptimizeStageBasedParallelism(
@@ -996,6 +1019,19 @@ class Model {
   std::deque<uint64_t> gap_times_usec_ TF_GUARDED_BY(gap_mu_);
   // The experiment that this job is part of.
   std::string experiment_ = "";
+
+  // Per-element cost of a node fitted by the `COST_MODEL` algorithm.
+  struct NodeCost {
+    // Processing time and number of elements of the node at the last update.
+    int64_t processing_time = 0;
+    int64_t num_elements = 0;
+    // Moving average of the per-element processing time in nanoseconds.
+    double self_time_nsec = 0.0;
+  };
+  // State of the `COST_MODEL` algorithm, only accessed by the optimization.
+  // Costs are keyed by node long name.
+  absl::flat_hash_map<std::string, NodeCost> node_costs_;
+  OptimizationParams cost_model_params_;
 };
 
 // Class to compute timing information for a model.
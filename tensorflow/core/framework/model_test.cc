@@ -1319,7 +1319,7 @@ TEST_P(OptimizeZeroRamBudgetTest, Model) {
 }
 
 INSTANTIATE_TEST_SUITE_P(Test, OptimizeZeroRamBudgetTest,
-                         ::testing::Values(0, 1, 2, 3));
+                         ::testing::Values(0, 1, 2, 3, 5));
 
 TEST(RecordTimeTest, RecordTimeTest) {
   std::shared_ptr<Node> source = model::MakeSourceNode({});
@@ -2763,6 +2763,168 @@ TEST_F(ModelTimingTest, SelfTime) {
   EXPECT_DOUBLE_EQ(910, node_2->ComputeSelfTime());
 }
 
+TEST_F(ModelTimingTest, OptimizeCostModel_CappedByCpuBudget) {
+  BuildModelFromProto(R"pb(
+    nodes: {
+      key: 1
+      value: {
+        id: 1
+        name: "ParallelMapV2"
+        autotune: true
+        num_elements: 100
+        processing_time: 100000
+        node_class: ASYNC_KNOWN_RATIO
+        ratio: 1
+        inputs: 2
+        parameters: {
+          name: "parallelism"
+          value: 8
+          min: 1
+          max: 16
+          tunable: true
+        }
+      }
+    }
+    nodes: {
+      key: 2
+      value: {
+        id: 2
+        name: "SSTable"
+        autotune: true
+        num_elements: 100
+        processing_time: 1000
+        node_class: KNOWN_RATIO
+        ratio: 1
+      }
+    }
+    output: 1
+  )pb");
+
+  CancellationManager cancellation_manager;
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 4, 1000000, 0,
+                   &cancellation_manager);
+
+  EXPECT_EQ(4, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+}
+
+TEST_F(ModelTimingTest, OptimizeCostModel_Incremental) {
+  BuildModelFromProto(R"pb(
+    nodes: {
+      key: 1
+      value: {
+        id: 1
+        name: "ParallelMapV2"
+        autotune: true
+        num_elements: 100
+        processing_time: 100000
+        node_class: ASYNC_KNOWN_RATIO
+        ratio: 1
+        inputs: 2
+        parameters: {
+          name: "parallelism"
+          value: 1
+          min: 1
+          max: 16
+          tunable: true
+        }
+      }
+    }
+    nodes: {
+      key: 2
+      value: {
+        id: 2
+        name: "SSTable"
+        autotune: true
+        num_elements: 100
+        processing_time: 1000
+        node_class: KNOWN_RATIO
+        ratio: 1
+      }
+    }
+    output: 1
+  )pb");
+
+  CancellationManager cancellation_manager;
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 4, 1000000, 0,
+                   &cancellation_manager);
+  EXPECT_EQ(4, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+
+  // Nothing has changed, so the parameters are left alone.
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 4, 1000000, 0,
+                   &cancellation_manager);
+  EXPECT_EQ(4, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+
+  // Elements are consumed every 600ns, which 2 threads suffice for.
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 4, 1000000, 600,
+                   &cancellation_manager);
+  EXPECT_EQ(2, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+
+  // The processing time of new elements triples.
+  auto node_1 = MutableGetNode(/*node_id=*/1);
+  for (int i = 0; i < 100; ++i) {
+    node_1->add_processing_time(3000);
+    node_1->record_element();
+  }
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 4, 1000000, 600,
+                   &cancellation_manager);
+  EXPECT_EQ(4, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+}
+
+TEST_F(ModelTimingTest, OptimizeCostModel_UsesFittedCosts) {
+  BuildModelFromProto(R"pb(
+    nodes: {
+      key: 1
+      value: {
+        id: 1
+        name: "ParallelMapV2"
+        autotune: true
+        num_elements: 100
+        processing_time: 100000
+        node_class: ASYNC_KNOWN_RATIO
+        ratio: 1
+        inputs: 2
+        parameters: {
+          name: "parallelism"
+          value: 1
+          min: 1
+          max: 16
+          tunable: true
+        }
+      }
+    }
+    nodes: {
+      key: 2
+      value: {
+        id: 2
+        name: "SSTable"
+        autotune: true
+        num_elements: 100
+        processing_time: 1000
+        node_class: KNOWN_RATIO
+        ratio: 1
+      }
+    }
+    output: 1
+  )pb");
+
+  CancellationManager cancellation_manager;
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 16, 1000000, 600,
+                   &cancellation_manager);
+  EXPECT_EQ(2, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+
+  // The processing time of new elements triples. The fitted per-element cost
+  // is 2000ns, which 4 threads suffice for, whereas the average over all
+  // elements is 2800ns, which would need 5 threads.
+  auto node_1 = MutableGetNode(/*node_id=*/1);
+  for (int i = 0; i < 900; ++i) {
+    node_1->add_processing_time(3000);
+    node_1->record_element();
+  }
+  model_->Optimize(AutotuneAlgorithm::COST_MODEL, 16, 1000000, 600,
+                   &cancellation_manager);
+  EXPECT_EQ(4, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+}
+
 }  // namespace
 }  // namespace model
 }  // namespace data
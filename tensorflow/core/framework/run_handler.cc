@@ -19,12 +19,15 @@ limitations under the License.
 
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <list>
 #include <memory>
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/run_handler_util.h"
 #include "tensorflow/core/lib/core/threadpool_interface.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/monitoring/sampler.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/context.h"
 #include "tensorflow/core/platform/denormal.h"
@@ -44,6 +47,33 @@ static constexpr int32_t kMaxConcurrentHandlers = 128;
 typedef typename internal::RunHandlerEnvironment::Task Task;
 typedef Eigen::RunQueue<Task, 1024> Queue;
 
+// Deadline of requests that do not have one.
+constexpr uint64 kNoDeadline = std::numeric_limits<uint64>::max();
+
+auto* run_handler_queueing_delay = monitoring::Sampler<1>::New(
+    {"/tensorflow/core/run_handler/queueing_delay_usecs",
+     "Time that requests wait for a run handler, by priority class.",
+     "priority"},
+    // Scale of 10, power of 1.8 with bucket count 33 (~20 minutes).
+    monitoring::Buckets::Exponential(10, 1.8, 33));
+
+auto* run_handler_shed_requests = monitoring::Counter<1>::New(
+    "/tensorflow/core/run_handler/shed_requests",
+    "The number of requests whose deadline expired while they waited for a run "
+    "handler, by priority class.",
+    "priority");
+
+// Returns whether a request with `priority` and `deadline_us` should be
+// scheduled before a request with `other_priority` and `other_deadline_us`:
+// requests are ordered by decreasing priority and then by earliest deadline.
+bool RunsBefore(int64_t priority, uint64 deadline_us, int64_t other_priority,
+                uint64 other_deadline_us) {
+  if (priority != other_priority) {
+    return priority > other_priority;
+  }
+  return deadline_us < other_deadline_us;
+}
+
 }  // namespace
 
 namespace internal {
@@ -740,7 +770,7 @@ class RunHandler::Impl {
   void ScheduleInterOpClosure(std::function<void()> fn);
   void ScheduleIntraOpClosure(std::function<void()> fn);
 
-  void Reset(int64_t step_id,
+  void Reset(int64_t step_id, uint64 deadline_us,
              const RunOptions::Experimental::RunHandlerPoolOptions& options);
 
   RunHandlerPool::Impl* pool_impl() { return pool_impl_; }
@@ -749,6 +779,9 @@ class RunHandler::Impl {
 
   int64_t priority() { return options_.priority(); }
 
+  // Deadline of the request in microseconds since unix epoch, or kNoDeadline.
+  uint64 deadline_us() const { return deadline_us_; }
+
  private:
   class ThreadPoolInterfaceWrapper : public thread::ThreadPoolInterface {
    public:
@@ -765,6 +798,7 @@ class RunHandler::Impl {
 
   RunHandlerPool::Impl* pool_impl_;  // NOT OWNED.
   uint64 start_time_us_;
+  uint64 deadline_us_;
   int64_t step_id_;
   std::unique_ptr<thread::ThreadPoolInterface> thread_pool_interface_;
   internal::ThreadWorkSource tws_;
@@ -842,12 +876,20 @@ class RunHandlerPool::Impl {
                     static_cast<int32>(ParamFromEnvWithDefault(
                         "TF_RUN_HANDLER_MAX_CONCURRENT_HANDLERS",
                         kMaxConcurrentHandlers))));
+    const uint64 request_time_us = EnvTime::NowMicros();
+    const uint64 deadline_us =
+        options.deadline_in_ms() > 0
+            ? request_time_us + options.deadline_in_ms() * 1000
+            : kNoDeadline;
+    const int64_t priority = options.priority();
     uint64 version;
     int num_active_requests;
+    std::vector<int64_t> priorities;
     RunHandler::Impl* handler_impl;
     {
       mutex_lock l(mu_);
-      if (!has_free_handler()) {
+      // Requests that are already waiting get the next free handlers first.
+      if (!has_free_handler() || !pending_requests_.empty()) {
         profiler::TraceMe activity(
             [&] {
               return strings::StrCat("WaitingForHandler#step_id=", step_id,
@@ -858,39 +900,42 @@ class RunHandlerPool::Impl {
             strings::StrCat("RunHandlerPool::Impl::Get waiting for a handler "
                             "with timeout in millisecond",
                             timeout_in_ms));
-        if (timeout_in_ms == 0) {
-          mu_.Await(Condition(this, &Impl::has_free_handler));
-        } else if (!mu_.AwaitWithDeadline(
-                       Condition(this, &Impl::has_free_handler),
-                       EnvTime::NowNanos() + timeout_in_ms * 1000 * 1000)) {
+        if (!WaitForHandler(priority, request_time_us, deadline_us,
+                            timeout_in_ms)) {
           return nullptr;
         }
       }
-      // Remove the last entry from free_handlers_ and add to the end of
-      // sorted_active_handlers_.
+      // Remove the last entry from free_handlers_ and insert it into
+      // sorted_active_handlers_ by priority and deadline.
       handler_impl = free_handlers_.back();
-      handler_impl->Reset(step_id, options);
+      handler_impl->Reset(step_id, deadline_us, options);
       free_handlers_.pop_back();
 
       num_active_requests = sorted_active_handlers_.size() + 1;
       thread_work_sources->resize(num_active_requests);
-      int priority = options.priority();
+      priorities.reserve(num_active_requests);
       auto it = sorted_active_handlers_.cbegin();
       bool new_handler_inserted = false;
       for (int i = 0; i < num_active_requests; ++i) {
-        if (!new_handler_inserted && (it == sorted_active_handlers_.cend() ||
-                                      priority > (*it)->priority())) {
+        if (!new_handler_inserted &&
+            (it == sorted_active_handlers_.cend() ||
+             RunsBefore(priority, deadline_us, (*it)->priority(),
+                        (*it)->deadline_us()))) {
           sorted_active_handlers_.insert(it, handler_impl);
           new_handler_inserted = true;
           // Point to the newly added handler.
           --it;
         }
         (*thread_work_sources)[i] = (*it)->tws();
+        priorities.push_back((*it)->priority());
         ++it;
       }
       version = ++version_;
     }
-    RecomputePoolStats(num_active_requests, version, *thread_work_sources);
+    run_handler_queueing_delay->GetCell(strings::StrCat(priority))
+        ->Add(EnvTime::NowMicros() - request_time_us);
+    RecomputePoolStats(num_active_requests, version, priorities,
+                       *thread_work_sources);
     return WrapUnique<RunHandler>(new RunHandler(handler_impl));
   }
 
@@ -935,9 +980,41 @@ class RunHandlerPool::Impl {
     return ret;
   }
 
+  std::vector<int64_t> GetActiveHandlerStepIdsForTesting()
+      TF_LOCKS_EXCLUDED(mu_) {
+    mutex_lock l(mu_);
+    std::vector<int64_t> ret;
+    for (const auto& handler_impl : sorted_active_handlers_) {
+      ret.push_back(handler_impl->step_id());
+    }
+    return ret;
+  }
+
  private:
+  // A Get() call that waits for a free handler.
+  struct PendingRequest {
+    Impl* pool;
+    int64_t priority;
+    uint64 deadline_us;
+
+    // Whether a handler is free and this is the most urgent pending request.
+    bool ReadyToRun() TF_NO_THREAD_SAFETY_ANALYSIS {
+      return pool->has_free_handler() &&
+             pool->pending_requests_.front() == this;
+    }
+  };
+
+  // Waits until a handler is free for a request that arrived at
+  // `request_time_us`, serving pending requests by priority and then by
+  // earliest deadline. Returns false if the request timed out or its deadline
+  // expired first.
+  bool WaitForHandler(int64_t priority, uint64 request_time_us,
+                      uint64 deadline_us, int64_t timeout_in_ms)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   void RecomputePoolStats(
       int num_active_requests, uint64 version,
+      const std::vector<int64_t>& priorities,
       const Eigen::MaxSizeVector<internal::ThreadWorkSource*>&
           thread_work_sources);
 
@@ -961,6 +1038,9 @@ class RunHandlerPool::Impl {
   // bottleneck.
   std::list<RunHandler::Impl*> sorted_active_handlers_ TF_GUARDED_BY(mu_);
   std::vector<RunHandler::Impl*> free_handlers_ TF_GUARDED_BY(mu_);
+  // Get() calls waiting for a free handler, in the order that they will be
+  // served.
+  std::list<PendingRequest*> pending_requests_ TF_GUARDED_BY(mu_);
   std::vector<std::unique_ptr<RunHandler::Impl>> handlers_ TF_GUARDED_BY(mu_);
 
   // Histogram of elapsed runtime of every handler (in ms).
@@ -972,12 +1052,55 @@ class RunHandlerPool::Impl {
   const std::vector<double> sub_thread_pool_end_request_percentage_;
 };
 
+bool RunHandlerPool::Impl::WaitForHandler(int64_t priority,
+                                          uint64 request_time_us,
+                                          uint64 deadline_us,
+                                          int64_t timeout_in_ms) {
+  PendingRequest request{this, priority, deadline_us};
+  auto pos = std::find_if(
+      pending_requests_.begin(), pending_requests_.end(),
+      [&request](const PendingRequest* other) {
+        return RunsBefore(request.priority, request.deadline_us,
+                          other->priority, other->deadline_us);
+      });
+  auto request_it = pending_requests_.insert(pos, &request);
+
+  uint64 wait_deadline_us = deadline_us;
+  if (timeout_in_ms > 0) {
+    wait_deadline_us =
+        std::min(wait_deadline_us, request_time_us + timeout_in_ms * 1000);
+  }
+  const Condition ready(&request, &PendingRequest::ReadyToRun);
+  bool ready_to_run = true;
+  if (wait_deadline_us == kNoDeadline) {
+    mu_.Await(ready);
+  } else {
+    ready_to_run = mu_.AwaitWithDeadline(ready, wait_deadline_us * 1000);
+  }
+  pending_requests_.erase(request_it);
+  if (!ready_to_run && wait_deadline_us == deadline_us) {
+    // Shed the request rather than run it after its deadline.
+    run_handler_shed_requests->GetCell(strings::StrCat(priority))
+        ->IncrementBy(1);
+  }
+  return ready_to_run;
+}
+
 void RunHandlerPool::Impl::RecomputePoolStats(
     int num_active_requests, uint64 version,
+    const std::vector<int64_t>& priorities,
     const Eigen::MaxSizeVector<internal::ThreadWorkSource*>&
         thread_work_sources) {
   if (num_active_requests == 0) return;
 
+  // Fraction of the threads reserved for each priority class of the active
+  // requests, from the highest priority down, so that requests of a class
+  // always get threads that attempt their work first. Nothing is reserved by
+  // default, which keeps the exponential distribution across requests.
+  static const std::vector<double> kReservedThreadsFraction =
+      ParamFromEnvWithDefault("TF_RUN_HANDLER_RESERVED_THREADS_FRACTION",
+                              std::vector<double>());
+
   int sub_thread_pool_id = 0;
   for (int i = 0; i < num_active_requests; ++i) {
     while (
@@ -998,6 +1121,8 @@ void RunHandlerPool::Impl::RecomputePoolStats(
 
   std::vector<int> request_idx_list = ChooseRequestsWithExponentialDistribution(
       num_active_requests, num_blocking_threads);
+  ReserveThreadsForPriorityClasses(priorities, kReservedThreadsFraction,
+                                   &request_idx_list);
   for (int i = 0; i < num_blocking_threads; ++i) {
     VLOG(2) << "Set work for tid=" << i
             << " with start_request_idx=" << request_idx_list[i];
@@ -1007,6 +1132,8 @@ void RunHandlerPool::Impl::RecomputePoolStats(
 
   request_idx_list = ChooseRequestsWithExponentialDistribution(
       num_active_requests, num_non_blocking_threads);
+  ReserveThreadsForPriorityClasses(priorities, kReservedThreadsFraction,
+                                   &request_idx_list);
   for (int i = 0; i < num_non_blocking_threads; ++i) {
     VLOG(2) << "Set work for tid=" << (i + num_blocking_threads)
             << " with start_request_idx=" << request_idx_list[i];
@@ -1060,7 +1187,7 @@ void RunHandler::Impl::ThreadPoolInterfaceWrapper::Schedule(
 RunHandler::Impl::Impl(RunHandlerPool::Impl* pool_impl)
     : pool_impl_(pool_impl) {
   thread_pool_interface_.reset(new ThreadPoolInterfaceWrapper(this));
-  Reset(0, RunOptions::Experimental::RunHandlerPoolOptions());
+  Reset(0, kNoDeadline, RunOptions::Experimental::RunHandlerPoolOptions());
 }
 
 void RunHandler::Impl::ScheduleInterOpClosure(std::function<void()> fn) {
@@ -1076,9 +1203,10 @@ void RunHandler::Impl::ScheduleIntraOpClosure(std::function<void()> fn) {
 }
 
 void RunHandler::Impl::Reset(
-    int64_t step_id,
+    int64_t step_id, uint64 deadline_us,
     const RunOptions::Experimental::RunHandlerPoolOptions& options) {
   start_time_us_ = tensorflow::Env::Default()->NowMicros();
+  deadline_us_ = deadline_us;
   step_id_ = step_id;
   options_ = options;
   tws_.SetTracemeId(step_id);
@@ -1104,6 +1232,10 @@ std::vector<int64_t> RunHandlerPool::GetActiveHandlerPrioritiesForTesting()
   return impl_->GetActiveHandlerPrioritiesForTesting();
 }
 
+std::vector<int64_t> RunHandlerPool::GetActiveHandlerStepIdsForTesting() const {
+  return impl_->GetActiveHandlerStepIdsForTesting();
+}
+
 RunHandler::RunHandler(Impl* impl) : impl_(impl) {}
 
 void RunHandler::ScheduleInterOpClosure(std::function<void()> fn) {
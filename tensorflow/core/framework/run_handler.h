@@ -72,6 +72,10 @@ class RunHandlerPool {
   // order of the active handler list.
   std::vector<int64_t> GetActiveHandlerPrioritiesForTesting() const;
 
+  // Get the step ids for active handlers, in the same order as
+  // GetActiveHandlerPrioritiesForTesting().
+  std::vector<int64_t> GetActiveHandlerStepIdsForTesting() const;
+
  private:
   class Impl;
   friend class RunHandler;
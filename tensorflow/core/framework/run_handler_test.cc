@@ -113,6 +113,31 @@ TEST(RunHandlerUtilTest, PrioritySchedulingTest) {
   EXPECT_EQ(sorted_active_list[3], 1);
 }
 
+TEST(RunHandlerUtilTest, DeadlineSchedulingTest) {
+  int num_threads = 2;
+  std::unique_ptr<RunHandlerPool> pool(
+      new RunHandlerPool(num_threads, num_threads));
+
+  RunOptions::Experimental::RunHandlerPoolOptions options;
+  options.set_priority(1);
+  auto handler1 = pool->Get(/*step_id=*/1, /*timeout_in_ms=*/0, options);
+  options.set_deadline_in_ms(100000);
+  auto handler2 = pool->Get(/*step_id=*/2, /*timeout_in_ms=*/0, options);
+  options.set_deadline_in_ms(1000);
+  auto handler3 = pool->Get(/*step_id=*/3, /*timeout_in_ms=*/0, options);
+  options.set_priority(2);
+  options.set_deadline_in_ms(0);
+  auto handler4 = pool->Get(/*step_id=*/4, /*timeout_in_ms=*/0, options);
+
+  // Requests are ordered by priority, and then by earliest deadline, with
+  // requests without a deadline last.
+  std::vector<int64_t> sorted_active_list =
+      pool->GetActiveHandlerPrioritiesForTesting();
+  EXPECT_EQ(sorted_active_list, std::vector<int64_t>({2, 1, 1, 1}));
+  std::vector<int64_t> step_ids = pool->GetActiveHandlerStepIdsForTesting();
+  EXPECT_EQ(step_ids, std::vector<int64_t>({4, 3, 2, 1}));
+}
+
 TEST(RunHandlerThreadPool, EnqueueTask) {
   Eigen::MaxSizeVector<mutex> waiters_mu(2);
   waiters_mu.resize(2);
@@ -811,5 +836,58 @@ TEST_F(RunHandlerTest, TestWaitTimeout) {
   EXPECT_NE(next_handle.get(), nullptr);
 }
 
+TEST_F(RunHandlerTest, TestExpiredRequestsAreShed) {
+  std::unique_ptr<RunHandlerPool> pool(new RunHandlerPool(1, 1));
+
+  std::vector<std::unique_ptr<RunHandler>> blocking_handles;
+  const int32_t kMaxConcurrentHandlers = 128;  // Copied from run_handler.cc.
+  blocking_handles.reserve(kMaxConcurrentHandlers);
+  for (int i = 0; i < kMaxConcurrentHandlers; ++i) {
+    blocking_handles.push_back(pool->Get(i));
+  }
+
+  // A request whose deadline expires while it waits fails, even without a
+  // timeout.
+  RunOptions::Experimental::RunHandlerPoolOptions options;
+  options.set_deadline_in_ms(1);
+  EXPECT_EQ(pool->Get(128, /*timeout_in_ms=*/0, options).get(), nullptr);
+}
+
+TEST_F(RunHandlerTest, TestWaitingRequestsAreServedByPriority) {
+  std::unique_ptr<RunHandlerPool> pool(new RunHandlerPool(1, 1));
+
+  std::vector<std::unique_ptr<RunHandler>> blocking_handles;
+  const int32_t kMaxConcurrentHandlers = 128;  // Copied from run_handler.cc.
+  blocking_handles.reserve(kMaxConcurrentHandlers);
+  for (int i = 0; i < kMaxConcurrentHandlers; ++i) {
+    blocking_handles.push_back(pool->Get(i));
+  }
+
+  // A low priority request starts waiting before a high priority one, but the
+  // high priority request gets the first released handler.
+  mutex mu;
+  std::vector<int64_t> served_priorities;
+  auto tp = std::make_unique<thread::ThreadPool>(Env::Default(), "test", 2);
+  for (int64_t priority : {1, 2}) {
+    tp->Schedule([&pool, &mu, &served_priorities, priority]() {
+      RunOptions::Experimental::RunHandlerPoolOptions options;
+      options.set_priority(priority);
+      auto handle = pool->Get(128 + priority, /*timeout_in_ms=*/0, options);
+      {
+        mutex_lock l(mu);
+        served_priorities.push_back(priority);
+      }
+      // Hold the handler until the other request is served as well.
+      Env::Default()->SleepForMicroseconds(50000);
+    });
+    Env::Default()->SleepForMicroseconds(20000);
+  }
+  blocking_handles[0].reset();
+  Env::Default()->SleepForMicroseconds(20000);
+  blocking_handles[1].reset();
+  tp.reset();
+  EXPECT_EQ(served_priorities, std::vector<int64_t>({2, 1}));
+}
+
 }  // namespace
 }  // namespace tensorflow
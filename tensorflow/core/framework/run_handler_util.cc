@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/framework/run_handler_util.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "tensorflow/core/lib/strings/numbers.h"
@@ -181,4 +182,52 @@ std::vector<int> ChooseRequestsWithExponentialDistribution(
   return request_idx_list;
 }
 
+void ReserveThreadsForPriorityClasses(
+    const std::vector<int64_t>& priorities,
+    const std::vector<double>& reserved_fractions,
+    std::vector<int>* request_idx_list) {
+  if (priorities.empty() || priorities.front() == priorities.back()) {
+    return;
+  }
+  // The requests of class k are [class_start[k], class_start[k + 1]).
+  std::vector<int> class_start;
+  std::vector<int> request_class(priorities.size());
+  for (int i = 0; i < priorities.size(); ++i) {
+    if (i == 0 || priorities[i] != priorities[i - 1]) {
+      class_start.push_back(i);
+    }
+    request_class[i] = class_start.size() - 1;
+  }
+  const int num_classes = class_start.size();
+  class_start.push_back(priorities.size());
+
+  const int num_threads = request_idx_list->size();
+  std::vector<int> reserved(num_classes, 0);
+  for (int k = 0; k < num_classes && k < reserved_fractions.size(); ++k) {
+    reserved[k] = static_cast<int>(std::round(
+        std::max(0.0, reserved_fractions[k]) * num_threads));
+  }
+  std::vector<int> num_class_threads(num_classes, 0);
+  for (int request_idx : *request_idx_list) {
+    ++num_class_threads[request_class[request_idx]];
+  }
+
+  for (int k = 0; k < num_classes; ++k) {
+    int next_request = class_start[k];
+    for (int tid = num_threads - 1;
+         tid >= 0 && num_class_threads[k] < reserved[k]; --tid) {
+      const int c = request_class[(*request_idx_list)[tid]];
+      if (c == k || num_class_threads[c] <= reserved[c]) {
+        continue;
+      }
+      --num_class_threads[c];
+      ++num_class_threads[k];
+      (*request_idx_list)[tid] = next_request;
+      if (++next_request == class_start[k + 1]) {
+        next_request = class_start[k];
+      }
+    }
+  }
+}
+
 }  // namespace tensorflow
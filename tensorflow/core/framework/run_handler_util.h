@@ -54,6 +54,20 @@ void ComputeInterOpStealingRanges(int num_threads, int min_threads_per_domain,
 std::vector<int> ChooseRequestsWithExponentialDistribution(
     int num_active_requests, int num_threads);
 
+// Reassigns threads in `request_idx_list`, as returned by
+// ChooseRequestsWithExponentialDistribution(), so that each priority class gets
+// a reserved number of threads that attempt its requests first.
+// `priorities[i]` is the priority of active request i, in non-increasing
+// order, and `reserved_fractions[k]` is the fraction of the threads reserved
+// for the k-th highest priority class among the active requests. Threads are
+// taken from the end of the list, from classes that hold more than their
+// reservation, and spread across the requests of the class in round-robin
+// order. Does nothing if all active requests have the same priority.
+void ReserveThreadsForPriorityClasses(
+    const std::vector<int64_t>& priorities,
+    const std::vector<double>& reserved_fractions,
+    std::vector<int>* request_idx_list);
+
 // Look up environment variable named 'var_name' and return the value if it
 // exist and can be parsed. Return 'default_value' otherwise.
 double ParamFromEnvWithDefault(const char* var_name, double default_value);
@@ -126,6 +126,37 @@ TEST(RunHandlerUtilTest, TestExponentialRequestDistribution) {
   ASSERT_EQ(actual_distribution, expected_distribution);
 }
 
+TEST(RunHandlerUtilTest, TestReserveThreadsForPriorityClasses) {
+  // Requests 0 and 1 have priority 2, and requests 2 and 3 have priority 1.
+  std::vector<int> request_idx_list =
+      ChooseRequestsWithExponentialDistribution(4, 10);
+  ASSERT_EQ(request_idx_list,
+            std::vector<int>({0, 0, 0, 0, 1, 1, 1, 2, 2, 3}));
+  ReserveThreadsForPriorityClasses({2, 2, 1, 1}, {0.2, 0.5},
+                                   &request_idx_list);
+  EXPECT_EQ(request_idx_list,
+            std::vector<int>({0, 0, 0, 0, 1, 3, 2, 2, 2, 3}));
+
+  // A single priority class is left unchanged.
+  request_idx_list = ChooseRequestsWithExponentialDistribution(4, 10);
+  ReserveThreadsForPriorityClasses({1, 1, 1, 1}, {0.2, 0.5},
+                                   &request_idx_list);
+  EXPECT_EQ(request_idx_list,
+            std::vector<int>({0, 0, 0, 0, 1, 1, 1, 2, 2, 3}));
+
+  // The highest class takes threads from the end of the list.
+  request_idx_list = ChooseRequestsWithExponentialDistribution(4, 10);
+  ReserveThreadsForPriorityClasses({3, 2, 2, 2}, {0.6}, &request_idx_list);
+  EXPECT_EQ(request_idx_list,
+            std::vector<int>({0, 0, 0, 0, 1, 1, 1, 2, 0, 0}));
+
+  // Without reserved fractions, which is the default, nothing is reassigned.
+  request_idx_list = ChooseRequestsWithExponentialDistribution(4, 10);
+  ReserveThreadsForPriorityClasses({2, 2, 1, 1}, {}, &request_idx_list);
+  EXPECT_EQ(request_idx_list,
+            std::vector<int>({0, 0, 0, 0, 1, 1, 1, 2, 2, 3}));
+}
+
 TEST(RunHandlerUtilTest, TestParamFromEnvWithDefault) {
   std::vector<double> result = ParamFromEnvWithDefault(
       "RUN_HANDLER_TEST_ENV", std::vector<double>{0, 0, 0});
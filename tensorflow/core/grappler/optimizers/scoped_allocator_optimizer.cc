@@ -888,7 +888,7 @@ class UnaryElementwiseRewriter : public ScopedAllocatorOptimizer::Rewriter {
 
 ScopedAllocatorOptimizer::ScopedAllocatorOptimizer(
     RewriterConfig::Toggle opt_level, const ScopedAllocatorOptions& opts)
-    : opt_level_(opt_level) {
+    : opt_level_(opt_level), max_bucket_bytes_(opts.max_bucket_bytes()) {
   VLOG(1) << "ScopedAllocatorOptimizer::ScopedAllocatorOptimizer";
   Rewriter* r = new UnaryElementwiseRewriter();
   to_delete_.push_back(r);
@@ -1060,6 +1060,50 @@ void PartitionByLoopStructure(const FrameView& frame_view,
   }
 }
 
+// Returns the size in bytes of the output of `node`, or -1 if it is unknown.
+int64_t OutputBytes(const GraphProperties& graph_properties,
+                    const NodeDef& node) {
+  if (!graph_properties.HasOutputProperties(node.name())) {
+    return -1;
+  }
+  const std::vector<OpInfo::TensorProperties>& prop_list =
+      graph_properties.GetOutputProperties(node.name());
+  if (prop_list.size() != 1 || !TensorShape::IsValid(prop_list[0].shape()) ||
+      prop_list[0].shape().unknown_rank()) {
+    return -1;
+  }
+  return TensorShape(prop_list[0].shape()).num_elements() *
+         DataTypeSize(prop_list[0].dtype());
+}
+
+// Splits `nodes` into consecutive buckets whose outputs total at most
+// `max_bucket_bytes` bytes, or into a single bucket if `max_bucket_bytes` is
+// not positive. Nodes whose output is larger, or of unknown size, are put in
+// buckets of their own.
+void PartitionIntoBuckets(const GraphProperties& graph_properties,
+                          int64_t max_bucket_bytes,
+                          const std::vector<NodeDef*>& nodes,
+                          std::vector<std::vector<NodeDef*>>* buckets) {
+  if (max_bucket_bytes <= 0) {
+    buckets->push_back(nodes);
+    return;
+  }
+  int64_t bucket_bytes = 0;
+  for (NodeDef* nd : nodes) {
+    int64_t bytes = OutputBytes(graph_properties, *nd);
+    if (bytes < 0 || bytes > max_bucket_bytes) {
+      // Overflows any bucket, including one that it starts.
+      bytes = max_bucket_bytes + 1;
+    }
+    if (buckets->empty() || bucket_bytes + bytes > max_bucket_bytes) {
+      buckets->emplace_back();
+      bucket_bytes = 0;
+    }
+    buckets->back().push_back(nd);
+    bucket_bytes += bytes;
+  }
+}
+
 // Identify outputs that are inputs to multiple sets of nodes.
 void IdentifyRepeatedInputs(const std::vector<NodeDef*>& nodes,
                             absl::flat_hash_set<string>* seen_outputs,
@@ -1121,7 +1165,8 @@ Status ScopedAllocatorOptimizer::ProcessGraphDef(
         // in the same Tree struct.  Split those groups into subgroups that
         // share identical loop nesting.
         status = ApplyToAll(root.get(), [this, rewriter, graph, &frame_view,
-                                         &op_name, invocation_count](Tree* t) {
+                                         &graph_properties, &op_name,
+                                         invocation_count](Tree* t) {
           VLOG(2) << "applied to tree node " << t->edge_ << " at depth "
                   << t->depth_ << " of size " << t->nodes_.size();
           if (t->nodes_.size() > 1) {
@@ -1129,13 +1174,22 @@ Status ScopedAllocatorOptimizer::ProcessGraphDef(
             PartitionByLoopStructure(frame_view, t->nodes_, &loop_groups);
             for (auto& lg : loop_groups) {
               if (lg.size() > 1) {
-                bool applied = false;
                 Status s = OrderNodeSet(&lg);
                 TF_RETURN_IF_ERROR(s);
-                VLOG(1) << "Applying Rewriter for " << op_name;
-                s = rewriter->Rewrite(this, invocation_count, graph, op_name,
-                                      lg, &applied);
-                LOG_WARNING_AND_RETURN_IF_ERROR(s);
+                // Buckets are formed in the order of the group so that, for
+                // collectives, every worker forms the same buckets.
+                std::vector<std::vector<NodeDef*>> buckets;
+                PartitionIntoBuckets(graph_properties, max_bucket_bytes_, lg,
+                                     &buckets);
+                for (const auto& bucket : buckets) {
+                  if (bucket.size() > 1) {
+                    bool applied = false;
+                    VLOG(1) << "Applying Rewriter for " << op_name;
+                    s = rewriter->Rewrite(this, invocation_count, graph,
+                                          op_name, bucket, &applied);
+                    LOG_WARNING_AND_RETURN_IF_ERROR(s);
+                  }
+                }
               }
             }
           }
@@ -108,6 +108,8 @@ class ScopedAllocatorOptimizer : public GraphOptimizer {
   Status OrderNodeSet(std::vector<NodeDef*>* nodes) const;
 
   RewriterConfig::Toggle opt_level_;
+  // See ScopedAllocatorOptions.max_bucket_bytes.
+  int64_t max_bucket_bytes_;
   std::unordered_set<string> nodes_to_preserve_;
   OpNameSet op_name_set_;
   absl::flat_hash_map<string, Rewriter*> rewriters_;
@@ -414,6 +414,35 @@ TEST_F(ScopedAllocatorOptimizerTest, UnaryRewriteOnly) {
   }
 }
 
+TEST_F(ScopedAllocatorOptimizerTest, BucketBytes) {
+  // Tests that parallel ops are only rewritten together if their outputs fit
+  // in a bucket.
+  GrapplerItem item;
+  BuildAbsGraph(&item.graph, false);
+  SetShapes(&item.graph);
+
+  auto num_scoped_allocators = [&item](int64_t max_bucket_bytes) {
+    ScopedAllocatorOptions opts;
+    opts.add_enable_op("Abs");
+    opts.set_max_bucket_bytes(max_bucket_bytes);
+    ScopedAllocatorOptimizer sao(RewriterConfig::ON, opts);
+    GraphDef optimized_graph;
+    TF_CHECK_OK(sao.Optimize(nullptr /*cluster*/, item, &optimized_graph));
+    int count = 0;
+    for (const NodeDef& node : optimized_graph.node()) {
+      if (node.op() == "_ScopedAllocator") {
+        ++count;
+      }
+    }
+    return count;
+  };
+  // Each Abs op outputs 16 bytes.
+  EXPECT_EQ(1, num_scoped_allocators(0));
+  EXPECT_EQ(1, num_scoped_allocators(32));
+  EXPECT_EQ(0, num_scoped_allocators(31));
+  EXPECT_EQ(0, num_scoped_allocators(8));
+}
+
 TEST_F(ScopedAllocatorOptimizerTest, UnaryExecute) {
   // Builds the same graph as UnaryRewriteOnly but also executes it and
   // validates the output.
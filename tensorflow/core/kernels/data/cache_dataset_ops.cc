@@ -19,6 +19,8 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
+#include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/data/name_utils.h"
 #include "tensorflow/core/data/serialization_utils.h"
 #include "tensorflow/core/framework/dataset.h"
@@ -29,10 +31,14 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/cache_ops.h"
 #include "tensorflow/core/kernels/data/iterator_ops.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
+#include "tensorflow/core/platform/byte_order.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/protobuf/tensor_bundle.pb.h"
+#include "tensorflow/core/util/tensor_bundle/naming.h"
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
 namespace tensorflow {
@@ -64,12 +70,105 @@ constexpr char kCacheCompleted[] = "cache_completed";
 constexpr char kIndex[] = "index";
 constexpr char kImpl[] = "Impl";
 constexpr char kCacheDataset[] = "CacheDataset";
+constexpr char kFileCacheMmapExperiment[] = "file_cache_mmap";
+// Target size of the chunks in which a memory cache spills elements that do
+// not fit into its RAM budget.
+constexpr int64_t kSpillChunkSizeBytes = 32 << 20;  // 32MB
+// Checkpoint keys of a spilled memory cache. Spill files are local to the
+// process, so the checkpoint holds their chunk index and a copy of their
+// (compressed) chunks.
+constexpr char kSpillChunks[] = "spill_chunks";
+constexpr char kSpillData[] = "spill_data";
+constexpr char kPendingSpillChunk[] = "pending_spill_chunk";
+// The key under which `WriteElementsToCheckpoint()` stores the number of
+// elements.
+constexpr char kNumElements[] = "num_elements";
 constexpr char kIncompleteCacheErrorMessage[] =
     "The calling iterator did not fully read the dataset being cached. In "
     "order to avoid unexpected truncation of the dataset, the partially cached "
     "contents of the dataset  will be discarded. This can happen if you have "
     "an input pipeline similar to `dataset.cache().take(k).repeat()`. You "
     "should use `dataset.take(k).cache().repeat()` instead.";
+
+// A tensor buffer that points into a memory-mapped cache data file. The
+// buffer keeps the mapping alive for as long as any tensor references it.
+class MappedTensorBuffer : public TensorBuffer {
+ public:
+  MappedTensorBuffer(std::shared_ptr<ReadOnlyMemoryRegion> region,
+                     const char* data, size_t size)
+      : TensorBuffer(const_cast<char*>(data)),
+        region_(std::move(region)),
+        size_(size) {}
+
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("MappedFileCache");
+  }
+  // The mapped pages are read-only, so kernels must never reuse this buffer
+  // for their outputs.
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  const std::shared_ptr<ReadOnlyMemoryRegion> region_;
+  const size_t size_;
+};
+
+// Returns true if the tensor described by `entry` can be handed out as a view
+// into its memory-mapped data file.
+bool IsMappable(const BundleEntryProto& entry) {
+  return DataTypeCanUseMemcpy(entry.dtype()) && entry.slices_size() == 0 &&
+         entry.offset() % Allocator::kAllocatorAlignment == 0;
+}
+
+// A memory-mapped cache data file, and the offsets of the entries whose
+// checksums have been verified. Entries are verified when they are first read,
+// so that opening a large cache does not read the whole file up front.
+struct MappedShard {
+  explicit MappedShard(std::unique_ptr<ReadOnlyMemoryRegion> region)
+      : region(std::move(region)) {}
+
+  // Returns OK if the `size` bytes at `offset`, which lie within the mapping,
+  // match the checksum `masked_crc32c` of the cache entry `key`.
+  Status VerifyEntry(const string& key, int64_t offset, int64_t size,
+                     uint32 masked_crc32c) {
+    {
+      tf_shared_lock l(mu);
+      if (verified_offsets.contains(offset)) {
+        return OkStatus();
+      }
+    }
+    // The checksum is computed without holding the lock, so that readers of
+    // other entries are not blocked while the pages are read in.
+    const uint32 crc = crc32c::Value(
+        static_cast<const char*>(region->data()) + offset, size);
+    if (crc32c::Unmask(masked_crc32c) != crc) {
+      return errors::DataLoss("Checksum does not match for cache entry ", key,
+                              ": stored ", crc32c::Unmask(masked_crc32c),
+                              " vs. calculated ", crc);
+    }
+    mutex_lock l(mu);
+    verified_offsets.insert(offset);
+    return OkStatus();
+  }
+
+  const std::shared_ptr<ReadOnlyMemoryRegion> region;
+  mutex mu;
+  absl::flat_hash_set<int64_t> verified_offsets TF_GUARDED_BY(mu);
+};
+
+// Returns the RAM budget of `cache`, unless the input pipeline overrides it
+// through the `memory_cache_ram_budget` option.
+int64_t GetRamBudgetBytes(IteratorContext* ctx, const MemoryCache& cache) {
+  const Options* options = ctx->options();
+  if (options != nullptr &&
+      options->optional_memory_cache_ram_budget_case() ==
+          Options::kMemoryCacheRamBudget) {
+    return std::max<int64_t>(options->memory_cache_ram_budget(), 0);
+  }
+  return cache.ram_budget_bytes();
+}
 }  // namespace
 
 class PartialCache {
@@ -139,6 +238,7 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
         input_(input),
         filename_(std::move(filename)),
         env_(env),
+        use_mmap_(GetExperiments().contains(kFileCacheMmapExperiment)),
         num_tensors_(input->output_dtypes().size()),
         tensor_index_padding_size_(StringPaddingSize(num_tensors_)),
         item_index_padding_size_(StringPaddingSize(kMaxItems)),
@@ -198,6 +298,37 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
                            tensor_index);
   }
 
+  BundleWriter::Options WriterOptions() const {
+    BundleWriter::Options options;
+    if (use_mmap_) {
+      // Aligning the tensor data allows `FileReaderIterator` to hand out
+      // tensors that point directly into the mapped data file.
+      options.data_alignment = Allocator::kAllocatorAlignment;
+    }
+    return options;
+  }
+
+  // Returns the memory mapping of data file `shard_id` of the cache. Each data
+  // file is mapped only once, and the mapping is shared by all iterators over
+  // the cache. Returns `Unimplemented` if the file system does not support
+  // memory mapping.
+  Status GetMappedShard(int32_t shard_id, int32_t num_shards,
+                        std::shared_ptr<MappedShard>* shard) const {
+    mutex_lock l(mapped_shards_mu_);
+    if (mapped_shards_.size() != static_cast<size_t>(num_shards)) {
+      mapped_shards_.assign(num_shards, nullptr);
+    }
+    std::shared_ptr<MappedShard>& mapped = mapped_shards_[shard_id];
+    if (!mapped) {
+      std::unique_ptr<ReadOnlyMemoryRegion> region;
+      TF_RETURN_IF_ERROR(env_->NewReadOnlyMemoryRegionFromFile(
+          DataFilename(filename_, shard_id, num_shards), &region));
+      mapped = std::make_shared<MappedShard>(std::move(region));
+    }
+    *shard = mapped;
+    return OkStatus();
+  }
+
   class FileIterator : public DatasetIterator<FileDatasetBase> {
    public:
     explicit FileIterator(const Params& params)
@@ -271,9 +402,12 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
     // elements.
     //
     // Caching is performed by writing the input tensors to disk using the
-    // `BundleWriter`. Note that the cache gets fully flushed to disk only
-    // after the input iterator has been fully exhausted. If the program
-    // exits, before completion of an epoch, the cached state would be lost.
+    // `BundleWriter`. When the `file_cache_mmap` experiment is enabled, the
+    // tensor data is aligned to `Allocator::kAllocatorAlignment` so that the
+    // cache can later be read without copying. Note that the cache gets fully
+    // flushed to disk only after the input iterator has been fully exhausted.
+    // If the program exits, before completion of an epoch, the cached state
+    // would be lost.
     // To ensure that the partial cache persists across sessions, one should
     // checkpoint the input pipeline. On each call to `SaveInternal` the
     // partial cache gets flushed to disk in files with prefix
@@ -438,7 +572,8 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
         }
         filename_ = strings::StrCat(dataset()->filename_, "_", shard_id_);
         lockfile_ = strings::StrCat(filename_, kLockFileSuffix);
-        writer_ = std::make_unique<BundleWriter>(dataset()->env_, filename_);
+        writer_ = std::make_unique<BundleWriter>(dataset()->env_, filename_,
+                                                 dataset()->WriterOptions());
         return OkStatus();
       }
 
@@ -500,7 +635,8 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
         // conditions are not met since BundleWriter's constructor creates
         // new temp files which can delete the temp files created by a
         // BundleWriter in another Session.
-        writer_ = std::make_unique<BundleWriter>(dataset()->env_, filename_);
+        writer_ = std::make_unique<BundleWriter>(dataset()->env_, filename_,
+                                                 dataset()->WriterOptions());
         lockfile_created_ = true;
         return OkStatus();
       }
@@ -549,13 +685,39 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
       bool iteration_completed_ TF_GUARDED_BY(mu_);
     };  // FileWriterIterator
 
+    // FileReaderIterator reads the elements of a completed cache.
+    //
+    // When the `file_cache_mmap` experiment is enabled, the data files of the
+    // cache are memory-mapped and tensors whose data is suitably aligned are
+    // returned as views into the mapped pages instead of being copied into
+    // freshly allocated buffers. The checksum of each such tensor is verified
+    // the first time it is read from the mapping, and not on later reads.
+    // Tensors that cannot be mapped (e.g. strings, or data written without
+    // alignment) and file systems that do not support memory mapping fall back
+    // to reading through the `BundleReader`.
     class FileReaderIterator : public DatasetIterator<FileDatasetBase> {
      public:
       explicit FileReaderIterator(const Params& params)
           : DatasetIterator<FileDatasetBase>(params),
             cur_index_(0),
             reader_(dataset()->env_, dataset()->filename_),
-            iterator_restored_(false) {}
+            iterator_restored_(false),
+            use_mmap_(false) {
+        // On construction, the reader is positioned at the header entry.
+        if (dataset()->use_mmap_ && reader_.status().ok() && reader_.Valid() &&
+            reader_.key() == kHeaderEntryKey) {
+          BundleHeaderProto header;
+          if (header.ParseFromArray(reader_.value().data(),
+                                    reader_.value().size()) &&
+              header.endianness() == (port::kLittleEndian
+                                          ? BundleHeaderProto::LITTLE
+                                          : BundleHeaderProto::BIG)) {
+            num_shards_ = header.num_shards();
+            mapped_shards_.resize(num_shards_);
+            use_mmap_ = num_shards_ > 0;
+          }
+        }
+      }
 
       Status GetNextInternal(IteratorContext* ctx,
                              std::vector<Tensor>* out_tensors,
@@ -586,7 +748,7 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
           }
           StringPiece key = reader_.key();
           DCHECK_EQ(key, dataset()->FormatName(cur_index_, i));
-          TF_RETURN_IF_ERROR(reader_.ReadCurrent(&(*out_tensors)[i]));
+          TF_RETURN_IF_ERROR(ReadCurrent(&(*out_tensors)[i]));
           TF_RETURN_IF_ERROR(reader_.status());
         }
         cur_index_++;
@@ -632,10 +794,88 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
       }
 
      private:
+      Status ReadCurrent(Tensor* val) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (use_mmap_) {
+          bool mapped = false;
+          TF_RETURN_IF_ERROR(ReadCurrentMapped(val, &mapped));
+          if (mapped) {
+            return OkStatus();
+          }
+        }
+        return reader_.ReadCurrent(val);
+      }
+
+      // Attempts to read the current entry as a view into the mapped data
+      // file. Sets `*mapped` to false if the entry must be read through the
+      // `BundleReader` instead.
+      Status ReadCurrentMapped(Tensor* val, bool* mapped)
+          TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        *mapped = false;
+        BundleEntryProto entry;
+        if (!entry.ParseFromArray(reader_.value().data(),
+                                  reader_.value().size())) {
+          return errors::DataLoss("Unable to parse cache entry for key ",
+                                  reader_.key(), " in ", dataset()->filename_);
+        }
+        if (!IsMappable(entry) || entry.shard_id() < 0 ||
+            entry.shard_id() >= num_shards_) {
+          return OkStatus();
+        }
+        TensorShape shape;
+        TF_RETURN_IF_ERROR(
+            TensorShape::BuildTensorShape(entry.shape(), &shape));
+        if (entry.size() !=
+            shape.num_elements() * DataTypeSize(entry.dtype())) {
+          return errors::DataLoss("Invalid size ", entry.size(),
+                                  " for cache entry ", reader_.key(), " in ",
+                                  dataset()->filename_);
+        }
+        std::shared_ptr<MappedShard>& shard = mapped_shards_[entry.shard_id()];
+        if (!shard) {
+          Status s = dataset()->GetMappedShard(entry.shard_id(), num_shards_,
+                                               &shard);
+          if (errors::IsUnimplemented(s)) {
+            VLOG(1) << "Memory mapping is not supported for "
+                    << dataset()->filename_ << ": " << s;
+            use_mmap_ = false;
+            return OkStatus();
+          }
+          TF_RETURN_IF_ERROR(s);
+        }
+        const std::shared_ptr<ReadOnlyMemoryRegion>& region = shard->region;
+        if (entry.offset() < 0 ||
+            static_cast<uint64>(entry.offset() + entry.size()) >
+                region->length()) {
+          return errors::DataLoss("Cache entry ", reader_.key(), " in ",
+                                  dataset()->filename_,
+                                  " extends past the end of the data file.");
+        }
+        const char* data =
+            static_cast<const char*>(region->data()) + entry.offset();
+        if (reinterpret_cast<uintptr_t>(data) %
+                Allocator::kAllocatorAlignment !=
+            0) {
+          return OkStatus();
+        }
+        TF_RETURN_IF_ERROR(shard->VerifyEntry(
+            strings::StrCat(reader_.key(), " in ", dataset()->filename_),
+            entry.offset(), entry.size(), entry.crc32c()));
+        auto* buf = new MappedTensorBuffer(region, data, entry.size());
+        *val = Tensor(entry.dtype(), shape, buf);
+        buf->Unref();
+        *mapped = true;
+        return OkStatus();
+      }
+
       mutex mu_;
       size_t cur_index_ TF_GUARDED_BY(mu_);
       BundleReader reader_ TF_GUARDED_BY(mu_);
       bool iterator_restored_ TF_GUARDED_BY(mu_);
+      bool use_mmap_ TF_GUARDED_BY(mu_);
+      int32 num_shards_ TF_GUARDED_BY(mu_) = 0;
+      // Memory mappings of the cache data files, indexed by shard id.
+      std::vector<std::shared_ptr<MappedShard>> mapped_shards_
+          TF_GUARDED_BY(mu_);
     };  // FileReaderIterator
 
     Status InitializeIterator(IteratorContext* ctx)
@@ -670,6 +910,12 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
   };  // FileIterator
 
   Env* const env_;
+  // Whether the cache is written and read in the memory-mappable layout.
+  const bool use_mmap_;
+  mutable mutex mapped_shards_mu_;
+  // Memory mappings of the cache data files, indexed by shard id.
+  mutable std::vector<std::shared_ptr<MappedShard>> mapped_shards_
+      TF_GUARDED_BY(mapped_shards_mu_);
   const size_t num_tensors_;
   const size_t tensor_index_padding_size_;
   static constexpr size_t kMaxItems = 10000000;  // 10 million
@@ -765,7 +1011,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
     return input_->Cardinality(options);
   };
 
-  Status Get(OpKernelContext* ctx, int64 index,
+  Status Get(AnyContext ctx, int64 index,
              std::vector<Tensor>* out_tensors) const override {
     mutex_lock l(mu_);
 
@@ -778,10 +1024,15 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       return errors::OutOfRange("Index out of range [0, ", cardinality,
                                 "):", index);
     }
+    if (ctx.op_kernel_context() == nullptr) {
+      return errors::Unimplemented(
+          "Random access to a cached dataset from an iterator is not "
+          "supported.");
+    }
     if (!partial_cache_) {
       partial_cache_ = std::make_unique<PartialCache>(input_);
     }
-    return partial_cache_->Get(ctx, index, out_tensors);
+    return partial_cache_->Get(ctx.op_kernel_context(), index, out_tensors);
   }
 
   Status InputDatasets(std::vector<const DatasetBase*>* inputs) const override {
@@ -825,6 +1076,15 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kCacheCompleted), ""));
         TF_RETURN_IF_ERROR(
             WriteElementsToCheckpoint(writer, prefix(), cache_->data()));
+        MemoryCacheSpillFile* spill_file = cache_->spill_file();
+        if (spill_file != nullptr) {
+          Tensor chunks;
+          Tensor data;
+          TF_RETURN_IF_ERROR(spill_file->Save(&chunks, &data));
+          TF_RETURN_IF_ERROR(
+              writer->WriteTensor(full_name(kSpillChunks), chunks));
+          TF_RETURN_IF_ERROR(writer->WriteTensor(full_name(kSpillData), data));
+        }
       }
       return SaveInput(ctx, writer, iterator_);
     }
@@ -838,13 +1098,34 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         std::vector<std::vector<Tensor>> temp_cache;
         TF_RETURN_IF_ERROR(
             ReadElementsFromCheckpoint(ctx, reader, prefix(), &temp_cache));
-        cache_->Complete(std::move(temp_cache));
+        std::unique_ptr<MemoryCacheSpillFile> spill_file;
+        if (reader->Contains(full_name(kSpillChunks))) {
+          Tensor chunks;
+          Tensor data;
+          TF_RETURN_IF_ERROR(
+              reader->ReadTensor(full_name(kSpillChunks), &chunks));
+          TF_RETURN_IF_ERROR(reader->ReadTensor(full_name(kSpillData), &data));
+          TF_ASSIGN_OR_RETURN(spill_file,
+                              MemoryCacheSpillFile::Restore(
+                                  ctx->env(), cache_->spill_directory(),
+                                  chunks, data, /*finished=*/true));
+        }
+        cache_->Complete(std::move(temp_cache), std::move(spill_file));
       }
       TF_RETURN_IF_ERROR(InitializeIterator(ctx));
       return RestoreInput(ctx, reader, iterator_);
     }
 
    private:
+    // MemoryWriterIterator passes through and caches items from the input
+    // dataset.
+    //
+    // If the cache has a RAM budget, the elements that fit into the budget are
+    // kept in memory and all subsequent elements are spilled to a
+    // `MemoryCacheSpillFile` in chunks of about `kSpillChunkSizeBytes`. Keeping
+    // the head of the dataset resident (rather than evicting it) means that
+    // every epoch streams the same, contiguous tail from disk, which the spill
+    // file reads ahead.
     class MemoryWriterIterator : public DatasetIterator<MemoryDatasetBase> {
      public:
       explicit MemoryWriterIterator(const Params& params, MemoryCache* cache)
@@ -852,7 +1133,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
 
       ~MemoryWriterIterator() override {
         mutex_lock l(mu_);
-        if (!temp_cache_.empty() && !cache_->IsCompleted()) {
+        if (NumElements() > 0 && !cache_->IsCompleted()) {
           LOG(WARNING) << kIncompleteCacheErrorMessage;
           cache_->Reset();
         }
@@ -872,16 +1153,15 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         if (*end_of_sequence) {
           if (!cache_->IsCompleted()) {
             VLOG(2) << "Finalizing the cache because EOF has been reached.";
-            cache_->Complete(std::move(temp_cache_));
+            TF_RETURN_IF_ERROR(CompleteCache(ctx));
           }
           return OkStatus();
         }
-        RecordBufferEnqueue(ctx, *out_tensors);
-        temp_cache_.emplace_back(*out_tensors);
-        if (temp_cache_.size() == dataset()->input_->Cardinality()) {
+        TF_RETURN_IF_ERROR(AddElement(ctx, *out_tensors));
+        if (NumElements() == dataset()->input_->Cardinality()) {
           VLOG(2) << "Finalizing the cache because its size matches the "
                      "expected input cardinality.";
-          cache_->Complete(std::move(temp_cache_));
+          TF_RETURN_IF_ERROR(CompleteCache(ctx));
         }
         return OkStatus();
       }
@@ -897,8 +1177,23 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                           IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
         if (!cache_->IsCompleted()) {
+          // The spilled elements are written in their compressed form, as
+          // stored in the spill file.
           TF_RETURN_IF_ERROR(
               WriteElementsToCheckpoint(writer, prefix(), temp_cache_));
+          if (spill_file_) {
+            Tensor chunks;
+            Tensor data;
+            TF_RETURN_IF_ERROR(spill_file_->Save(&chunks, &data));
+            TF_RETURN_IF_ERROR(
+                writer->WriteTensor(full_name(kSpillChunks), chunks));
+            TF_RETURN_IF_ERROR(
+                writer->WriteTensor(full_name(kSpillData), data));
+          }
+          if (!spill_chunk_.empty()) {
+            TF_RETURN_IF_ERROR(WriteElementsToCheckpoint(
+                writer, full_name(kPendingSpillChunk), spill_chunk_));
+          }
         }
         return SaveInput(ctx, writer, input_impl_);
       }
@@ -906,18 +1201,120 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       Status RestoreInternal(IteratorContext* ctx,
                              IteratorStateReader* reader) override {
         mutex_lock l(mu_);
+        temp_cache_.clear();
+        temp_cache_bytes_ = 0;
+        spill_chunk_.clear();
+        spill_chunk_bytes_ = 0;
+        if (spill_file_) {
+          TF_RETURN_IF_ERROR(spill_file_->Delete());
+          spill_file_.reset();
+        }
         if (!reader->Contains(full_name(kCacheCompleted))) {
+          std::vector<std::vector<Tensor>> elements;
           TF_RETURN_IF_ERROR(
-              ReadElementsFromCheckpoint(ctx, reader, prefix(), &temp_cache_));
+              ReadElementsFromCheckpoint(ctx, reader, prefix(), &elements));
+          if (!reader->Contains(full_name(kSpillChunks))) {
+            for (std::vector<Tensor>& element : elements) {
+              TF_RETURN_IF_ERROR(AddElement(ctx, std::move(element)));
+            }
+          } else {
+            // The in-memory elements preceded the spilled ones when the
+            // checkpoint was written, so they are kept in memory as they are.
+            for (std::vector<Tensor>& element : elements) {
+              RecordBufferEnqueue(ctx, element);
+              temp_cache_bytes_ += GetTotalBytes(element);
+              temp_cache_.push_back(std::move(element));
+            }
+            Tensor chunks;
+            Tensor data;
+            TF_RETURN_IF_ERROR(
+                reader->ReadTensor(full_name(kSpillChunks), &chunks));
+            TF_RETURN_IF_ERROR(
+                reader->ReadTensor(full_name(kSpillData), &data));
+            TF_ASSIGN_OR_RETURN(spill_file_,
+                                MemoryCacheSpillFile::Restore(
+                                    ctx->env(), cache_->spill_directory(),
+                                    chunks, data, /*finished=*/false));
+          }
+          // The pending spill chunk is only checkpointed if it is not empty.
+          if (reader->Contains(full_name(kPendingSpillChunk),
+                               kNumElements)) {
+            std::vector<std::vector<Tensor>> pending;
+            TF_RETURN_IF_ERROR(ReadElementsFromCheckpoint(
+                ctx, reader, full_name(kPendingSpillChunk), &pending));
+            for (std::vector<Tensor>& element : pending) {
+              spill_chunk_bytes_ += GetTotalBytes(element);
+              spill_chunk_.push_back(std::move(element));
+            }
+          }
         }
         return RestoreInput(ctx, reader, input_impl_);
       }
 
      private:
+      int64_t NumElements() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return temp_cache_.size() + spill_chunk_.size() +
+               (spill_file_ ? spill_file_->size() : 0);
+      }
+
+      // Adds `element` to the in-memory part of the cache if it fits into the
+      // RAM budget, and to the pending spill chunk otherwise.
+      Status AddElement(IteratorContext* ctx, std::vector<Tensor> element)
+          TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        const int64_t bytes = GetTotalBytes(element);
+        const int64_t budget = GetRamBudgetBytes(ctx, *cache_);
+        if (budget == 0 || (!spill_file_ && spill_chunk_.empty() &&
+                            temp_cache_bytes_ + bytes <= budget)) {
+          RecordBufferEnqueue(ctx, element);
+          temp_cache_.push_back(std::move(element));
+          temp_cache_bytes_ += bytes;
+          return OkStatus();
+        }
+        spill_chunk_.push_back(std::move(element));
+        spill_chunk_bytes_ += bytes;
+        if (spill_chunk_bytes_ >= kSpillChunkSizeBytes) {
+          return FlushSpillChunk(ctx);
+        }
+        return OkStatus();
+      }
+
+      Status FlushSpillChunk(IteratorContext* ctx)
+          TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (spill_chunk_.empty()) {
+          return OkStatus();
+        }
+        if (!spill_file_) {
+          TF_ASSIGN_OR_RETURN(spill_file_,
+                              MemoryCacheSpillFile::Create(
+                                  ctx->env(), cache_->spill_directory()));
+        }
+        TF_RETURN_IF_ERROR(spill_file_->AppendChunk(spill_chunk_));
+        spill_chunk_.clear();
+        spill_chunk_bytes_ = 0;
+        return OkStatus();
+      }
+
+      Status CompleteCache(IteratorContext* ctx)
+          TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        TF_RETURN_IF_ERROR(FlushSpillChunk(ctx));
+        if (spill_file_) {
+          TF_RETURN_IF_ERROR(spill_file_->Finish());
+        }
+        temp_cache_bytes_ = 0;
+        cache_->Complete(std::move(temp_cache_), std::move(spill_file_));
+        return OkStatus();
+      }
+
       mutex mu_;
       std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
       MemoryCache* const cache_ TF_GUARDED_BY(mu_);  // not owned.
       std::vector<std::vector<Tensor>> temp_cache_ TF_GUARDED_BY(mu_);
+      int64_t temp_cache_bytes_ TF_GUARDED_BY(mu_) = 0;
+      // Elements that did not fit into the RAM budget and have not been
+      // written to `spill_file_` yet.
+      std::vector<std::vector<Tensor>> spill_chunk_ TF_GUARDED_BY(mu_);
+      int64_t spill_chunk_bytes_ TF_GUARDED_BY(mu_) = 0;
+      std::unique_ptr<MemoryCacheSpillFile> spill_file_ TF_GUARDED_BY(mu_);
     };  // MemoryWriterIterator
 
     class MemoryReaderIterator : public DatasetIterator<MemoryDatasetBase> {
@@ -933,9 +1330,10 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         // thus we record the memory allocated for the cache here. The caveat
         // is that this is incorrect if there are concurrent instances of this
         // iterator.
+        // Spilled elements do not occupy memory and are not recorded.
         tf_shared_lock l(mu_);
-        for (size_t i = 0; i < cache_->size(); ++i) {
-          RecordBufferEnqueue(ctx, cache_->at(i));
+        for (const std::vector<Tensor>& element : cache_->data()) {
+          RecordBufferEnqueue(ctx, element);
         }
         return OkStatus();
       }
@@ -945,7 +1343,8 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                              bool* end_of_sequence) override {
         mutex_lock l(mu_);
         if (index_ < cache_->size()) {
-          const std::vector<Tensor>& cache_tensors = cache_->at(index_);
+          std::vector<Tensor> cache_tensors;
+          TF_RETURN_IF_ERROR(cache_->Get(index_, &cache_tensors));
           out_tensors->insert(out_tensors->begin(), cache_tensors.begin(),
                               cache_tensors.end());
           index_++;
@@ -17,6 +17,7 @@ limitations under the License.
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/data/serialization_utils.h"
+#include "tensorflow/core/framework/tensor_description.pb.h"
 #include "tensorflow/core/platform/path.h"
 
 namespace tensorflow {
@@ -370,6 +371,153 @@ INSTANTIATE_TEST_CASE_P(CacheDatasetOpTest,
                         ParameterizedIteratorSaveAndRestoreTest,
                         ::testing::ValuesIn(IteratorSaveAndRestoreTestCases()));
 
+// Enables the `file_cache_mmap` experiment for the duration of a test.
+class CacheDatasetOpMmapTest : public CacheDatasetOpTest {
+ public:
+  CacheDatasetOpMmapTest() {
+    setenv("TF_JOB_NAME", "test_job", /*overwrite=*/1);
+    setenv("TF_TASK_ID", "0", /*overwrite=*/1);
+    setenv("TF_DATA_EXPERIMENT_OPT_IN", "file_cache_mmap", /*overwrite=*/1);
+  }
+
+  ~CacheDatasetOpMmapTest() override {
+    unsetenv("TF_JOB_NAME");
+    unsetenv("TF_TASK_ID");
+    unsetenv("TF_DATA_EXPERIMENT_OPT_IN");
+  }
+
+ protected:
+  // Runs `iterator_` to the end of its input, which completes the cache.
+  Status WriteCache() {
+    bool end_of_sequence = false;
+    while (!end_of_sequence) {
+      std::vector<Tensor> next;
+      TF_RETURN_IF_ERROR(
+          iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    }
+    return OkStatus();
+  }
+};
+
+TEST_F(CacheDatasetOpMmapTest, ReadsMappedTensors) {
+  auto dataset_params = CacheDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(WriteCache());
+  const std::vector<Tensor> expected_outputs = CreateTensors<int64_t>(
+      TensorShape({3, 1}), {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}});
+
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  std::vector<Tensor> next;
+  bool end_of_sequence = false;
+  TF_ASSERT_OK(iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+  ASSERT_FALSE(end_of_sequence);
+  ASSERT_EQ(next.size(), 1);
+  TensorDescription description;
+  next[0].FillDescription(&description);
+  EXPECT_EQ(description.allocation_description().allocator_name(),
+            "MappedFileCache");
+  TF_EXPECT_OK(ExpectEqual(next[0], expected_outputs[0]));
+
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  TF_EXPECT_OK(CheckIteratorGetNext(iterator.get(), iterator_ctx_.get(),
+                                    expected_outputs,
+                                    /*compare_order=*/true));
+  TF_EXPECT_OK(CheckIteratorSaveAndRestore(dataset_params.iterator_prefix(),
+                                           expected_outputs,
+                                           /*breakpoints=*/{0, 1, 4},
+                                           /*compare_order=*/true));
+}
+
+// Strings cannot be mapped, so they are read through the `BundleReader`.
+TEST_F(CacheDatasetOpMmapTest, FallsBackForUnmappableTensors) {
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<tstring>(TensorShape{3}, {"a", "b", "c"})},
+      /*node_name=*/"tensor_slice");
+  auto dataset_params = CacheDatasetParams(
+      std::move(tensor_slice_dataset_params),
+      /*filename=*/io::JoinPath(testing::TmpDir(), "cache_data"),
+      /*output_dtypes=*/{DT_STRING},
+      /*output_shapes=*/{PartialTensorShape({})}, kNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(WriteCache());
+  const std::vector<Tensor> expected_outputs =
+      CreateTensors<tstring>(TensorShape({}), {{"a"}, {"b"}, {"c"}});
+
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  TF_EXPECT_OK(CheckIteratorGetNext(iterator.get(), iterator_ctx_.get(),
+                                    expected_outputs,
+                                    /*compare_order=*/true));
+  TF_EXPECT_OK(CheckIteratorSaveAndRestore(dataset_params.iterator_prefix(),
+                                           expected_outputs,
+                                           /*breakpoints=*/{0, 1, 4},
+                                           /*compare_order=*/true));
+}
+
+TEST_F(CacheDatasetOpMmapTest, DetectsCorruptedDataFile) {
+  auto dataset_params = CacheDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(WriteCache());
+
+  Env* env = device_->env();
+  std::vector<string> data_files;
+  TF_ASSERT_OK(env->GetMatchingPaths(
+      strings::StrCat(cache_filename_, ".data-*"), &data_files));
+  ASSERT_EQ(data_files.size(), 1);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(env, data_files[0], &contents));
+  ASSERT_FALSE(contents.empty());
+  contents[0] ^= 0xff;
+  TF_ASSERT_OK(WriteStringToFile(env, data_files[0], contents));
+
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  std::vector<Tensor> next;
+  bool end_of_sequence = false;
+  Status s = iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence);
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+}
+
+// Entries are verified as they are read, so elements before a corrupted entry
+// are still returned.
+TEST_F(CacheDatasetOpMmapTest, VerifiesEntriesWhenRead) {
+  auto dataset_params = CacheDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(WriteCache());
+
+  Env* env = device_->env();
+  std::vector<string> data_files;
+  TF_ASSERT_OK(env->GetMatchingPaths(
+      strings::StrCat(cache_filename_, ".data-*"), &data_files));
+  ASSERT_EQ(data_files.size(), 1);
+  string contents;
+  TF_ASSERT_OK(ReadFileToString(env, data_files[0], &contents));
+  ASSERT_FALSE(contents.empty());
+  // Corrupts the last element.
+  contents.back() ^= 0xff;
+  TF_ASSERT_OK(WriteStringToFile(env, data_files[0], contents));
+
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  std::vector<Tensor> next;
+  bool end_of_sequence = false;
+  TF_ASSERT_OK(iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+  TF_ASSERT_OK(iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+  Status s = iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence);
+  EXPECT_TRUE(errors::IsDataLoss(s)) << s;
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
@@ -14,29 +14,459 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/cache_ops.h"
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "absl/memory/memory.h"
+#include "tensorflow/core/data/compression_utils.h"
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/dataset.pb.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/lib/io/record_writer.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/random/random_distributions.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 namespace data {
 namespace {
 
 constexpr char kMemoryCache[] = "MemoryCache";
+constexpr char kSpillFilePrefix[] = "tf_data_memory_cache_spill_";
+// The columns of the chunk index returned by `MemoryCacheSpillFile::Save()`.
+constexpr int kChunkFirstElement = 0;
+constexpr int kChunkNumElements = 1;
+constexpr int kChunkNumComponents = 2;
+constexpr int kChunkOffset = 3;
+constexpr int kChunkIndexColumns = 4;
+
+int64_t GetRamBudgetFromEnv() {
+  int64_t budget_mb = 0;
+  Status s = ReadInt64FromEnvVar(kMemoryCacheRamBudgetEnvVar, 0, &budget_mb);
+  if (!s.ok()) {
+    LOG(WARNING) << "Ignoring invalid memory cache RAM budget: " << s;
+    return 0;
+  }
+  return std::max<int64_t>(budget_mb, 0) << 20;
+}
+
+std::string GetSpillDirectoryFromEnv() {
+  std::string directory;
+  Status s = ReadStringFromEnvVar(kMemoryCacheSpillDirEnvVar, "", &directory);
+  if (!s.ok()) {
+    LOG(WARNING) << "Ignoring invalid memory cache spill directory: " << s;
+    return "";
+  }
+  return directory;
+}
 
 }  // namespace
 
+StatusOr<std::unique_ptr<MemoryCacheSpillFile>> MemoryCacheSpillFile::Create(
+    Env* env, const std::string& directory) {
+  std::string filename;
+  if (directory.empty()) {
+    if (!env->LocalTempFilename(&filename)) {
+      return errors::Internal(
+          "Failed to create a local temporary file name for the memory cache "
+          "spill file.");
+    }
+  } else {
+    TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(directory));
+    filename = io::JoinPath(directory,
+                            strings::StrCat(kSpillFilePrefix, random::New64()));
+  }
+  std::unique_ptr<WritableFile> file;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(filename, &file));
+  VLOG(2) << "Spilling memory cache elements to " << filename;
+  return absl::WrapUnique(new MemoryCacheSpillFile(env, std::move(filename),
+                                                   std::move(file),
+                                                   /*size=*/0));
+}
+
+StatusOr<std::unique_ptr<MemoryCacheSpillFile>> MemoryCacheSpillFile::Restore(
+    Env* env, const std::string& directory, const Tensor& chunks,
+    const Tensor& data, bool finished) {
+  if (chunks.dtype() != DT_INT64 || chunks.dims() != 2 ||
+      chunks.dim_size(1) != kChunkIndexColumns || data.dtype() != DT_STRING ||
+      data.dims() != 1 || data.dim_size(0) != chunks.dim_size(0)) {
+    return errors::DataLoss(
+        "Invalid checkpoint of memory cache spill file: chunk index ",
+        chunks.DebugString(), ", chunk contents ", data.DebugString());
+  }
+  TF_ASSIGN_OR_RETURN(std::unique_ptr<MemoryCacheSpillFile> spill_file,
+                      Create(env, directory));
+  mutex_lock l(spill_file->mu_);
+  auto index = chunks.matrix<int64_t>();
+  auto contents = data.vec<tstring>();
+  for (int64_t i = 0; i < chunks.dim_size(0); ++i) {
+    Chunk chunk;
+    chunk.first_element = index(i, kChunkFirstElement);
+    chunk.num_elements = index(i, kChunkNumElements);
+    chunk.num_components = index(i, kChunkNumComponents);
+    // The chunks are written back to back, so the offsets of the original
+    // file are not needed.
+    chunk.offset = spill_file->file_size_;
+    if (chunk.first_element != spill_file->num_elements_ ||
+        chunk.num_elements <= 0 || contents(i).empty()) {
+      return errors::DataLoss(
+          "Invalid chunk index of memory cache spill file: ",
+          chunks.DebugString());
+    }
+    TF_RETURN_IF_ERROR(spill_file->file_->Append(contents(i)));
+    spill_file->file_size_ += contents(i).size();
+    spill_file->chunks_.push_back(chunk);
+    spill_file->num_elements_ += chunk.num_elements;
+  }
+  TF_RETURN_IF_ERROR(spill_file->file_->Flush());
+  if (finished) {
+    TF_RETURN_IF_ERROR(spill_file->file_->Close());
+    spill_file->file_.reset();
+    spill_file->finished_ = true;
+  }
+  return spill_file;
+}
+
+MemoryCacheSpillFile::MemoryCacheSpillFile(Env* env, std::string filename,
+                                           std::unique_ptr<WritableFile> file,
+                                           uint64 size)
+    : env_(env),
+      filename_(std::move(filename)),
+      file_(std::move(file)),
+      file_size_(size) {}
+
+MemoryCacheSpillFile::~MemoryCacheSpillFile() {
+  Status s = Delete();
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to delete memory cache spill file " << filename_
+                 << ": " << s;
+  }
+}
+
+Status MemoryCacheSpillFile::Delete() {
+  {
+    mutex_lock l(mu_);
+    if (deleted_) {
+      return OkStatus();
+    }
+    deleted_ = true;
+    cancelled_ = true;
+    cond_var_.notify_all();
+  }
+  // Joins the read-ahead thread.
+  prefetch_thread_.reset();
+  mutex_lock l(mu_);
+  Status s;
+  if (file_) {
+    s.Update(file_->Close());
+    file_.reset();
+  }
+  finished_ = true;
+  read_file_.reset();
+  cached_chunks_.clear();
+  s.Update(env_->DeleteFile(filename_));
+  return s;
+}
+
+Status MemoryCacheSpillFile::AppendChunk(
+    const std::vector<std::vector<Tensor>>& chunk) {
+  if (chunk.empty()) {
+    return OkStatus();
+  }
+  mutex_lock l(mu_);
+  if (deleted_) {
+    return errors::FailedPrecondition(
+        "Cannot append to a deleted memory cache spill file.");
+  }
+  if (finished_) {
+    return errors::FailedPrecondition(
+        "Cannot append to a finished memory cache spill file.");
+  }
+  Chunk info;
+  info.first_element = num_elements_;
+  info.num_elements = chunk.size();
+  info.num_components = chunk.front().size();
+  // The offset is tracked rather than obtained from `Tell()`, which does not
+  // account for the existing contents of a file reopened for appending.
+  info.offset = file_size_;
+
+  io::RecordWriter writer(file_.get());
+  uint64 chunk_bytes = 0;
+  std::vector<Tensor> column;
+  column.reserve(chunk.size());
+  for (int64_t i = 0; i < info.num_components; ++i) {
+    column.clear();
+    for (const std::vector<Tensor>& element : chunk) {
+      if (static_cast<int64_t>(element.size()) != info.num_components) {
+        return errors::InvalidArgument(
+            "All elements of a memory cache must have the same number of "
+            "components. Expected ",
+            info.num_components, " got ", element.size());
+      }
+      column.push_back(element[i]);
+    }
+    CompressedElement compressed;
+    TF_RETURN_IF_ERROR(CompressElement(column, &compressed));
+    const std::string record = compressed.SerializeAsString();
+    TF_RETURN_IF_ERROR(writer.WriteRecord(record));
+    chunk_bytes += io::RecordWriter::kHeaderSize + record.size() +
+                   io::RecordWriter::kFooterSize;
+  }
+  TF_RETURN_IF_ERROR(writer.Close());
+  // Makes the chunk visible to readers of the file.
+  TF_RETURN_IF_ERROR(file_->Flush());
+  file_size_ += chunk_bytes;
+  chunks_.push_back(info);
+  num_elements_ += info.num_elements;
+  return OkStatus();
+}
+
+Status MemoryCacheSpillFile::Finish() {
+  mutex_lock l(mu_);
+  if (finished_) {
+    return OkStatus();
+  }
+  TF_RETURN_IF_ERROR(file_->Close());
+  file_.reset();
+  finished_ = true;
+  return OkStatus();
+}
+
+Status MemoryCacheSpillFile::Get(int64_t index, std::vector<Tensor>* out) {
+  int64_t chunk_index;
+  Chunk chunk;
+  RandomAccessFile* file;
+  std::shared_ptr<const ChunkElements> elements;
+  {
+    mutex_lock l(mu_);
+    if (deleted_) {
+      return errors::FailedPrecondition(
+          "Cannot read from a deleted memory cache spill file.");
+    }
+    if (index < 0 || index >= num_elements_) {
+      return errors::OutOfRange("Index out of range [0, ", num_elements_,
+                                "):", index);
+    }
+    TF_RETURN_IF_ERROR(StartReading());
+    chunk_index = ChunkIndex(index);
+    chunk = chunks_[chunk_index];
+    file = read_file_.get();
+    // Wait for an in-flight read of the chunk instead of reading it twice.
+    while (reading_chunks_.contains(chunk_index)) {
+      cond_var_.wait(l);
+    }
+    elements = LookupChunk(chunk_index);
+    if (elements == nullptr) {
+      reading_chunks_.insert(chunk_index);
+    }
+    MaybePrefetch(chunk_index + 1);
+  }
+  if (elements == nullptr) {
+    // The chunk is read without holding the lock, so that readers of cached
+    // chunks are not blocked on the disk.
+    auto read_elements = std::make_shared<ChunkElements>();
+    Status s = ReadChunk(file, chunk, read_elements.get());
+    mutex_lock l(mu_);
+    reading_chunks_.erase(chunk_index);
+    cond_var_.notify_all();
+    TF_RETURN_IF_ERROR(s);
+    InsertChunk(chunk_index, read_elements);
+    elements = std::move(read_elements);
+  }
+  *out = (*elements)[index - chunk.first_element];
+  return OkStatus();
+}
+
+int64_t MemoryCacheSpillFile::size() {
+  tf_shared_lock l(mu_);
+  return num_elements_;
+}
+
+Status MemoryCacheSpillFile::Save(Tensor* chunks, Tensor* data) {
+  std::vector<Chunk> saved_chunks;
+  uint64 file_size;
+  {
+    mutex_lock l(mu_);
+    if (deleted_) {
+      return errors::FailedPrecondition(
+          "Cannot save a deleted memory cache spill file.");
+    }
+    saved_chunks = chunks_;
+    file_size = file_size_;
+  }
+  const int64_t num_chunks = saved_chunks.size();
+  *chunks = Tensor(DT_INT64, TensorShape({num_chunks, kChunkIndexColumns}));
+  *data = Tensor(DT_STRING, TensorShape({num_chunks}));
+  if (num_chunks == 0) {
+    return OkStatus();
+  }
+  // Appended chunks never change, so they are read without holding the lock.
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env_->NewRandomAccessFile(filename_, &file));
+  auto index = chunks->matrix<int64_t>();
+  auto contents = data->vec<tstring>();
+  for (int64_t i = 0; i < num_chunks; ++i) {
+    const Chunk& chunk = saved_chunks[i];
+    index(i, kChunkFirstElement) = chunk.first_element;
+    index(i, kChunkNumElements) = chunk.num_elements;
+    index(i, kChunkNumComponents) = chunk.num_components;
+    index(i, kChunkOffset) = chunk.offset;
+    const uint64 end =
+        i + 1 < num_chunks ? saved_chunks[i + 1].offset : file_size;
+    const size_t n = end - chunk.offset;
+    tstring& chunk_data = contents(i);
+    chunk_data.resize_uninitialized(n);
+    StringPiece result;
+    TF_RETURN_IF_ERROR(
+        file->Read(chunk.offset, n, &result, chunk_data.mdata()));
+    if (result.size() != n) {
+      return errors::DataLoss("Expected ", n, " bytes of memory cache spill "
+                              "chunk ", i, " in ", filename_, ", got ",
+                              result.size());
+    }
+    if (result.data() != chunk_data.mdata()) {
+      memmove(chunk_data.mdata(), result.data(), n);
+    }
+  }
+  return OkStatus();
+}
+
+Status MemoryCacheSpillFile::StartReading() {
+  if (read_file_) {
+    return OkStatus();
+  }
+  TF_RETURN_IF_ERROR(env_->NewRandomAccessFile(filename_, &read_file_));
+  prefetch_thread_ = absl::WrapUnique(
+      env_->StartThread(ThreadOptions(), "tf_data_memory_cache_spill",
+                        [this]() { PrefetchThread(); }));
+  return OkStatus();
+}
+
+std::shared_ptr<const MemoryCacheSpillFile::ChunkElements>
+MemoryCacheSpillFile::LookupChunk(int64_t chunk_index) {
+  for (auto it = cached_chunks_.begin(); it != cached_chunks_.end(); ++it) {
+    if (it->first == chunk_index) {
+      cached_chunks_.splice(cached_chunks_.begin(), cached_chunks_, it);
+      return cached_chunks_.front().second;
+    }
+  }
+  return nullptr;
+}
+
+void MemoryCacheSpillFile::InsertChunk(
+    int64_t chunk_index, std::shared_ptr<const ChunkElements> elements) {
+  cached_chunks_.emplace_front(chunk_index, std::move(elements));
+  while (cached_chunks_.size() > kMaxCachedChunks) {
+    cached_chunks_.pop_back();
+  }
+}
+
+void MemoryCacheSpillFile::MaybePrefetch(int64_t chunk_index) {
+  if (chunk_index >= static_cast<int64_t>(chunks_.size()) ||
+      prefetch_chunk_ >= 0 || reading_chunks_.contains(chunk_index)) {
+    return;
+  }
+  for (const auto& cached_chunk : cached_chunks_) {
+    if (cached_chunk.first == chunk_index) {
+      return;
+    }
+  }
+  prefetch_chunk_ = chunk_index;
+  reading_chunks_.insert(chunk_index);
+  cond_var_.notify_all();
+}
+
+size_t MemoryCacheSpillFile::ChunkIndex(int64_t index) {
+  auto it = std::upper_bound(chunks_.begin(), chunks_.end(), index,
+                             [](int64_t i, const Chunk& chunk) {
+                               return i < chunk.first_element;
+                             });
+  return std::distance(chunks_.begin(), it) - 1;
+}
+
+Status MemoryCacheSpillFile::ReadChunk(RandomAccessFile* file,
+                                       const Chunk& chunk,
+                                       ChunkElements* elements) {
+  io::RecordReader reader(file);
+  uint64 offset = chunk.offset;
+  elements->assign(chunk.num_elements,
+                   std::vector<Tensor>(chunk.num_components));
+  tstring record;
+  std::vector<Tensor> column;
+  for (int64_t i = 0; i < chunk.num_components; ++i) {
+    TF_RETURN_IF_ERROR(reader.ReadRecord(&offset, &record));
+    CompressedElement compressed;
+    if (!compressed.ParseFromArray(record.data(), record.size())) {
+      return errors::DataLoss("Failed to parse memory cache spill record.");
+    }
+    column.clear();
+    TF_RETURN_IF_ERROR(UncompressElement(compressed, &column));
+    if (static_cast<int64_t>(column.size()) != chunk.num_elements) {
+      return errors::DataLoss("Expected ", chunk.num_elements,
+                              " elements in memory cache spill record, got ",
+                              column.size());
+    }
+    for (int64_t j = 0; j < chunk.num_elements; ++j) {
+      (*elements)[j][i] = std::move(column[j]);
+    }
+  }
+  return OkStatus();
+}
+
+void MemoryCacheSpillFile::PrefetchThread() {
+  while (true) {
+    int64_t chunk_index;
+    Chunk chunk;
+    RandomAccessFile* file;
+    {
+      mutex_lock l(mu_);
+      while (!cancelled_ && prefetch_chunk_ < 0) {
+        cond_var_.wait(l);
+      }
+      if (cancelled_) {
+        return;
+      }
+      chunk_index = prefetch_chunk_;
+      prefetch_chunk_ = -1;
+      chunk = chunks_[chunk_index];
+      file = read_file_.get();
+    }
+    auto elements = std::make_shared<ChunkElements>();
+    Status s = ReadChunk(file, chunk, elements.get());
+    mutex_lock l(mu_);
+    if (s.ok()) {
+      InsertChunk(chunk_index, std::move(elements));
+    } else {
+      // `Get()` reads the chunk again and reports the error.
+      VLOG(1) << "Failed to read ahead memory cache spill chunk: " << s;
+    }
+    reading_chunks_.erase(chunk_index);
+    cond_var_.notify_all();
+  }
+}
+
 string MemoryCacheManager::DebugString() const { return kMemoryCache; }
 
-void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache) {
+MemoryCache::MemoryCache()
+    : MemoryCache(GetRamBudgetFromEnv(), GetSpillDirectoryFromEnv()) {}
+
+MemoryCache::MemoryCache(int64_t ram_budget_bytes, std::string spill_directory)
+    : ram_budget_bytes_(ram_budget_bytes),
+      spill_directory_(std::move(spill_directory)) {}
+
+void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache,
+                           std::unique_ptr<MemoryCacheSpillFile> spill_file) {
   mutex_lock l(mu_);
   if (!completed_) {
     cache_ = std::move(cache);
+    spill_file_ = std::move(spill_file);
     completed_ = true;
   }
 }
@@ -50,17 +480,38 @@ void MemoryCache::Reset() {
   mutex_lock l(mu_);
   completed_ = false;
   cache_.clear();
+  if (spill_file_) {
+    Status s = spill_file_->Delete();
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to delete memory cache spill file: " << s;
+    }
+    spill_file_.reset();
+  }
 }
 
 const std::vector<Tensor>& MemoryCache::at(int64_t index) {
   tf_shared_lock l(mu_);
-  DCHECK(index < cache_.size());
+  DCHECK(index < static_cast<int64_t>(cache_.size()));
   return cache_[index];
 }
 
+Status MemoryCache::Get(int64_t index, std::vector<Tensor>* out) {
+  tf_shared_lock l(mu_);
+  const int64_t num_cached = cache_.size();
+  if (index < num_cached) {
+    *out = cache_[index];
+    return OkStatus();
+  }
+  if (!spill_file_) {
+    return errors::OutOfRange("Index out of range [0, ", num_cached,
+                              "):", index);
+  }
+  return spill_file_->Get(index - num_cached, out);
+}
+
 size_t MemoryCache::size() {
   tf_shared_lock l(mu_);
-  return cache_.size();
+  return cache_.size() + (spill_file_ ? spill_file_->size() : 0);
 }
 
 const std::vector<std::vector<Tensor>>& MemoryCache::data() {
@@ -68,6 +519,16 @@ const std::vector<std::vector<Tensor>>& MemoryCache::data() {
   return cache_;
 }
 
+bool MemoryCache::HasSpilled() {
+  tf_shared_lock l(mu_);
+  return spill_file_ != nullptr;
+}
+
+MemoryCacheSpillFile* MemoryCache::spill_file() {
+  tf_shared_lock l(mu_);
+  return spill_file_.get();
+}
+
 AnonymousMemoryCacheHandleOp::AnonymousMemoryCacheHandleOp(
     OpKernelConstruction* ctx)
     : AnonymousResourceOp<MemoryCacheManager>(ctx,
@@ -16,23 +16,186 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_DATA_CACHE_OPS_H_
 #define TENSORFLOW_CORE_KERNELS_DATA_CACHE_OPS_H_
 
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/statusor.h"
 
 namespace tensorflow {
 namespace data {
 
+// Environment variable that sets the number of megabytes of dataset elements
+// a `MemoryCache` keeps in RAM. Elements beyond the budget are spilled to a
+// local file. A value of 0 (the default) means that the budget is unlimited.
+// The `memory_cache_ram_budget` dataset option takes precedence over it.
+constexpr char kMemoryCacheRamBudgetEnvVar[] =
+    "TF_DATA_MEMORY_CACHE_RAM_BUDGET_MB";
+
+// Environment variable that sets the directory in which a `MemoryCache`
+// creates its spill files. Defaults to a local temporary directory.
+constexpr char kMemoryCacheSpillDirEnvVar[] = "TF_DATA_MEMORY_CACHE_SPILL_DIR";
+
+// An append-only file of dataset elements that did not fit into the RAM
+// budget of a `MemoryCache`.
+//
+// Elements are appended in chunks. Each chunk is stored in a columnar layout:
+// for every component, the values of that component across all elements of
+// the chunk are stored in a single compressed record. Chunks are read back as
+// a whole, outside of the lock, and the most recently used chunks are kept in
+// memory. When a chunk is read, the following chunk is read ahead on a
+// background thread so that sequential reads rarely wait for the disk.
+//
+// The file is local to the process that created it: checkpoints hold a copy
+// of its chunks rather than a reference to it, and it is deleted by `Delete()`
+// or when the object is destroyed.
+class MemoryCacheSpillFile {
+ public:
+  // Creates a new spill file in `directory`. If `directory` is empty, a local
+  // temporary directory is used.
+  static StatusOr<std::unique_ptr<MemoryCacheSpillFile>> Create(
+      Env* env, const std::string& directory);
+
+  // Recreates a spill file from the chunk index and chunk contents returned
+  // by `Save()`, as a new file in `directory`. If `finished` is false, more
+  // chunks can be appended to it.
+  static StatusOr<std::unique_ptr<MemoryCacheSpillFile>> Restore(
+      Env* env, const std::string& directory, const Tensor& chunks,
+      const Tensor& data, bool finished);
+
+  ~MemoryCacheSpillFile();
+
+  // Appends a chunk of elements to the file. Must not be called after
+  // `Finish()`.
+  Status AppendChunk(const std::vector<std::vector<Tensor>>& chunk);
+
+  // Closes the file for writing.
+  Status Finish();
+
+  // Returns the element at the given index. Elements can be read as soon as
+  // the chunk containing them has been appended.
+  Status Get(int64_t index, std::vector<Tensor>* out);
+
+  // Returns the number of elements in the file.
+  int64_t size();
+
+  // Returns the chunk index of the file in `chunks` and the contents of its
+  // chunks in `data`, one string per chunk, from which `Restore()` recreates
+  // the file. The chunks are copied as they are stored, without uncompressing
+  // them.
+  Status Save(Tensor* chunks, Tensor* data);
+
+  // Closes and deletes the file. The file can no longer be read or appended
+  // to. Must not be called concurrently with the other methods. Called on
+  // destruction, with errors logged, unless it has been called before.
+  Status Delete();
+
+ private:
+  struct Chunk {
+    // Index of the first element of the chunk.
+    int64_t first_element;
+    int64_t num_elements;
+    int64_t num_components;
+    // Offset of the first record of the chunk in the file.
+    uint64 offset;
+  };
+
+  using ChunkElements = std::vector<std::vector<Tensor>>;
+
+  // The number of chunks kept in memory, including the one read ahead.
+  static constexpr size_t kMaxCachedChunks = 4;
+
+  MemoryCacheSpillFile(Env* env, std::string filename,
+                       std::unique_ptr<WritableFile> file, uint64 size);
+
+  // Returns the index of the chunk containing the element at `index`.
+  size_t ChunkIndex(int64_t index) TF_SHARED_LOCKS_REQUIRED(mu_);
+
+  // Opens the file for reading and starts the read-ahead thread, unless this
+  // has already been done.
+  Status StartReading() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the cached elements of the chunk at `chunk_index`, or nullptr if
+  // the chunk is not cached.
+  std::shared_ptr<const ChunkElements> LookupChunk(int64_t chunk_index)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Caches the elements of the chunk at `chunk_index`, evicting the least
+  // recently used chunk if the cache is full.
+  void InsertChunk(int64_t chunk_index,
+                   std::shared_ptr<const ChunkElements> elements)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Requests a read-ahead of the chunk at `chunk_index` if it exists and is
+  // neither cached nor being read.
+  void MaybePrefetch(int64_t chunk_index) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Reads the elements of `chunk` from `file`.
+  static Status ReadChunk(RandomAccessFile* file, const Chunk& chunk,
+                          ChunkElements* elements);
+
+  // Reads ahead the chunks requested through `prefetch_chunk_`.
+  void PrefetchThread();
+
+  Env* const env_;
+  const std::string filename_;
+
+  mutex mu_;
+  condition_variable cond_var_;
+  std::unique_ptr<WritableFile> file_ TF_GUARDED_BY(mu_);
+  std::unique_ptr<RandomAccessFile> read_file_ TF_GUARDED_BY(mu_);
+  bool finished_ TF_GUARDED_BY(mu_) = false;
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+  bool deleted_ TF_GUARDED_BY(mu_) = false;
+  // The size of the file, which is the offset of the next chunk.
+  uint64 file_size_ TF_GUARDED_BY(mu_);
+  std::vector<Chunk> chunks_ TF_GUARDED_BY(mu_);
+  int64_t num_elements_ TF_GUARDED_BY(mu_) = 0;
+  // The cached chunks, most recently used first.
+  std::list<std::pair<int64_t, std::shared_ptr<const ChunkElements>>>
+      cached_chunks_ TF_GUARDED_BY(mu_);
+  // The chunks that are being read by `Get()` or by the read-ahead thread.
+  absl::flat_hash_set<int64_t> reading_chunks_ TF_GUARDED_BY(mu_);
+  // The chunk to read ahead, or -1 if there is no pending read-ahead request.
+  int64_t prefetch_chunk_ TF_GUARDED_BY(mu_) = -1;
+  // Started by the first call to `Get()` and joined on destruction.
+  std::unique_ptr<Thread> prefetch_thread_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(MemoryCacheSpillFile);
+};
+
 // A thread-safe data structure for caching dataset elements.
 //
 // The expected use is that a single `MemoryWriterIterator` populates the
 // cache with dataset elements. Once all elements are cached, the cache can
 // be used by one or more `MemoryReaderIterator`s.
+//
+// If the cache has a RAM budget, the writer keeps the first elements that fit
+// into the budget in memory and spills the remaining ones to a
+// `MemoryCacheSpillFile`, which becomes part of the completed cache.
 class MemoryCache {
  public:
-  MemoryCache() = default;
+  // Creates a cache whose RAM budget is read from the environment (see
+  // `kMemoryCacheRamBudgetEnvVar` and `kMemoryCacheSpillDirEnvVar`).
+  MemoryCache();
 
-  // Marks the cache as completed.
-  void Complete(std::vector<std::vector<Tensor>>&& cache);
+  // Creates a cache with the given RAM budget and spill directory. A budget of
+  // 0 means that the budget is unlimited.
+  MemoryCache(int64_t ram_budget_bytes, std::string spill_directory);
+
+  // Marks the cache as completed. `spill_file` holds the elements following
+  // the ones in `cache`, if any.
+  void Complete(std::vector<std::vector<Tensor>>&& cache,
+                std::unique_ptr<MemoryCacheSpillFile> spill_file = nullptr);
 
   // Returns whether the cache is completed.
   bool IsCompleted();
@@ -40,21 +203,45 @@ class MemoryCache {
   // Resets the cache.
   void Reset();
 
-  // Returns the element at the given index.
+  // Returns the in-memory element at the given index.
   const std::vector<Tensor>& at(int64_t index);
 
-  // Returns the size of the cache.
+  // Returns the element at the given index, reading it from the spill file if
+  // it is not held in memory.
+  Status Get(int64_t index, std::vector<Tensor>* out);
+
+  // Returns the size of the cache, including spilled elements.
   size_t size();
 
-  // Returns a reference to the cache's data. The returned reference will be
-  // invalidated by any call to Reset().
+  // Returns a reference to the in-memory part of the cache's data. The
+  // returned reference will be invalidated by any call to Reset().
   const std::vector<std::vector<Tensor>>& data();
 
+  // Returns whether some elements of the cache were spilled to disk.
+  bool HasSpilled();
+
+  // Returns the file holding the spilled elements of the cache, or nullptr if
+  // there is none. The returned pointer will be invalidated by any call to
+  // Reset().
+  MemoryCacheSpillFile* spill_file();
+
+  // Returns the number of bytes of elements the cache may keep in memory, or 0
+  // if the budget is unlimited. The `memory_cache_ram_budget` dataset option
+  // overrides it.
+  int64_t ram_budget_bytes() const { return ram_budget_bytes_; }
+
+  // Returns the directory in which spill files are created.
+  const std::string& spill_directory() const { return spill_directory_; }
+
  private:
+  const int64_t ram_budget_bytes_;
+  const std::string spill_directory_;
+
   mutex mu_;
   // Determines whether all elements of the dataset have been cached.
   bool completed_ TF_GUARDED_BY(mu_) = false;
   std::vector<std::vector<Tensor>> cache_ TF_GUARDED_BY(mu_);
+  std::unique_ptr<MemoryCacheSpillFile> spill_file_ TF_GUARDED_BY(mu_);
 };
 
 // A resource wrapping a shared instance of a memory cache.
@@ -0,0 +1,219 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/cache_ops.h"
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/statusor.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+std::vector<std::vector<Tensor>> MakeElements(int64_t first, int64_t count) {
+  std::vector<std::vector<Tensor>> elements;
+  for (int64_t i = first; i < first + count; ++i) {
+    elements.push_back({test::AsScalar<int64_t>(i),
+                        test::AsTensor<tstring>({strings::StrCat("e", i)})});
+  }
+  return elements;
+}
+
+void ExpectElement(const std::vector<Tensor>& element, int64_t i) {
+  ASSERT_EQ(element.size(), 2);
+  test::ExpectEqual(element[0], test::AsScalar<int64_t>(i));
+  test::ExpectEqual(element[1],
+                    test::AsTensor<tstring>({strings::StrCat("e", i)}));
+}
+
+std::string SpillDirectory() {
+  return io::JoinPath(testing::TmpDir(), "memory_cache_spill");
+}
+
+TEST(MemoryCacheSpillFileTest, ReadsBackAppendedChunks) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<MemoryCacheSpillFile> spill_file,
+      MemoryCacheSpillFile::Create(Env::Default(), SpillDirectory()));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(0, 3)));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(3, 1)));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(4, 5)));
+  TF_ASSERT_OK(spill_file->Finish());
+  EXPECT_EQ(spill_file->size(), 9);
+
+  // Reads sequentially twice, then in reverse order.
+  for (int epoch = 0; epoch < 2; ++epoch) {
+    for (int64_t i = 0; i < 9; ++i) {
+      std::vector<Tensor> element;
+      TF_ASSERT_OK(spill_file->Get(i, &element));
+      ExpectElement(element, i);
+    }
+  }
+  for (int64_t i = 8; i >= 0; --i) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(spill_file->Get(i, &element));
+    ExpectElement(element, i);
+  }
+  std::vector<Tensor> element;
+  EXPECT_TRUE(errors::IsOutOfRange(spill_file->Get(9, &element)));
+}
+
+TEST(MemoryCacheSpillFileTest, ReadsBeforeFinish) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<MemoryCacheSpillFile> spill_file,
+      MemoryCacheSpillFile::Create(Env::Default(), SpillDirectory()));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(0, 2)));
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(spill_file->Get(1, &element));
+  ExpectElement(element, 1);
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(2, 2)));
+  TF_ASSERT_OK(spill_file->Get(3, &element));
+  ExpectElement(element, 3);
+}
+
+TEST(MemoryCacheSpillFileTest, DeletesFileOnDestruction) {
+  std::string directory = io::JoinPath(SpillDirectory(), "delete");
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<MemoryCacheSpillFile> spill_file,
+      MemoryCacheSpillFile::Create(Env::Default(), directory));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(0, 2)));
+  TF_ASSERT_OK(spill_file->Finish());
+  std::vector<string> children;
+  TF_ASSERT_OK(Env::Default()->GetChildren(directory, &children));
+  EXPECT_EQ(children.size(), 1);
+  spill_file.reset();
+  TF_ASSERT_OK(Env::Default()->GetChildren(directory, &children));
+  EXPECT_TRUE(children.empty());
+}
+
+TEST(MemoryCacheSpillFileTest, ConcurrentReads) {
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<MemoryCacheSpillFile> spill_file,
+      MemoryCacheSpillFile::Create(Env::Default(), SpillDirectory()));
+  constexpr int64_t kNumChunks = 8;
+  for (int64_t i = 0; i < kNumChunks; ++i) {
+    TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(i * 4, 4)));
+  }
+  TF_ASSERT_OK(spill_file->Finish());
+  {
+    thread::ThreadPool pool(Env::Default(), "readers", 4);
+    for (int reader = 0; reader < 4; ++reader) {
+      pool.Schedule([&spill_file, reader]() {
+        // Each reader starts at a different chunk, so that there are more
+        // chunks in use than are kept in memory.
+        for (int64_t i = 0; i < kNumChunks * 4; ++i) {
+          const int64_t index = (i + reader * 8) % (kNumChunks * 4);
+          std::vector<Tensor> element;
+          TF_ASSERT_OK(spill_file->Get(index, &element));
+          ExpectElement(element, index);
+        }
+      });
+    }
+  }
+}
+
+TEST(MemoryCacheSpillFileTest, SavesAndRestores) {
+  std::string directory = io::JoinPath(SpillDirectory(), "restore");
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<MemoryCacheSpillFile> spill_file,
+      MemoryCacheSpillFile::Create(Env::Default(), directory));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(0, 3)));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(3, 2)));
+  Tensor chunks;
+  Tensor data;
+  TF_ASSERT_OK(spill_file->Save(&chunks, &data));
+  // Appended after the save, so not part of the restored file.
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(100, 2)));
+  // The checkpoint does not depend on the original file.
+  spill_file.reset();
+  std::vector<string> children;
+  TF_ASSERT_OK(Env::Default()->GetChildren(directory, &children));
+  EXPECT_TRUE(children.empty());
+
+  std::string other_directory = io::JoinPath(SpillDirectory(), "other");
+  TF_ASSERT_OK_AND_ASSIGN(
+      spill_file,
+      MemoryCacheSpillFile::Restore(Env::Default(), other_directory, chunks,
+                                    data, /*finished=*/false));
+  EXPECT_EQ(spill_file->size(), 5);
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(5, 4)));
+  TF_ASSERT_OK(spill_file->Finish());
+  EXPECT_EQ(spill_file->size(), 9);
+  for (int64_t i = 0; i < 9; ++i) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(spill_file->Get(i, &element));
+    ExpectElement(element, i);
+  }
+
+  TF_ASSERT_OK(spill_file->Save(&chunks, &data));
+  TF_ASSERT_OK(spill_file->Delete());
+  TF_ASSERT_OK(Env::Default()->GetChildren(other_directory, &children));
+  EXPECT_TRUE(children.empty());
+  std::vector<Tensor> element;
+  EXPECT_TRUE(errors::IsFailedPrecondition(spill_file->Get(0, &element)));
+
+  TF_ASSERT_OK_AND_ASSIGN(
+      spill_file, MemoryCacheSpillFile::Restore(Env::Default(), directory,
+                                                chunks, data,
+                                                /*finished=*/true));
+  EXPECT_EQ(spill_file->size(), 9);
+  TF_ASSERT_OK(spill_file->Get(8, &element));
+  ExpectElement(element, 8);
+  EXPECT_TRUE(errors::IsFailedPrecondition(
+      spill_file->AppendChunk(MakeElements(9, 1))));
+  spill_file.reset();
+  TF_ASSERT_OK(Env::Default()->GetChildren(directory, &children));
+  EXPECT_TRUE(children.empty());
+
+  Tensor truncated_data(DT_STRING, TensorShape({1}));
+  EXPECT_TRUE(errors::IsDataLoss(
+      MemoryCacheSpillFile::Restore(Env::Default(), directory, chunks,
+                                    truncated_data, /*finished=*/true)
+          .status()));
+}
+
+TEST(MemoryCacheTest, GetsInMemoryAndSpilledElements) {
+  MemoryCache cache(/*ram_budget_bytes=*/1 << 20, SpillDirectory());
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<MemoryCacheSpillFile> spill_file,
+      MemoryCacheSpillFile::Create(Env::Default(), cache.spill_directory()));
+  TF_ASSERT_OK(spill_file->AppendChunk(MakeElements(4, 6)));
+  TF_ASSERT_OK(spill_file->Finish());
+  cache.Complete(MakeElements(0, 4), std::move(spill_file));
+
+  EXPECT_TRUE(cache.IsCompleted());
+  EXPECT_TRUE(cache.HasSpilled());
+  EXPECT_EQ(cache.size(), 10);
+  EXPECT_EQ(cache.data().size(), 4);
+  for (int64_t i = 0; i < 10; ++i) {
+    std::vector<Tensor> element;
+    TF_ASSERT_OK(cache.Get(i, &element));
+    ExpectElement(element, i);
+  }
+
+  cache.Reset();
+  EXPECT_FALSE(cache.IsCompleted());
+  EXPECT_FALSE(cache.HasSpilled());
+  EXPECT_EQ(cache.size(), 0);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -14,6 +14,8 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/map_dataset_op.h"
 
+#include <utility>
+
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/common_runtime/input_colocation_exemption_registry.h"
 #include "tensorflow/core/data/captured_function.h"
@@ -22,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/mutex.h"
 
 namespace tensorflow {
 namespace data {
@@ -99,17 +102,26 @@ class MapDatasetOp::Dataset : public DatasetBase {
     return input_->CheckExternalState();
   }
 
-  Status Get(OpKernelContext* ctx, int64 index,
+  Status Get(AnyContext ctx, int64 index,
              std::vector<Tensor>* out_tensors) const override {
     TF_RETURN_IF_ERROR(CheckRandomAccessCompatible(index));
     std::vector<Tensor> args;
     TF_RETURN_IF_ERROR(input_->Get(ctx, index, &args));
-    if (!instantiated_captured_func_) {
-      TF_RETURN_IF_ERROR(
-          captured_func_->Instantiate(InstantiateCapturedFunctionParams(ctx),
-                                      &instantiated_captured_func_));
+    InstantiatedCapturedFunction* instantiated_captured_func;
+    {
+      mutex_lock l(instantiated_captured_func_mu_);
+      if (!instantiated_captured_func_) {
+        // The function is instantiated once per dataset, so it must not use
+        // the function handle cache of the iterator making the first access,
+        // which may be destroyed before the dataset.
+        InstantiateCapturedFunctionParams params(ctx);
+        params.function_handle_cache = nullptr;
+        TF_RETURN_IF_ERROR(captured_func_->Instantiate(
+            std::move(params), &instantiated_captured_func_));
+      }
+      instantiated_captured_func = instantiated_captured_func_.get();
     }
-    return instantiated_captured_func_->RunInstantiated(args, out_tensors);
+    return instantiated_captured_func->RunInstantiated(args, out_tensors);
   }
 
  protected:
@@ -232,8 +244,9 @@ class MapDatasetOp::Dataset : public DatasetBase {
   const DataTypeVector output_types_;
   const std::vector<PartialTensorShape> output_shapes_;
   // This is used for random access provided by Get().
+  mutable mutex instantiated_captured_func_mu_;
   mutable std::unique_ptr<InstantiatedCapturedFunction>
-      instantiated_captured_func_;
+      instantiated_captured_func_ TF_GUARDED_BY(instantiated_captured_func_mu_);
 };
 
 MapDatasetOp::MapDatasetOp(OpKernelConstruction* ctx)
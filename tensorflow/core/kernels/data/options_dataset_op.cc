@@ -73,7 +73,7 @@ class OptionsDatasetOp::Dataset : public DatasetBase {
     return input_->Cardinality(options);
   }
 
-  Status Get(OpKernelContext* ctx, int64 index,
+  Status Get(AnyContext ctx, int64 index,
              std::vector<Tensor>* out_tensors) const override {
     return input_->Get(ctx, index, out_tensors);
   }
@@ -14,12 +14,19 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_map_dataset_op.h"
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
+#include <map>
+#include <memory>
+#include <utility>
 
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/common_runtime/input_colocation_exemption_registry.h"
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/numa_thread_pools.h"
+#include "tensorflow/core/data/spsc_ring.h"
 #include "tensorflow/core/data/stats_utils.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/model.h"
@@ -28,10 +35,13 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/stringprintf.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
 #include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/protobuf/error_codes.pb.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace data {
@@ -58,6 +68,7 @@ namespace data {
 namespace {
 
 constexpr char kParallelMapDatasetV1[] = "ParallelMapDataset";
+constexpr char kNumaAwareParallelMapExperiment[] = "numa_aware_parallel_map";
 constexpr char kParallelMapDatasetV2[] = "ParallelMapDatasetV2";
 
 constexpr char kInvocationResults[] = "invocation_results";
@@ -140,17 +151,26 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
     }
   }
 
-  Status Get(OpKernelContext* ctx, int64 index,
+  Status Get(AnyContext ctx, int64 index,
              std::vector<Tensor>* out_tensors) const override {
     TF_RETURN_IF_ERROR(CheckRandomAccessCompatible(index));
     std::vector<Tensor> args;
     TF_RETURN_IF_ERROR(input_->Get(ctx, index, &args));
-    if (!instantiated_captured_func_) {
-      TF_RETURN_IF_ERROR(
-          captured_func_->Instantiate(InstantiateCapturedFunctionParams(ctx),
-                                      &instantiated_captured_func_));
+    InstantiatedCapturedFunction* instantiated_captured_func;
+    {
+      mutex_lock l(instantiated_captured_func_mu_);
+      if (!instantiated_captured_func_) {
+        // The function is instantiated once per dataset, so it must not use
+        // the function handle cache of the iterator making the first access,
+        // which may be destroyed before the dataset.
+        InstantiateCapturedFunctionParams params(ctx);
+        params.function_handle_cache = nullptr;
+        TF_RETURN_IF_ERROR(captured_func_->Instantiate(
+            std::move(params), &instantiated_captured_func_));
+      }
+      instantiated_captured_func = instantiated_captured_func_.get();
     }
-    return instantiated_captured_func_->RunInstantiated(args, out_tensors);
+    return instantiated_captured_func->RunInstantiated(args, out_tensors);
   }
 
   Status InputDatasets(std::vector<const DatasetBase*>* inputs) const override {
@@ -271,6 +291,7 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       TF_RETURN_IF_ERROR(dataset()->input_->MakeIterator(
           &iter_ctx, this, prefix(), &input_impl_));
       ctx->MergeCheckpoint(iter_ctx.checkpoint());
+      MaybeUseNumaThreadPools(ctx);
       return dataset()->captured_func_->Instantiate(
           ctx, &instantiated_captured_func_);
     }
@@ -278,6 +299,9 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
     Status GetNextInternal(IteratorContext* ctx,
                            std::vector<Tensor>* out_tensors,
                            bool* end_of_sequence) override {
+      if (numa_thread_pools_ != nullptr) {
+        return GetNextFromRings(ctx, out_tensors, end_of_sequence);
+      }
       std::shared_ptr<InvocationResult> result;
       {
         mutex_lock l(*mu_);
@@ -321,19 +345,30 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       }
       mutex_lock l(*mu_);
       // Wait for all in-flight calls to complete.
-      while (num_calls_ > 0) {
+      while (NumCallsLocked() > 0) {
         cond_var_->wait(l);
       }
-      if (num_calls_ != 0) {
+      if (NumCallsLocked() != 0) {
         return errors::FailedPrecondition(
             "Unexpected outstanding calls encountered.");
       }
+      std::vector<std::shared_ptr<InvocationResult>> invocation_results;
+      if (numa_thread_pools_ != nullptr) {
+        mutex_lock consumer_l(ring_consumer_mu_);
+        DrainResultRings();
+        for (const auto& it : ring_results_) {
+          invocation_results.push_back(it.second);
+        }
+      } else {
+        invocation_results.assign(invocation_results_.begin(),
+                                  invocation_results_.end());
+      }
       TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
       TF_RETURN_IF_ERROR(writer->WriteScalar(
           full_name(absl::StrCat(kInvocationResults, "_", kSize)),
-          invocation_results_.size()));
-      for (size_t i = 0; i < invocation_results_.size(); i++) {
-        const auto& result = *(invocation_results_[i]);
+          invocation_results.size()));
+      for (size_t i = 0; i < invocation_results.size(); i++) {
+        const auto& result = *(invocation_results[i]);
         std::string element_prefix =
             absl::StrCat(kInvocationResults, "[", i, "]");
         TF_RETURN_IF_ERROR(
@@ -363,8 +398,15 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
           &invocation_results_size));
       DCHECK(invocation_results_.empty());
       for (size_t i = 0; i < invocation_results_size; i++) {
-        invocation_results_.push_back(std::make_shared<InvocationResult>());
-        auto& result = *invocation_results_.back();
+        auto result_ptr = std::make_shared<InvocationResult>();
+        if (numa_thread_pools_ != nullptr) {
+          result_ptr->seq = i;
+          mutex_lock consumer_l(ring_consumer_mu_);
+          ring_results_.emplace(i, result_ptr);
+        } else {
+          invocation_results_.push_back(result_ptr);
+        }
+        auto& result = *result_ptr;
         std::string element_prefix =
             absl::StrCat(kInvocationResults, "[", i, "]");
         TF_RETURN_IF_ERROR(
@@ -396,6 +438,12 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
         RecordBufferEnqueue(ctx, result.return_values);
         result.notification.Notify();
       }
+      if (numa_thread_pools_ != nullptr) {
+        next_ring_seq_ = invocation_results_size;
+        num_ring_results_ = invocation_results_size;
+        mutex_lock consumer_l(ring_consumer_mu_);
+        num_ring_consumed_ = 0;
+      }
       return OkStatus();
     }
 
@@ -433,6 +481,10 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       bool end_of_input = false;
       MemoryCheckpoint checkpoint;
       const int64_t uid;
+      // The position of the call among the calls of the iterator, in the
+      // order their input was read. Only set when results are published on
+      // `result_rings_`.
+      int64_t seq = 0;
     };
 
     void CancelThreads(bool wait) TF_LOCKS_EXCLUDED(mu_) {
@@ -440,12 +492,22 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       mutex_lock l(*mu_);
       cancelled_ = true;
       cond_var_->notify_all();
+      if (numa_thread_pools_ != nullptr) {
+        mutex_lock consumer_l(ring_consumer_mu_);
+        ring_cancelled_ = true;
+        ring_consumer_cv_.notify_all();
+      }
       // Wait for all in-flight calls to complete.
-      while (wait && num_calls_ > 0) {
+      while (wait && NumCallsLocked() > 0) {
         cond_var_->wait(l);
       }
     }
 
+    int64_t NumCallsLocked() const TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
+      return numa_thread_pools_ != nullptr ? num_ring_calls_.load()
+                                           : num_calls_;
+    }
+
     void EnsureThreadsStarted(IteratorContext* ctx)
         TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
       if (!runner_thread_) {
@@ -464,12 +526,134 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
     void CallCompleted(const std::shared_ptr<IteratorContext>& ctx,
                        const std::shared_ptr<InvocationResult>& result)
         TF_LOCKS_EXCLUDED(*mu_) {
+      if (numa_thread_pools_ != nullptr) {
+        PublishResult(result);
+        return;
+      }
       mutex_lock l(*mu_);
       num_calls_--;
       result->notification.Notify();
       cond_var_->notify_all();
     }
 
+    // Publishes `result` on the ring of the calling thread, or on the shared
+    // ring if the thread is not one of `numa_thread_pools_`. Only wakes the
+    // consumer if it waits for a result, and only takes `mu_` for the last
+    // call in flight, which `SaveInternal` and `CancelThreads` may wait for.
+    void PublishResult(const std::shared_ptr<InvocationResult>& result)
+        TF_LOCKS_EXCLUDED(*mu_, ring_consumer_mu_) {
+      std::shared_ptr<InvocationResult> element = result;
+      const int thread_id = numa_thread_pools_->CurrentThreadId();
+      if (thread_id >= 0) {
+        CHECK(result_rings_[thread_id]->Push(element));
+      } else {
+        mutex_lock l(shared_ring_mu_);
+        CHECK(result_rings_.back()->Push(element));
+      }
+      if (consumer_waiting_) {
+        mutex_lock l(ring_consumer_mu_);
+        ring_consumer_cv_.notify_one();
+      }
+      // The iterator may be destroyed as soon as the last call is done.
+      std::shared_ptr<mutex> mu = mu_;
+      std::shared_ptr<condition_variable> cond_var = cond_var_;
+      if (num_ring_calls_.fetch_sub(1) == 1) {
+        mutex_lock l(*mu);
+        cond_var->notify_all();
+      }
+    }
+
+    // Returns the next result published on `result_rings_`.
+    Status GetNextFromRings(IteratorContext* ctx,
+                            std::vector<Tensor>* out_tensors,
+                            bool* end_of_sequence)
+        TF_LOCKS_EXCLUDED(*mu_, ring_consumer_mu_) {
+      if (!ring_threads_started_) {
+        mutex_lock l(*mu_);
+        EnsureThreadsStarted(ctx);
+        ring_threads_started_ = true;
+      }
+      std::shared_ptr<InvocationResult> result;
+      {
+        mutex_lock l(ring_consumer_mu_);
+        while (true) {
+          if (ring_cancelled_) {
+            return errors::Cancelled("Iterator was cancelled");
+          }
+          DrainResultRings();
+          if (TakeRingResult(&result)) {
+            break;
+          }
+          // Producers push before they read `consumer_waiting_`, and this
+          // thread sets it before it checks the rings, so a result pushed
+          // from now on either is seen below or wakes this thread.
+          consumer_waiting_ = true;
+          if (ResultRingsEmpty()) {
+            RecordStop(ctx);
+            ring_consumer_cv_.wait(l);
+            RecordStart(ctx);
+          }
+          consumer_waiting_ = false;
+        }
+      }
+      num_ring_results_--;
+      if (runner_waiting_) {
+        mutex_lock l(*mu_);
+        cond_var_->notify_all();
+      }
+      profiler::TraceMe traceme([&] {
+        return profiler::TraceMeEncode("ParallelMapConsume",
+                                       {{"element_id", result->uid}});
+      });
+      return ProcessResult(ctx, result, out_tensors, end_of_sequence);
+    }
+
+    void DrainResultRings() TF_EXCLUSIVE_LOCKS_REQUIRED(ring_consumer_mu_) {
+      std::shared_ptr<InvocationResult> result;
+      for (auto& ring : result_rings_) {
+        while (ring->Pop(&result)) {
+          const int64_t seq = result->seq;
+          ring_results_.emplace(seq, std::move(result));
+        }
+      }
+    }
+
+    bool ResultRingsEmpty() const
+        TF_EXCLUSIVE_LOCKS_REQUIRED(ring_consumer_mu_) {
+      for (const auto& ring : result_rings_) {
+        if (!ring->Empty()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Takes the next result to return from `ring_results_`, following the
+    // same rules as `ShouldWait`. Returns false if there is none yet.
+    bool TakeRingResult(std::shared_ptr<InvocationResult>* result)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(ring_consumer_mu_) {
+      auto it = ring_results_.begin();
+      if (!deterministic_) {
+        // End-of-input results only follow the other results, so all earlier
+        // results have been consumed when as many results as the position of
+        // the end-of-input result have.
+        while (it != ring_results_.end() && it->second->end_of_input &&
+               it->first != num_ring_consumed_) {
+          ++it;
+        }
+      } else if (it != ring_results_.end() &&
+                 it->first != num_ring_consumed_) {
+        it = ring_results_.end();
+      }
+      if (it == ring_results_.end()) {
+        return false;
+      }
+      *result = std::move(it->second);
+      ring_results_.erase(it);
+      ++num_ring_consumed_;
+      return true;
+    }
+
     void CallFunction(const std::shared_ptr<IteratorContext>& ctx,
                       const std::shared_ptr<InvocationResult>& result)
         TF_LOCKS_EXCLUDED(*mu_) {
@@ -510,8 +694,8 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
                   model_node());
             },
             std::move(input_element));
-        (*ctx->runner())(
-            [this, ctx, fn = std::move(fn), done = std::move(done)]() {
+        ScheduleCall(
+            ctx, [this, ctx, fn = std::move(fn), done = std::move(done)]() {
               Status s;
               // Check whether we are already recording to prevent invalid
               // nesting of `RecordStart` calls.
@@ -527,6 +711,72 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       }
     }
 
+    // On hosts with multiple NUMA nodes, runs map function invocations that
+    // do not use inter-op parallelism on the per-node thread pools shared by
+    // the process instead of on the runner. Each invocation, and the memory
+    // it first touches, then stays on one node. The invocations publish their
+    // results on a lock-free ring per pool thread instead of the shared
+    // `invocation_results_` buffer, so that they do not contend on `mu_`
+    // with each other and with the consumer. The pools are sized from the
+    // runner's thread budget. Pipelines that have a private thread pool keep
+    // using it.
+    void MaybeUseNumaThreadPools(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
+      if (dataset()->captured_func_->use_inter_op_parallelism() ||
+          !GetExperiments().contains(kNumaAwareParallelMapExperiment)) {
+        return;
+      }
+      const Options* options = ctx->options();
+      if (options != nullptr && ShouldUsePrivateThreadPool(*options)) {
+        return;
+      }
+      numa_thread_pools_ =
+          NumaThreadPools::Global(ctx->runner_threadpool_size());
+      if (numa_thread_pools_ == nullptr) {
+        return;
+      }
+      if (options != nullptr &&
+          ShouldConfigureMaxIntraOpParallelism(*options)) {
+        max_intra_op_parallelism_ =
+            options->threading_options().max_intra_op_parallelism();
+        if (max_intra_op_parallelism_ == 0) {
+          max_intra_op_parallelism_ = port::MaxParallelism();
+        }
+      }
+      // Bounds the results that are scheduled and not consumed, so that each
+      // ring can hold all of them.
+      ring_capacity_ =
+          autotune_ ? std::max<int64_t>(num_parallel_calls_->value,
+                                        ctx->runner_threadpool_size())
+                    : num_parallel_calls_->value;
+      for (int i = 0; i <= numa_thread_pools_->NumThreads(); ++i) {
+        result_rings_.push_back(
+            std::make_unique<SpscRing<std::shared_ptr<InvocationResult>>>(
+                ring_capacity_));
+      }
+      VLOG(2) << "Running map function invocations of " << prefix() << " on "
+              << numa_thread_pools_->NumNodes() << " NUMA nodes.";
+    }
+
+    // Schedules `fn` on the runner, or on the NUMA node thread pools if they
+    // are used.
+    void ScheduleCall(const std::shared_ptr<IteratorContext>& ctx,
+                      std::function<void()> fn) {
+      if (numa_thread_pools_ == nullptr) {
+        (*ctx->runner())(std::move(fn));
+        return;
+      }
+      if (max_intra_op_parallelism_ > 0) {
+        // Applies the limit that the runner would have applied.
+        fn = [max_parallelism = max_intra_op_parallelism_,
+              fn = std::move(fn)]() {
+          ScopedPerThreadMaxParallelism scope(max_parallelism);
+          fn();
+        };
+      }
+      numa_thread_pools_->Schedule(std::move(fn));
+    }
+
     Status ProcessResult(IteratorContext* ctx,
                          const std::shared_ptr<InvocationResult>& result,
                          std::vector<Tensor>* out_tensors,
@@ -568,24 +818,40 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       }
       auto busy = [this]() TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) -> bool {
         int64_t num_parallel_calls = num_parallel_calls_->value;
+        if (numa_thread_pools_ != nullptr) {
+          // Results that are not consumed include the calls in flight.
+          return num_ring_results_ >=
+                 std::min(num_parallel_calls, ring_capacity_);
+        }
         return num_calls_ >= num_parallel_calls ||
                invocation_results_.size() >= num_parallel_calls;
       };
       while (true) {
         {
           mutex_lock l(*mu_);
+          // Set before `busy()` reads `num_ring_results_`, which the consumer
+          // decrements before it reads this.
+          runner_waiting_ = true;
           while (!cancelled_ && busy()) {
             RecordStop(ctx.get());
             cond_var_->wait(l);
             RecordStart(ctx.get());
           }
+          runner_waiting_ = false;
           if (cancelled_) {
             return;
           }
           while (!busy()) {
-            invocation_results_.push_back(std::make_shared<InvocationResult>());
-            new_calls.push_back(invocation_results_.back());
-            num_calls_++;
+            auto call = std::make_shared<InvocationResult>();
+            if (numa_thread_pools_ != nullptr) {
+              call->seq = next_ring_seq_++;
+              num_ring_calls_++;
+              num_ring_results_++;
+            } else {
+              invocation_results_.push_back(call);
+              num_calls_++;
+            }
+            new_calls.push_back(std::move(call));
           }
           cond_var_->notify_all();
         }
@@ -641,7 +907,7 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
           if (cancelled_) {
             return;
           }
-          num_calls = num_calls_;
+          num_calls = NumCallsLocked();
           num_parallel_calls = num_parallel_calls_->value;
         }
         if (num_parallel_calls == 0) {
@@ -712,9 +978,42 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
     // Must be ordered after `cancellation_manager_` so that `input_impl_` is
     // destroyed first.
     std::unique_ptr<IteratorBase> input_impl_;
+    // Not owned. Null unless the `numa_aware_parallel_map` experiment is
+    // enabled on a host with multiple NUMA nodes.
+    NumaThreadPools* numa_thread_pools_ = nullptr;
+    // The intra-op parallelism of invocations run on `numa_thread_pools_`, or
+    // 0 if it is not limited.
+    int max_intra_op_parallelism_ = 0;
     // Buffer for storing the invocation results.
     std::deque<std::shared_ptr<InvocationResult>> invocation_results_
         TF_GUARDED_BY(*mu_);
+    // Used instead of `invocation_results_` if `numa_thread_pools_` is set.
+    // Holds one ring per thread of `numa_thread_pools_`, on which only that
+    // thread pushes, followed by a ring shared by the other threads. Only
+    // the thread that holds `ring_consumer_mu_` pops.
+    std::vector<std::unique_ptr<SpscRing<std::shared_ptr<InvocationResult>>>>
+        result_rings_;
+    int64_t ring_capacity_ = 0;
+    // Serializes pushes on the shared ring.
+    mutex shared_ring_mu_;
+    // Counts the calls in flight, and the results that were scheduled and
+    // not consumed, whether in flight, on a ring or in `ring_results_`.
+    std::atomic<int64_t> num_ring_calls_{0};
+    std::atomic<int64_t> num_ring_results_{0};
+    // Whether the consumer waits on `ring_consumer_cv_`, or the runner thread
+    // on `cond_var_`.
+    std::atomic<bool> consumer_waiting_{false};
+    std::atomic<bool> runner_waiting_{false};
+    std::atomic<bool> ring_threads_started_{false};
+    int64_t next_ring_seq_ TF_GUARDED_BY(*mu_) = 0;
+    // Acquired after `mu_` when both are held.
+    mutex ring_consumer_mu_;
+    condition_variable ring_consumer_cv_;
+    // Results taken off the rings and not yet consumed, keyed by `seq`.
+    std::map<int64_t, std::shared_ptr<InvocationResult>> ring_results_
+        TF_GUARDED_BY(ring_consumer_mu_);
+    int64_t num_ring_consumed_ TF_GUARDED_BY(ring_consumer_mu_) = 0;
+    bool ring_cancelled_ TF_GUARDED_BY(ring_consumer_mu_) = false;
     bool cancelled_ TF_GUARDED_BY(*mu_) = false;
     std::unique_ptr<Thread> runner_thread_ TF_GUARDED_BY(*mu_);
     std::unique_ptr<Thread> stats_thread_ TF_GUARDED_BY(*mu_);
@@ -738,8 +1037,9 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
   const std::unique_ptr<CapturedFunction> captured_func_;
   const int op_version_;
   // This is used for random access provided by Get().
+  mutable mutex instantiated_captured_func_mu_;
   mutable std::unique_ptr<InstantiatedCapturedFunction>
-      instantiated_captured_func_;
+      instantiated_captured_func_ TF_GUARDED_BY(instantiated_captured_func_mu_);
 };
 
 ParallelMapDatasetOp::ParallelMapDatasetOp(OpKernelConstruction* ctx)
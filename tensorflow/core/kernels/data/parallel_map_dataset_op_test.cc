@@ -11,8 +11,15 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_map_dataset_op.h"
 
+#include <stdlib.h>
+
+#include <optional>
+#include <string>
+
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/numa_thread_pools.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
 
 namespace tensorflow {
 namespace data {
@@ -405,6 +412,93 @@ ITERATOR_SAVE_AND_RESTORE_TEST_P(ParallelMapDatasetOpTest,
                                  ParallelMapDatasetParams,
                                  IteratorSaveAndRestoreTestCases())
 
+// Sets an environment variable for the lifetime of the object, and restores
+// its previous value on destruction.
+class ScopedEnvVar {
+ public:
+  ScopedEnvVar(const char* name, const char* value) : name_(name) {
+    const char* old_value = getenv(name);
+    if (old_value != nullptr) {
+      old_value_ = old_value;
+    }
+    setenv(name, value, /*overwrite=*/1);
+  }
+  ~ScopedEnvVar() {
+    if (old_value_.has_value()) {
+      setenv(name_, old_value_->c_str(), /*overwrite=*/1);
+    } else {
+      unsetenv(name_);
+    }
+  }
+
+ private:
+  const char* const name_;
+  std::optional<std::string> old_value_;
+};
+
+// With the experiment, the invocations run on the per-node thread pools. The
+// outputs and checkpoints are unchanged.
+TEST_F(ParallelMapDatasetOpTest, NumaAwareParallelMapExperiment) {
+  ScopedEnvVar job_name("TF_JOB_NAME", "test_job");
+  ScopedEnvVar task_id("TF_TASK_ID", "0");
+  ScopedEnvVar opt_in("TF_DATA_EXPERIMENT_OPT_IN", "numa_aware_parallel_map");
+  // Uses two nodes regardless of the NUMA topology of the test host.
+  NumaThreadPools pools(Env::Default(), "test", {1, 1});
+  NumaThreadPools::SetGlobalForTesting(&pools);
+  // The iterator is destroyed before the pools it schedules on.
+  auto reset_pools = gtl::MakeCleanup([this]() {
+    iterator_.reset();
+    NumaThreadPools::SetGlobalForTesting(nullptr);
+  });
+
+  auto dataset_params = ParallelMapDatasetParams4();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  const std::vector<Tensor> expected_outputs =
+      CreateTensors<int64_t>(TensorShape{}, {{0}, {6}, {12}, {18}});
+  TF_EXPECT_OK(CheckIteratorGetNext(expected_outputs,
+                                    /*compare_order=*/true));
+  EXPECT_GT(pools.NumScheduled(), 0);
+  TF_EXPECT_OK(CheckIteratorSaveAndRestore(
+      dataset_params.iterator_prefix(), expected_outputs,
+      /*breakpoints=*/{0, 1, 5}, /*compare_order=*/true));
+}
+
+// Without determinism, results are returned as their invocations complete, and
+// the end of input only once all of them have been returned.
+TEST_F(ParallelMapDatasetOpTest, NumaAwareParallelMapNondeterministic) {
+  ScopedEnvVar job_name("TF_JOB_NAME", "test_job");
+  ScopedEnvVar task_id("TF_TASK_ID", "0");
+  ScopedEnvVar opt_in("TF_DATA_EXPERIMENT_OPT_IN", "numa_aware_parallel_map");
+  NumaThreadPools pools(Env::Default(), "test", {2, 2});
+  NumaThreadPools::SetGlobalForTesting(&pools);
+  auto reset_pools = gtl::MakeCleanup([this]() {
+    iterator_.reset();
+    NumaThreadPools::SetGlobalForTesting(nullptr);
+  });
+
+  auto dataset_params = ParallelMapDatasetParams(
+      RangeDatasetParams(0, 100, 1),
+      /*other_arguments=*/{},
+      /*num_parallel_calls=*/8,
+      /*func=*/MapFunc("XTimesTwo", DT_INT64),
+      /*func_lib*/ {test::function::XTimesTwo()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})},
+      /*use_inter_op_parallelism=*/false,
+      /*deterministic=*/DeterminismPolicy::kNondeterministic,
+      /*preserve_cardinality=*/false,
+      /*node_name=*/kNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  std::vector<Tensor> expected_outputs;
+  for (int64_t i = 0; i < 100; ++i) {
+    expected_outputs.push_back(CreateTensor<int64_t>(TensorShape{}, {2 * i}));
+  }
+  TF_EXPECT_OK(CheckIteratorGetNext(expected_outputs,
+                                    /*compare_order=*/false));
+  EXPECT_EQ(pools.NumScheduled(), 100);
+}
+
 TEST_F(ParallelMapDatasetOpTest, InvalidNumParallelCalls) {
   auto dataset_params = ParallelMapDatasetParamsWithInvalidNumParallelCalls();
   EXPECT_EQ(Initialize(dataset_params).code(),
@@ -14,10 +14,10 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/shuffle_dataset_op.h"
 
+#include <array>
 #include <cstdint>
 #include <deque>
 #include <memory>
-#include <numeric>
 #include <string>
 #include <tuple>
 #include <utility>
@@ -31,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/random_seed_ops.h"
+#include "tensorflow/core/kernels/random_index_shuffle.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/random.h"
@@ -61,6 +62,8 @@ namespace data {
 
 const int64_t kLogIntervalMicros = 10 * 1000000;  // 10 seconds.
 const int64_t kMaxEpochsInBuffer = 3;
+// Number of rounds of the cipher used to permute indices for random access.
+const int32_t kIndexShuffleRounds = 8;
 
 constexpr char kNumRandomSamples[] = "num_random_samples";
 constexpr char kDataProduced[] = "data_produced";
@@ -72,12 +75,28 @@ constexpr char kSlicesStart[] = "slices_start";
 constexpr char kSlicesEnd[] = "slices_end";
 constexpr char kSeedGenerator[] = "SeedGenerator";
 constexpr char kEpochNumRandomSamples[] = "epoch_num_random_samples";
+constexpr char kGlobalShufflePosition[] = "global_shuffle_position";
 constexpr char kShuffleDatasetV1[] = "ShuffleDataset";
 constexpr char kShuffleDatasetV2[] = "ShuffleDatasetV2";
 constexpr char kShuffleDatasetV3[] = "ShuffleDatasetV3";
 constexpr char kShuffleAndRepeatDatasetV1[] = "ShuffleAndRepeatDataset";
 constexpr char kShuffleAndRepeatDatasetV2[] = "ShuffleAndRepeatDatasetV2";
 
+// Returns the position of `index` in the permutation of [0, `cardinality`)
+// determined by the seeds and `epoch`. Computing it needs O(1) memory.
+int64_t ShuffleIndex(int64_t index, int64_t cardinality, uint64_t seed,
+                     uint64_t seed2, int64_t epoch) {
+  if (cardinality <= 1) {
+    return index;
+  }
+  const std::array<uint32_t, 3> key = {
+      static_cast<uint32_t>(seed ^ (seed >> 32)),
+      static_cast<uint32_t>(seed2 ^ (seed2 >> 32)),
+      static_cast<uint32_t>(epoch)};
+  return random::index_shuffle(index, key, cardinality - 1,
+                               kIndexShuffleRounds);
+}
+
 ShuffleDatasetOpBase::ShuffleDatasetOpBase(OpKernelConstruction* ctx)
     : UnaryDatasetOpKernel(ctx) {}
 
@@ -140,21 +159,23 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
     return input_->CheckExternalState();
   }
 
-  Status Get(OpKernelContext* ctx, int64 index,
+  Status Get(AnyContext ctx, int64 index,
              std::vector<Tensor>* out_tensors) const override {
     TF_RETURN_IF_ERROR(CheckRandomAccessCompatible(index));
-    {
-      mutex_lock l(mu_);
-      if (shuffled_indices_.empty()) {
-        InitializeRandomAccessIndices();
-      }
-    }
-    int64 shuffled_index;
-    {
-      tf_shared_lock l(mu_);
-      shuffled_index = shuffled_indices_[index];
-    }
-    TF_RETURN_IF_ERROR(input_->Get(ctx, shuffled_index, out_tensors));
+    // `index` is mapped through a per-epoch pseudorandom permutation of the
+    // input indices, so random access needs O(1) memory regardless of the
+    // cardinality of the input.
+    CardinalityOptions options;
+    options.set_compute_level(
+        CardinalityOptions::CARDINALITY_COMPUTE_MODERATE);
+    const int64_t input_cardinality = input_->Cardinality(options);
+    const int64_t epoch = index / input_cardinality;
+    const int64_t index_in_epoch = index % input_cardinality;
+    TF_RETURN_IF_ERROR(input_->Get(
+        ctx,
+        ShuffleIndex(index_in_epoch, input_cardinality,
+                     seed_generator_->seed(), seed_generator_->seed2(), epoch),
+        out_tensors));
     return OkStatus();
   }
 
@@ -172,24 +193,6 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
         seed_generator_.get());
   }
 
-  void InitializeRandomAccessIndices() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-    const int64 cardinality = Cardinality();
-    shuffled_indices_ = std::vector<std::int64_t>(cardinality);
-    std::iota(shuffled_indices_.begin(), shuffled_indices_.end(), 0);
-    int64_t shuffled_index = 0;
-    random::PhiloxRandom parent_generator =
-        random::PhiloxRandom(seed_generator_->seed(), seed_generator_->seed2());
-    random::SingleSampleAdapter<random::PhiloxRandom> generator =
-        random::SingleSampleAdapter<random::PhiloxRandom>(&parent_generator);
-
-    while (shuffled_index < cardinality) {
-      int64_t offset = generator() % (cardinality - shuffled_index);
-      std::swap(shuffled_indices_[shuffled_index + offset],
-                shuffled_indices_[shuffled_index]);
-      shuffled_index += 1;
-    }
-  }
-
  protected:
   class Iterator : public DatasetIterator<ShuffleDatasetBase> {
    public:
@@ -206,13 +209,23 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       mutex_lock l(mu_);
       seed_generator_->GenerateSeeds(&seed_, &seed2_);
       ResetRngs();
-      return OkStatus();
+      return InitializeGlobalShuffle(ctx);
     }
 
     Status GetNextInternal(IteratorContext* ctx,
                            std::vector<Tensor>* out_tensors,
                            bool* end_of_sequence) override {
       mutex_lock l(mu_);
+      if (global_shuffle_) {
+        Status s = GetNextFromPermutation(ctx, out_tensors, end_of_sequence);
+        if (errors::IsUnimplemented(s)) {
+          return errors::FailedPrecondition(
+              "The `global_shuffle` option requires the input of ",
+              dataset()->DebugString(),
+              " to support random access, but it does not: ", s.message());
+        }
+        return s;
+      }
       TF_RETURN_IF_ERROR(FillBuffer(ctx));
       if (num_elements_ == 0) {
         DCHECK(input_impl_ == nullptr);
@@ -259,10 +272,16 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       TF_RETURN_IF_ERROR(
           writer->WriteScalar(full_name(kEpochNumRandomSamples),
                               seed_generator_->num_random_samples()));
-      TF_RETURN_IF_ERROR(writer->WriteScalar(this->full_name(kNumRandomSamples),
-                                             num_random_samples_));
       TF_RETURN_IF_ERROR(writer->WriteScalar(this->full_name(kSeed), seed_));
       TF_RETURN_IF_ERROR(writer->WriteScalar(this->full_name(kSeed2), seed2_));
+      if (global_shuffle_) {
+        // The seeds and the position in the permutation determine the rest
+        // of the sequence.
+        return writer->WriteScalar(full_name(kGlobalShufflePosition),
+                                   global_position_);
+      }
+      TF_RETURN_IF_ERROR(writer->WriteScalar(this->full_name(kNumRandomSamples),
+                                             num_random_samples_));
 
       // Save input iterator if it hasn't been exhausted else write
       // "end_of_input_sequence".
@@ -306,10 +325,15 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
                                             &num_random_samples));
       seed_generator_->set_num_random_samples(num_random_samples);
       seed_generator_->Reset();
-      TF_RETURN_IF_ERROR(reader->ReadScalar(this->full_name(kNumRandomSamples),
-                                            &num_random_samples_));
       TF_RETURN_IF_ERROR(reader->ReadScalar(this->full_name(kSeed), &seed_));
       TF_RETURN_IF_ERROR(reader->ReadScalar(this->full_name(kSeed2), &seed2_));
+      global_shuffle_ = reader->Contains(full_name(kGlobalShufflePosition));
+      if (global_shuffle_) {
+        return reader->ReadScalar(full_name(kGlobalShufflePosition),
+                                  &global_position_);
+      }
+      TF_RETURN_IF_ERROR(reader->ReadScalar(this->full_name(kNumRandomSamples),
+                                            &num_random_samples_));
       ResetRngs();
 
       // Restore the input iterator if it wasn't already exhausted.
@@ -374,6 +398,57 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       int64_t end;
     };
 
+    // Sets `global_shuffle_` if the `global_shuffle` option is set, in which
+    // case elements are fetched from the input through a permutation of its
+    // indices instead of sampled from `buffer_`. Returns an error if the input
+    // cannot be shuffled that way, rather than silently shuffling from a
+    // buffer of `buffer_size` elements.
+    Status InitializeGlobalShuffle(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      global_shuffle_ = false;
+      if (ctx->options() == nullptr || !ctx->options()->global_shuffle()) {
+        return OkStatus();
+      }
+      if (!ctx->split_providers().empty()) {
+        return errors::FailedPrecondition(
+            "The `global_shuffle` option is not supported for ",
+            dataset()->DebugString(), " when its input is split.");
+      }
+      const int64_t cardinality = dataset()->input_->Cardinality();
+      if (cardinality == kInfiniteCardinality ||
+          cardinality == kUnknownCardinality) {
+        return errors::FailedPrecondition(
+            "The `global_shuffle` option requires the input of ",
+            dataset()->DebugString(),
+            " to have a known, finite cardinality, but its cardinality is ",
+            cardinality, ".");
+      }
+      global_shuffle_ = true;
+      return OkStatus();
+    }
+
+    // Produces the element at `global_position_` of the shuffled sequence by
+    // random access to the input. Each epoch uses its own permutation.
+    Status GetNextFromPermutation(IteratorContext* ctx,
+                                  std::vector<Tensor>* out_tensors,
+                                  bool* end_of_sequence)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64_t cardinality = dataset()->input_->Cardinality();
+      const int64_t count = dataset()->count_;
+      if (cardinality == 0 ||
+          (count != -1 && global_position_ >= cardinality * count)) {
+        *end_of_sequence = true;
+        return OkStatus();
+      }
+      const int64_t epoch = global_position_ / cardinality;
+      const int64_t index = ShuffleIndex(global_position_ % cardinality,
+                                         cardinality, seed_, seed2_, epoch);
+      TF_RETURN_IF_ERROR(dataset()->input_->Get(ctx, index, out_tensors));
+      *end_of_sequence = false;
+      ++global_position_;
+      return OkStatus();
+    }
+
     random::SingleSampleAdapter<random::PhiloxRandom>::ResultType Random()
         TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       num_random_samples_++;
@@ -500,6 +575,10 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
         TF_GUARDED_BY(mu_);
     int64_t num_random_samples_ TF_GUARDED_BY(mu_) = 0;
     bool data_produced_ TF_GUARDED_BY(mu_) = false;
+    // Whether elements are fetched through a permutation of the input indices
+    // rather than sampled from `buffer_`, and the number of elements fetched.
+    bool global_shuffle_ TF_GUARDED_BY(mu_) = false;
+    int64_t global_position_ TF_GUARDED_BY(mu_) = 0;
   };
 
   const DatasetBase* const input_;
@@ -510,8 +589,6 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
   // responsible for repeating as well.
   const int64_t count_;
   const TraceMeMetadata traceme_metadata_;
-  mutable mutex mu_;
-  mutable std::vector<std::int64_t> shuffled_indices_ TF_GUARDED_BY(mu_);
 };  // ShuffleDatasetBase
 
 // This version of memory dataset has an exclusive ownership of the seed
@@ -11,6 +11,8 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/shuffle_dataset_op.h"
 
+#include <algorithm>
+#include <numeric>
 #include <string>
 #include <utility>
 
@@ -554,6 +556,126 @@ INSTANTIATE_TEST_CASE_P(ShuffleDatasetOpTest,
                         ParameterizedIteratorSaveAndRestoreTest,
                         ::testing::ValuesIn(IteratorSaveAndRestoreTestCases()));
 
+TEST_F(ShuffleDatasetOpTest, RandomAccessPermutesEachEpoch) {
+  auto dataset_params = ShuffleDatasetParams(RangeDatasetParams(0, 100, 1),
+                                             /*buffer_size=*/10,
+                                             /*seed=*/1,
+                                             /*seed2=*/2,
+                                             /*count=*/2,
+                                             /*reshuffle_each_iteration=*/false,
+                                             /*output_dtypes=*/{DT_INT64},
+                                             /*output_shapes=*/{
+                                                 PartialTensorShape({})},
+                                             /*node_name=*/
+                                             kShuffleAndRepeatNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  std::vector<std::vector<int64_t>> epochs(2);
+  for (int64_t index = 0; index < 200; ++index) {
+    std::vector<Tensor> out_tensors;
+    TF_ASSERT_OK(dataset_->Get(dataset_ctx_.get(), index, &out_tensors));
+    ASSERT_EQ(out_tensors.size(), 1);
+    epochs[index / 100].push_back(out_tensors[0].scalar<int64_t>()());
+
+    // Random access is deterministic.
+    std::vector<Tensor> out_tensors_again;
+    TF_ASSERT_OK(dataset_->Get(dataset_ctx_.get(), index, &out_tensors_again));
+    test::ExpectTensorEqual<int64_t>(out_tensors[0], out_tensors_again[0]);
+  }
+  std::vector<int64_t> expected(100);
+  std::iota(expected.begin(), expected.end(), 0);
+  for (const auto& epoch : epochs) {
+    EXPECT_NE(epoch, expected);
+    std::vector<int64_t> sorted = epoch;
+    std::sort(sorted.begin(), sorted.end());
+    EXPECT_EQ(sorted, expected);
+  }
+  EXPECT_NE(epochs[0], epochs[1]);
+
+  std::vector<Tensor> out_tensors;
+  EXPECT_EQ(dataset_->Get(dataset_ctx_.get(), 200, &out_tensors).code(),
+            tensorflow::error::OUT_OF_RANGE);
+}
+
+TEST_F(ShuffleDatasetOpTest, GlobalShuffleIterator) {
+  auto dataset_params = ShuffleDatasetParams(RangeDatasetParams(0, 100, 1),
+                                             /*buffer_size=*/10,
+                                             /*seed=*/1,
+                                             /*seed2=*/2,
+                                             /*count=*/2,
+                                             /*reshuffle_each_iteration=*/false,
+                                             /*output_dtypes=*/{DT_INT64},
+                                             /*output_shapes=*/{
+                                                 PartialTensorShape({})},
+                                             /*node_name=*/
+                                             kShuffleAndRepeatNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  Options options;
+  options.set_global_shuffle(true);
+  IteratorContext::Params params(iterator_ctx_.get());
+  params.options = &options;
+  IteratorContext ctx(params);
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(&ctx, /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+
+  // The iterator produces the same sequence as random access to the dataset,
+  // which permutes the whole input in each epoch.
+  std::vector<Tensor> expected_outputs;
+  for (int64_t index = 0; index < 200; ++index) {
+    std::vector<Tensor> out_tensors;
+    TF_ASSERT_OK(dataset_->Get(dataset_ctx_.get(), index, &out_tensors));
+    expected_outputs.push_back(out_tensors[0]);
+  }
+  std::vector<Tensor> outputs;
+  bool end_of_sequence = false;
+  while (!end_of_sequence) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(iterator->GetNext(&ctx, &next, &end_of_sequence));
+    outputs.insert(outputs.end(), next.begin(), next.end());
+  }
+  TF_EXPECT_OK(ExpectEqual(outputs, expected_outputs,
+                           /*compare_order=*/true));
+
+  // Restoring from a checkpoint continues the same sequence.
+  TF_EXPECT_OK(CheckIteratorSaveAndRestore(
+      dataset_, &ctx, dataset_params.iterator_prefix(), expected_outputs,
+      /*breakpoints=*/{0, 5, 150, 250}, /*compare_order=*/true));
+}
+
+TEST_F(ShuffleDatasetOpTest, GlobalShuffleRequiresFiniteInput) {
+  auto dataset_params = ShuffleDatasetParams(
+      ShuffleDatasetParams(RangeDatasetParams(0, 10, 1),
+                           /*buffer_size=*/10,
+                           /*seed=*/1,
+                           /*seed2=*/2,
+                           /*count=*/-1,
+                           /*reshuffle_each_iteration=*/false,
+                           /*output_dtypes=*/{DT_INT64},
+                           /*output_shapes=*/{PartialTensorShape({})},
+                           /*node_name=*/"infinite_shuffle_dataset"),
+      /*buffer_size=*/10,
+      /*seed=*/1,
+      /*seed2=*/2,
+      /*count=*/1,
+      /*reshuffle_each_iteration=*/false,
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})},
+      /*node_name=*/kShuffleNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  Options options;
+  options.set_global_shuffle(true);
+  IteratorContext::Params params(iterator_ctx_.get());
+  params.options = &options;
+  IteratorContext ctx(params);
+  std::unique_ptr<IteratorBase> iterator;
+  // The iterator fails instead of shuffling from a buffer.
+  EXPECT_EQ(dataset_->MakeIterator(&ctx, /*parent=*/nullptr,
+                                   dataset_params.iterator_prefix(), &iterator)
+                .code(),
+            tensorflow::error::FAILED_PRECONDITION);
+}
+
 TEST_F(ShuffleDatasetOpTest, InvalidArguments) {
   std::vector<ShuffleDatasetParams> dataset_params_vec(
       {ShuffleDatasetParamsWithInvalidBufferSize(),
@@ -14,7 +14,12 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/tf_record_dataset_op.h"
 
+#include <algorithm>
+#include <string>
+
+#include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/read_ahead_file.h"
 #include "tensorflow/core/data/utils.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
@@ -39,10 +44,16 @@ namespace data {
 
 constexpr char kCurrentFileIndex[] = "current_file_index";
 constexpr char kOffset[] = "offset";
+constexpr char kRecordNumber[] = "record_number";
 constexpr char kGcsFsPrefix[] = "gs://";
 constexpr char kS3FsPrefix[] = "s3://";
 constexpr int64_t kCloudTpuBlockSize = 127LL << 20;  // 127MB.
 constexpr int64_t kS3BlockSize = kCloudTpuBlockSize;
+constexpr char kReadAheadExperiment[] = "tf_record_read_ahead";
+// Size and number of the reads kept in flight per file when the read-ahead
+// experiment is enabled.
+constexpr int64_t kReadAheadBlockSize = 1 << 20;  // 1MB.
+constexpr int kReadAheadNumOutstandingReads = 8;
 
 bool is_cloud_tpu_gcs_fs() {
 #if (defined(PLATFORM_CLOUD_TPU) && defined(TPU_GCS_FS)) || \
@@ -60,7 +71,8 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
         filenames_(std::move(filenames)),
         compression_type_(compression_type),
         options_(io::RecordReaderOptions::CreateRecordReaderOptions(
-            compression_type)) {
+            compression_type)),
+        use_read_ahead_(GetExperiments().contains(kReadAheadExperiment)) {
     if (buffer_size > 0) {
       options_.buffer_size = buffer_size;
     }
@@ -127,6 +139,7 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
           Status s =
               reader_->ReadRecord(&out_tensors->back().scalar<tstring>()());
           if (s.ok()) {
+            ++record_number_;
             static monitoring::CounterCell* bytes_counter =
                 metrics::GetTFDataBytesReadCounter(kDatasetType);
             bytes_counter->IncrementBy(
@@ -169,8 +182,8 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
         // the next (num_to_skip - *num_skipped) record.
         if (reader_) {
           int last_num_skipped;
-          Status s = reader_->SkipRecords(num_to_skip - *num_skipped,
-                                          &last_num_skipped);
+          Status s = SkipRecordsLocked(ctx->env(), num_to_skip - *num_skipped,
+                                       &last_num_skipped);
           *num_skipped += last_num_skipped;
           if (s.ok()) {
             *end_of_sequence = false;
@@ -216,6 +229,8 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       if (reader_) {
         TF_RETURN_IF_ERROR(
             writer->WriteScalar(full_name(kOffset), reader_->TellOffset()));
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name(kRecordNumber), record_number_));
       }
       return OkStatus();
     }
@@ -233,6 +248,16 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kOffset), &offset));
         TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
         TF_RETURN_IF_ERROR(reader_->SeekOffset(offset));
+        if (reader->Contains(full_name(kRecordNumber))) {
+          int64_t record_number;
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(full_name(kRecordNumber), &record_number));
+          record_number_ = record_number;
+        } else {
+          // Without the record number the record index cannot be used for
+          // the rest of this file.
+          record_index_checked_ = true;
+        }
       }
       return OkStatus();
     }
@@ -250,6 +275,11 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       TF_RETURN_IF_ERROR(env->NewRandomAccessFile(
           TranslateFileName(dataset()->filenames_[current_file_index_]),
           &file_));
+      if (dataset()->use_read_ahead_) {
+        file_ = std::make_unique<ReadAheadRandomAccessFile>(
+            env, std::move(file_), kReadAheadBlockSize,
+            kReadAheadNumOutstandingReads);
+      }
       reader_ = std::make_unique<io::SequentialRecordReader>(
           file_.get(), dataset()->options_);
       return OkStatus();
@@ -259,6 +289,100 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     void ResetStreamsLocked() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       reader_.reset();
       file_.reset();
+      record_index_.reset();
+      record_index_checked_ = false;
+      record_number_ = 0;
+    }
+
+    // Skips up to `num_to_skip` records of the current file. If the file has a
+    // record index sidecar, the reader seeks directly to the target record
+    // instead of reading every record header in between. If the index does
+    // not match the file, it is ignored and the records are skipped one by
+    // one.
+    Status SkipRecordsLocked(Env* env, int num_to_skip, int* num_skipped)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      MaybeOpenRecordIndexLocked(env);
+      int num_seeked = 0;
+      if (record_index_ && record_number_ < record_index_->num_records()) {
+        // Seek at most to the last indexed record, so that the reader still
+        // detects the end of the file (or records appended after indexing).
+        const uint64 num_seekable =
+            record_index_->num_records() - record_number_ - 1;
+        num_seeked =
+            static_cast<int>(std::min<uint64>(num_to_skip, num_seekable));
+      }
+      if (num_seeked > 0) {
+        Status s = SeekWithRecordIndexLocked(record_number_ + num_seeked);
+        if (s.ok()) {
+          record_number_ += num_seeked;
+        } else {
+          LOG(WARNING) << "Ignoring the record index of "
+                       << dataset()->filenames_[current_file_index_]
+                       << ", which does not match the file: " << s;
+          record_index_.reset();
+          num_seeked = 0;
+        }
+      }
+      int num_read = 0;
+      Status s = reader_->SkipRecords(num_to_skip - num_seeked, &num_read);
+      record_number_ += num_read;
+      *num_skipped = num_seeked + num_read;
+      return s;
+    }
+
+    // Moves the reader to record `record_number` (> `record_number_`) of the
+    // current file using the record index. To check that the index matches
+    // the file, the record before the target is read from its indexed offset
+    // and must end at the indexed offset of the target. On error, the reader
+    // is moved back to where it was.
+    Status SeekWithRecordIndexLocked(uint64 record_number)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const uint64 current_offset = reader_->TellOffset();
+      Status s = [&]() -> Status {
+        uint64 offset;
+        TF_RETURN_IF_ERROR(
+            record_index_->GetOffset(record_number - 1, &offset));
+        if (offset < current_offset) {
+          return errors::DataLoss("Record ", record_number - 1,
+                                  " is indexed at offset ", offset,
+                                  ", before the current offset ",
+                                  current_offset);
+        }
+        uint64 target_offset;
+        TF_RETURN_IF_ERROR(
+            record_index_->GetOffset(record_number, &target_offset));
+        TF_RETURN_IF_ERROR(reader_->SeekOffset(offset));
+        tstring record;
+        TF_RETURN_IF_ERROR(reader_->ReadRecord(&record));
+        if (reader_->TellOffset() != target_offset) {
+          return errors::DataLoss("Record ", record_number,
+                                  " is indexed at offset ", target_offset,
+                                  ", but the previous record ends at offset ",
+                                  reader_->TellOffset());
+        }
+        return OkStatus();
+      }();
+      if (!s.ok()) {
+        TF_RETURN_IF_ERROR(reader_->SeekOffset(current_offset));
+      }
+      return s;
+    }
+
+    // Opens the record index sidecar of the current file, if there is one. An
+    // index that cannot be opened is ignored.
+    void MaybeOpenRecordIndexLocked(Env* env) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (record_index_checked_) {
+        return;
+      }
+      record_index_checked_ = true;
+      const std::string index_filename = io::RecordIndexFilename(
+          TranslateFileName(dataset()->filenames_[current_file_index_]));
+      Status s = io::RecordIndex::Open(env, index_filename, &record_index_);
+      if (!s.ok() && !errors::IsNotFound(s)) {
+        LOG(WARNING) << "Ignoring the record index " << index_filename
+                     << ", which cannot be opened: " << s;
+        record_index_.reset();
+      }
     }
 
     mutex mu_;
@@ -268,11 +392,19 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     // we must destroy `reader_` before `file_`.
     std::unique_ptr<RandomAccessFile> file_ TF_GUARDED_BY(mu_);
     std::unique_ptr<io::SequentialRecordReader> reader_ TF_GUARDED_BY(mu_);
+    // Number of records of the current file read or skipped so far.
+    uint64 record_number_ TF_GUARDED_BY(mu_) = 0;
+    // Record index sidecar of the current file, opened on the first skip.
+    std::unique_ptr<io::RecordIndex> record_index_ TF_GUARDED_BY(mu_);
+    bool record_index_checked_ TF_GUARDED_BY(mu_) = false;
   };
 
   const std::vector<string> filenames_;
   const tstring compression_type_;
   io::RecordReaderOptions options_;
+  // Whether files are read through a `ReadAheadRandomAccessFile`, which keeps
+  // several reads in flight instead of blocking on one buffer at a time.
+  const bool use_read_ahead_;
 };
 
 TFRecordDatasetOp::TFRecordDatasetOp(OpKernelConstruction* ctx)
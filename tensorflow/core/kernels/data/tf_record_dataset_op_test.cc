@@ -12,6 +12,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/tf_record_dataset_op.h"
 
 #include "tensorflow/core/data/dataset_test_base.h"
+#include "tensorflow/core/lib/io/record_reader.h"
 
 namespace tensorflow {
 namespace data {
@@ -152,6 +153,34 @@ std::vector<GetNextTestCase<TFRecordDatasetParams>> GetNextTestCases() {
            TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})}};
 }
 
+// Test case 4: multiple text files without compression, with record index
+// sidecars.
+TFRecordDatasetParams TFRecordDatasetParams4() {
+  std::vector<tstring> filenames = {
+      absl::StrCat(testing::TmpDir(), "/tf_record_INDEXED_1"),
+      absl::StrCat(testing::TmpDir(), "/tf_record_INDEXED_2")};
+  std::vector<std::vector<string>> contents = {{"1", "22", "333", "4444"},
+                                               {"a", "bb", "ccc"}};
+  CompressionType compression_type = CompressionType::UNCOMPRESSED;
+  if (!CreateTestFiles(filenames, contents, compression_type).ok()) {
+    VLOG(WARNING) << "Failed to create the test files: "
+                  << absl::StrJoin(filenames, ", ");
+  }
+  for (const tstring& filename : filenames) {
+    Status s = io::BuildRecordIndex(Env::Default(), filename,
+                                    io::RecordReaderOptions(),
+                                    io::RecordIndexFilename(filename));
+    if (!s.ok()) {
+      VLOG(WARNING) << "Failed to build the record index of " << filename
+                    << ": " << s;
+    }
+  }
+  return TFRecordDatasetParams(filenames,
+                               /*compression_type=*/compression_type,
+                               /*buffer_size=*/10,
+                               /*node_name=*/kNodeName);
+}
+
 ITERATOR_GET_NEXT_TEST_P(TFRecordDatasetOpTest, TFRecordDatasetParams,
                          GetNextTestCases())
 
@@ -187,7 +216,18 @@ std::vector<SkipTestCase<TFRecordDatasetParams>> SkipTestCases() {
            /*expected_outputs=*/
            CreateTensors<tstring>(TensorShape({}), {{"bb"}})},
           {/*dataset_params=*/TFRecordDatasetParams3(),
-           /*num_to_skip*/ 7, /*expected_num_skipped*/ 6}};
+           /*num_to_skip*/ 7, /*expected_num_skipped*/ 6},
+
+          {/*dataset_params=*/TFRecordDatasetParams4(),
+           /*num_to_skip*/ 2, /*expected_num_skipped*/ 2, /*get_next*/ true,
+           /*expected_outputs=*/
+           CreateTensors<tstring>(TensorShape({}), {{"333"}})},
+          {/*dataset_params=*/TFRecordDatasetParams4(),
+           /*num_to_skip*/ 5, /*expected_num_skipped*/ 5, /*get_next*/ true,
+           /*expected_outputs=*/
+           CreateTensors<tstring>(TensorShape({}), {{"bb"}})},
+          {/*dataset_params=*/TFRecordDatasetParams4(),
+           /*num_to_skip*/ 9, /*expected_num_skipped*/ 7}};
 }
 
 ITERATOR_SKIP_TEST_P(TFRecordDatasetOpTest, TFRecordDatasetParams,
@@ -258,12 +298,90 @@ IteratorSaveAndRestoreTestCases() {
       {/*dataset_params=*/TFRecordDatasetParams3(),
        /*breakpoints=*/{0, 2, 7},
        CreateTensors<tstring>(
-           TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})}};
+           TensorShape({}), {{"1"}, {"22"}, {"333"}, {"a"}, {"bb"}, {"ccc"}})},
+      {/*dataset_params=*/TFRecordDatasetParams4(),
+       /*breakpoints=*/{0, 2, 8},
+       CreateTensors<tstring>(TensorShape({}), {{"1"},
+                                                {"22"},
+                                                {"333"},
+                                                {"4444"},
+                                                {"a"},
+                                                {"bb"},
+                                                {"ccc"}})}};
 }
 
 ITERATOR_SAVE_AND_RESTORE_TEST_P(TFRecordDatasetOpTest, TFRecordDatasetParams,
                                  IteratorSaveAndRestoreTestCases())
 
+// Writes the records of `contents` to a single uncompressed file with a record
+// index sidecar, and returns the parameters of a dataset reading it.
+TFRecordDatasetParams IndexedFileDatasetParams(
+    const string& basename, const std::vector<string>& contents) {
+  tstring filename = absl::StrCat(testing::TmpDir(), "/", basename);
+  TF_CHECK_OK(CreateTestFiles({filename}, {contents},
+                              CompressionType::UNCOMPRESSED));
+  TF_CHECK_OK(io::BuildRecordIndex(Env::Default(), filename,
+                                   io::RecordReaderOptions(),
+                                   io::RecordIndexFilename(filename)));
+  return TFRecordDatasetParams({filename},
+                               /*compression_type=*/
+                               CompressionType::UNCOMPRESSED,
+                               /*buffer_size=*/10,
+                               /*node_name=*/kNodeName);
+}
+
+TEST_F(TFRecordDatasetOpTest, SkipUsesRecordIndex) {
+  const string basename = "tf_record_INDEXED_CORRUPT";
+  auto dataset_params =
+      IndexedFileDatasetParams(basename, {"1", "22", "333", "4444"});
+  // Corrupts the length checksum in the header of the second record, which
+  // starts after the 17 bytes of the first one. Reading the records one by
+  // one now fails on it, so skipping past it only succeeds through the index.
+  const string filename = absl::StrCat(testing::TmpDir(), "/", basename);
+  string data;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), filename, &data));
+  data[17 + sizeof(uint64)] ^= 0xff;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), filename, data));
+
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_EXPECT_OK(CheckIteratorSkip(
+      /*num_to_skip=*/3, /*expected_num_skipped=*/3, /*get_next=*/true,
+      CreateTensors<tstring>(TensorShape({}), {{"4444"}}),
+      /*compare_order=*/true));
+}
+
+TEST_F(TFRecordDatasetOpTest, SkipIgnoresStaleRecordIndex) {
+  const string basename = "tf_record_INDEXED_STALE";
+  auto dataset_params =
+      IndexedFileDatasetParams(basename, {"1", "22", "333", "4444"});
+  // Rewrites the file with records of other sizes, leaving its index stale.
+  TF_ASSERT_OK(CreateTestFiles({absl::StrCat(testing::TmpDir(), "/", basename)},
+                               {{"aaaa", "b", "cc", "ddd"}},
+                               CompressionType::UNCOMPRESSED));
+
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_EXPECT_OK(CheckIteratorSkip(
+      /*num_to_skip=*/2, /*expected_num_skipped=*/2, /*get_next=*/true,
+      CreateTensors<tstring>(TensorShape({}), {{"cc"}}),
+      /*compare_order=*/true));
+}
+
+TEST_F(TFRecordDatasetOpTest, SkipIgnoresMalformedRecordIndex) {
+  const string basename = "tf_record_INDEXED_MALFORMED";
+  auto dataset_params =
+      IndexedFileDatasetParams(basename, {"1", "22", "333", "4444"});
+  TF_ASSERT_OK(WriteStringToFile(
+      Env::Default(),
+      io::RecordIndexFilename(absl::StrCat(testing::TmpDir(), "/", basename)),
+      "abc"));
+
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_EXPECT_OK(CheckIteratorSkip(
+      /*num_to_skip=*/2, /*expected_num_skipped=*/2, /*get_next=*/true,
+      CreateTensors<tstring>(TensorShape({}), {{"333"}}),
+      /*compare_order=*/true));
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
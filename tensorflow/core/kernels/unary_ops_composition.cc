@@ -17,6 +17,8 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
+
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/kernels/cwise_ops.h"
@@ -116,14 +118,19 @@ class UnaryOpsComposition : public OpKernel {
     const std::size_t num_fns = fns_.size();
     auto compute_fn = [this, &in_flat, &out_flat, &num_fns](int64_t begin,
                                                             int64_t end) {
-      int64_t len = end - begin;
-      const InputBuffer in_slice(in_flat.data() + begin, len);
-      const InputBuffer scratch_slice(out_flat.data() + begin, len);
-      OutputBuffer out_slice(out_flat.data() + begin, len);
-
-      fns_[0](in_slice, &out_slice);
-      for (int i = 1; i < num_fns; ++i) {
-        fns_[i](scratch_slice, &out_slice);
+      // Applies all functions to one cache-sized slice before moving on to the
+      // next, so that the composition is a single pass over memory.
+      for (int64_t slice_begin = begin; slice_begin < end;
+           slice_begin += kCacheBlockSize) {
+        int64_t len = std::min<int64_t>(kCacheBlockSize, end - slice_begin);
+        const InputBuffer in_slice(in_flat.data() + slice_begin, len);
+        const InputBuffer scratch_slice(out_flat.data() + slice_begin, len);
+        OutputBuffer out_slice(out_flat.data() + slice_begin, len);
+
+        fns_[0](in_slice, &out_slice);
+        for (int i = 1; i < num_fns; ++i) {
+          fns_[i](scratch_slice, &out_slice);
+        }
       }
     };
 
@@ -140,6 +147,12 @@ class UnaryOpsComposition : public OpKernel {
   static constexpr int kPacketSize =
       Eigen::internal::unpacket_traits<Packet>::size;
 
+  // Number of elements of the slices that all functions are applied to in
+  // turn, such that the input and output slices stay in the L1 cache. A
+  // multiple of the packet size.
+  static constexpr int64_t kCacheBlockSize = 8192 / sizeof(T) / kPacketSize *
+                                             kPacketSize;
+
   static inline int64_t AlignBlockSize(int64_t block_size) {
     // Align block size to packet size and account for unrolling in run above.
     if (block_size >= 16 * kPacketSize) {
@@ -30,6 +30,9 @@ limitations under the License.
 namespace tensorflow {
 namespace io {
 // NOLINTBEGIN(misc-unused-using-decls)
+using tsl::io::BuildRecordIndex;
+using tsl::io::RecordIndex;
+using tsl::io::RecordIndexFilename;
 using tsl::io::RecordReader;
 using tsl::io::RecordReaderOptions;
 using tsl::io::SequentialRecordReader;
@@ -1252,12 +1252,14 @@ Status FastParseExample(const Config& config,
     TF_RETURN_IF_ERROR(status);
   }
 
-  result->sparse_indices.reserve(config.sparse.size());
-  result->sparse_values.reserve(config.sparse.size());
-  result->sparse_shapes.reserve(config.sparse.size());
+  // Output slots are allocated up front so that features can be merged into
+  // them concurrently (see below).
+  result->sparse_indices.resize(config.sparse.size());
+  result->sparse_values.resize(config.sparse.size());
+  result->sparse_shapes.resize(config.sparse.size());
   result->dense_values.reserve(config.dense.size());
-  result->ragged_values.reserve(config.ragged.size());
-  result->ragged_splits.reserve(config.ragged.size());
+  result->ragged_values.resize(config.ragged.size());
+  result->ragged_splits.resize(config.ragged.size());
 
   for (size_t d = 0; d < config.dense.size(); ++d) {
     result->dense_values.push_back(std::move(fixed_dense_values[d]));
@@ -1274,16 +1276,16 @@ Status FastParseExample(const Config& config,
     TensorShape indices_shape;
     indices_shape.AddDim(total_num_features);
     indices_shape.AddDim(2);
-    result->sparse_indices.emplace_back(DT_INT64, indices_shape);
-    Tensor* indices = &result->sparse_indices.back();
+    result->sparse_indices[d] = Tensor(DT_INT64, indices_shape);
+    Tensor* indices = &result->sparse_indices[d];
 
     TensorShape values_shape;
     values_shape.AddDim(total_num_features);
-    result->sparse_values.emplace_back(config.sparse[d].dtype, values_shape);
-    Tensor* values = &result->sparse_values.back();
+    result->sparse_values[d] = Tensor(config.sparse[d].dtype, values_shape);
+    Tensor* values = &result->sparse_values[d];
 
-    result->sparse_shapes.emplace_back(DT_INT64, TensorShape({2}));
-    auto shapes_shape_t = result->sparse_shapes.back().vec<int64_t>();
+    result->sparse_shapes[d] = Tensor(DT_INT64, TensorShape({2}));
+    auto shapes_shape_t = result->sparse_shapes[d].vec<int64_t>();
     shapes_shape_t(0) = serialized.size();
     shapes_shape_t(1) = max_num_features;
 
@@ -1326,9 +1328,9 @@ Status FastParseExample(const Config& config,
 
     TensorShape row_splits_shape;
     row_splits_shape.AddDim(serialized.size() + 1);
-    result->ragged_splits.emplace_back(config.ragged[d].splits_dtype,
-                                       row_splits_shape);
-    Tensor* row_splits = &result->ragged_splits.back();
+    result->ragged_splits[d] =
+        Tensor(config.ragged[d].splits_dtype, row_splits_shape);
+    Tensor* row_splits = &result->ragged_splits[d];
     if (config.ragged[d].splits_dtype == DT_INT64) {
       row_splits->flat<int64_t>()(0) = 0;
     } else {
@@ -1337,8 +1339,8 @@ Status FastParseExample(const Config& config,
 
     TensorShape values_shape;
     values_shape.AddDim(total_num_features);
-    result->ragged_values.emplace_back(config.ragged[d].dtype, values_shape);
-    Tensor* values = &result->ragged_values.back();
+    result->ragged_values[d] = Tensor(config.ragged[d].dtype, values_shape);
+    Tensor* values = &result->ragged_values[d];
 
     size_t values_offset = 0;
     size_t splits_offset = 0;
@@ -1426,17 +1428,37 @@ Status FastParseExample(const Config& config,
     }
   };
 
-  for (size_t d = 0; d < config.dense.size(); ++d) {
-    MergeDenseVarLenMinibatches(d);
-  }
-
-  for (size_t d = 0; d < config.sparse.size(); ++d) {
-    MergeSparseMinibatches(d);
-  }
-
-  for (size_t d = 0; d < config.ragged.size(); ++d) {
-    MergeRaggedMinibatches(d);
-  }
+  // Each feature is merged into its own output tensors and reads only its own
+  // column of the minibatch buffers, so features are independent of each
+  // other. For wide inputs (thousands of features per example) a sequential
+  // merge dominates the parse time, so contiguous ranges of features are
+  // merged in parallel.
+  auto MergeFeature = [&](size_t f) {
+    if (f < config.dense.size()) {
+      MergeDenseVarLenMinibatches(f);
+      return;
+    }
+    f -= config.dense.size();
+    if (f < config.sparse.size()) {
+      MergeSparseMinibatches(f);
+      return;
+    }
+    f -= config.sparse.size();
+    MergeRaggedMinibatches(f);
+  };
+  // An empty batch has no minibatches but still needs (empty) outputs.
+  const size_t num_merge_shards =
+      config.merge_features_in_parallel
+          ? std::min(std::max<size_t>(num_minibatches, 1), config_size)
+          : 1;
+  auto MergeFeatureShard = [&](size_t shard) {
+    const size_t begin = (config_size * shard) / num_merge_shards;
+    const size_t end = (config_size * (shard + 1)) / num_merge_shards;
+    for (size_t f = begin; f < end; ++f) {
+      MergeFeature(f);
+    }
+  };
+  ParallelFor(MergeFeatureShard, num_merge_shards, thread_pool);
 
   return OkStatus();
 }
@@ -95,6 +95,12 @@ struct FastParseExampleConfig {
   // If `true`, `Result::feature_stats` will contain one
   // `PerExampleFeatureStats` for each serialized example in the input.
   bool collect_feature_stats = false;
+
+  // If `true` and `FastParseExample()` is given a thread pool, the parsed
+  // features are copied into the output tensors in parallel, one range of
+  // features per minibatch. Otherwise they are copied one after another on
+  // the calling thread.
+  bool merge_features_in_parallel = true;
 };
 
 // Statistics about the features in each example passed to
@@ -13,12 +13,16 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <memory>
 #include <utility>
 
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -427,6 +431,101 @@ TEST(TestFastParseExample, Empty) {
   EXPECT_TRUE(status.ok()) << status;
 }
 
+// Builds a config and matching batch of examples with `num_features` features
+// per example, cycling through fixed-length dense, variable-length dense,
+// sparse and ragged features.
+void MakeWideExamples(int num_features, int num_examples,
+                      FastParseExampleConfig* config,
+                      std::vector<tstring>* serialized) {
+  Example example;
+  auto& features = *example.mutable_features()->mutable_feature();
+  for (int i = 0; i < num_features; ++i) {
+    const string name = strings::StrCat("f", i);
+    features[name].mutable_int64_list()->add_value(i);
+    features[name].mutable_int64_list()->add_value(i + 1);
+    switch (i % 4) {
+      case 0:
+        AddDenseFeature(name.c_str(), DT_INT64, {2}, false, 2, config);
+        break;
+      case 1:
+        AddDenseFeature(name.c_str(), DT_INT64, {-1}, true, 1, config);
+        break;
+      case 2:
+        AddSparseFeature(name.c_str(), DT_INT64, config);
+        break;
+      case 3:
+        config->ragged.push_back({name, DT_INT64, DT_INT64});
+        break;
+    }
+  }
+  serialized->assign(num_examples, Serialize(example));
+}
+
+TEST(FastParse, WideExampleWithThreadPool) {
+  FastParseExampleConfig config;
+  std::vector<tstring> serialized;
+  MakeWideExamples(/*num_features=*/101, /*num_examples=*/32, &config,
+                   &serialized);
+
+  Result expected;
+  TF_ASSERT_OK(FastParseExample(config, serialized, {}, nullptr, &expected));
+
+  thread::ThreadPool thread_pool(Env::Default(), "fast_parse_test", 4);
+  Result result;
+  TF_ASSERT_OK(
+      FastParseExample(config, serialized, {}, &thread_pool, &result));
+
+  ASSERT_EQ(expected.dense_values.size(), result.dense_values.size());
+  for (size_t i = 0; i < result.dense_values.size(); ++i) {
+    test::ExpectTensorEqual<int64_t>(expected.dense_values[i],
+                                     result.dense_values[i]);
+  }
+  ASSERT_EQ(expected.sparse_indices.size(), result.sparse_indices.size());
+  for (size_t i = 0; i < result.sparse_indices.size(); ++i) {
+    test::ExpectTensorEqual<int64_t>(expected.sparse_indices[i],
+                                     result.sparse_indices[i]);
+    test::ExpectTensorEqual<int64_t>(expected.sparse_values[i],
+                                     result.sparse_values[i]);
+    test::ExpectTensorEqual<int64_t>(expected.sparse_shapes[i],
+                                     result.sparse_shapes[i]);
+  }
+  ASSERT_EQ(expected.ragged_values.size(), result.ragged_values.size());
+  for (size_t i = 0; i < result.ragged_values.size(); ++i) {
+    test::ExpectTensorEqual<int64_t>(expected.ragged_values[i],
+                                     result.ragged_values[i]);
+    test::ExpectTensorEqual<int64_t>(expected.ragged_splits[i],
+                                     result.ragged_splits[i]);
+  }
+}
+
+// Parses a batch of examples with `num_features` features each on a thread
+// pool of 8 threads, copying the features into the outputs on the calling
+// thread or, with `merge_features_in_parallel`, on the pool.
+void BM_FastParseWideExample(::testing::benchmark::State& state) {
+  const int num_features = state.range(0);
+  const int num_examples = state.range(1);
+  FastParseExampleConfig config;
+  config.merge_features_in_parallel = state.range(2);
+  std::vector<tstring> serialized;
+  MakeWideExamples(num_features, num_examples, &config, &serialized);
+  thread::ThreadPool thread_pool(Env::Default(), "fast_parse_benchmark", 8);
+  for (auto s : state) {
+    Result result;
+    TF_CHECK_OK(
+        FastParseExample(config, serialized, {}, &thread_pool, &result));
+  }
+  state.SetItemsProcessed(state.iterations() * num_examples);
+}
+
+BENCHMARK(BM_FastParseWideExample)
+    ->ArgNames({"features", "examples", "parallel_merge"})
+    ->Args({1000, 128, false})
+    ->Args({1000, 128, true})
+    ->Args({1000, 1024, false})
+    ->Args({1000, 1024, true})
+    ->Args({4000, 128, false})
+    ->Args({4000, 128, true});
+
 }  // namespace
 }  // namespace example
 }  // namespace tensorflow
@@ -43,12 +43,17 @@ class AutotuneAlgorithm(enum.Enum):
 
   STAGE_BASED: In each optimization step, this algorithm chooses the worst
   bottleneck parameter and increases its value by 1.
+
+  COST_MODEL: Jointly tunes parallelism and buffer sizes within the CPU and RAM
+  budgets, spending them where they decrease the latency the most, and only
+  re-tunes the parameters when the measured processing times drift.
   """
   DEFAULT = 0
   HILL_CLIMB = 1
   GRADIENT_DESCENT = 2
   MAX_PARALLELISM = 3
   STAGE_BASED = 4
+  COST_MODEL = 5
 
   @classmethod
   def _to_proto(cls, obj):
@@ -62,9 +67,11 @@ class AutotuneAlgorithm(enum.Enum):
       return model_pb2.AutotuneAlgorithm.MAX_PARALLELISM
     if obj == cls.STAGE_BASED:
       return model_pb2.AutotuneAlgorithm.STAGE_BASED
+    if obj == cls.COST_MODEL:
+      return model_pb2.AutotuneAlgorithm.COST_MODEL
     raise ValueError(
         f"Invalid `obj.` Supported values include `DEFAULT`, `HILL_CLIMB` "
-        f"`GRADIENT_DESCENT`, and `STAGE_BASED`. Got {obj.name}.")
+        f"`GRADIENT_DESCENT`, `STAGE_BASED` and `COST_MODEL`. Got {obj.name}.")
 
   @classmethod
   def _from_proto(cls, pb):
@@ -78,9 +85,11 @@ class AutotuneAlgorithm(enum.Enum):
       return cls.MAX_PARALLELISM
     if pb == model_pb2.AutotuneAlgorithm.STAGE_BASED:
       return cls.STAGE_BASED
+    if pb == model_pb2.AutotuneAlgorithm.COST_MODEL:
+      return cls.COST_MODEL
     raise ValueError(
         f"Invalid `pb.` Supported values include `DEFAULT`, `HILL_CLIMB`, "
-        f"`GRADIENT_DESCENT` and `STAGE_BASED`. Got {pb}.")
+        f"`GRADIENT_DESCENT`, `STAGE_BASED` and `COST_MODEL`. Got {pb}.")
 
 
 @tf_export("data.experimental.AutoShardPolicy")
@@ -554,6 +563,24 @@ class Options(options_lib.OptionsBase):
       "state is ignored and a warning is logged; FAIL: External state results "
       "in an error.")
 
+  experimental_global_shuffle = options_lib.create_option(
+      name="experimental_global_shuffle",
+      ty=bool,
+      docstring="Whether `shuffle()` permutes the indices of its input instead "
+      "of sampling from a buffer. The whole input is then shuffled, using "
+      "constant memory. The input must have a known, finite cardinality and "
+      "support random access, or iterating fails with a "
+      "`FailedPreconditionError`. If None, defaults to False.")
+
+  experimental_memory_cache_ram_budget = options_lib.create_option(
+      name="experimental_memory_cache_ram_budget",
+      ty=int,
+      docstring="The number of bytes of elements that an in-memory `cache()` "
+      "keeps in RAM. Elements beyond the budget are spilled to a local file. "
+      "A value of 0 means that the budget is unlimited. If None, the budget is "
+      "read from the `TF_DATA_MEMORY_CACHE_RAM_BUDGET_MB` environment "
+      "variable.")
+
   experimental_optimization = options_lib.create_option(
       name="experimental_optimization",
       ty=OptimizationOptions,
@@ -630,6 +657,10 @@ class Options(options_lib.OptionsBase):
       pb.external_state_policy = (
           ExternalStatePolicy._to_proto(  # pylint: disable=protected-access
               self.experimental_external_state_policy))
+    if self.experimental_global_shuffle is not None:
+      pb.global_shuffle = self.experimental_global_shuffle
+    if self.experimental_memory_cache_ram_budget is not None:
+      pb.memory_cache_ram_budget = self.experimental_memory_cache_ram_budget
     pb.optimization_options.CopyFrom(self.experimental_optimization._to_proto())  # pylint: disable=protected-access
     if self.experimental_slack is not None:
       pb.slack = self.experimental_slack
@@ -647,6 +678,10 @@ class Options(options_lib.OptionsBase):
       self.experimental_external_state_policy = (
           ExternalStatePolicy._from_proto(  # pylint: disable=protected-access
               pb.external_state_policy))
+    if pb.WhichOneof("optional_global_shuffle") is not None:
+      self.experimental_global_shuffle = pb.global_shuffle
+    if pb.WhichOneof("optional_memory_cache_ram_budget") is not None:
+      self.experimental_memory_cache_ram_budget = pb.memory_cache_ram_budget
     self.experimental_optimization._from_proto(pb.optimization_options)  # pylint: disable=protected-access
     if pb.WhichOneof("optional_slack") is not None:
       self.experimental_slack = pb.slack
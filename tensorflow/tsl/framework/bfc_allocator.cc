@@ -48,6 +48,9 @@ BFCAllocator::BFCAllocator(std::unique_ptr<SubAllocator> sub_allocator,
       name_(name),
       free_chunks_list_(kInvalidChunkHandle),
       next_allocation_id_(1) {
+  if (opts.thread_cache) {
+    cache_shards_ = std::make_unique<CacheShard[]>(kNumCacheShards);
+  }
   if (opts.allow_growth) {
     // 2MiB smallest initial allocation, unless total memory available
     // is less.
@@ -264,6 +267,15 @@ void* BFCAllocator::AllocateRawInternalWithRetry(
 void* BFCAllocator::AllocateRaw(size_t unused_alignment, size_t num_bytes,
                                 const AllocationAttributes& allocation_attr) {
   VLOG(3) << "AllocateRaw " << Name() << "  " << num_bytes;
+  const int size_class = CacheSizeClass(num_bytes, allocation_attr);
+  if (size_class >= 0) {
+    void* ptr = AllocateFromCache(size_class, num_bytes);
+    if (ptr != nullptr) {
+      VLOG(3) << "AllocateRaw " << Name() << "  " << num_bytes << " " << ptr
+              << " (cached)";
+      return ptr;
+    }
+  }
   void* result = [&] {
     if (!opts_.allow_retry_on_failure || !allocation_attr.retry_on_failure) {
       // If we have globally disabled retry-on-failure and fail to allocate an
@@ -310,6 +322,9 @@ void* BFCAllocator::AllocateRaw(size_t unused_alignment, size_t num_bytes,
                                           allocation_attr);
     }
   }();
+  if (size_class >= 0 && result != nullptr) {
+    AddCachedAllocation(result, num_bytes, AllocatedSize(result));
+  }
   VLOG(3) << "AllocateRaw " << Name() << "  " << num_bytes << " " << result;
   return result;
 }
@@ -450,6 +465,16 @@ void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
     }
   }
 
+  // Chunks held by the thread caches may coalesce with their neighbors into a
+  // chunk that fits once they are back in the bins.
+  if (FlushCaches()) {
+    ptr = FindChunkPtr(bin_num, rounded_bytes, num_bytes, freed_before);
+    if (ptr != nullptr) {
+      AddTraceMe("MemoryAllocation", ptr);
+      return ptr;
+    }
+  }
+
   if ((freed_before == 0) && (!timestamped_chunks_.empty())) {
     // We're unable to satisfy an allocation request without a specific
     // timestamp requirement.  Rather than fail, try merging any held-out
@@ -684,7 +709,9 @@ void BFCAllocator::SplitChunk(BFCAllocator::ChunkHandle h, size_t num_bytes) {
 void BFCAllocator::DeallocateRaw(void* ptr) {
   VLOG(3) << "DeallocateRaw " << Name() << " "
           << (ptr ? RequestedSize(ptr) : 0);
-  DeallocateRawInternal(ptr);
+  if (!DeallocateToCache(ptr)) {
+    DeallocateRawInternal(ptr);
+  }
   retry_helper_.NotifyDealloc();
 }
 
@@ -694,7 +721,10 @@ void BFCAllocator::DeallocateRawInternal(void* ptr) {
     return;
   }
   mutex_lock l(lock_);
+  FreeChunk(ptr);
+}
 
+void BFCAllocator::FreeChunk(void* ptr) {
   // Find the chunk from the ptr.
   BFCAllocator::ChunkHandle h = region_manager_.get_handle(ptr);
   CHECK(h != kInvalidChunkHandle);
@@ -937,6 +967,10 @@ bool BFCAllocator::TracksAllocationSizes() const { return true; }
 
 size_t BFCAllocator::RequestedSize(const void* ptr) const {
   CHECK(ptr);
+  CachedAllocation allocation;
+  if (FindCachedAllocation(ptr, &allocation)) {
+    return allocation.requested_size;
+  }
   mutex_lock l(lock_);
   BFCAllocator::ChunkHandle h = region_manager_.get_handle(ptr);
   CHECK(h != kInvalidChunkHandle)
@@ -946,6 +980,10 @@ size_t BFCAllocator::RequestedSize(const void* ptr) const {
 }
 
 size_t BFCAllocator::AllocatedSize(const void* ptr) const {
+  CachedAllocation allocation;
+  if (FindCachedAllocation(ptr, &allocation)) {
+    return allocation.chunk_size;
+  }
   mutex_lock l(lock_);
   BFCAllocator::ChunkHandle h = region_manager_.get_handle(ptr);
   CHECK(h != kInvalidChunkHandle)
@@ -955,6 +993,10 @@ size_t BFCAllocator::AllocatedSize(const void* ptr) const {
 }
 
 int64_t BFCAllocator::AllocationId(const void* ptr) const {
+  CachedAllocation allocation;
+  if (FindCachedAllocation(ptr, &allocation)) {
+    return allocation.allocation_id;
+  }
   mutex_lock l(lock_);
   BFCAllocator::ChunkHandle h = region_manager_.get_handle(ptr);
   CHECK(h != kInvalidChunkHandle)
@@ -1207,17 +1249,176 @@ MemoryDump BFCAllocator::RecordMemoryMapInternal() {
 
 absl::optional<AllocatorStats> BFCAllocator::GetStats() {
   mutex_lock l(lock_);
-  return stats_;
+  AllocatorStats stats = stats_;
+  stats.num_allocs += num_cached_allocs_.load(std::memory_order_relaxed);
+  stats.bytes_in_use -= cached_bytes_.load(std::memory_order_relaxed);
+  return stats;
 }
 
 bool BFCAllocator::ClearStats() {
   mutex_lock l(lock_);
   stats_.num_allocs = 0;
+  num_cached_allocs_.store(0, std::memory_order_relaxed);
   stats_.peak_bytes_in_use = stats_.bytes_in_use;
   stats_.largest_alloc_size = 0;
   return true;
 }
 
+BFCAllocator::CacheShard& BFCAllocator::ThreadCacheShard() const {
+  static std::atomic<int> next_thread_index{0};
+  thread_local const int thread_index =
+      next_thread_index.fetch_add(1, std::memory_order_relaxed);
+  return cache_shards_[thread_index % kNumCacheShards];
+}
+
+BFCAllocator::CacheShard& BFCAllocator::PointerCacheShard(
+    const void* ptr) const {
+  const std::uintptr_t p_int = reinterpret_cast<std::uintptr_t>(ptr);
+  return cache_shards_[(p_int >> kMinAllocationBits) % kNumCacheShards];
+}
+
+int BFCAllocator::ChunkSizeClass(size_t chunk_size) {
+  return std::min(kNumCacheSizeClasses - 1,
+                  Log2FloorNonZero(chunk_size >> kMinAllocationBits));
+}
+
+int BFCAllocator::CacheSizeClass(size_t num_bytes,
+                                 const AllocationAttributes& allocation_attr) {
+  // Cached chunks do not track when they were freed, so they cannot serve
+  // allocations that depend on the timing counter.
+  if (cache_shards_ == nullptr || num_bytes == 0 ||
+      num_bytes > kMaxCachedAllocationSize || timing_counter_ != nullptr ||
+      allocation_attr.freed_by_func != nullptr) {
+    return -1;
+  }
+  return ChunkSizeClass(RoundedBytes(num_bytes));
+}
+
+void* BFCAllocator::AllocateFromCache(int size_class, size_t num_bytes) {
+  const size_t rounded_bytes = RoundedBytes(num_bytes);
+  CachedChunk chunk;
+  {
+    CacheShard& shard = ThreadCacheShard();
+    mutex_lock l(shard.mu);
+    // Chunks of the allocation's own class may be smaller than it, so only the
+    // most recently freed ones are checked.
+    std::vector<CachedChunk>& free_chunks = shard.free_chunks[size_class];
+    const int num_scanned = std::min<int>(free_chunks.size(),
+                                          kMaxCachedChunksScanned);
+    for (int i = 0; i < num_scanned && chunk.ptr == nullptr; ++i) {
+      auto it = free_chunks.end() - 1 - i;
+      if (it->size >= rounded_bytes) {
+        chunk = *it;
+        free_chunks.erase(it);
+      }
+    }
+    // Any chunk of the next class is large enough.
+    if (chunk.ptr == nullptr && size_class + 1 < kNumCacheSizeClasses &&
+        !shard.free_chunks[size_class + 1].empty()) {
+      chunk = shard.free_chunks[size_class + 1].back();
+      shard.free_chunks[size_class + 1].pop_back();
+    }
+    if (chunk.ptr == nullptr) {
+      return nullptr;
+    }
+  }
+  cached_bytes_.fetch_sub(chunk.size, std::memory_order_relaxed);
+  num_cached_allocs_.fetch_add(1, std::memory_order_relaxed);
+  AddCachedAllocation(chunk.ptr, num_bytes, chunk.size);
+  return chunk.ptr;
+}
+
+void BFCAllocator::AddCachedAllocation(void* ptr, size_t requested_size,
+                                       size_t chunk_size) {
+  CachedAllocation allocation;
+  allocation.chunk_size = chunk_size;
+  allocation.requested_size = requested_size;
+  allocation.allocation_id = next_allocation_id_++;
+  CacheShard& shard = PointerCacheShard(ptr);
+  mutex_lock l(shard.mu);
+  shard.allocations[ptr] = allocation;
+}
+
+bool BFCAllocator::DeallocateToCache(void* ptr) {
+  if (cache_shards_ == nullptr || ptr == nullptr) {
+    return false;
+  }
+  CachedAllocation allocation;
+  {
+    CacheShard& shard = PointerCacheShard(ptr);
+    mutex_lock l(shard.mu);
+    auto it = shard.allocations.find(ptr);
+    if (it == shard.allocations.end()) {
+      return false;
+    }
+    allocation = it->second;
+    shard.allocations.erase(it);
+  }
+  if (timing_counter_ != nullptr) {
+    return false;
+  }
+
+  const int size_class = ChunkSizeClass(allocation.chunk_size);
+  std::vector<CachedChunk> evicted;
+  {
+    CacheShard& shard = ThreadCacheShard();
+    mutex_lock l(shard.mu);
+    std::vector<CachedChunk>& free_chunks = shard.free_chunks[size_class];
+    free_chunks.push_back({ptr, allocation.chunk_size});
+    cached_bytes_.fetch_add(allocation.chunk_size, std::memory_order_relaxed);
+    const size_t max_chunks =
+        kMaxCachedBytesPerSizeClass / (kMinAllocationSize << size_class);
+    if (free_chunks.size() > max_chunks) {
+      const auto end = free_chunks.begin() + free_chunks.size() / 2;
+      evicted.assign(free_chunks.begin(), end);
+      free_chunks.erase(free_chunks.begin(), end);
+    }
+  }
+  if (!evicted.empty()) {
+    mutex_lock l(lock_);
+    for (const CachedChunk& chunk : evicted) {
+      cached_bytes_.fetch_sub(chunk.size, std::memory_order_relaxed);
+      FreeChunk(chunk.ptr);
+    }
+  }
+  return true;
+}
+
+bool BFCAllocator::FindCachedAllocation(const void* ptr,
+                                        CachedAllocation* allocation) const {
+  if (cache_shards_ == nullptr) {
+    return false;
+  }
+  CacheShard& shard = PointerCacheShard(ptr);
+  mutex_lock l(shard.mu);
+  auto it = shard.allocations.find(ptr);
+  if (it == shard.allocations.end()) {
+    return false;
+  }
+  *allocation = it->second;
+  return true;
+}
+
+bool BFCAllocator::FlushCaches() {
+  if (cache_shards_ == nullptr) {
+    return false;
+  }
+  std::vector<CachedChunk> chunks;
+  for (int i = 0; i < kNumCacheShards; ++i) {
+    CacheShard& shard = cache_shards_[i];
+    mutex_lock l(shard.mu);
+    for (std::vector<CachedChunk>& free_chunks : shard.free_chunks) {
+      chunks.insert(chunks.end(), free_chunks.begin(), free_chunks.end());
+      free_chunks.clear();
+    }
+  }
+  for (const CachedChunk& chunk : chunks) {
+    cached_bytes_.fetch_sub(chunk.size, std::memory_order_relaxed);
+    FreeChunk(chunk.ptr);
+  }
+  return !chunks.empty();
+}
+
 std::array<BFCAllocator::BinDebugInfo, BFCAllocator::kNumBins>
 BFCAllocator::get_bin_debug_info() {
   std::array<BinDebugInfo, kNumBins> bin_infos;
@@ -17,12 +17,14 @@ limitations under the License.
 #define TENSORFLOW_TSL_FRAMEWORK_BFC_ALLOCATOR_H_
 
 #include <array>
+#include <atomic>
 #include <deque>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "tensorflow/tsl/framework/allocator.h"
 #include "tensorflow/tsl/framework/allocator_retry.h"
@@ -68,6 +70,14 @@ class BFCAllocator : public Allocator {
     // Controls when a chunk should be split, if its size exceeds the requested
     // allocation size.
     double fragmentation_fraction = 0;
+
+    // If true, small allocations are served from thread caches of freed
+    // chunks in front of the bins, so that most small allocations and
+    // deallocations do not take the allocator lock. Cached chunks are only
+    // reusable by allocations of the same size class, until they are returned
+    // to the bins in batches or when the allocator runs out of memory. The
+    // caches are bypassed while a timing counter is set.
+    bool thread_cache = false;
   };
   BFCAllocator(std::unique_ptr<SubAllocator> sub_allocator, size_t total_memory,
                const string& name, const Options& opts);
@@ -120,6 +130,9 @@ class BFCAllocator : public Allocator {
 
   void DeallocateRawInternal(void* ptr);
 
+  // Frees the chunk at `ptr` and returns it to the bins.
+  void FreeChunk(void* ptr) TF_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
   // Chunks whose freed_at_count is later than the safe frontier value are kept
   // on a special list and not subject to merging immediately upon being freed.
   //
@@ -526,6 +539,84 @@ class BFCAllocator : public Allocator {
     size_t total_chunks_in_bin = 0;
   };
 
+  // Thread caches (see Options::thread_cache).
+  //
+  // Threads are assigned round-robin to one of kNumCacheShards shards, whose
+  // cache holds freed chunks in power-of-two size classes from
+  // kMinAllocationSize to kMaxCachedAllocationSize: a chunk of class c is at
+  // least kMinAllocationSize << c bytes, and less than twice that except in the
+  // last class. As far as the bins and `stats_` are concerned, chunks held by a
+  // cache are still in use.
+  //
+  // Allocations that miss the caches are not rounded up to their size class.
+  // Only an allocation served from a cache may get a larger chunk: one of its
+  // own class that is large enough, or else any chunk of the next class.
+  //
+  // Allocations served through the caches are recorded in the shard that their
+  // pointer hashes to, so that they can be looked up and freed without taking
+  // `lock_`. Shard locks may be acquired while holding `lock_`, but not the
+  // other way around.
+  static constexpr int kNumCacheShards = 16;
+  static constexpr int kNumCacheSizeClasses = 9;
+  static constexpr size_t kMaxCachedAllocationSize =
+      kMinAllocationSize << (kNumCacheSizeClasses - 1);
+  // The maximum number of bytes that a cache holds per size class. Once it is
+  // exceeded, the least recently freed half of the chunks is returned to the
+  // bins under a single acquisition of `lock_`.
+  static constexpr size_t kMaxCachedBytesPerSizeClass = 128 << 10;
+  // The number of most recently freed chunks of an allocation's own size class
+  // that are checked for one that is large enough.
+  static constexpr int kMaxCachedChunksScanned = 8;
+
+  struct CachedChunk {
+    void* ptr = nullptr;
+    size_t size = 0;
+  };
+
+  struct CachedAllocation {
+    size_t chunk_size = 0;
+    size_t requested_size = 0;
+    int64_t allocation_id = -1;
+  };
+
+  struct CacheShard {
+    mutex mu;
+    std::array<std::vector<CachedChunk>, kNumCacheSizeClasses> free_chunks
+        TF_GUARDED_BY(mu);
+    absl::flat_hash_map<const void*, CachedAllocation> allocations
+        TF_GUARDED_BY(mu);
+  };
+
+  CacheShard& ThreadCacheShard() const;
+  CacheShard& PointerCacheShard(const void* ptr) const;
+
+  // Returns the size class of a chunk of `chunk_size` bytes.
+  int ChunkSizeClass(size_t chunk_size);
+
+  // Returns the size class of an allocation of `num_bytes`, or -1 if the
+  // allocation bypasses the caches.
+  int CacheSizeClass(size_t num_bytes,
+                     const AllocationAttributes& allocation_attr);
+
+  // Returns a chunk of at least `num_bytes` from `size_class` or the next class
+  // of the calling thread's cache, or nullptr if it has none.
+  void* AllocateFromCache(int size_class, size_t num_bytes);
+
+  // Records an allocation served through the caches.
+  void AddCachedAllocation(void* ptr, size_t requested_size, size_t chunk_size);
+
+  // Returns the allocation at `ptr` to the calling thread's cache. Returns false
+  // if the chunk must be freed through the bins instead.
+  bool DeallocateToCache(void* ptr);
+
+  // Looks up the allocation at `ptr` if it was served through the caches.
+  bool FindCachedAllocation(const void* ptr,
+                            CachedAllocation* allocation) const;
+
+  // Returns all chunks held by the caches to the bins. Returns true if there
+  // were any.
+  bool FlushCaches() TF_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
   // Computes and returns a BinDebugInfo for each Bin.
   std::array<BinDebugInfo, kNumBins> get_bin_debug_info()
       TF_EXCLUSIVE_LOCKS_REQUIRED(lock_);
@@ -607,7 +698,18 @@ class BFCAllocator : public Allocator {
 
   // Counter containing the next unique identifier to assign to a
   // newly-created chunk.
-  int64_t next_allocation_id_ TF_GUARDED_BY(lock_);
+  std::atomic<int64_t> next_allocation_id_;
+
+  // Null unless Options::thread_cache is set.
+  std::unique_ptr<CacheShard[]> cache_shards_;
+
+  // Bytes of the chunks held by the caches, which `stats_` counts as in use.
+  // GetStats() reports them as free, but they still count towards
+  // `peak_bytes_in_use`.
+  std::atomic<int64_t> cached_bytes_{0};
+
+  // Number of allocations served by the caches without taking `lock_`.
+  std::atomic<int64_t> num_cached_allocs_{0};
 
   // Stats.
   AllocatorStats stats_ TF_GUARDED_BY(lock_);
@@ -0,0 +1,212 @@
+/* Copyright 2022 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/tsl/framework/bfc_allocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "tensorflow/tsl/framework/allocator.h"
+#include "tensorflow/tsl/platform/blocking_counter.h"
+#include "tensorflow/tsl/platform/env.h"
+#include "tensorflow/tsl/platform/mem.h"
+#include "tensorflow/tsl/platform/test.h"
+#include "tensorflow/tsl/platform/test_benchmark.h"
+#include "tensorflow/tsl/platform/threadpool.h"
+
+namespace tsl {
+namespace {
+
+class HostSubAllocator : public SubAllocator {
+ public:
+  HostSubAllocator() : SubAllocator({}, {}) {}
+
+  void* Alloc(size_t alignment, size_t num_bytes,
+              size_t* bytes_received) override {
+    *bytes_received = num_bytes;
+    return port::AlignedMalloc(
+        num_bytes, std::max<size_t>(alignment, Allocator::kAllocatorAlignment));
+  }
+
+  void Free(void* ptr, size_t num_bytes) override { port::AlignedFree(ptr); }
+
+  bool SupportsCoalescing() const override { return false; }
+
+  AllocatorMemoryType GetMemoryType() const override {
+    return AllocatorMemoryType::kHostPageable;
+  }
+};
+
+std::unique_ptr<BFCAllocator> CreateAllocator(size_t total_memory,
+                                              bool thread_cache) {
+  BFCAllocator::Options opts;
+  opts.thread_cache = thread_cache;
+  return std::make_unique<BFCAllocator>(std::make_unique<HostSubAllocator>(),
+                                        total_memory, "bfc", opts);
+}
+
+void CheckStats(Allocator* a, int64_t num_allocs, int64_t bytes_in_use) {
+  absl::optional<AllocatorStats> stats = a->GetStats();
+  ASSERT_TRUE(stats);
+  EXPECT_EQ(stats->num_allocs, num_allocs);
+  EXPECT_EQ(stats->bytes_in_use, bytes_in_use);
+}
+
+TEST(BFCAllocatorTest, ThreadCacheReusesFreedChunks) {
+  auto a = CreateAllocator(1 << 20, /*thread_cache=*/true);
+  void* p1 = a->AllocateRaw(1, 1000);
+  ASSERT_NE(p1, nullptr);
+  EXPECT_EQ(a->RequestedSize(p1), 1000);
+  EXPECT_EQ(a->AllocatedSize(p1), 1024);
+  const int64_t id1 = a->AllocationId(p1);
+  CheckStats(a.get(), 1, 1024);
+  a->DeallocateRaw(p1);
+  CheckStats(a.get(), 1, 0);
+
+  void* p2 = a->AllocateRaw(1, 900);
+  EXPECT_EQ(p2, p1);
+  EXPECT_EQ(a->RequestedSize(p2), 900);
+  EXPECT_EQ(a->AllocatedSize(p2), 1024);
+  EXPECT_GT(a->AllocationId(p2), id1);
+  CheckStats(a.get(), 2, 1024);
+  a->DeallocateRaw(p2);
+  CheckStats(a.get(), 2, 0);
+
+  EXPECT_TRUE(a->ClearStats());
+  CheckStats(a.get(), 0, 0);
+}
+
+TEST(BFCAllocatorTest, ThreadCacheDoesNotRoundUpMisses) {
+  auto a = CreateAllocator(1 << 20, /*thread_cache=*/true);
+  void* p1 = a->AllocateRaw(1, 1280);
+  ASSERT_NE(p1, nullptr);
+  EXPECT_EQ(a->AllocatedSize(p1), 1280);
+  absl::optional<AllocatorStats> stats = a->GetStats();
+  ASSERT_TRUE(stats);
+  EXPECT_EQ(stats->largest_alloc_size, 1280);
+  a->DeallocateRaw(p1);
+
+  // The freed chunk serves allocations of the same size.
+  void* p2 = a->AllocateRaw(1, 1280);
+  EXPECT_EQ(p2, p1);
+  a->DeallocateRaw(p2);
+
+  // And smaller allocations of its size class, rounded up to the chunk.
+  void* p3 = a->AllocateRaw(1, 1024);
+  EXPECT_EQ(p3, p1);
+  EXPECT_EQ(a->RequestedSize(p3), 1024);
+  EXPECT_EQ(a->AllocatedSize(p3), 1280);
+  a->DeallocateRaw(p3);
+  CheckStats(a.get(), 3, 0);
+}
+
+TEST(BFCAllocatorTest, ThreadCacheBypassesLargeAllocations) {
+  auto a = CreateAllocator(1 << 20, /*thread_cache=*/true);
+  void* p = a->AllocateRaw(1, 100 << 10);
+  ASSERT_NE(p, nullptr);
+  EXPECT_EQ(a->RequestedSize(p), 100 << 10);
+  EXPECT_EQ(a->AllocatedSize(p), 100 << 10);
+  a->DeallocateRaw(p);
+  CheckStats(a.get(), 1, 0);
+}
+
+TEST(BFCAllocatorTest, ThreadCacheIsFlushedWhenOutOfMemory) {
+  constexpr size_t kTotalMemory = 1 << 20;
+  constexpr int kNumChunks = kTotalMemory / (64 << 10);
+  auto a = CreateAllocator(kTotalMemory, /*thread_cache=*/true);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < kNumChunks; ++i) {
+    ptrs.push_back(a->AllocateRaw(1, 64 << 10));
+    ASSERT_NE(ptrs.back(), nullptr);
+  }
+  for (void* p : ptrs) {
+    a->DeallocateRaw(p);
+  }
+  CheckStats(a.get(), kNumChunks, 0);
+
+  // Only fits once the cached chunks are coalesced.
+  void* p = a->AllocateRaw(1, kTotalMemory);
+  ASSERT_NE(p, nullptr);
+  a->DeallocateRaw(p);
+}
+
+TEST(BFCAllocatorTest, ThreadCacheWithConcurrentThreads) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumRounds = 100;
+  constexpr int kNumLiveAllocations = 16;
+  auto a = CreateAllocator(64 << 20, /*thread_cache=*/true);
+  {
+    thread::ThreadPool pool(Env::Default(), "test", kNumThreads);
+    for (int t = 0; t < kNumThreads; ++t) {
+      pool.Schedule([&a, t]() {
+        for (int round = 0; round < kNumRounds; ++round) {
+          std::vector<std::pair<char*, size_t>> allocations;
+          for (int i = 0; i < kNumLiveAllocations; ++i) {
+            const size_t num_bytes = 1 + (round * 131 + i * 977) % (32 << 10);
+            char* p = static_cast<char*>(a->AllocateRaw(1, num_bytes));
+            ASSERT_NE(p, nullptr);
+            ASSERT_GE(a->AllocatedSize(p), num_bytes);
+            memset(p, t, num_bytes);
+            allocations.push_back({p, num_bytes});
+          }
+          for (const auto& [p, num_bytes] : allocations) {
+            // Detects chunks handed out twice.
+            ASSERT_EQ(p[0], static_cast<char>(t));
+            ASSERT_EQ(p[num_bytes - 1], static_cast<char>(t));
+            a->DeallocateRaw(p);
+          }
+        }
+      });
+    }
+  }
+  CheckStats(a.get(), kNumThreads * kNumRounds * kNumLiveAllocations, 0);
+}
+
+static void BM_SmallAllocationThreaded(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  const bool thread_cache = state.range(1);
+  auto a = CreateAllocator(1 << 30, thread_cache);
+  thread::ThreadPool pool(Env::Default(), "bench", num_threads);
+  constexpr int kNumIterationsPerThread = 10000;
+  for (auto s : state) {
+    BlockingCounter counter(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      pool.Schedule([&a, &counter]() {
+        for (int i = 0; i < kNumIterationsPerThread; ++i) {
+          void* p = a->AllocateRaw(1, 256 << (i % 8));
+          a->DeallocateRaw(p);
+        }
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads *
+                          kNumIterationsPerThread);
+}
+BENCHMARK(BM_SmallAllocationThreaded)
+    ->ArgPair(1, false)
+    ->ArgPair(1, true)
+    ->ArgPair(4, false)
+    ->ArgPair(4, true)
+    ->ArgPair(16, false)
+    ->ArgPair(16, true);
+
+}  // namespace
+}  // namespace tsl
@@ -21,9 +21,11 @@ limitations under the License.
 #include "tensorflow/tsl/lib/io/buffered_inputstream.h"
 #include "tensorflow/tsl/lib/io/compression.h"
 #include "tensorflow/tsl/lib/io/random_inputstream.h"
+#include "tensorflow/tsl/platform/coding.h"
 #include "tensorflow/tsl/platform/env.h"
 #include "tensorflow/tsl/platform/errors.h"
 #include "tensorflow/tsl/platform/raw_coding.h"
+#include "tensorflow/tsl/platform/strcat.h"
 
 namespace tsl {
 namespace io {
@@ -259,5 +261,72 @@ SequentialRecordReader::SequentialRecordReader(
     RandomAccessFile* file, const RecordReaderOptions& options)
     : underlying_(file, options), offset_(0) {}
 
+string RecordIndexFilename(const string& filename) {
+  return strings::StrCat(filename, ".record_index");
+}
+
+Status RecordIndex::Open(Env* env, const string& index_filename,
+                         std::unique_ptr<RecordIndex>* index) {
+  uint64 file_size;
+  TF_RETURN_IF_ERROR(env->GetFileSize(index_filename, &file_size));
+  if (file_size % sizeof(uint64) != 0) {
+    return errors::DataLoss("Record index ", index_filename, " has size ",
+                            file_size, ", which is not a multiple of ",
+                            sizeof(uint64));
+  }
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(index_filename, &file));
+  index->reset(new RecordIndex(std::move(file), file_size / sizeof(uint64)));
+  return OkStatus();
+}
+
+RecordIndex::RecordIndex(std::unique_ptr<RandomAccessFile> file,
+                         uint64 num_records)
+    : file_(std::move(file)), num_records_(num_records) {}
+
+RecordIndex::~RecordIndex() = default;
+
+Status RecordIndex::GetOffset(uint64 record_number, uint64* offset) const {
+  if (record_number >= num_records_) {
+    return errors::OutOfRange("Record ", record_number,
+                              " is out of range of the record index with ",
+                              num_records_, " records");
+  }
+  char scratch[sizeof(uint64)];
+  StringPiece entry;
+  TF_RETURN_IF_ERROR(file_->Read(record_number * sizeof(uint64),
+                                 sizeof(uint64), &entry, scratch));
+  if (entry.size() != sizeof(uint64)) {
+    return errors::DataLoss("Truncated record index entry ", record_number);
+  }
+  *offset = core::DecodeFixed64(entry.data());
+  return OkStatus();
+}
+
+Status BuildRecordIndex(Env* env, const string& filename,
+                        const RecordReaderOptions& options,
+                        const string& index_filename) {
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filename, &file));
+  std::unique_ptr<WritableFile> index_file;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(index_filename, &index_file));
+
+  RecordReader reader(file.get(), options);
+  uint64 offset = 0;
+  while (true) {
+    const uint64 record_offset = offset;
+    int num_skipped = 0;
+    Status s = reader.SkipRecords(&offset, 1, &num_skipped);
+    if (errors::IsOutOfRange(s) && num_skipped == 0) {
+      break;
+    }
+    TF_RETURN_IF_ERROR(s);
+    char entry[sizeof(uint64)];
+    core::EncodeFixed64(entry, record_offset);
+    TF_RETURN_IF_ERROR(index_file->Append(StringPiece(entry, sizeof(entry))));
+  }
+  return index_file->Close();
+}
+
 }  // namespace io
 }  // namespace tsl
@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef TENSORFLOW_TSL_LIB_IO_RECORD_READER_H_
 #define TENSORFLOW_TSL_LIB_IO_RECORD_READER_H_
 
+#include <memory>
+
 #include "tensorflow/tsl/lib/io/inputstream_interface.h"
 #include "tensorflow/tsl/platform/errors.h"
 #include "tensorflow/tsl/platform/stringpiece.h"
@@ -29,6 +31,7 @@ limitations under the License.
 #include "tensorflow/tsl/platform/types.h"
 
 namespace tsl {
+class Env;
 class RandomAccessFile;
 
 namespace io {
@@ -173,6 +176,54 @@ class SequentialRecordReader {
   uint64 offset_ = 0;
 };
 
+// Returns the name of the record index sidecar of the TFRecord file
+// `filename`.
+string RecordIndexFilename(const string& filename);
+
+// Index of the record offsets of a TFRecord file, stored in a sidecar file
+// next to it. The sidecar holds one little-endian uint64 offset per record,
+// in record order. It is emitted by `RecordWriter` (see
+// `RecordWriterOptions::index_file`) or built for existing files with
+// `BuildRecordIndex`.
+//
+// Offsets are positions in the uncompressed record stream, as used by
+// `RecordReader::ReadRecord` and `SequentialRecordReader::SeekOffset`, so
+// reaching record N is O(1) for uncompressed files instead of a scan from the
+// start of the file. Entries are read on demand; the index is not held in
+// memory.
+//
+// Note: this class is not thread safe; external synchronization required.
+class RecordIndex {
+ public:
+  // Opens the record index in `index_filename`. Returns NOT_FOUND if the file
+  // does not exist.
+  static Status Open(Env* env, const string& index_filename,
+                     std::unique_ptr<RecordIndex>* index);
+
+  ~RecordIndex();
+
+  // Number of records in the indexed file.
+  uint64 num_records() const { return num_records_; }
+
+  // Stores the offset of record `record_number` in `*offset`. Returns
+  // OUT_OF_RANGE if `record_number` >= `num_records()`.
+  Status GetOffset(uint64 record_number, uint64* offset) const;
+
+ private:
+  RecordIndex(std::unique_ptr<RandomAccessFile> file, uint64 num_records);
+
+  const std::unique_ptr<RandomAccessFile> file_;
+  const uint64 num_records_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(RecordIndex);
+};
+
+// Scans the TFRecord file `filename`, read with `options`, and writes its
+// record index to `index_filename`.
+Status BuildRecordIndex(Env* env, const string& filename,
+                        const RecordReaderOptions& options,
+                        const string& index_filename);
+
 }  // namespace io
 }  // namespace tsl
 
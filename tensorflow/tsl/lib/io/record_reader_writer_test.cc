@@ -233,6 +233,108 @@ TEST(RecordReaderWriterTest, TestSkipOutOfRange) {
   }
 }
 
+TEST(RecordReaderWriterTest, TestRecordIndex) {
+  Env* env = Env::Default();
+  string fname = testing::TmpDir() + "/record_reader_writer_index_test";
+  string index_fname = io::RecordIndexFilename(fname);
+  std::vector<string> records = {"abc", "", "defg", string(1000, 'x'), "hij"};
+
+  {
+    std::unique_ptr<WritableFile> file;
+    TF_CHECK_OK(env->NewWritableFile(fname, &file));
+    std::unique_ptr<WritableFile> index_file;
+    TF_CHECK_OK(env->NewWritableFile(index_fname, &index_file));
+    io::RecordWriterOptions options;
+    options.index_file = index_file.get();
+    io::RecordWriter writer(file.get(), options);
+    for (const string& record : records) {
+      TF_EXPECT_OK(writer.WriteRecord(record));
+    }
+    TF_CHECK_OK(writer.Close());
+    TF_CHECK_OK(index_file->Close());
+    TF_CHECK_OK(file->Close());
+  }
+
+  std::unique_ptr<io::RecordIndex> index;
+  TF_ASSERT_OK(io::RecordIndex::Open(env, index_fname, &index));
+  ASSERT_EQ(records.size(), index->num_records());
+
+  std::unique_ptr<RandomAccessFile> read_file;
+  TF_CHECK_OK(env->NewRandomAccessFile(fname, &read_file));
+  io::RecordReader reader(read_file.get());
+  // Read the records back in reverse order through the index.
+  for (int i = records.size() - 1; i >= 0; --i) {
+    uint64 offset;
+    TF_ASSERT_OK(index->GetOffset(i, &offset));
+    tstring record;
+    TF_ASSERT_OK(reader.ReadRecord(&offset, &record));
+    EXPECT_EQ(records[i], record);
+  }
+  uint64 offset;
+  EXPECT_TRUE(errors::IsOutOfRange(index->GetOffset(records.size(), &offset)));
+
+  // An index built for the existing file matches the one written with it.
+  string built_index_fname = fname + ".built";
+  TF_ASSERT_OK(io::BuildRecordIndex(env, fname, io::RecordReaderOptions(),
+                                    built_index_fname));
+  string index_contents;
+  TF_ASSERT_OK(ReadFileToString(env, index_fname, &index_contents));
+  string built_index_contents;
+  TF_ASSERT_OK(
+      ReadFileToString(env, built_index_fname, &built_index_contents));
+  EXPECT_EQ(index_contents, built_index_contents);
+}
+
+TEST(RecordReaderWriterTest, TestRecordIndexWhenAppending) {
+  Env* env = Env::Default();
+  string fname = testing::TmpDir() + "/record_reader_writer_append_index_test";
+  string index_fname = io::RecordIndexFilename(fname);
+  std::vector<string> records = {"abc", "defg", "hij", string(100, 'x')};
+
+  // Writes the records in two sessions, appending to the file and its index.
+  for (int i = 0; i < 2; ++i) {
+    std::unique_ptr<WritableFile> file;
+    std::unique_ptr<WritableFile> index_file;
+    if (i == 0) {
+      TF_CHECK_OK(env->NewWritableFile(fname, &file));
+      TF_CHECK_OK(env->NewWritableFile(index_fname, &index_file));
+    } else {
+      TF_CHECK_OK(env->NewAppendableFile(fname, &file));
+      TF_CHECK_OK(env->NewAppendableFile(index_fname, &index_file));
+    }
+    io::RecordWriterOptions options;
+    options.index_file = index_file.get();
+    io::RecordWriter writer(file.get(), options);
+    TF_EXPECT_OK(writer.WriteRecord(records[2 * i]));
+    TF_EXPECT_OK(writer.WriteRecord(records[2 * i + 1]));
+    TF_CHECK_OK(writer.Close());
+    TF_CHECK_OK(index_file->Close());
+    TF_CHECK_OK(file->Close());
+  }
+
+  // The index matches the one built for the whole file.
+  string built_index_fname = fname + ".built";
+  TF_ASSERT_OK(io::BuildRecordIndex(env, fname, io::RecordReaderOptions(),
+                                    built_index_fname));
+  string index_contents;
+  TF_ASSERT_OK(ReadFileToString(env, index_fname, &index_contents));
+  string built_index_contents;
+  TF_ASSERT_OK(
+      ReadFileToString(env, built_index_fname, &built_index_contents));
+  EXPECT_EQ(index_contents, built_index_contents);
+  EXPECT_EQ(records.size() * sizeof(uint64), index_contents.size());
+}
+
+TEST(RecordReaderWriterTest, TestRecordIndexErrors) {
+  Env* env = Env::Default();
+  string fname = testing::TmpDir() + "/record_reader_writer_bad_index_test";
+  std::unique_ptr<io::RecordIndex> index;
+  EXPECT_TRUE(errors::IsNotFound(io::RecordIndex::Open(env, fname, &index)));
+
+  TF_CHECK_OK(WriteStringToFile(env, fname, "abc"));
+  EXPECT_TRUE(errors::IsDataLoss(io::RecordIndex::Open(env, fname, &index)));
+}
+
 TEST(RecordReaderWriterTest, TestMalformedInput) {
   Env* env = Env::Default();
   string fname =
@@ -60,6 +60,19 @@ RecordWriterOptions RecordWriterOptions::CreateRecordWriterOptions(
 RecordWriter::RecordWriter(WritableFile* dest,
                            const RecordWriterOptions& options)
     : dest_(dest), options_(options) {
+  if (options.index_file != nullptr &&
+      options.compression_type == RecordWriterOptions::NONE) {
+    // When appending to a non-empty file, the new records follow the existing
+    // ones in the record stream.
+    int64_t position;
+    Status s = dest->Tell(&position);
+    if (s.ok()) {
+      offset_ = position;
+    } else {
+      LOG(WARNING) << "Could not determine the offset of the first record, "
+                   << "assuming that the file is empty: " << s;
+    }
+  }
 #if defined(IS_SLIM_BUILD)
   if (options.compression_type != RecordWriterOptions::NONE) {
     LOG(FATAL) << "Compression is unsupported on mobile platforms.";
@@ -112,7 +125,8 @@ Status RecordWriter::WriteRecord(StringPiece data) {
   PopulateFooter(footer, data.data(), data.size());
   TF_RETURN_IF_ERROR(dest_->Append(StringPiece(header, sizeof(header))));
   TF_RETURN_IF_ERROR(dest_->Append(data));
-  return dest_->Append(StringPiece(footer, sizeof(footer)));
+  TF_RETURN_IF_ERROR(dest_->Append(StringPiece(footer, sizeof(footer))));
+  return UpdateIndex(data.size());
 }
 
 #if defined(TF_CORD_SUPPORT)
@@ -132,10 +146,22 @@ Status RecordWriter::WriteRecord(const absl::Cord& data) {
   PopulateFooter(footer, data);
   TF_RETURN_IF_ERROR(dest_->Append(StringPiece(header, sizeof(header))));
   TF_RETURN_IF_ERROR(dest_->Append(data));
-  return dest_->Append(StringPiece(footer, sizeof(footer)));
+  TF_RETURN_IF_ERROR(dest_->Append(StringPiece(footer, sizeof(footer))));
+  return UpdateIndex(data.size());
 }
 #endif
 
+Status RecordWriter::UpdateIndex(size_t data_size) {
+  if (options_.index_file != nullptr) {
+    char entry[sizeof(uint64)];
+    core::EncodeFixed64(entry, offset_);
+    TF_RETURN_IF_ERROR(
+        options_.index_file->Append(StringPiece(entry, sizeof(entry))));
+  }
+  offset_ += kHeaderSize + data_size + kFooterSize;
+  return OkStatus();
+}
+
 Status RecordWriter::Close() {
   if (dest_ == nullptr) return OkStatus();
   if (IsZlibCompressed(options_) || IsSnappyCompressed(options_)) {
@@ -48,6 +48,15 @@ struct RecordWriterOptions {
   static RecordWriterOptions CreateRecordWriterOptions(
       const string& compression_type);
 
+  // If set, the writer emits a record index sidecar (see `RecordIndex` in
+  // record_reader.h) by appending the offset of every record to this file.
+  // It is not owned, and must be closed by the caller after the writer has
+  // been closed. For uncompressed files, the destination may already hold
+  // records (e.g. when opened for appending): offsets then start at its
+  // current size, and the index file should be opened for appending as well.
+  // Compressed destinations must be initially empty.
+  WritableFile* index_file = nullptr;
+
 #if !defined(IS_SLIM_BUILD)
   // Options specific to compression.
   io::ZlibCompressionOptions zlib_options;
@@ -111,8 +120,14 @@ class RecordWriter {
 #endif
 
  private:
+  // Appends the offset of the record that was just written to the record
+  // index (if any) and advances the offset by the size of the record.
+  Status UpdateIndex(size_t data_size);
+
   WritableFile* dest_;
   RecordWriterOptions options_;
+  // Offset of the next record in the (uncompressed) record stream.
+  uint64 offset_ = 0;
 
   inline static uint32 MaskedCrc(const char* data, size_t n) {
     return crc32c::Mask(crc32c::Value(data, n));